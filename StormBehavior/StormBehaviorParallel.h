@@ -0,0 +1,202 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+// Splits [0, count) into contiguous chunks and runs func(index) over them on up to thread_count threads.
+// The calling thread works on the first chunk, so a thread_count of 1 runs everything inline and in order.
+// Threads are created and joined on every call, so this suits one-off jobs; per-tick work should go through a
+// StormBehaviorThreadPool
+template <typename Func>
+void StormBehaviorParallelFor(int count, int thread_count, Func && func)
+{
+  if(count <= 0)
+  {
+    return;
+  }
+
+  thread_count = std::max(1, std::min(thread_count, count));
+  if(thread_count == 1)
+  {
+    for(int index = 0; index < count; ++index)
+    {
+      func(index);
+    }
+
+    return;
+  }
+
+  auto chunk_size = (count + thread_count - 1) / thread_count;
+  auto run_chunk = [&](int chunk)
+  {
+    auto start = chunk * chunk_size;
+    auto end = std::min(count, start + chunk_size);
+    for(int index = start; index < end; ++index)
+    {
+      func(index);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count - 1);
+  for(int chunk = 1; chunk < thread_count; ++chunk)
+  {
+    threads.emplace_back(run_chunk, chunk);
+  }
+
+  run_chunk(0);
+
+  for(auto & thread : threads)
+  {
+    thread.join();
+  }
+}
+
+// Same chunking as StormBehaviorParallelFor, but the worker threads are started on first use and then sleep
+// between jobs instead of being created for every one.  Worker n always runs chunk n, and the calling thread
+// runs chunk 0 and waits for the rest.  Only one thread may call ParallelFor at a time
+class StormBehaviorThreadPool
+{
+public:
+
+  StormBehaviorThreadPool() = default;
+  StormBehaviorThreadPool(const StormBehaviorThreadPool & rhs) = delete;
+  StormBehaviorThreadPool & operator = (const StormBehaviorThreadPool & rhs) = delete;
+
+  ~StormBehaviorThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Stop = true;
+    }
+
+    m_WorkCondition.notify_all();
+    for(auto & thread : m_Workers)
+    {
+      thread.join();
+    }
+  }
+
+  template <typename Func>
+  void ParallelFor(int count, int thread_count, Func && func)
+  {
+    if(count <= 0)
+    {
+      return;
+    }
+
+    thread_count = std::max(1, std::min(thread_count, count));
+    if(thread_count == 1)
+    {
+      for(int index = 0; index < count; ++index)
+      {
+        func(index);
+      }
+
+      return;
+    }
+
+    while(static_cast<int>(m_Workers.size()) < thread_count - 1)
+    {
+      auto chunk = static_cast<int>(m_Workers.size()) + 1;
+      m_Workers.emplace_back([this, chunk] { WorkerLoop(chunk); });
+    }
+
+    using FuncType = std::remove_reference_t<Func>;
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Job = [](void * job_context, int index) { (*static_cast<FuncType *>(job_context))(index); };
+      m_JobContext = const_cast<void *>(static_cast<const void *>(&func));
+      m_Count = count;
+      m_ChunkCount = thread_count;
+      m_ChunkSize = (count + thread_count - 1) / thread_count;
+      m_PendingChunks = thread_count - 1;
+      m_Generation++;
+    }
+
+    m_WorkCondition.notify_all();
+
+    RunChunk(0);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    Wait(m_DoneCondition, lock, [this] { return m_PendingChunks == 0; });
+  }
+
+  int GetWorkerCount() const
+  {
+    return static_cast<int>(m_Workers.size());
+  }
+
+private:
+
+  // Timed waits keep the binary off condition_variable::wait, which newer compilers bind to a libstdc++ symbol
+  // that older runtimes don't have.  A timeout just checks the predicate again
+  template <typename Predicate>
+  static void Wait(std::condition_variable & condition, std::unique_lock<std::mutex> & lock, Predicate && predicate)
+  {
+    while(predicate() == false)
+    {
+      condition.wait_for(lock, std::chrono::milliseconds(100));
+    }
+  }
+
+  void RunChunk(int chunk)
+  {
+    auto start = chunk * m_ChunkSize;
+    auto end = std::min(m_Count, start + m_ChunkSize);
+    for(int index = start; index < end; ++index)
+    {
+      m_Job(m_JobContext, index);
+    }
+  }
+
+  void WorkerLoop(int chunk)
+  {
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while(true)
+    {
+      Wait(m_WorkCondition, lock, [&] { return m_Stop || m_Generation != generation; });
+      if(m_Stop)
+      {
+        return;
+      }
+
+      generation = m_Generation;
+      if(chunk >= m_ChunkCount)
+      {
+        continue;
+      }
+
+      lock.unlock();
+      RunChunk(chunk);
+      lock.lock();
+
+      if(--m_PendingChunks == 0)
+      {
+        m_DoneCondition.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> m_Workers;
+  std::mutex m_Mutex;
+  std::condition_variable m_WorkCondition;
+  std::condition_variable m_DoneCondition;
+
+  void (*m_Job)(void * job_context, int index) = nullptr;
+  void * m_JobContext = nullptr;
+  int m_Count = 0;
+  int m_ChunkCount = 0;
+  int m_ChunkSize = 0;
+  int m_PendingChunks = 0;
+  uint64_t m_Generation = 0;
+  bool m_Stop = false;
+};
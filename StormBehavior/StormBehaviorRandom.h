@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+inline uint64_t StormBehaviorSplitMix64(uint64_t val)
+{
+  val += 0x9E3779B97F4A7C15ULL;
+  val = (val ^ (val >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  val = (val ^ (val >> 27)) * 0x94D049BB133111EBULL;
+  return val ^ (val >> 31);
+}
+
+// Stateless counter based generator.  Every draw is a pure function of (seed, instance id, tick, node index,
+// draw index), so results don't depend on the order instances are updated in or which thread runs them.
+// Construct one per instance per tick; the tree calls SetNode before the draws for each random node
+class StormBehaviorCounterRandom
+{
+public:
+  StormBehaviorCounterRandom(uint64_t seed, uint64_t instance_id, uint64_t tick)
+  {
+    m_Key = StormBehaviorSplitMix64(seed ^ StormBehaviorSplitMix64(instance_id ^ StormBehaviorSplitMix64(tick)));
+    SetNode(-1);
+  }
+
+  void SetNode(int node_index)
+  {
+    m_NodeKey = StormBehaviorSplitMix64(m_Key ^ static_cast<uint64_t>(static_cast<uint32_t>(node_index)));
+    m_Counter = 0;
+  }
+
+  uint32_t operator()()
+  {
+    auto val = StormBehaviorSplitMix64(m_NodeKey + 0x9E3779B97F4A7C15ULL * m_Counter);
+    m_Counter++;
+    return static_cast<uint32_t>(val >> 32);
+  }
+
+  // Unbiased value in [0, bound) using multiply and reject
+  uint32_t Bounded(uint32_t bound)
+  {
+    uint64_t val = static_cast<uint64_t>((*this)()) * bound;
+    auto low = static_cast<uint32_t>(val);
+    if(low < bound)
+    {
+      auto threshold = static_cast<uint32_t>(0u - bound) % bound;
+      while(low < threshold)
+      {
+        val = static_cast<uint64_t>((*this)()) * bound;
+        low = static_cast<uint32_t>(val);
+      }
+    }
+
+    return static_cast<uint32_t>(val >> 32);
+  }
+
+private:
+  uint64_t m_Key;
+  uint64_t m_NodeKey;
+  uint64_t m_Counter;
+};
+
+template <typename T>
+struct StormBehaviorHasSetNode
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::SetNode));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasBounded
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::Bounded));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename RandomSource>
+void StormBehaviorRandomSetNode(RandomSource & random, int node_index)
+{
+  if constexpr(StormBehaviorHasSetNode<RandomSource>::value)
+  {
+    random.SetNode(node_index);
+  }
+}
+
+template <typename RandomSource>
+int StormBehaviorRandomBounded(RandomSource & random, int bound)
+{
+  if constexpr(StormBehaviorHasBounded<RandomSource>::value)
+  {
+    return static_cast<int>(random.Bounded(static_cast<uint32_t>(bound)));
+  }
+  else
+  {
+    return (int)random() % bound;
+  }
+}
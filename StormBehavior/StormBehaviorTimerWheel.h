@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timer wheel keyed by tick.  Each level has 64 slots and covers 64 times the range of the level
+// below it.  An entry lives in the level of the highest 6 bit group in which its deadline differs from the current
+// tick, and is cascaded down a level each time the current tick catches up to that group, so scheduling is O(1) and 
+// advancing only touches the entries that are due
+class StormBehaviorTimerWheel
+{
+public:
+
+  // Deadlines at or before the current tick fire on the next call to Advance
+  void Schedule(int handle, uint64_t deadline)
+  {
+    Insert(Entry{ handle, deadline > m_Tick ? deadline : m_Tick + 1 });
+  }
+
+  // Moves to the next tick and calls expired(handle) for every entry due on it
+  template <typename Callback>
+  void Advance(Callback && expired)
+  {
+    m_Tick++;
+
+    for(int level = kLevels - 1; level > 0; --level)
+    {
+      auto shift = level * kSlotBits;
+      if((m_Tick & ((uint64_t(1) << shift) - 1)) == 0)
+      {
+        if(level == kLevels - 1 && ((m_Tick >> shift) & kSlotMask) == 0)
+        {
+          Cascade(m_Overflow);
+        }
+
+        Cascade(m_Wheels[level][(m_Tick >> shift) & kSlotMask]);
+      }
+    }
+
+    auto & slot = m_Wheels[0][m_Tick & kSlotMask];
+    if(slot.size() == 0)
+    {
+      return;
+    }
+
+    m_Expired.swap(slot);
+    for(auto & elem : m_Expired)
+    {
+      expired(elem.m_Handle);
+    }
+
+    m_Expired.clear();
+  }
+
+  uint64_t GetTick() const
+  {
+    return m_Tick;
+  }
+
+private:
+
+  static const int kSlotBits = 6;
+  static const int kSlots = 1 << kSlotBits;
+  static const uint64_t kSlotMask = kSlots - 1;
+  static const int kLevels = 4;
+
+  struct Entry
+  {
+    int m_Handle;
+    uint64_t m_Deadline;
+  };
+
+  void Insert(const Entry & entry)
+  {
+    auto diff = entry.m_Deadline ^ m_Tick;
+    for(int level = 0; level < kLevels; ++level)
+    {
+      auto shift = (level + 1) * kSlotBits;
+      if((diff >> shift) == 0)
+      {
+        m_Wheels[level][(entry.m_Deadline >> (level * kSlotBits)) & kSlotMask].push_back(entry);
+        return;
+      }
+    }
+
+    m_Overflow.push_back(entry);
+  }
+
+  void Cascade(std::vector<Entry> & slot)
+  {
+    if(slot.size() == 0)
+    {
+      return;
+    }
+
+    m_Cascade.swap(slot);
+    for(auto & elem : m_Cascade)
+    {
+      Insert(elem);
+    }
+
+    m_Cascade.clear();
+  }
+
+  uint64_t m_Tick = 0;
+  std::vector<Entry> m_Wheels[kLevels][kSlots];
+  std::vector<Entry> m_Overflow;
+  std::vector<Entry> m_Cascade;
+  std::vector<Entry> m_Expired;
+};
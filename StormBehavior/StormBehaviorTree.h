@@ -1,471 +1,1418 @@
-#pragma once
-
-#include <memory>
-#include <cassert>
-
-#include "StormBehaviorTreeTemplate.h"
-
-#define ONE_UPDATE_PER_CALL
-
-enum class StormBehaviorTreeElementType
-{
-  kConditional,
-  kService,
-  kState,
-};
-
-template <typename DataType, typename ContextType>
-class StormBehaviorTree
-{
-public:
-  StormBehaviorTree() = default;
-  StormBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> & bt)
-  {
-    SetBehaviorTree(&bt);
-  }
-
-  ~StormBehaviorTree()
-  {
-    Destroy();
-  }
-
-  void SetBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> * bt)
-  {
-    Destroy();
-    m_BehaviorTree = bt;
-
-    if(m_BehaviorTree)
-    {
-      m_TreeMemory = std::make_unique<uint8_t[]>(m_BehaviorTree->m_TotalSize);
-      for(auto & elem : m_BehaviorTree->m_InitInfo)
-      {
-        void * mem = m_TreeMemory.get() + elem.m_TargetOffset;
-        void * init = bt->m_InitDataMemory.get() + elem.m_InitOffset;
-        elem.m_Allocate(mem, init);
-      }
-    }
-  }
-
-  template <typename RandomSource>
-  void Update(DataType & data, ContextType & context, RandomSource & random)
-  {
-    if(m_BehaviorTree == nullptr || m_BehaviorTree->m_Nodes.size() == 0)
-    {
-      return;
-    }
-
-    if (m_CurrentNode == -1)
-    {
-      AdvanceToNextNode(data, context, random, true);
-    }
-    else if(m_AdvanceNode)
-    {
-      AdvanceToNextNode(data, context, random, false);
-    }
-    else if(CheckNodeConditionals(m_CurrentNode, data, context) == false)
-    {
-      AdvanceToNextNode(data, context, random, true);
-    }
-    
-    if(m_CurrentNode != -1)
-    {
-      m_AdvanceNode = UpdateNode(data, context);
-    }
-  }
-
-  template <typename Visitor>
-  void VisitNodes(Visitor && visitor)
-  {
-    if(m_CurrentNode == -1)
-    {
-      for(auto & elem : m_BehaviorTree->m_States)
-      {
-        auto * mem = m_TreeMemory.get() + elem.m_Offset;
-        visitor(StormBehaviorTreeElementType::kState, elem.m_TypeId, mem, false);
-      }
-
-      for(auto & elem : m_BehaviorTree->m_Conditionals)
-      {
-        auto * mem = m_TreeMemory.get() + elem.m_Offcset;
-        visitor(StormBehaviorTreeElementType::kConditional, elem.m_TypeId, mem, false);
-      }
-
-      for(auto & elem : m_BehaviorTree->m_Services)
-      {
-        auto * mem = m_TreeMemory.get() + elem.m_Offset;
-        visitor(StormBehaviorTreeElementType::kService, elem.m_TypeId, mem, false);
-      }
-    }
-    else
-    {
-      auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
-      auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
-
-      auto current_node = &m_BehaviorTree->m_States[node_info.m_LeafIndex];
-
-      for(auto & elem : m_BehaviorTree->m_States)
-      {
-        auto * mem = m_TreeMemory.get() + elem.m_Offset;
-        visitor(StormBehaviorTreeElementType::kState, elem.m_TypeId, mem, current_node == &elem);
-      }
-
-      for(int index = 0; index < static_cast<int>(m_BehaviorTree->m_Conditionals.size()); ++index)
-      {
-        bool active = false;
-        for(auto lookup_index = leaf_info.m_ConditionalStart; lookup_index < leaf_info.m_ConditionalEnd; ++lookup_index)
-        {
-          auto conditional_index = m_BehaviorTree->m_ConditionalLookup[lookup_index];
-          if(conditional_index == index)
-          {
-            active = true;
-          }
-        }
-
-        auto & elem = m_BehaviorTree->m_Conditionals[index];
-
-        auto * mem = m_TreeMemory.get() + elem.m_Offcset;
-        visitor(StormBehaviorTreeElementType::kConditional, elem.m_TypeId, mem, active);
-      }
-
-      for(int index = 0; index < static_cast<int>(m_BehaviorTree->m_Services.size()); ++index)
-      {
-        bool active = false;
-        for(auto lookup_index = leaf_info.m_ServiceStart; lookup_index < leaf_info.m_ServiceEnd; ++lookup_index)
-        {
-          auto service_index = m_BehaviorTree->m_ServiceLookup[lookup_index];
-          if(service_index == index)
-          {
-            active = true;
-          }
-        }
-        
-        auto & elem = m_BehaviorTree->m_Services[index];
-
-        auto * mem = m_TreeMemory.get() + elem.m_Offset;
-        visitor(StormBehaviorTreeElementType::kService, elem.m_TypeId, mem, active);
-      }      
-    }
-  }
-
-  int GetCurrentNode() const
-  {
-    return m_CurrentNode;
-  }
-
-  int GetNodeCount() const
-  {
-    return static_cast<int>(m_BehaviorTree->m_Nodes.size());
-  }
-
-private:
-
-  void Destroy()
-  {
-    if(m_BehaviorTree == nullptr)
-    {
-      return;
-    }
-
-    for(auto & elem : m_BehaviorTree->m_InitInfo)
-    {
-      void * mem = m_TreeMemory.get() + elem.m_TargetOffset;
-      elem.m_Deallocate(mem);
-    }
-  }
-
-  template <typename RandomSource>
-  void RandomShuffle(std::vector<std::pair<int, int>> & vals, RandomSource & random)
-  {
-    int total_weight = 0;
-    for(auto & elem : vals)
-    {
-      total_weight += elem.second;
-    }
-
-    for(int index = 0; index < static_cast<int>(vals.size()) - 1; ++index)
-    {
-      if(total_weight == 0)
-      {
-        return;
-      }
-      
-      auto s = (int)random() % total_weight;
-      for(int sort = index; sort < static_cast<int>(vals.size()); ++sort)
-      {
-        if(s < vals[sort].second)
-        {
-          total_weight -= vals[sort].second;
-          std::swap(vals[index], vals[sort]);
-          break;
-        }
-        else
-        {
-          s -= vals[sort].second;
-        }
-      }
-    }
-  }
-
-  void ActivateNode(int node_index, int prev_node_index, DataType & data, ContextType & context)
-  {
-    if(node_index == prev_node_index)
-    {
-      return;
-    }
-
-    std::vector<int> new_service_indices;
-    std::vector<int> old_service_indices;
-    if(node_index != -1)
-    {
-      auto & node_info = m_BehaviorTree->m_Nodes[node_index];
-      auto leaf_index = node_info.m_LeafIndex;
-
-      auto & leaf_info = m_BehaviorTree->m_Leaves[leaf_index];
-      for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
-      {
-        new_service_indices.push_back(m_BehaviorTree->m_ServiceLookup[index]);
-      }
-    }
-
-    if(prev_node_index != -1)
-    {
-      auto & node_info = m_BehaviorTree->m_Nodes[prev_node_index];
-      auto leaf_index = node_info.m_LeafIndex;
-
-      auto & leaf_info = m_BehaviorTree->m_Leaves[leaf_index];
-      for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
-      {
-        old_service_indices.push_back(m_BehaviorTree->m_ServiceLookup[index]);
-      }
-    }
-
-    for(std::size_t a = 0; a < new_service_indices.size(); ++a)
-    {
-      for(std::size_t b = 0; b < old_service_indices.size(); ++b)
-      {
-        if(new_service_indices[a] == old_service_indices[b])
-        {
-          std::swap(new_service_indices[a], new_service_indices[new_service_indices.size() - 1]);
-          new_service_indices.erase(new_service_indices.end() - 1);
-          std::swap(old_service_indices[b], old_service_indices[old_service_indices.size() - 1]);
-          old_service_indices.erase(old_service_indices.end() - 1);
-        }
-      }
-    }
-
-    for(auto & elem : old_service_indices)
-    {
-      auto & service_info = m_BehaviorTree->m_Services[elem];
-      if(service_info.m_Deactivate)
-      {
-        void * service_mem = m_TreeMemory.get() + service_info.m_Offset;
-        service_info.m_Deactivate(service_mem, data, context);
-      }
-    }
-
-    for(auto & elem : new_service_indices)
-    {
-      auto & service_info = m_BehaviorTree->m_Services[elem];
-      if(service_info.m_Activate)
-      {
-        void * service_mem = m_TreeMemory.get() + service_info.m_Offset;
-        service_info.m_Activate(service_mem, data, context);
-      }
-    }
-
-    m_CurrentNode = node_index;
-  }
-
-  bool CheckNodeConditionals(int node_index, DataType & data, ContextType & context)
-  {
-    auto & node_info = m_BehaviorTree->m_Nodes[node_index];
-    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
-
-    for(int index = leaf_info.m_ContinuousConditionalStart; index < leaf_info.m_ContinuousConditionalEnd; ++index)
-    {
-      auto conditional_index = m_BehaviorTree->m_ConditionalLookup[index];
-      auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
-      auto conditional_mem = m_TreeMemory.get() + conditional_info.m_Offset;
-
-      if(conditional_info.m_Check(conditional_mem, data, context) == false)
-      {
-        return false;
-      }
-    }
-
-    for(int index = leaf_info.m_PreemptConditionalStart; index < leaf_info.m_PreemptConditionalEnd; ++index)
-    {
-      auto conditional_index = m_BehaviorTree->m_ConditionalLookup[index];
-      auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
-      auto conditional_mem = m_TreeMemory.get() + conditional_info.m_Offset;
-
-      if(conditional_info.m_Check(conditional_mem, data, context) == true)
-      {
-        return false;
-      }
-    }    
-
-    return true;
-  }
-
-  bool UpdateNode(DataType & data, ContextType & context)
-  {
-    auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
-    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
-
-    for (int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
-    {
-      auto service_index = m_BehaviorTree->m_ServiceLookup[index];
-      auto & service_info = m_BehaviorTree->m_Services[service_index];
-      if(service_info.m_Update)
-      {
-        auto service_mem = m_TreeMemory.get() + service_info.m_Offset;
-        service_info.m_Update(service_mem, data, context);
-      }
-    }
-
-    auto & state_info = m_BehaviorTree->m_States[node_info.m_LeafIndex];
-    auto state_mem = m_TreeMemory.get() + state_info.m_Offset;
-
-    bool result = state_info.m_Update(state_mem, data, context);
-    if (result)
-    {
-      return true;
-    }
-
-    return false;
-  }
-
-  template <typename RandomSource>
-  int TraverseNode(int node_index, DataType & data, ContextType & context, RandomSource & random)
-  {
-    assert(node_index != -1);
-
-    auto & node = m_BehaviorTree->m_Nodes[node_index];
-    for(int conditional_index = node.m_ConditionalStart; conditional_index < node.m_ConditionalEnd; ++conditional_index)
-    {
-      auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
-
-      void * conditional_mem = m_TreeMemory.get() + conditional_info.m_Offset;
-      if(conditional_info.m_Check(conditional_mem, data, context) == false)
-      {
-        return -1;
-      }
-    }
-
-    switch(node.m_Type)
-    {
-      case StormBehaviorNodeType::kSelect:
-      {
-        for(int index = node.m_ChildStart; index < node.m_ChildEnd; ++index)
-        {
-          auto child_index = m_BehaviorTree->m_ChildNodeLookup[index];
-          auto result_node = TraverseNode(child_index, data, context, random);
-
-          if(result_node != -1)
-          {
-            return result_node;
-          }
-        }
-      }
-      break;
-      case StormBehaviorNodeType::kRandom:
-      {
-        std::vector<std::pair<int, int>> potential_nodes;
-        for(int index = node.m_ChildStart, random_index = 0; index < node.m_ChildEnd; ++index, ++random_index)
-        {
-          auto child_index = m_BehaviorTree->m_ChildNodeLookup[index];
-          auto r = m_BehaviorTree->m_RandomValues[node.m_RandomStart + random_index];
-          potential_nodes.push_back(std::make_pair(child_index, r));
-        }
-
-        RandomShuffle(potential_nodes, random);
-
-        for(auto & elem : potential_nodes)
-        {
-          auto result_node = TraverseNode(elem.first, data, context, random);
-          if(result_node != -1)
-          {
-            return result_node;
-          }
-        }
-      }
-      break;
-      case StormBehaviorNodeType::kSequence:
-      {
-        if(node.m_ChildStart == node.m_ChildEnd)
-        {
-          return -1;
-        }
-
-        auto child_index = m_BehaviorTree->m_ChildNodeLookup[node.m_ChildStart];
-        auto result_node = TraverseNode(child_index, data, context, random);
-
-        if(result_node != -1)
-        {
-          return result_node;
-        }
-      }
-      break;
-      case StormBehaviorNodeType::kLeaf:
-      {
-        return node_index;
-      }
-      break;
-    }
-
-    return -1;
-  }
-
-  template <typename RandomSource>
-  void AdvanceToNextNode(DataType & data, ContextType & context, RandomSource & random, bool restart)
-  {
-    bool restarted = restart;
-    int new_node = restart ? -1 : m_CurrentNode;
-
-    while(true)
-    {
-      if(new_node == -1)
-      {
-        new_node = TraverseNode(0, data, context, random);
-
-        ActivateNode(new_node, m_CurrentNode, data, context);
-        return;
-      }
-      else
-      {
-        auto & node_info = m_BehaviorTree->m_Nodes[new_node];
-        auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
-        
-        new_node = -1;
-        if(leaf_info.m_NextInSequence != -1)
-        {
-          new_node = TraverseNode(leaf_info.m_NextInSequence, data, context, random);
-        }
-
-        if (new_node == -1)
-        {
-          if(restarted)
-          {
-            ActivateNode(new_node, m_CurrentNode, data, context);
-            return;
-          }  
-
-          restarted = true;
-          continue;
-        }
-
-        ActivateNode(new_node, m_CurrentNode, data, context);
-        return;
-      }
-    }
-  }
-
-private:
-
-  StormBehaviorTreeTemplate<DataType, ContextType> * m_BehaviorTree = nullptr;
-  std::unique_ptr<uint8_t[]> m_TreeMemory;
-
-  int m_CurrentNode = -1;
-  bool m_AdvanceNode = false;
-};
+#pragma once
+
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <limits>
+
+#include "StormBehaviorTreeTemplate.h"
+#include "StormBehaviorRandom.h"
+#include "StormBehaviorTreeEvents.h"
+#include "StormBehaviorTreeReplay.h"
+
+#define ONE_UPDATE_PER_CALL
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeLayered;
+
+// What other threads see of an instance through StormBehaviorTree::Observe.  Dwell ticks saturate at 2^31 - 1
+struct StormBehaviorTreeObservedState
+{
+  int m_CurrentNode = -1;
+  bool m_AdvanceNode = false;
+  uint32_t m_DwellTicks = 0;
+};
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTree
+{
+public:
+  StormBehaviorTree() = default;
+  StormBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> & bt)
+  {
+    SetBehaviorTree(&bt);
+  }
+
+  StormBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> & bt, const StormBehaviorTreeParamBlock & params)
+  {
+    SetBehaviorTree(&bt, nullptr, &params);
+  }
+
+  StormBehaviorTree(const StormBehaviorTree & rhs) = delete;
+  StormBehaviorTree & operator = (const StormBehaviorTree & rhs) = delete;
+
+  // Moving an instance hands over its node memory, so the elements themselves stay where they are.  No other 
+  // thread may post events to rhs while it is being moved
+  StormBehaviorTree(StormBehaviorTree && rhs) noexcept
+  {
+    *this = std::move(rhs);
+  }
+
+  StormBehaviorTree & operator = (StormBehaviorTree && rhs) noexcept
+  {
+    if(this == &rhs)
+    {
+      return *this;
+    }
+
+    Destroy();
+
+    m_BehaviorTree = rhs.m_BehaviorTree;
+    m_TreeMemory = rhs.m_TreeMemory;
+    m_OwnedTreeMemory = std::move(rhs.m_OwnedTreeMemory);
+    m_Params = rhs.m_Params;
+    m_Profile = rhs.m_Profile;
+    m_ReplayLog = rhs.m_ReplayLog;
+    m_UtilityScores = rhs.m_UtilityScores;
+    m_UtilityScoreStride = rhs.m_UtilityScoreStride;
+    m_Mailbox = std::move(rhs.m_Mailbox);
+    m_Broadcast = rhs.m_Broadcast;
+    m_BroadcastSequence = rhs.m_BroadcastSequence;
+    m_InterruptNodes = std::move(rhs.m_InterruptNodes);
+    m_ConditionalMemo = std::move(rhs.m_ConditionalMemo);
+    m_SharedMemo = rhs.m_SharedMemo;
+    m_SharedMemoSlots = rhs.m_SharedMemoSlots;
+    m_MemoGeneration = rhs.m_MemoGeneration;
+    m_ServiceDue = std::move(rhs.m_ServiceDue);
+    m_ServiceClock = rhs.m_ServiceClock;
+    m_NextServiceDue = rhs.m_NextServiceDue;
+    m_ServiceSeed = rhs.m_ServiceSeed;
+    m_CurrentNode = rhs.m_CurrentNode;
+    m_SleepTicks = rhs.m_SleepTicks;
+    m_DwellTicks = rhs.m_DwellTicks;
+    m_AdvanceNode = rhs.m_AdvanceNode;
+    PublishObservedState();
+
+    rhs.m_BehaviorTree = nullptr;
+    rhs.m_TreeMemory = nullptr;
+    rhs.m_CurrentNode = -1;
+    rhs.PublishObservedState();
+    return *this;
+  }
+
+  ~StormBehaviorTree()
+  {
+    Destroy();
+  }
+
+  void SetBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> * bt)
+  {
+    SetBehaviorTree(bt, nullptr);
+  }
+
+  // Builds the node memory in memory, which must hold at least bt->GetInstanceMemorySize() bytes and outlive the 
+  // instance, instead of allocating it.  Pass nullptr to allocate.  Elements built with StormBehaviorParam
+  // arguments take their values from params, which must come from bt->CreateParamBlock, or their defaults
+  void SetBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> * bt, void * memory, 
+                       const StormBehaviorTreeParamBlock * params = nullptr)
+  {
+    AttachBehaviorTree(bt, memory);
+    m_Params = params;
+
+    if(m_BehaviorTree)
+    {
+      assert(params == nullptr || params->GetSlots() == &m_BehaviorTree->m_ParamSlots);
+
+      for(auto & elem : m_BehaviorTree->m_InitInfo)
+      {
+        void * mem = m_TreeMemory + elem.m_TargetOffset;
+        void * init = bt->m_InitDataMemory.get() + elem.m_InitOffset;
+        elem.m_Allocate(mem, init, params);
+      }
+    }
+  }
+
+  // Writes the active node, the advance flag, the node memory and where each timed service is in its interval.
+  // The template must be serializable
+  void Save(StormBehaviorTreeWriteBuffer & buffer) const
+  {
+    assert(m_BehaviorTree && m_BehaviorTree->IsSerializable());
+
+    buffer.WriteVarInt(static_cast<uint64_t>(m_BehaviorTree->m_TotalSize));
+    buffer.WriteVarInt(StormBehaviorZigZag(m_CurrentNode));
+    buffer.Write<uint8_t>(m_AdvanceNode ? 1 : 0);
+    m_BehaviorTree->SaveInstanceMemory(m_TreeMemory, buffer);
+
+    auto state_init_info = GetLazyStateInitInfo(m_CurrentNode);
+    if(state_init_info && m_BehaviorTree->m_RawSerializable == false)
+    {
+      state_init_info->m_Save(m_TreeMemory + state_init_info->m_TargetOffset, buffer);
+    }
+
+    // Due ticks are written relative to the clock, which is kept so deviation draws carry on where they left off
+    if(m_ServiceDue.size() > 0)
+    {
+      buffer.WriteVarInt(m_ServiceClock);
+      for(auto & elem : m_ServiceDue)
+      {
+        buffer.WriteVarInt(StormBehaviorZigZag(static_cast<int64_t>(elem - m_ServiceClock)));
+      }
+    }
+  }
+
+  // Restores an instance written by Save with the same template.  The elements are constructed straight from the 
+  // saved data, so their init arguments and Activate callbacks are not run again.  memory works the same as in 
+  // SetBehaviorTree.  Returns false if the data is truncated or was written for a different template, in which 
+  // case the instance may be left with partially loaded elements
+  bool Load(StormBehaviorTreeTemplate<DataType, ContextType> * bt, StormBehaviorTreeReadBuffer & buffer, void * memory = nullptr)
+  {
+    assert(bt && bt->IsSerializable());
+
+    Destroy();
+    if(buffer.ReadVarInt() != static_cast<uint64_t>(bt->m_TotalSize))
+    {
+      return false;
+    }
+
+    auto current_node = StormBehaviorUnZigZag(buffer.ReadVarInt());
+    auto advance_node = buffer.Read<uint8_t>() != 0;
+    if(buffer.HasFailed() || current_node < -1 || current_node >= static_cast<int64_t>(bt->m_Nodes.size()) ||
+       (current_node != -1 && bt->m_Nodes[current_node].m_Type != StormBehaviorNodeType::kLeaf))
+    {
+      return false;
+    }
+
+    AttachBehaviorTree(bt, memory);
+    m_BehaviorTree->LoadInstanceMemory(m_TreeMemory, buffer);
+
+    m_CurrentNode = static_cast<int>(current_node);
+    m_AdvanceNode = advance_node;
+    PublishObservedState();
+
+    auto state_init_info = GetLazyStateInitInfo(m_CurrentNode);
+    if(state_init_info && m_BehaviorTree->m_RawSerializable == false)
+    {
+      state_init_info->m_Load(m_TreeMemory + state_init_info->m_TargetOffset, buffer);
+    }
+
+    if(m_ServiceDue.size() > 0)
+    {
+      m_ServiceClock = buffer.ReadVarInt();
+      m_NextServiceDue = std::numeric_limits<uint64_t>::max();
+      for(auto & elem : m_ServiceDue)
+      {
+        elem = m_ServiceClock + static_cast<uint64_t>(StormBehaviorUnZigZag(buffer.ReadVarInt()));
+        m_NextServiceDue = std::min(m_NextServiceDue, elem);
+      }
+    }
+
+    return buffer.HasFailed() == false;
+  }
+
+  // Moves the node memory to memory, with the same requirements as SetBehaviorTree, or to a new allocation if 
+  // memory is nullptr.  The template must be relocatable
+  void Relocate(void * memory)
+  {
+    if(m_BehaviorTree == nullptr)
+    {
+      return;
+    }
+
+    assert(m_BehaviorTree->IsRelocatable());
+
+    std::unique_ptr<uint8_t[]> owned_memory;
+    if(memory == nullptr)
+    {
+      owned_memory = std::make_unique<uint8_t[]>(m_BehaviorTree->m_TotalSize);
+      memory = owned_memory.get();
+    }
+
+    m_BehaviorTree->RelocateInstanceMemory(memory, m_TreeMemory);
+
+    auto state_init_info = GetLazyStateInitInfo(m_CurrentNode);
+    if(state_init_info && m_BehaviorTree->m_TriviallyRelocatable == false)
+    {
+      auto offset = state_init_info->m_TargetOffset;
+      state_init_info->m_Relocate(static_cast<uint8_t *>(memory) + offset, m_TreeMemory + offset);
+    }
+
+    m_TreeMemory = static_cast<uint8_t *>(memory);
+    m_OwnedTreeMemory = std::move(owned_memory);
+  }
+
+  bool OwnsMemory() const
+  {
+    return m_OwnedTreeMemory != nullptr;
+  }
+
+  template <typename RandomSource>
+  void Update(DataType & data, ContextType & context, RandomSource & random)
+  {
+    if(m_BehaviorTree == nullptr || m_BehaviorTree->m_Nodes.size() == 0)
+    {
+      return;
+    }
+
+    auto target_node = Evaluate(data, context, random);
+    Apply(target_node, data, context);
+  }
+
+  // Read-only half of Update.  Runs the traversal and conditional checks and returns the node that
+  // the instance should be in for this tick.  Only touches this instance's own node memory, so it
+  // is safe to call for many instances in parallel as long as each has its own random source
+  template <typename RandomSource>
+  int Evaluate(const DataType & data, const ContextType & context, RandomSource & random)
+  {
+    if(m_BehaviorTree == nullptr || m_BehaviorTree->m_Nodes.size() == 0)
+    {
+      return -1;
+    }
+
+    m_MemoGeneration++;
+
+    if(m_ReplayLog)
+    {
+      m_ReplayLog->BeginTick();
+    }
+
+    if(m_Mailbox.IsEmpty() == false || (m_Broadcast && m_Broadcast->GetSequence() != m_BroadcastSequence))
+    {
+      auto interrupt_node = ProcessInterrupts(data, context, random);
+      if(interrupt_node != -1)
+      {
+        return interrupt_node;
+      }
+    }
+
+    if (m_CurrentNode == -1)
+    {
+      return FindNextNode(data, context, random, true);
+    }
+    else if(m_AdvanceNode)
+    {
+      return FindNextNode(data, context, random, false);
+    }
+    else if(CheckNodeConditionals(m_CurrentNode, data, context) == false)
+    {
+      return FindNextNode(data, context, random, true);
+    }
+
+    return m_CurrentNode;
+  }
+
+  // Mutating half of Update.  Switches to the node returned by Evaluate for this tick (running the
+  // deactivate / activate callbacks) and updates the services and state of the active leaf
+  void Apply(int target_node, DataType & data, ContextType & context)
+  {
+    if(m_BehaviorTree == nullptr || m_BehaviorTree->m_Nodes.size() == 0)
+    {
+      return;
+    }
+
+    if(m_Profile && target_node != -1)
+    {
+      if(m_CurrentNode != -1 && target_node != m_CurrentNode)
+      {
+        auto from_leaf = m_BehaviorTree->m_Nodes[m_CurrentNode].m_LeafIndex;
+        auto to_leaf = m_BehaviorTree->m_Nodes[target_node].m_LeafIndex;
+        m_Profile->m_LeafTransitions[static_cast<std::size_t>(from_leaf) * m_Profile->m_LeafCount + to_leaf]++;
+      }
+
+      m_Profile->m_NodeHits[target_node]++;
+    }
+
+    if(m_BehaviorTree->m_TransitionStats && target_node != m_CurrentNode && m_CurrentNode != -1)
+    {
+      auto from_leaf = m_BehaviorTree->m_Nodes[m_CurrentNode].m_LeafIndex;
+      m_BehaviorTree->m_TransitionStats->RecordDwell(from_leaf, m_DwellTicks);
+
+      if(target_node != -1)
+      {
+        m_BehaviorTree->m_TransitionStats->RecordTransition(from_leaf, m_BehaviorTree->m_Nodes[target_node].m_LeafIndex);
+      }
+    }
+
+    if(target_node != m_CurrentNode)
+    {
+      m_DwellTicks = 0;
+    }
+
+    ActivateNode(target_node, m_CurrentNode, data, context);
+
+    m_SleepTicks = 0;
+    if(m_CurrentNode != -1)
+    {
+      m_DwellTicks++;
+      m_AdvanceNode = UpdateNode(data, context);
+    }
+
+    m_ServiceClock++;
+
+    PublishObservedState();
+  }
+
+  // Counts ticks the instance was not updated for towards the time spent in the active leaf
+  void AddDwellTicks(int ticks)
+  {
+    m_DwellTicks += ticks;
+    m_ServiceClock += ticks;
+  }
+
+  // Seeds the deviation of timed service intervals so instances don't all draw the same ones.  The world seeds 
+  // each instance with its handle
+  void SetServiceSeed(uint64_t seed)
+  {
+    m_ServiceSeed = seed;
+  }
+
+  // Queues event_id for the next Evaluate, which re-selects from every node that was built with InterruptOn(event_id).
+  // Safe to call from any thread
+  void PostEvent(int event_id)
+  {
+    m_Mailbox.Push(StormBehaviorTreeInterrupt{ event_id, -1 });
+  }
+
+  // Queues an immediate re-selection from node_index (0 for the root) for the next Evaluate.  Safe to call from any thread
+  void Interrupt(int node_index)
+  {
+    m_Mailbox.Push(StormBehaviorTreeInterrupt{ -1, node_index });
+  }
+
+  // Uses precomputed utility scores instead of calling the scorers.  The score for scorer index i is read from
+  // scores[i * stride].  Pass nullptr to go back to scoring on demand
+  void SetUtilityScores(const float * scores, int stride)
+  {
+    m_UtilityScores = scores;
+    m_UtilityScoreStride = stride;
+  }
+
+  // Calls visitor(conditional_index, conditional_memory) for each conditional with a CheckBatch that the next
+  // Evaluate checks to decide whether to stay in the active leaf
+  template <typename Visitor>
+  void VisitBatchConditionals(Visitor && visitor)
+  {
+    if(m_CurrentNode == -1 || m_AdvanceNode)
+    {
+      return;
+    }
+
+    auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
+    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+
+    for(int index = leaf_info.m_ContinuousConditionalStart; index < leaf_info.m_PreemptConditionalEnd; ++index)
+    {
+      auto conditional_index = m_BehaviorTree->m_ConditionalLookup[index];
+      auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
+      if(conditional_info.m_CheckBatch)
+      {
+        visitor(conditional_index, static_cast<void *>(m_TreeMemory + conditional_info.m_Offset));
+      }
+    }
+  }
+
+  // Hands the next Evaluate the result of a conditional with a memo slot, so it is not checked again
+  void SetConditionalResult(int conditional_index, bool result)
+  {
+    auto memo = GetConditionalMemo(conditional_index);
+    assert(memo != nullptr);
+
+    *memo = ((m_MemoGeneration + 1) << 1) | (result ? 1 : 0);
+  }
+
+  // Events broadcast after this call are treated as if they were posted to this instance
+  void SetBroadcast(const StormBehaviorTreeBroadcast * broadcast)
+  {
+    m_Broadcast = broadcast;
+    m_BroadcastSequence = broadcast ? broadcast->GetSequence() : 0;
+  }
+
+  // Number of ticks the active state asked to sleep for after the last Apply, kStormBehaviorSleepUntilWoken
+  // to sleep until explicitly woken or zero to stay awake.  Sleeping is carried out by StormBehaviorTreeWorld
+  int GetSleepTicks() const
+  {
+    return m_SleepTicks;
+  }
+
+  bool HasPollingConditionals() const
+  {
+    if(m_CurrentNode == -1)
+    {
+      return false;
+    }
+
+    auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
+    return m_BehaviorTree->m_Leaves[node_info.m_LeafIndex].m_PollWhileSleeping;
+  }
+
+  // Checks only the conditionals of the active leaf that opted into polling while sleeping.  Returns false 
+  // if any of them would cause the leaf to be left, in which case the instance should be woken
+  bool CheckPollingConditionals(const DataType & data, const ContextType & context)
+  {
+    if(m_CurrentNode == -1)
+    {
+      return true;
+    }
+
+    m_MemoGeneration++;
+
+    auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
+    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+
+    for(int index = leaf_info.m_ContinuousConditionalStart; index < leaf_info.m_PreemptConditionalEnd; ++index)
+    {
+      auto conditional_index = m_BehaviorTree->m_ConditionalLookup[index];
+      auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
+      if(conditional_info.m_PollWhileSleeping == false)
+      {
+        continue;
+      }
+
+      auto expected = index < leaf_info.m_ContinuousConditionalEnd;
+      if(CheckConditionalMemo(conditional_index, data, context) != expected)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  template <typename Visitor>
+  void VisitNodes(Visitor && visitor)
+  {
+    if(m_CurrentNode == -1)
+    {
+      for(auto & elem : m_BehaviorTree->m_States)
+      {
+        auto * mem = m_TreeMemory + elem.m_Offset;
+        visitor(StormBehaviorTreeElementType::kState, elem.m_TypeId, mem, false);
+      }
+
+      for(auto & elem : m_BehaviorTree->m_Conditionals)
+      {
+        auto * mem = m_TreeMemory + elem.m_Offcset;
+        visitor(StormBehaviorTreeElementType::kConditional, elem.m_TypeId, mem, false);
+      }
+
+      for(auto & elem : m_BehaviorTree->m_Services)
+      {
+        auto * mem = m_TreeMemory + elem.m_Offset;
+        visitor(StormBehaviorTreeElementType::kService, elem.m_TypeId, mem, false);
+      }
+    }
+    else
+    {
+      auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
+      auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+
+      auto current_node = &m_BehaviorTree->m_States[node_info.m_LeafIndex];
+
+      for(auto & elem : m_BehaviorTree->m_States)
+      {
+        auto * mem = m_TreeMemory + elem.m_Offset;
+        visitor(StormBehaviorTreeElementType::kState, elem.m_TypeId, mem, current_node == &elem);
+      }
+
+      for(int index = 0; index < static_cast<int>(m_BehaviorTree->m_Conditionals.size()); ++index)
+      {
+        bool active = false;
+        for(auto lookup_index = leaf_info.m_ConditionalStart; lookup_index < leaf_info.m_ConditionalEnd; ++lookup_index)
+        {
+          auto conditional_index = m_BehaviorTree->m_ConditionalLookup[lookup_index];
+          if(conditional_index == index)
+          {
+            active = true;
+          }
+        }
+
+        auto & elem = m_BehaviorTree->m_Conditionals[index];
+
+        auto * mem = m_TreeMemory + elem.m_Offcset;
+        visitor(StormBehaviorTreeElementType::kConditional, elem.m_TypeId, mem, active);
+      }
+
+      for(int index = 0; index < static_cast<int>(m_BehaviorTree->m_Services.size()); ++index)
+      {
+        bool active = false;
+        for(auto lookup_index = leaf_info.m_ServiceStart; lookup_index < leaf_info.m_ServiceEnd; ++lookup_index)
+        {
+          auto service_index = m_BehaviorTree->m_ServiceLookup[lookup_index];
+          if(service_index == index)
+          {
+            active = true;
+          }
+        }
+        
+        auto & elem = m_BehaviorTree->m_Services[index];
+
+        auto * mem = m_TreeMemory + elem.m_Offset;
+        visitor(StormBehaviorTreeElementType::kService, elem.m_TypeId, mem, active);
+      }      
+    }
+  }
+
+  int GetCurrentNode() const
+  {
+    return m_CurrentNode;
+  }
+
+  int GetNodeCount() const
+  {
+    return static_cast<int>(m_BehaviorTree->m_Nodes.size());
+  }
+
+  // Calls visitor with the template service index of every service running in the active leaf
+  template <typename Visitor>
+  void VisitActiveServices(Visitor && visitor) const
+  {
+    VisitNodeServices(m_CurrentNode, visitor);
+  }
+
+  // Safe to call from any thread while the instance is updating, without blocking the update.  Returns the state 
+  // as of the end of the last Apply, so a node that is halfway through being switched to is never seen.  The 
+  // instance itself must stay alive and in place
+  StormBehaviorTreeObservedState Observe() const
+  {
+    auto packed = m_ObservedState.load(std::memory_order_acquire);
+
+    StormBehaviorTreeObservedState state;
+    state.m_CurrentNode = static_cast<int>(static_cast<uint32_t>(packed));
+    state.m_AdvanceNode = ((packed >> 32) & 1) != 0;
+    state.m_DwellTicks = static_cast<uint32_t>(packed >> 33);
+    return state;
+  }
+
+  // Calls visitor with the template service index of every service running in an observed state.  Only reads the 
+  // template, so it can be called alongside Observe as long as the instance isn't given a different template
+  template <typename Visitor>
+  void VisitObservedServices(const StormBehaviorTreeObservedState & state, Visitor && visitor) const
+  {
+    VisitNodeServices(state.m_CurrentNode, visitor);
+  }
+
+  // Raw node memory, GetBehaviorTree()->GetInstanceMemorySize() bytes
+  const void * GetNodeMemory() const
+  {
+    return m_TreeMemory;
+  }
+
+  void * GetNodeMemory()
+  {
+    return m_TreeMemory;
+  }
+
+  // Switches the active node without running any callbacks, for client side mirrors of server instances.  Lazy
+  // states are still constructed and destroyed
+  void SetReplicatedNode(int node_index)
+  {
+    if(node_index != m_CurrentNode)
+    {
+      DestroyLazyState(m_CurrentNode);
+      ConstructLazyState(node_index);
+    }
+
+    m_CurrentNode = node_index;
+    m_AdvanceNode = false;
+    m_SleepTicks = 0;
+    PublishObservedState();
+  }
+
+  // Records traversal hits and leaf transitions into the profile for StormBehaviorTreeTemplate::ApplyProfileLayout
+  void SetProfile(StormBehaviorTreeProfile * profile)
+  {
+    m_Profile = profile;
+  }
+
+  // Records into the log every tick, or feeds the traversal from it once it is replaying.  Every Evaluate is one 
+  // tick of the log
+  void SetReplayLog(StormBehaviorTreeReplayLog * replay_log)
+  {
+    m_ReplayLog = replay_log;
+  }
+
+  StormBehaviorTreeTemplate<DataType, ContextType> * GetBehaviorTree()
+  {
+    return m_BehaviorTree;
+  }
+
+  const StormBehaviorTreeTemplate<DataType, ContextType> * GetBehaviorTree() const
+  {
+    return m_BehaviorTree;
+  }
+
+  StormBehaviorTreeInstanceMemoryStats GetMemoryStats() const
+  {
+    StormBehaviorTreeInstanceMemoryStats stats;
+    stats.m_ObjectBytes = sizeof(*this);
+
+    if(m_BehaviorTree)
+    {
+      stats.m_NodeMemoryBytes = static_cast<std::size_t>(m_BehaviorTree->m_TotalSize);
+      stats.m_PaddingBytes = m_BehaviorTree->GetInstancePaddingBytes();
+      stats.m_AllocationSlackBytes = m_OwnedTreeMemory ? StormBehaviorGetAllocationSlack(stats.m_NodeMemoryBytes) : 0;
+    }
+
+    return stats;
+  }
+
+private:
+
+  void AttachBehaviorTree(StormBehaviorTreeTemplate<DataType, ContextType> * bt, void * memory)
+  {
+    Destroy();
+    m_BehaviorTree = bt;
+
+    if(m_BehaviorTree)
+    {
+      if(memory)
+      {
+        m_TreeMemory = static_cast<uint8_t *>(memory);
+      }
+      else
+      {
+        m_OwnedTreeMemory = std::make_unique<uint8_t[]>(m_BehaviorTree->m_TotalSize);
+        m_TreeMemory = m_OwnedTreeMemory.get();
+      }
+
+      if(m_SharedMemo == nullptr)
+      {
+        m_ConditionalMemo.assign(m_BehaviorTree->m_ConditionalMemoSlotCount, 0);
+      }
+
+      m_ServiceDue.assign(m_BehaviorTree->m_TimedServiceCount, 0);
+      m_NextServiceDue = 0;
+    }
+  }
+
+  void Destroy()
+  {
+    if(m_BehaviorTree == nullptr)
+    {
+      return;
+    }
+
+    for(auto & elem : m_BehaviorTree->m_InitInfo)
+    {
+      void * mem = m_TreeMemory + elem.m_TargetOffset;
+      elem.m_Deallocate(mem);
+    }
+
+    DestroyLazyState(m_CurrentNode);
+
+    m_BehaviorTree = nullptr;
+    m_Params = nullptr;
+    m_TreeMemory = nullptr;
+    m_OwnedTreeMemory.reset();
+    m_CurrentNode = -1;
+    m_AdvanceNode = false;
+    m_SleepTicks = 0;
+    m_DwellTicks = 0;
+    PublishObservedState();
+  }
+
+  // The whole observed state is packed into one word so monitor threads never need a lock or a retry loop
+  void PublishObservedState()
+  {
+    auto dwell_ticks = std::min<uint64_t>(m_DwellTicks, 0x7FFFFFFF);
+    auto packed = static_cast<uint64_t>(static_cast<uint32_t>(m_CurrentNode)) | (m_AdvanceNode ? 1ULL << 32 : 0) | (dwell_ticks << 33);
+    m_ObservedState.store(packed, std::memory_order_release);
+  }
+
+  template <typename Visitor>
+  void VisitNodeServices(int node_index, Visitor & visitor) const
+  {
+    if(node_index == -1)
+    {
+      return;
+    }
+
+    auto & node_info = m_BehaviorTree->m_Nodes[node_index];
+    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+    for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
+    {
+      visitor(m_BehaviorTree->m_ServiceLookup[index]);
+    }
+  }
+
+  template <typename RandomSource>
+  int DrawRandom(RandomSource & random, int bound)
+  {
+    if(m_ReplayLog == nullptr)
+    {
+      return StormBehaviorRandomBounded(random, bound);
+    }
+
+    if(m_ReplayLog->IsReplaying())
+    {
+      return m_ReplayLog->ReadDraw();
+    }
+
+    auto draw = StormBehaviorRandomBounded(random, bound);
+    m_ReplayLog->WriteDraw(draw);
+    return draw;
+  }
+
+  template <typename RandomSource>
+  void RandomShuffle(std::vector<std::pair<int, int>> & vals, RandomSource & random)
+  {
+    int total_weight = 0;
+    for(auto & elem : vals)
+    {
+      total_weight += elem.second;
+    }
+
+    for(int index = 0; index < static_cast<int>(vals.size()) - 1; ++index)
+    {
+      if(total_weight == 0)
+      {
+        return;
+      }
+      
+      auto s = DrawRandom(random, total_weight);
+      for(int sort = index; sort < static_cast<int>(vals.size()); ++sort)
+      {
+        if(s < vals[sort].second)
+        {
+          total_weight -= vals[sort].second;
+          std::swap(vals[index], vals[sort]);
+          break;
+        }
+        else
+        {
+          s -= vals[sort].second;
+        }
+      }
+    }
+  }
+
+  // Init info of the node's state if the template constructs states on activation, otherwise nullptr
+  const typename StormBehaviorTreeTemplate<DataType, ContextType>::MemInitInfo * GetLazyStateInitInfo(int node_index) const
+  {
+    if(m_BehaviorTree->m_LazyStates == false || node_index == -1)
+    {
+      return nullptr;
+    }
+
+    return &m_BehaviorTree->m_StateInitInfo[m_BehaviorTree->m_Nodes[node_index].m_LeafIndex];
+  }
+
+  void ConstructLazyState(int node_index)
+  {
+    auto init_info = GetLazyStateInitInfo(node_index);
+    if(init_info)
+    {
+      init_info->m_Allocate(m_TreeMemory + init_info->m_TargetOffset, m_BehaviorTree->m_InitDataMemory.get() + init_info->m_InitOffset, m_Params);
+    }
+  }
+
+  void DestroyLazyState(int node_index)
+  {
+    auto init_info = GetLazyStateInitInfo(node_index);
+    if(init_info)
+    {
+      init_info->m_Deallocate(m_TreeMemory + init_info->m_TargetOffset);
+    }
+  }
+
+  void ActivateNode(int node_index, int prev_node_index, DataType & data, ContextType & context)
+  {
+    if(node_index == prev_node_index)
+    {
+      return;
+    }
+
+    std::vector<int> new_service_indices;
+    std::vector<int> old_service_indices;
+    if(node_index != -1)
+    {
+      auto & node_info = m_BehaviorTree->m_Nodes[node_index];
+      auto leaf_index = node_info.m_LeafIndex;
+
+      auto & leaf_info = m_BehaviorTree->m_Leaves[leaf_index];
+      for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
+      {
+        new_service_indices.push_back(m_BehaviorTree->m_ServiceLookup[index]);
+      }
+    }
+
+    if(prev_node_index != -1)
+    {
+      auto & node_info = m_BehaviorTree->m_Nodes[prev_node_index];
+      auto leaf_index = node_info.m_LeafIndex;
+
+      auto & leaf_info = m_BehaviorTree->m_Leaves[leaf_index];
+      for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
+      {
+        old_service_indices.push_back(m_BehaviorTree->m_ServiceLookup[index]);
+      }
+    }
+
+    for(std::size_t a = 0; a < new_service_indices.size(); ++a)
+    {
+      for(std::size_t b = 0; b < old_service_indices.size(); ++b)
+      {
+        if(new_service_indices[a] == old_service_indices[b])
+        {
+          std::swap(new_service_indices[a], new_service_indices[new_service_indices.size() - 1]);
+          new_service_indices.erase(new_service_indices.end() - 1);
+          std::swap(old_service_indices[b], old_service_indices[old_service_indices.size() - 1]);
+          old_service_indices.erase(old_service_indices.end() - 1);
+        }
+      }
+    }
+
+    if(prev_node_index != -1)
+    {
+      auto & state_info = m_BehaviorTree->m_States[m_BehaviorTree->m_Nodes[prev_node_index].m_LeafIndex];
+      if(state_info.m_Deactivate)
+      {
+        void * state_mem = m_TreeMemory + state_info.m_Offset;
+        state_info.m_Deactivate(state_mem, data, context);
+      }
+
+      DestroyLazyState(prev_node_index);
+    }
+
+    for(auto & elem : old_service_indices)
+    {
+      auto & service_info = m_BehaviorTree->m_Services[elem];
+      if(service_info.m_Deactivate)
+      {
+        void * service_mem = m_TreeMemory + service_info.m_Offset;
+        service_info.m_Deactivate(service_mem, data, context);
+      }
+    }
+
+    for(auto & elem : new_service_indices)
+    {
+      auto & service_info = m_BehaviorTree->m_Services[elem];
+      if(service_info.m_Activate)
+      {
+        void * service_mem = m_TreeMemory + service_info.m_Offset;
+        service_info.m_Activate(service_mem, data, context);
+      }
+
+      if(service_info.m_TimedIndex != -1)
+      {
+        m_ServiceDue[service_info.m_TimedIndex] = m_ServiceClock;
+        m_NextServiceDue = std::min(m_NextServiceDue, m_ServiceClock);
+      }
+    }
+
+    if(node_index != -1)
+    {
+      ConstructLazyState(node_index);
+
+      auto & state_info = m_BehaviorTree->m_States[m_BehaviorTree->m_Nodes[node_index].m_LeafIndex];
+      if(state_info.m_Activate)
+      {
+        void * state_mem = m_TreeMemory + state_info.m_Offset;
+        state_info.m_Activate(state_mem, data, context);
+      }
+    }
+
+    m_CurrentNode = node_index;
+  }
+
+  // Returns nullptr if the conditional is not memoized.  The layers of a layered instance share one memo, indexed 
+  // by declaration index so it survives conditional reordering
+  uint64_t * GetConditionalMemo(int conditional_index)
+  {
+    auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
+    if(m_SharedMemo)
+    {
+      auto memo_slot = m_SharedMemoSlots[conditional_info.m_DeclarationIndex];
+      return memo_slot != -1 ? m_SharedMemo + memo_slot : nullptr;
+    }
+
+    return conditional_info.m_MemoSlot != -1 ? &m_ConditionalMemo[conditional_info.m_MemoSlot] : nullptr;
+  }
+
+  bool CheckConditional(int conditional_index, const DataType & data, const ContextType & context)
+  {
+    if(m_ReplayLog == nullptr)
+    {
+      return CheckConditionalMemo(conditional_index, data, context);
+    }
+
+    if(m_ReplayLog->IsReplaying())
+    {
+      return m_ReplayLog->ReadResult();
+    }
+
+    auto result = CheckConditionalMemo(conditional_index, data, context);
+    m_ReplayLog->WriteResult(result);
+    return result;
+  }
+
+  // Memoized conditionals are checked at most once per Evaluate
+  bool CheckConditionalMemo(int conditional_index, const DataType & data, const ContextType & context)
+  {
+    auto memo = GetConditionalMemo(conditional_index);
+    if(memo == nullptr)
+    {
+      return EvaluateConditional(conditional_index, data, context);
+    }
+
+    if((*memo >> 1) == m_MemoGeneration)
+    {
+      return (*memo & 1) != 0;
+    }
+
+    auto result = EvaluateConditional(conditional_index, data, context);
+    *memo = (m_MemoGeneration << 1) | (result ? 1 : 0);
+    return result;
+  }
+
+  bool EvaluateConditional(int conditional_index, const DataType & data, const ContextType & context)
+  {
+    auto & conditional_info = m_BehaviorTree->m_Conditionals[conditional_index];
+    auto conditional_mem = m_TreeMemory + conditional_info.m_Offset;
+
+    if(m_BehaviorTree->m_ConditionalStats.empty())
+    {
+      return m_BehaviorTree->RunConditional(conditional_info, conditional_mem, data, context);
+    }
+
+    auto & stats = m_BehaviorTree->m_ConditionalStats[conditional_index];
+    auto evaluation = stats.m_Evaluations.fetch_add(1, std::memory_order_relaxed);
+
+    bool result;
+    if(evaluation % kStormBehaviorConditionalTimingInterval == 0)
+    {
+      auto start = std::chrono::steady_clock::now();
+      result = m_BehaviorTree->RunConditional(conditional_info, conditional_mem, data, context);
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+      stats.m_TimedEvaluations.fetch_add(1, std::memory_order_relaxed);
+      stats.m_TimedNanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+    }
+    else
+    {
+      result = m_BehaviorTree->RunConditional(conditional_info, conditional_mem, data, context);
+    }
+
+    if(result)
+    {
+      stats.m_Passes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return result;
+  }
+
+  bool CheckNodeConditionals(int node_index, const DataType & data, const ContextType & context)
+  {
+    auto & node_info = m_BehaviorTree->m_Nodes[node_index];
+    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+
+    for(int index = leaf_info.m_ContinuousConditionalStart; index < leaf_info.m_ContinuousConditionalEnd; ++index)
+    {
+      auto conditional_index = m_BehaviorTree->m_ConditionalLookup[index];
+      if(CheckConditional(conditional_index, data, context) == false)
+      {
+        RecordPreemption(conditional_index);
+        return false;
+      }
+    }
+
+    for(int index = leaf_info.m_PreemptConditionalStart; index < leaf_info.m_PreemptConditionalEnd; ++index)
+    {
+      auto conditional_index = m_BehaviorTree->m_ConditionalLookup[index];
+      if(CheckConditional(conditional_index, data, context) == true)
+      {
+        RecordPreemption(conditional_index);
+        return false;
+      }
+    }    
+
+    return true;
+  }
+
+  void RecordPreemption(int conditional_index)
+  {
+    if(m_BehaviorTree->m_TransitionStats)
+    {
+      m_BehaviorTree->m_TransitionStats->RecordPreemption(conditional_index);
+    }
+  }
+
+  bool UpdateNode(DataType & data, ContextType & context)
+  {
+    auto & node_info = m_BehaviorTree->m_Nodes[m_CurrentNode];
+    auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+
+    for (int index = leaf_info.m_ServiceStart; index < leaf_info.m_TimedServiceStart; ++index)
+    {
+      auto service_index = m_BehaviorTree->m_ServiceLookup[index];
+      auto & service_info = m_BehaviorTree->m_Services[service_index];
+      if(service_info.m_Update)
+      {
+        auto service_mem = m_TreeMemory + service_info.m_Offset;
+        service_info.m_Update(service_mem, data, context);
+      }
+    }
+
+    if(leaf_info.m_TimedServiceStart != leaf_info.m_ServiceEnd && m_ServiceClock >= m_NextServiceDue)
+    {
+      UpdateTimedServices(leaf_info, data, context);
+    }
+
+    auto & state_info = m_BehaviorTree->m_States[node_info.m_LeafIndex];
+    auto state_mem = m_TreeMemory + state_info.m_Offset;
+
+    bool result = state_info.m_Update(state_mem, data, context);
+    if(m_ReplayLog)
+    {
+      if(m_ReplayLog->IsReplaying())
+      {
+        result = m_ReplayLog->ReadResult();
+      }
+      else
+      {
+        m_ReplayLog->WriteResult(result);
+      }
+    }
+
+    if (result)
+    {
+      return true;
+    }
+
+    if(state_info.m_GetSleepTicks)
+    {
+      m_SleepTicks = state_info.m_GetSleepTicks(state_mem, data, context);
+    }
+
+    return false;
+  }
+
+  // Runs the timed services that are due and finds when the next one is.  Only called when one is due, so 
+  // instances whose timed services are all waiting only pay for one compare per tick
+  void UpdateTimedServices(const StormBehaviorTreeTemplateLeaf & leaf_info, DataType & data, ContextType & context)
+  {
+    auto next_due = std::numeric_limits<uint64_t>::max();
+    for(int index = leaf_info.m_TimedServiceStart; index < leaf_info.m_ServiceEnd; ++index)
+    {
+      auto service_index = m_BehaviorTree->m_ServiceLookup[index];
+      auto & service_info = m_BehaviorTree->m_Services[service_index];
+      auto & due = m_ServiceDue[service_info.m_TimedIndex];
+      if(m_ServiceClock >= due)
+      {
+        if(service_info.m_Update)
+        {
+          auto service_mem = m_TreeMemory + service_info.m_Offset;
+          service_info.m_Update(service_mem, data, context);
+        }
+
+        uint64_t interval = service_info.m_Interval;
+        if(service_info.m_Deviation > 0)
+        {
+          auto range = static_cast<uint64_t>(service_info.m_Deviation) * 2 + 1;
+          auto draw = StormBehaviorSplitMix64(m_ServiceSeed ^ StormBehaviorSplitMix64(m_ServiceClock ^ (static_cast<uint64_t>(service_index) << 40)));
+          interval = interval - service_info.m_Deviation + draw % range;
+        }
+
+        due = m_ServiceClock + interval;
+      }
+
+      next_due = std::min(next_due, due);
+    }
+
+    m_NextServiceDue = next_due;
+  }
+
+  float GetUtilityScore(int scorer_index, const DataType & data, const ContextType & context)
+  {
+    if(m_ReplayLog == nullptr)
+    {
+      return CalculateUtilityScore(scorer_index, data, context);
+    }
+
+    if(m_ReplayLog->IsReplaying())
+    {
+      return m_ReplayLog->ReadScore();
+    }
+
+    auto score = CalculateUtilityScore(scorer_index, data, context);
+    m_ReplayLog->WriteScore(score);
+    return score;
+  }
+
+  float CalculateUtilityScore(int scorer_index, const DataType & data, const ContextType & context)
+  {
+    if(m_UtilityScores)
+    {
+      return m_UtilityScores[static_cast<std::size_t>(scorer_index) * m_UtilityScoreStride];
+    }
+
+    auto & scorer_info = m_BehaviorTree->m_Scorers[scorer_index];
+    if(scorer_info.m_Score == nullptr)
+    {
+      return 0.0f;
+    }
+
+    return scorer_info.m_Score(m_BehaviorTree->m_InitDataMemory.get() + scorer_info.m_InitDataOffset, data, context);
+  }
+
+  int GetSwitchKey(int switch_index, const DataType & data, const ContextType & context)
+  {
+    if(m_ReplayLog && m_ReplayLog->IsReplaying())
+    {
+      return m_ReplayLog->ReadKey();
+    }
+
+    auto & switch_key = m_BehaviorTree->m_SwitchKeys[switch_index];
+    auto key = switch_key.m_GetKey ? switch_key.m_GetKey(m_BehaviorTree->m_InitDataMemory.get() + switch_key.m_InitDataOffset, data, context) : 0;
+
+    if(m_ReplayLog)
+    {
+      m_ReplayLog->WriteKey(key);
+    }
+
+    return key;
+  }
+
+  template <typename RandomSource>
+  int TraverseNode(int node_index, const DataType & data, const ContextType & context, RandomSource & random)
+  {
+    assert(node_index != -1);
+
+    if(m_Profile)
+    {
+      m_Profile->m_NodeHits[node_index]++;
+    }
+
+    auto & node = m_BehaviorTree->m_Nodes[node_index];
+    for(int conditional_index = node.m_ConditionalStart; conditional_index < node.m_ConditionalEnd; ++conditional_index)
+    {
+      if(CheckConditional(conditional_index, data, context) == false)
+      {
+        return -1;
+      }
+    }
+
+    switch(node.m_Type)
+    {
+      case StormBehaviorNodeType::kSelect:
+      {
+        for(int index = node.m_ChildStart; index < node.m_ChildEnd; ++index)
+        {
+          auto child_index = m_BehaviorTree->m_ChildNodeLookup[index];
+          auto result_node = TraverseNode(child_index, data, context, random);
+
+          if(result_node != -1)
+          {
+            return result_node;
+          }
+        }
+      }
+      break;
+      case StormBehaviorNodeType::kRandom:
+      {
+        std::vector<std::pair<int, int>> potential_nodes;
+        for(int index = node.m_ChildStart, random_index = 0; index < node.m_ChildEnd; ++index, ++random_index)
+        {
+          auto child_index = m_BehaviorTree->m_ChildNodeLookup[index];
+          auto r = m_BehaviorTree->m_RandomValues[node.m_RandomStart + random_index];
+          potential_nodes.push_back(std::make_pair(child_index, r));
+        }
+
+        StormBehaviorRandomSetNode(random, node_index);
+        RandomShuffle(potential_nodes, random);
+
+        for(auto & elem : potential_nodes)
+        {
+          auto result_node = TraverseNode(elem.first, data, context, random);
+          if(result_node != -1)
+          {
+            return result_node;
+          }
+        }
+      }
+      break;
+      case StormBehaviorNodeType::kUtility:
+      {
+        std::vector<std::pair<int, float>> potential_nodes;
+        for(int index = node.m_ChildStart, scorer_index = node.m_ScorerStart; index < node.m_ChildEnd; ++index, ++scorer_index)
+        {
+          auto child_index = m_BehaviorTree->m_ChildNodeLookup[index];
+          potential_nodes.push_back(std::make_pair(child_index, GetUtilityScore(scorer_index, data, context)));
+        }
+
+        std::stable_sort(potential_nodes.begin(), potential_nodes.end(), [](auto & a, auto & b) { return a.second > b.second; });
+
+        for(auto & elem : potential_nodes)
+        {
+          auto result_node = TraverseNode(elem.first, data, context, random);
+          if(result_node != -1)
+          {
+            return result_node;
+          }
+        }
+      }
+      break;
+      case StormBehaviorNodeType::kSwitch:
+      {
+        auto & switch_info = m_BehaviorTree->m_Switches[node.m_SwitchIndex];
+        auto child_index = m_BehaviorTree->FindSwitchChild(switch_info, GetSwitchKey(node.m_SwitchIndex, data, context));
+        if(child_index != -1)
+        {
+          auto result_node = TraverseNode(child_index, data, context, random);
+          if(result_node != -1)
+          {
+            return result_node;
+          }
+        }
+
+        if(switch_info.m_DefaultChild != -1 && switch_info.m_DefaultChild != child_index)
+        {
+          return TraverseNode(switch_info.m_DefaultChild, data, context, random);
+        }
+      }
+      break;
+      case StormBehaviorNodeType::kSequence:
+      {
+        if(node.m_ChildStart == node.m_ChildEnd)
+        {
+          return -1;
+        }
+
+        auto child_index = m_BehaviorTree->m_ChildNodeLookup[node.m_ChildStart];
+        auto result_node = TraverseNode(child_index, data, context, random);
+
+        if(result_node != -1)
+        {
+          return result_node;
+        }
+      }
+      break;
+      case StormBehaviorNodeType::kLeaf:
+      {
+        return node_index;
+      }
+      break;
+    }
+
+    return -1;
+  }
+
+  // Drains the mailbox and any new broadcast events in the order they were posted.  The first interrupted
+  // subtree that has a valid leaf wins.  Missed broadcasts are treated as an interrupt from the root
+  template <typename RandomSource>
+  int ProcessInterrupts(const DataType & data, const ContextType & context, RandomSource & random)
+  {
+    m_InterruptNodes.clear();
+
+    m_Mailbox.Drain([&](const StormBehaviorTreeInterrupt & interrupt)
+    {
+      if(interrupt.m_NodeIndex != -1)
+      {
+        m_InterruptNodes.push_back(interrupt.m_NodeIndex);
+      }
+      else
+      {
+        m_BehaviorTree->VisitEventNodes(interrupt.m_EventId, [&](int node_index) { m_InterruptNodes.push_back(node_index); });
+      }
+    });
+
+    if(m_Broadcast)
+    {
+      auto complete = m_Broadcast->Read(m_BroadcastSequence, [&](int event_id)
+      {
+        m_BehaviorTree->VisitEventNodes(event_id, [&](int node_index) { m_InterruptNodes.push_back(node_index); });
+      });
+
+      // Missed events could have interrupted any event node, so replan from the root.  Read has already
+      // moved the sequence past them, which is all a tree without event nodes needs
+      if(complete == false && m_BehaviorTree->HasEventNodes())
+      {
+        m_InterruptNodes.push_back(0);
+      }
+    }
+
+    for(auto & node_index : m_InterruptNodes)
+    {
+      auto result_node = TraverseNode(node_index, data, context, random);
+      if(result_node != -1)
+      {
+        return result_node;
+      }
+    }
+
+    return -1;
+  }
+
+  template <typename RandomSource>
+  int FindNextNode(const DataType & data, const ContextType & context, RandomSource & random, bool restart)
+  {
+    bool restarted = restart;
+    int new_node = restart ? -1 : m_CurrentNode;
+
+    while(true)
+    {
+      if(new_node == -1)
+      {
+        return TraverseNode(0, data, context, random);
+      }
+      else
+      {
+        auto & node_info = m_BehaviorTree->m_Nodes[new_node];
+        auto & leaf_info = m_BehaviorTree->m_Leaves[node_info.m_LeafIndex];
+        
+        new_node = -1;
+        if(leaf_info.m_NextInSequence != -1)
+        {
+          new_node = TraverseNode(leaf_info.m_NextInSequence, data, context, random);
+        }
+
+        if (new_node == -1)
+        {
+          if(restarted)
+          {
+            return new_node;
+          }  
+
+          restarted = true;
+          continue;
+        }
+
+        return new_node;
+      }
+    }
+  }
+
+private:
+
+  StormBehaviorTreeTemplate<DataType, ContextType> * m_BehaviorTree = nullptr;
+  uint8_t * m_TreeMemory = nullptr;
+  std::unique_ptr<uint8_t[]> m_OwnedTreeMemory;
+
+  const StormBehaviorTreeParamBlock * m_Params = nullptr;
+  StormBehaviorTreeProfile * m_Profile = nullptr;
+  StormBehaviorTreeReplayLog * m_ReplayLog = nullptr;
+
+  struct StormBehaviorTreeInterrupt
+  {
+    int m_EventId;
+    int m_NodeIndex;
+  };
+
+  const float * m_UtilityScores = nullptr;
+  int m_UtilityScoreStride = 0;
+
+  StormBehaviorMpscQueue<StormBehaviorTreeInterrupt> m_Mailbox;
+  const StormBehaviorTreeBroadcast * m_Broadcast = nullptr;
+  uint64_t m_BroadcastSequence = 0;
+  std::vector<int> m_InterruptNodes;
+
+  std::vector<uint64_t> m_ConditionalMemo;
+  uint64_t * m_SharedMemo = nullptr;
+  const int * m_SharedMemoSlots = nullptr;
+  uint64_t m_MemoGeneration = 0;
+
+  std::vector<uint64_t> m_ServiceDue;
+  uint64_t m_ServiceClock = 0;
+  uint64_t m_NextServiceDue = 0;
+  uint64_t m_ServiceSeed = 0;
+
+  int m_CurrentNode = -1;
+  int m_SleepTicks = 0;
+  uint64_t m_DwellTicks = 0;
+  bool m_AdvanceNode = false;
+
+  std::atomic<uint64_t> m_ObservedState = { 0xFFFFFFFFULL };
+
+  friend class StormBehaviorTreeLayered<DataType, ContextType>;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free multi producer, single consumer queue.  Producers push onto an intrusive stack with a CAS and the
+// consumer takes the whole stack with one exchange, then walks it oldest first
+template <typename T>
+class StormBehaviorMpscQueue
+{
+public:
+  StormBehaviorMpscQueue() = default;
+  StormBehaviorMpscQueue(const StormBehaviorMpscQueue & rhs) = delete;
+  StormBehaviorMpscQueue & operator = (const StormBehaviorMpscQueue & rhs) = delete;
+
+  // Takes over everything queued in rhs.  Not safe while other threads are pushing to either queue
+  StormBehaviorMpscQueue(StormBehaviorMpscQueue && rhs) noexcept
+  {
+    m_Head.store(rhs.m_Head.exchange(nullptr, std::memory_order_acquire), std::memory_order_relaxed);
+  }
+
+  StormBehaviorMpscQueue & operator = (StormBehaviorMpscQueue && rhs) noexcept
+  {
+    if(this != &rhs)
+    {
+      Drain([](const T &) {});
+      m_Head.store(rhs.m_Head.exchange(nullptr, std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+    return *this;
+  }
+
+  ~StormBehaviorMpscQueue()
+  {
+    Drain([](const T &) {});
+  }
+
+  void Push(const T & val)
+  {
+    auto node = new Node{ val, m_Head.load(std::memory_order_relaxed) };
+    while(m_Head.compare_exchange_weak(node->m_Next, node, std::memory_order_release, std::memory_order_relaxed) == false)
+    {
+
+    }
+  }
+
+  bool IsEmpty() const
+  {
+    return m_Head.load(std::memory_order_relaxed) == nullptr;
+  }
+
+  // Only one thread may drain at a time
+  template <typename Callback>
+  void Drain(Callback && callback)
+  {
+    auto head = m_Head.exchange(nullptr, std::memory_order_acquire);
+
+    Node * reversed = nullptr;
+    while(head)
+    {
+      auto next = head->m_Next;
+      head->m_Next = reversed;
+      reversed = head;
+      head = next;
+    }
+
+    while(reversed)
+    {
+      auto next = reversed->m_Next;
+      callback(reversed->m_Value);
+      delete reversed;
+      reversed = next;
+    }
+  }
+
+private:
+
+  struct Node
+  {
+    T m_Value;
+    Node * m_Next;
+  };
+
+  std::atomic<Node *> m_Head = { nullptr };
+};
+
+// Fixed size ring of broadcast event ids.  Posting is a single fetch_add and store, so any number of threads can
+// broadcast to any number of instances in O(1).  Each reader keeps its own sequence number and picks up everything
+// posted since it last looked.  A reader that falls more than kBroadcastSlots events behind is told it missed events
+class StormBehaviorTreeBroadcast
+{
+public:
+
+  static const int kBroadcastSlots = 256;
+
+  StormBehaviorTreeBroadcast()
+  {
+    for(auto & elem : m_Slots)
+    {
+      elem.m_Sequence.store(0, std::memory_order_relaxed);
+      elem.m_EventId.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  StormBehaviorTreeBroadcast(const StormBehaviorTreeBroadcast & rhs) = delete;
+  StormBehaviorTreeBroadcast & operator = (const StormBehaviorTreeBroadcast & rhs) = delete;
+
+  void Broadcast(int event_id)
+  {
+    auto sequence = m_WriteSequence.fetch_add(1, std::memory_order_relaxed);
+    auto & slot = m_Slots[sequence % kBroadcastSlots];
+    slot.m_Sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.m_EventId.store(event_id, std::memory_order_relaxed);
+    slot.m_Sequence.store(sequence + 1, std::memory_order_release);
+  }
+
+  uint64_t GetSequence() const
+  {
+    return m_WriteSequence.load(std::memory_order_acquire);
+  }
+
+  // Calls callback(event_id) for every event from sequence onward and advances sequence past them.  Stops early
+  // at an event that has been reserved but not written yet.  Returns false if events were overwritten before 
+  // they could be read
+  template <typename Callback>
+  bool Read(uint64_t & sequence, Callback && callback) const
+  {
+    auto end = GetSequence();
+    if(end - sequence > kBroadcastSlots)
+    {
+      sequence = end;
+      return false;
+    }
+
+    for(; sequence < end; ++sequence)
+    {
+      auto & slot = m_Slots[sequence % kBroadcastSlots];
+      auto slot_sequence = slot.m_Sequence.load(std::memory_order_acquire);
+      if(slot_sequence != sequence + 1)
+      {
+        if(slot_sequence > sequence + 1)
+        {
+          sequence = end;
+          return false;
+        }
+
+        break;
+      }
+
+      auto event_id = slot.m_EventId.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if(slot.m_Sequence.load(std::memory_order_relaxed) != sequence + 1)
+      {
+        sequence = end;
+        return false;
+      }
+
+      callback(event_id);
+    }
+
+    return true;
+  }
+
+private:
+
+  struct Slot
+  {
+    std::atomic<uint64_t> m_Sequence;
+    std::atomic<int> m_EventId;
+  };
+
+  std::atomic<uint64_t> m_WriteSequence = { 0 };
+  Slot m_Slots[kBroadcastSlots];
+};
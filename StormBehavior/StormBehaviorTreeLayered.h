@@ -0,0 +1,258 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <algorithm>
+
+#include "StormBehaviorTree.h"
+
+// Layout shared by every agent that runs the same templates as layers, for example locomotion, combat and barks.
+// Build it once per combination of templates and keep it alive as long as any instance made from it.
+//
+// Pure conditionals that show up in more than one layer get one memo slot, so within a tick they are checked
+// once for the whole agent instead of once per layer
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeLayerSet
+{
+public:
+
+  using TreeType = StormBehaviorTree<DataType, ContextType>;
+  using TemplateType = StormBehaviorTreeTemplate<DataType, ContextType>;
+
+  static const std::size_t kBlockAlignment = alignof(std::max_align_t);
+
+  StormBehaviorTreeLayerSet(std::vector<TemplateType *> layers) :
+    m_Layers(std::move(layers))
+  {
+    auto layer_count = static_cast<int>(m_Layers.size());
+
+    // Instance block: the layer instances, their targets for Apply, the shared memo, then each layer's node memory
+    m_BlockSize = AlignBlock(sizeof(TreeType) * layer_count);
+    m_TargetOffset = m_BlockSize;
+    m_BlockSize = AlignBlock(m_BlockSize + sizeof(int) * layer_count);
+
+    AssignMemoSlots();
+    m_MemoOffset = m_BlockSize;
+    m_BlockSize = AlignBlock(m_BlockSize + sizeof(uint64_t) * m_MemoSlotCount);
+
+    for(auto bt : m_Layers)
+    {
+      m_LayerOffsets.push_back(m_BlockSize);
+      m_BlockSize = AlignBlock(m_BlockSize + bt->GetInstanceMemorySize());
+    }
+  }
+
+  int GetLayerCount() const
+  {
+    return static_cast<int>(m_Layers.size());
+  }
+
+  TemplateType * GetLayer(int layer) const
+  {
+    return m_Layers[layer];
+  }
+
+  // Bytes in the single allocation each instance makes
+  std::size_t GetBlockSize() const
+  {
+    return m_BlockSize;
+  }
+
+  int GetMemoSlotCount() const
+  {
+    return m_MemoSlotCount;
+  }
+
+private:
+
+  static std::size_t AlignBlock(std::size_t size)
+  {
+    return (size + kBlockAlignment - 1) / kBlockAlignment * kBlockAlignment;
+  }
+
+  // Groups conditionals that always give the same result, within or across layers.  Groups with more than one
+  // member, and conditionals the template memoizes on its own, get a slot in the shared memo
+  void AssignMemoSlots()
+  {
+    struct Member
+    {
+      int m_Layer;
+      int m_ConditionalIndex;
+      int m_Group;
+    };
+
+    std::vector<Member> members;
+    std::vector<int> group_counts;
+
+    for(int layer = 0; layer < GetLayerCount(); ++layer)
+    {
+      auto bt = m_Layers[layer];
+      m_MemoSlotStarts.push_back(static_cast<int>(m_MemoSlots.size()));
+      m_MemoSlots.resize(m_MemoSlots.size() + bt->GetConditionalCount(), -1);
+
+      for(int conditional_index = 0; conditional_index < bt->GetConditionalCount(); ++conditional_index)
+      {
+        auto memo_slot = bt->GetConditionalMemoSlot(conditional_index);
+        auto group = -1;
+        for(auto & member : members)
+        {
+          auto member_bt = m_Layers[member.m_Layer];
+          auto same_memo = member.m_Layer == layer && memo_slot != -1 && member_bt->GetConditionalMemoSlot(member.m_ConditionalIndex) == memo_slot;
+
+          if(same_memo || member_bt->IsSameConditional(member.m_ConditionalIndex, *bt, conditional_index))
+          {
+            group = member.m_Group;
+            break;
+          }
+        }
+
+        if(group == -1)
+        {
+          group = static_cast<int>(group_counts.size());
+          group_counts.push_back(0);
+        }
+
+        group_counts[group]++;
+        members.emplace_back(Member{ layer, conditional_index, group });
+      }
+    }
+
+    std::vector<int> group_slots(group_counts.size(), -1);
+    for(auto & member : members)
+    {
+      auto bt = m_Layers[member.m_Layer];
+      auto & slot = group_slots[member.m_Group];
+      if(slot == -1 && (group_counts[member.m_Group] > 1 || bt->GetConditionalMemoSlot(member.m_ConditionalIndex) != -1))
+      {
+        slot = m_MemoSlotCount;
+        m_MemoSlotCount++;
+      }
+
+      m_MemoSlots[m_MemoSlotStarts[member.m_Layer] + bt->GetConditionalDeclarationIndex(member.m_ConditionalIndex)] = slot;
+    }
+  }
+
+  std::vector<TemplateType *> m_Layers;
+  std::vector<std::size_t> m_LayerOffsets;
+  std::vector<int> m_MemoSlots;
+  std::vector<int> m_MemoSlotStarts;
+  int m_MemoSlotCount = 0;
+  std::size_t m_TargetOffset = 0;
+  std::size_t m_MemoOffset = 0;
+  std::size_t m_BlockSize = 0;
+
+  friend class StormBehaviorTreeLayered<DataType, ContextType>;
+};
+
+// One agent running every layer of a layer set.  The layer instances, the shared memo and all node memory live
+// in one allocation, and Update evaluates every layer before applying any of them, so all layers see the same
+// data while they select.  Elements can look at the other layers through GetCurrentNode, for example from a
+// pointer kept in DataType.  During Evaluate every layer still reports last tick's node
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeLayered
+{
+public:
+
+  using TreeType = StormBehaviorTree<DataType, ContextType>;
+  using LayerSetType = StormBehaviorTreeLayerSet<DataType, ContextType>;
+
+  StormBehaviorTreeLayered(const LayerSetType & layer_set) :
+    m_LayerSet(&layer_set),
+    m_Block(std::make_unique<uint8_t[]>(layer_set.GetBlockSize()))
+  {
+    auto memo = reinterpret_cast<uint64_t *>(m_Block.get() + layer_set.m_MemoOffset);
+    std::fill(memo, memo + layer_set.m_MemoSlotCount, 0);
+
+    for(int layer = 0; layer < layer_set.GetLayerCount(); ++layer)
+    {
+      auto tree = new (m_Block.get() + sizeof(TreeType) * layer) TreeType();
+      tree->m_SharedMemo = memo;
+      tree->m_SharedMemoSlots = layer_set.m_MemoSlots.data() + layer_set.m_MemoSlotStarts[layer];
+      tree->SetBehaviorTree(layer_set.GetLayer(layer), m_Block.get() + layer_set.m_LayerOffsets[layer]);
+    }
+  }
+
+  StormBehaviorTreeLayered(const StormBehaviorTreeLayered & rhs) = delete;
+  StormBehaviorTreeLayered & operator = (const StormBehaviorTreeLayered & rhs) = delete;
+
+  // Moving hands over the block, so the layers and their node memory stay where they are
+  StormBehaviorTreeLayered(StormBehaviorTreeLayered && rhs) = default;
+
+  ~StormBehaviorTreeLayered()
+  {
+    if(m_Block == nullptr)
+    {
+      return;
+    }
+
+    for(int layer = 0; layer < GetLayerCount(); ++layer)
+    {
+      GetLayer(layer).~TreeType();
+    }
+  }
+
+  int GetLayerCount() const
+  {
+    return m_LayerSet->GetLayerCount();
+  }
+
+  TreeType & GetLayer(int layer)
+  {
+    return reinterpret_cast<TreeType *>(m_Block.get())[layer];
+  }
+
+  const TreeType & GetLayer(int layer) const
+  {
+    return reinterpret_cast<const TreeType *>(m_Block.get())[layer];
+  }
+
+  int GetCurrentNode(int layer) const
+  {
+    return GetLayer(layer).GetCurrentNode();
+  }
+
+  template <typename RandomSource>
+  void Update(DataType & data, ContextType & context, RandomSource & random)
+  {
+    Evaluate(data, context, random);
+    Apply(data, context);
+  }
+
+  // Read-only half of Update for every layer
+  template <typename RandomSource>
+  void Evaluate(const DataType & data, const ContextType & context, RandomSource & random)
+  {
+    m_MemoGeneration++;
+
+    auto targets = GetTargets();
+    for(int layer = 0; layer < GetLayerCount(); ++layer)
+    {
+      // Every layer evaluates under the same generation, so results memoized by one layer are valid in the next
+      auto & tree = GetLayer(layer);
+      tree.m_MemoGeneration = m_MemoGeneration - 1;
+      targets[layer] = tree.Evaluate(data, context, random);
+    }
+  }
+
+  // Mutating half of Update for every layer, in layer order
+  void Apply(DataType & data, ContextType & context)
+  {
+    auto targets = GetTargets();
+    for(int layer = 0; layer < GetLayerCount(); ++layer)
+    {
+      GetLayer(layer).Apply(targets[layer], data, context);
+    }
+  }
+
+private:
+
+  int * GetTargets()
+  {
+    return reinterpret_cast<int *>(m_Block.get() + m_LayerSet->m_TargetOffset);
+  }
+
+  const LayerSetType * m_LayerSet;
+  std::unique_ptr<uint8_t[]> m_Block;
+  uint64_t m_MemoGeneration = 0;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+
+#include "StormBehaviorTreeTemplateBuilder.h"
+
+// Heap blocks are handed out in 16 byte granules by the common allocators, so anything past the requested
+// size up to the next granule is wasted per instance
+inline std::size_t StormBehaviorGetAllocationSlack(std::size_t size)
+{
+  return ((size + 15) & ~static_cast<std::size_t>(15)) - size;
+}
+
+template <typename T>
+std::size_t StormBehaviorGetVectorBytes(const std::vector<T> & vec)
+{
+  return vec.size() * sizeof(T);
+}
+
+template <typename T>
+std::size_t StormBehaviorGetVectorSlack(const std::vector<T> & vec)
+{
+  return (vec.capacity() - vec.size()) * sizeof(T);
+}
+
+struct StormBehaviorTreeTypeMemoryStats
+{
+  std::size_t m_TypeId = 0;
+  const char * m_DebugName = nullptr;
+  StormBehaviorTreeElementType m_ElementType = StormBehaviorTreeElementType::kState;
+
+  // Number of times the type appears in the template (or across the population when aggregated)
+  int m_Count = 0;
+
+  // Bytes of node memory the type takes up in each instance (or in all instances when aggregated)
+  std::size_t m_InstanceBytes = 0;
+};
+
+struct StormBehaviorTreeTemplateMemoryStats
+{
+  std::size_t m_NodeBytes = 0;
+  std::size_t m_ElementBytes = 0;
+  std::size_t m_LookupBytes = 0;
+  std::size_t m_InitInfoBytes = 0;
+  std::size_t m_InitDataBytes = 0;
+
+  // Unused vector capacity left over from building the template
+  std::size_t m_SlackBytes = 0;
+
+  // Size of the node memory block allocated by each instance
+  std::size_t m_InstanceBytes = 0;
+
+  std::vector<StormBehaviorTreeTypeMemoryStats> m_Types;
+
+  std::size_t GetStaticBytes() const
+  {
+    return m_NodeBytes + m_ElementBytes + m_LookupBytes + m_InitInfoBytes + m_InitDataBytes + m_SlackBytes;
+  }
+};
+
+struct StormBehaviorTreeInstanceMemoryStats
+{
+  std::size_t m_ObjectBytes = 0;
+  std::size_t m_NodeMemoryBytes = 0;
+
+  // Alignment padding between elements inside the node memory block.  Already counted in m_NodeMemoryBytes
+  std::size_t m_PaddingBytes = 0;
+
+  // Estimated allocator rounding on top of the node memory block
+  std::size_t m_AllocationSlackBytes = 0;
+
+  std::size_t GetTotalBytes() const
+  {
+    return m_ObjectBytes + m_NodeMemoryBytes + m_AllocationSlackBytes;
+  }
+};
+
+// Accumulates memory usage across a population of instances.  Static template memory is only counted once
+// per template no matter how many instances share it, and each template's stats are only gathered for its
+// first instance, so adding an instance doesn't depend on the size of its template
+class StormBehaviorTreePopulationMemoryStats
+{
+public:
+
+  template <typename TreeType>
+  void AddInstance(const TreeType & tree)
+  {
+    auto instance_stats = tree.GetMemoryStats();
+    m_InstanceCount++;
+    m_InstanceBytes += instance_stats.GetTotalBytes();
+    m_PaddingBytes += instance_stats.m_PaddingBytes + instance_stats.m_AllocationSlackBytes;
+
+    auto bt = tree.GetBehaviorTree();
+    if(bt == nullptr)
+    {
+      return;
+    }
+
+    auto & template_entry = m_Templates[bt];
+    if(template_entry.m_InstanceCount == 0)
+    {
+      auto template_stats = bt->GetMemoryStats();
+      m_StaticBytes += template_stats.GetStaticBytes();
+      template_entry.m_Types = std::move(template_stats.m_Types);
+    }
+
+    template_entry.m_InstanceCount++;
+  }
+
+  void AddExternalBytes(std::size_t bytes)
+  {
+    m_ExternalBytes += bytes;
+  }
+
+  int GetTemplateCount() const
+  {
+    return static_cast<int>(m_Templates.size());
+  }
+
+  int GetInstanceCount() const
+  {
+    return m_InstanceCount;
+  }
+
+  std::size_t GetStaticBytes() const
+  {
+    return m_StaticBytes;
+  }
+
+  std::size_t GetInstanceBytes() const
+  {
+    return m_InstanceBytes;
+  }
+
+  std::size_t GetPaddingBytes() const
+  {
+    return m_PaddingBytes;
+  }
+
+  std::size_t GetTotalBytes() const
+  {
+    return m_StaticBytes + m_InstanceBytes + m_ExternalBytes;
+  }
+
+  // Per type totals across every instance, largest first
+  std::vector<StormBehaviorTreeTypeMemoryStats> GetTypeStats() const
+  {
+    std::map<std::pair<std::size_t, int>, StormBehaviorTreeTypeMemoryStats> type_lookup;
+    for(auto & template_entry : m_Templates)
+    {
+      auto instance_count = template_entry.second.m_InstanceCount;
+      for(auto & elem : template_entry.second.m_Types)
+      {
+        auto & type_stats = type_lookup[std::make_pair(elem.m_TypeId, static_cast<int>(elem.m_ElementType))];
+        type_stats.m_TypeId = elem.m_TypeId;
+        type_stats.m_DebugName = elem.m_DebugName;
+        type_stats.m_ElementType = elem.m_ElementType;
+        type_stats.m_Count += elem.m_Count * instance_count;
+        type_stats.m_InstanceBytes += elem.m_InstanceBytes * instance_count;
+      }
+    }
+
+    std::vector<StormBehaviorTreeTypeMemoryStats> types;
+    for(auto & elem : type_lookup)
+    {
+      types.push_back(elem.second);
+    }
+
+    std::stable_sort(types.begin(), types.end(), [](auto & a, auto & b) { return a.m_InstanceBytes > b.m_InstanceBytes; });
+    return types;
+  }
+
+private:
+
+  struct TemplateEntry
+  {
+    std::vector<StormBehaviorTreeTypeMemoryStats> m_Types;
+    int m_InstanceCount = 0;
+  };
+
+  std::unordered_map<const void *, TemplateEntry> m_Templates;
+
+  int m_InstanceCount = 0;
+  std::size_t m_StaticBytes = 0;
+  std::size_t m_InstanceBytes = 0;
+  std::size_t m_PaddingBytes = 0;
+  std::size_t m_ExternalBytes = 0;
+};
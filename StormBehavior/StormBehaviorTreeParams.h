@@ -0,0 +1,205 @@
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <typeinfo>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+// Named, typed placeholder that can be passed in place of an init argument to State, AddConditional and AddService.
+// The template collects every placeholder into a parameter slot (placeholders with the same name share a slot)
+// and each instance constructs its elements with the value from the parameter block given to SetBehaviorTree,
+// or with the default if there is none.  Values are copied byte-wise, so T must be trivially copyable
+struct StormBehaviorParamBase
+{
+  const char * m_Name;
+  std::size_t m_TypeId;
+  int m_Size;
+  int m_Align;
+  int m_Slot = -1;
+};
+
+template <typename T>
+struct StormBehaviorParam : public StormBehaviorParamBase
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Parameter types must be trivially copyable");
+
+  StormBehaviorParam(const char * name, const T & default_val = T{}) :
+    StormBehaviorParamBase{ name, typeid(T).hash_code(), static_cast<int>(sizeof(T)), static_cast<int>(alignof(T)) },
+    m_Default(default_val)
+  {
+
+  }
+
+  // Two placeholders with the same name resolve to the same value on an instance with a parameter block, but
+  // instances without one get the default, so it has to match too
+  bool operator == (const StormBehaviorParam<T> & rhs) const
+  {
+    return strcmp(m_Name, rhs.m_Name) == 0 && memcmp(&m_Default, &rhs.m_Default, sizeof(T)) == 0;
+  }
+
+  T m_Default;
+};
+
+struct StormBehaviorTreeParamSlot
+{
+  const char * m_Name;
+  std::size_t m_TypeId;
+  int m_Offset;
+  int m_Size;
+};
+
+// Parameter values for one or more instances of a template.  Create it with the template's CreateParamBlock,
+// which fills in the defaults.  It is only read while SetBehaviorTree runs, so it can be reused for the next
+// instance or thrown away afterwards, unless the template has lazy states, which read it on every activation
+class StormBehaviorTreeParamBlock
+{
+public:
+
+  StormBehaviorTreeParamBlock(const std::vector<StormBehaviorTreeParamSlot> * slots, const std::vector<uint64_t> & defaults) :
+    m_Slots(slots),
+    m_Data(defaults)
+  {
+
+  }
+
+  int FindSlot(const char * name) const
+  {
+    for(int index = 0; index < static_cast<int>(m_Slots->size()); ++index)
+    {
+      if(strcmp((*m_Slots)[index].m_Name, name) == 0)
+      {
+        return index;
+      }
+    }
+
+    return -1;
+  }
+
+  // Returns false if the template has no parameter with this name or it has a different type
+  template <typename T>
+  bool Set(const char * name, const T & val)
+  {
+    auto slot = FindSlot(name);
+    if(slot == -1)
+    {
+      return false;
+    }
+
+    return Set(slot, val);
+  }
+
+  // Returns false if the slot doesn't exist or holds a different type, so a value of the wrong type is never
+  // copied over the slot or past it
+  template <typename T>
+  bool Set(int slot, const T & val)
+  {
+    if(slot < 0 || slot >= static_cast<int>(m_Slots->size()))
+    {
+      return false;
+    }
+
+    auto & slot_info = (*m_Slots)[slot];
+    if(slot_info.m_TypeId != typeid(T).hash_code() || slot_info.m_Size != static_cast<int>(sizeof(T)))
+    {
+      return false;
+    }
+
+    memcpy(GetSlotData(slot), &val, sizeof(T));
+    return true;
+  }
+
+  template <typename T>
+  T Get(int slot) const
+  {
+    assert((*m_Slots)[slot].m_TypeId == typeid(T).hash_code());
+
+    T val;
+    memcpy(&val, GetSlotData(slot), sizeof(T));
+    return val;
+  }
+
+  const std::vector<StormBehaviorTreeParamSlot> * GetSlots() const
+  {
+    return m_Slots;
+  }
+
+private:
+
+  void * GetSlotData(int slot)
+  {
+    return reinterpret_cast<uint8_t *>(m_Data.data()) + (*m_Slots)[slot].m_Offset;
+  }
+
+  const void * GetSlotData(int slot) const
+  {
+    return reinterpret_cast<const uint8_t *>(m_Data.data()) + (*m_Slots)[slot].m_Offset;
+  }
+
+  const std::vector<StormBehaviorTreeParamSlot> * m_Slots;
+  std::vector<uint64_t> m_Data;
+};
+
+template <typename T>
+struct StormBehaviorIsParam : std::false_type {};
+
+template <typename T>
+struct StormBehaviorIsParam<StormBehaviorParam<T>> : std::true_type {};
+
+template <typename T>
+T & StormBehaviorResolveParam(T & val, const StormBehaviorTreeParamBlock *)
+{
+  return val;
+}
+
+template <typename T>
+T StormBehaviorResolveParam(StormBehaviorParam<T> & param, const StormBehaviorTreeParamBlock * params)
+{
+  return params ? params->Get<T>(param.m_Slot) : param.m_Default;
+}
+
+template <class T, class Tuple, std::size_t... I>
+void StormBehaviorMakeFromTupleWithParamsImpl(void * mem, Tuple & t, const StormBehaviorTreeParamBlock * params, std::index_sequence<I...>)
+{
+  new (mem) T(StormBehaviorResolveParam(std::get<I>(t), params)...);
+}
+
+template <class T, class Tuple>
+void StormBehaviorMakeFromTupleWithParams(void * mem, Tuple & t, const StormBehaviorTreeParamBlock * params)
+{
+  StormBehaviorMakeFromTupleWithParamsImpl<T>(mem, t, params, std::make_index_sequence<std::tuple_size<Tuple>::value>{});
+}
+
+using StormBehaviorParamCallback = void(*)(void * user, StormBehaviorParamBase & param, const void * default_val);
+
+template <typename InitData>
+void StormBehaviorVisitParams(void * init_data, void * user, StormBehaviorParamCallback callback)
+{
+  std::apply([&](auto & ... elems)
+  {
+    auto visit = [&](auto & elem)
+    {
+      if constexpr(StormBehaviorIsParam<std::decay_t<decltype(elem)>>::value)
+      {
+        callback(user, elem, &elem.m_Default);
+      }
+    };
+
+    (visit(elems), ...);
+  }, *static_cast<InitData *>(init_data));
+}
+
+template <typename ... Args>
+constexpr auto StormBehaviorGetParamVisitor() -> void(*)(void *, void *, StormBehaviorParamCallback)
+{
+  if constexpr((StormBehaviorIsParam<Args>::value || ...))
+  {
+    return &StormBehaviorVisitParams<std::tuple<Args...>>;
+  }
+  else
+  {
+    return nullptr;
+  }
+}
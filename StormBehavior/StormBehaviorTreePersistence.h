@@ -0,0 +1,360 @@
+#pragma once
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "StormBehaviorTree.h"
+
+// Saved populations start with kStormBehaviorPopulationMagic and kStormBehaviorPopulationVersion as two uint32s,
+// followed by chunks of instances:
+//
+//   uint32 instance count, uint32 byte size, instances...
+//   instance: varint template id, then StormBehaviorTree::Save
+//
+// A chunk with an instance count of zero ends the stream.  Template ids are whatever the caller uses to find
+// the template again when loading
+
+static const uint32_t kStormBehaviorPopulationMagic = 0x50544253;
+static const uint32_t kStormBehaviorPopulationVersion = 1;
+
+// Writes to a file with stdio.  Sinks take as much of a write as they can and return the number of bytes taken,
+// the same as the telemetry sinks
+class StormBehaviorTreeFileSink
+{
+public:
+  StormBehaviorTreeFileSink() = default;
+  StormBehaviorTreeFileSink(const StormBehaviorTreeFileSink & rhs) = delete;
+  StormBehaviorTreeFileSink & operator = (const StormBehaviorTreeFileSink & rhs) = delete;
+
+  ~StormBehaviorTreeFileSink()
+  {
+    Close();
+  }
+
+  bool Open(const char * path)
+  {
+    Close();
+    m_File = fopen(path, "wb");
+    return m_File != nullptr;
+  }
+
+  // Returns false if anything failed to reach the file
+  bool Close()
+  {
+    if(m_File == nullptr)
+    {
+      return true;
+    }
+
+    auto result = fclose(m_File) == 0;
+    m_File = nullptr;
+    return result;
+  }
+
+  std::size_t Write(const void * data, std::size_t size)
+  {
+    return m_File ? fwrite(data, 1, size, m_File) : 0;
+  }
+
+private:
+  FILE * m_File = nullptr;
+};
+
+// Streams a population into a sink in chunks of about chunk_bytes.  Every template used must be serializable
+template <typename Sink>
+class StormBehaviorTreePopulationWriter
+{
+public:
+
+  StormBehaviorTreePopulationWriter(Sink & sink, std::size_t chunk_bytes = 1024 * 1024) :
+    m_Sink(sink),
+    m_ChunkBytes(chunk_bytes)
+  {
+    uint32_t header[2] = { kStormBehaviorPopulationMagic, kStormBehaviorPopulationVersion };
+    WriteToSink(header, sizeof(header));
+  }
+
+  template <typename DataType, typename ContextType>
+  void Write(int template_id, const StormBehaviorTree<DataType, ContextType> & tree)
+  {
+    m_Chunk.WriteVarInt(static_cast<uint64_t>(template_id));
+    tree.Save(m_Chunk);
+    m_ChunkInstanceCount++;
+    m_InstanceCount++;
+
+    if(m_Chunk.GetSize() >= m_ChunkBytes)
+    {
+      FlushChunk();
+    }
+  }
+
+  // Writes out the last chunk and the end marker.  Returns false if the sink did not take everything
+  bool Finish()
+  {
+    FlushChunk();
+
+    uint32_t end_header[2] = { 0, 0 };
+    WriteToSink(end_header, sizeof(end_header));
+    return m_Failed == false;
+  }
+
+  bool HasFailed() const
+  {
+    return m_Failed;
+  }
+
+  uint64_t GetInstanceCount() const
+  {
+    return m_InstanceCount;
+  }
+
+  uint64_t GetWrittenBytes() const
+  {
+    return m_WrittenBytes;
+  }
+
+private:
+
+  void FlushChunk()
+  {
+    if(m_ChunkInstanceCount == 0)
+    {
+      return;
+    }
+
+    uint32_t chunk_header[2] = { m_ChunkInstanceCount, static_cast<uint32_t>(m_Chunk.GetSize()) };
+    WriteToSink(chunk_header, sizeof(chunk_header));
+    WriteToSink(m_Chunk.GetData().data(), m_Chunk.GetSize());
+
+    m_Chunk.Clear();
+    m_ChunkInstanceCount = 0;
+  }
+
+  void WriteToSink(const void * data, std::size_t size)
+  {
+    if(m_Sink.Write(data, size) != size)
+    {
+      m_Failed = true;
+    }
+
+    m_WrittenBytes += size;
+  }
+
+  Sink & m_Sink;
+  std::size_t m_ChunkBytes;
+  StormBehaviorTreeWriteBuffer m_Chunk;
+  uint32_t m_ChunkInstanceCount = 0;
+  uint64_t m_InstanceCount = 0;
+  uint64_t m_WrittenBytes = 0;
+  bool m_Failed = false;
+};
+
+// Read only view of a whole file.  Maps it where mmap is available and reads it into memory otherwise
+class StormBehaviorTreeMappedFile
+{
+public:
+  StormBehaviorTreeMappedFile() = default;
+  StormBehaviorTreeMappedFile(const StormBehaviorTreeMappedFile & rhs) = delete;
+  StormBehaviorTreeMappedFile & operator = (const StormBehaviorTreeMappedFile & rhs) = delete;
+
+  ~StormBehaviorTreeMappedFile()
+  {
+    Close();
+  }
+
+  bool Open(const char * path)
+  {
+    Close();
+
+#if !defined(_WIN32)
+    auto fd = open(path, O_RDONLY);
+    if(fd == -1)
+    {
+      return false;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0)
+    {
+      close(fd);
+      return false;
+    }
+
+    m_Size = static_cast<std::size_t>(file_stat.st_size);
+    if(m_Size > 0)
+    {
+      auto memory = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(memory == MAP_FAILED)
+      {
+        close(fd);
+        m_Size = 0;
+        return false;
+      }
+
+      madvise(memory, m_Size, MADV_SEQUENTIAL);
+      m_Data = static_cast<const uint8_t *>(memory);
+    }
+
+    close(fd);
+    m_Open = true;
+    return true;
+#else
+    auto file = fopen(path, "rb");
+    if(file == nullptr)
+    {
+      return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    m_Buffer.resize(static_cast<std::size_t>(ftell(file)));
+    fseek(file, 0, SEEK_SET);
+
+    auto result = fread(m_Buffer.data(), 1, m_Buffer.size(), file) == m_Buffer.size();
+    fclose(file);
+
+    m_Data = m_Buffer.data();
+    m_Size = m_Buffer.size();
+    m_Open = result;
+    return result;
+#endif
+  }
+
+  void Close()
+  {
+#if !defined(_WIN32)
+    if(m_Data)
+    {
+      munmap(const_cast<uint8_t *>(m_Data), m_Size);
+    }
+#else
+    m_Buffer.clear();
+#endif
+
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Open = false;
+  }
+
+  bool IsOpen() const
+  {
+    return m_Open;
+  }
+
+  const uint8_t * GetData() const
+  {
+    return m_Data;
+  }
+
+  std::size_t GetSize() const
+  {
+    return m_Size;
+  }
+
+private:
+  const uint8_t * m_Data = nullptr;
+  std::size_t m_Size = 0;
+  bool m_Open = false;
+
+#if defined(_WIN32)
+  std::vector<uint8_t> m_Buffer;
+#endif
+};
+
+// Walks a saved population in place.  Call NextInstance to get the template id of the next instance, then Load
+// it with that template.  The data must stay alive while reading, but not after
+//
+//   int template_id;
+//   while(reader.NextInstance(template_id))
+//   {
+//     reader.Load(trees[index++], templates[template_id]);
+//   }
+class StormBehaviorTreePopulationReader
+{
+public:
+
+  StormBehaviorTreePopulationReader(const void * data, std::size_t size) :
+    m_Buffer(data, size)
+  {
+    auto magic = m_Buffer.Read<uint32_t>();
+    auto version = m_Buffer.Read<uint32_t>();
+    m_Failed = m_Buffer.HasFailed() || magic != kStormBehaviorPopulationMagic || version != kStormBehaviorPopulationVersion;
+  }
+
+  // Returns false at the end of the stream or if it is malformed
+  bool NextInstance(int & template_id)
+  {
+    assert(m_PendingLoad == false);
+
+    if(m_Failed || m_Finished)
+    {
+      return false;
+    }
+
+    if(m_ChunkRemaining == 0)
+    {
+      m_ChunkRemaining = m_Buffer.Read<uint32_t>();
+      auto chunk_size = m_Buffer.Read<uint32_t>();
+
+      if(m_Buffer.HasFailed() || m_Buffer.GetRemaining() < chunk_size)
+      {
+        m_Failed = true;
+        return false;
+      }
+
+      if(m_ChunkRemaining == 0)
+      {
+        m_Finished = true;
+        return false;
+      }
+    }
+
+    template_id = static_cast<int>(m_Buffer.ReadVarInt());
+    m_ChunkRemaining--;
+
+    m_PendingLoad = m_Buffer.HasFailed() == false;
+    m_Failed = m_Buffer.HasFailed();
+    return m_PendingLoad;
+  }
+
+  template <typename DataType, typename ContextType>
+  bool Load(StormBehaviorTree<DataType, ContextType> & tree, StormBehaviorTreeTemplate<DataType, ContextType> & bt, void * memory = nullptr)
+  {
+    assert(m_PendingLoad);
+    m_PendingLoad = false;
+
+    if(tree.Load(&bt, m_Buffer, memory) == false)
+    {
+      m_Failed = true;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool HasFailed() const
+  {
+    return m_Failed;
+  }
+
+  // True once the end marker has been read, so a stream cut short can be told apart from a complete one
+  bool IsFinished() const
+  {
+    return m_Finished;
+  }
+
+private:
+  StormBehaviorTreeReadBuffer m_Buffer;
+  uint32_t m_ChunkRemaining = 0;
+  bool m_PendingLoad = false;
+  bool m_Failed = false;
+  bool m_Finished = false;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+#include "StormBehaviorTree.h"
+
+// Keeps a population of instances and their node memory in two dense arrays.  Instances are addressed by
+// handle since creating, destroying and compacting move them around, so pointers and references from Get
+// are only valid until the next call to one of those.  Destroying an instance moves the last one into its
+// slot and leaves a hole in the node memory arena, which Compact closes by relocating every instance back to
+// back in instance order.  Every template used with the pool must be relocatable
+template <typename DataType, typename ContextType>
+class StormBehaviorTreePool
+{
+public:
+
+  using TreeType = StormBehaviorTree<DataType, ContextType>;
+  using TemplateType = StormBehaviorTreeTemplate<DataType, ContextType>;
+
+  static const std::size_t kBlockAlignment = alignof(std::max_align_t);
+
+  StormBehaviorTreePool() = default;
+  StormBehaviorTreePool(const StormBehaviorTreePool & rhs) = delete;
+  StormBehaviorTreePool & operator = (const StormBehaviorTreePool & rhs) = delete;
+
+  ~StormBehaviorTreePool()
+  {
+    m_Trees.clear();
+  }
+
+  int Create(TemplateType & bt, const StormBehaviorTreeParamBlock * params = nullptr)
+  {
+    assert(bt.IsRelocatable());
+
+    auto block_size = GetBlockSize(bt);
+    if(m_ArenaUsed + block_size > m_ArenaCapacity)
+    {
+      Compact(std::max(m_ArenaCapacity, block_size));
+    }
+
+    int handle;
+    if(m_FreeHandles.size() > 0)
+    {
+      handle = m_FreeHandles.back();
+      m_FreeHandles.pop_back();
+    }
+    else
+    {
+      handle = static_cast<int>(m_HandleIndices.size());
+      m_HandleIndices.emplace_back();
+    }
+
+    m_HandleIndices[handle] = static_cast<int>(m_Trees.size());
+    m_Handles.push_back(handle);
+
+    m_Trees.emplace_back();
+    m_Trees.back().SetBehaviorTree(&bt, m_Arena.get() + m_ArenaUsed, params);
+
+    m_ArenaUsed += block_size;
+    m_LiveBytes += block_size;
+    return handle;
+  }
+
+  void Destroy(int handle)
+  {
+    auto index = m_HandleIndices[handle];
+    assert(index != -1);
+
+    m_LiveBytes -= GetBlockSize(*m_Trees[index].GetBehaviorTree());
+
+    auto last_index = static_cast<int>(m_Trees.size()) - 1;
+    if(index != last_index)
+    {
+      m_Trees[index] = std::move(m_Trees[last_index]);
+      m_Handles[index] = m_Handles[last_index];
+      m_HandleIndices[m_Handles[index]] = index;
+    }
+
+    m_Trees.pop_back();
+    m_Handles.pop_back();
+
+    m_HandleIndices[handle] = -1;
+    m_FreeHandles.push_back(handle);
+
+    if(m_CompactThreshold > 0.0f && GetFragmentedBytes() > m_CompactThreshold * m_ArenaUsed)
+    {
+      Compact();
+    }
+  }
+
+  // Relocates every instance into a new arena with no holes and extra_capacity bytes free at the end
+  void Compact(std::size_t extra_capacity = 0)
+  {
+    auto capacity = m_LiveBytes + extra_capacity;
+    auto arena = std::make_unique<uint8_t[]>(capacity);
+
+    std::size_t offset = 0;
+    for(auto & elem : m_Trees)
+    {
+      elem.Relocate(arena.get() + offset);
+      offset += GetBlockSize(*elem.GetBehaviorTree());
+    }
+
+    m_Arena = std::move(arena);
+    m_ArenaCapacity = capacity;
+    m_ArenaUsed = offset;
+  }
+
+  // Compacts automatically when a Destroy leaves more than threshold of the used arena as holes.  Zero only compacts
+  // when asked to or when the arena is full
+  void SetCompactThreshold(float threshold)
+  {
+    m_CompactThreshold = threshold;
+  }
+
+  TreeType & Get(int handle)
+  {
+    return m_Trees[m_HandleIndices[handle]];
+  }
+
+  const TreeType & Get(int handle) const
+  {
+    return m_Trees[m_HandleIndices[handle]];
+  }
+
+  int GetCount() const
+  {
+    return static_cast<int>(m_Trees.size());
+  }
+
+  // Instances are stored densely, so iterating them in index order walks the node memory front to back
+  TreeType & GetByIndex(int index)
+  {
+    return m_Trees[index];
+  }
+
+  int GetHandleByIndex(int index) const
+  {
+    return m_Handles[index];
+  }
+
+  std::size_t GetArenaCapacity() const
+  {
+    return m_ArenaCapacity;
+  }
+
+  std::size_t GetLiveBytes() const
+  {
+    return m_LiveBytes;
+  }
+
+  std::size_t GetFragmentedBytes() const
+  {
+    return m_ArenaUsed - m_LiveBytes;
+  }
+
+private:
+
+  static std::size_t GetBlockSize(const TemplateType & bt)
+  {
+    return (bt.GetInstanceMemorySize() + kBlockAlignment - 1) / kBlockAlignment * kBlockAlignment;
+  }
+
+  std::unique_ptr<uint8_t[]> m_Arena;
+  std::size_t m_ArenaCapacity = 0;
+  std::size_t m_ArenaUsed = 0;
+  std::size_t m_LiveBytes = 0;
+  float m_CompactThreshold = 0.0f;
+
+  std::vector<TreeType> m_Trees;
+  std::vector<int> m_Handles;
+  std::vector<int> m_HandleIndices;
+  std::vector<int> m_FreeHandles;
+};
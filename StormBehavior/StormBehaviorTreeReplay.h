@@ -0,0 +1,309 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "StormBehaviorTreeSerializer.h"
+
+// Log of everything an instance's traversal decides on that doesn't come from the tree itself: conditional
+// results, leaf Update results, random draws, switch keys and utility scores.  Results are packed one bit each,
+// draws and keys are varints and scores are raw floats, with the start of each tick indexed so a replay can tell
+// where it diverged.
+//
+// Attach it with StormBehaviorTree::SetReplayLog while recording, then call StartReplay and run Update once per
+// recorded tick to get the same traversal back without the data the conditionals and scorers read.  Services and
+// states still run during a replay but their Update results come from the log.  Events, interrupts and broadcasts
+// are not logged and have to be posted again on the same ticks.  Polling conditionals only decide when a sleeping
+// instance wakes up, so they are left out as well
+class StormBehaviorTreeReplayLog
+{
+public:
+
+  void Clear()
+  {
+    m_Results.clear();
+    m_ResultCount = 0;
+    m_Values.clear();
+    m_Ticks.clear();
+    m_Replaying = false;
+  }
+
+  // Replays from the start of tick.  The instance has to be in the state it was in at that tick, for example
+  // restored with Load from a save taken then
+  void StartReplay(int tick = 0)
+  {
+    m_Replaying = true;
+    m_CurrentTick = -1;
+    m_NextTick = tick;
+    m_DivergentTick = -1;
+    m_ResultCursor = 0;
+    m_ValueCursor = 0;
+  }
+
+  // Goes back to recording, dropping everything after the last replayed tick.  The last replayed tick is only
+  // checked for divergence here, since there is no next tick to check it on
+  void StopReplay()
+  {
+    if(m_Replaying)
+    {
+      CheckTickConsumed();
+    }
+
+    if(m_Replaying && m_NextTick < GetTickCount())
+    {
+      auto & tick = m_Ticks[m_NextTick];
+      m_ResultCount = tick.m_ResultStart;
+      m_Results.resize((m_ResultCount + 7) / 8);
+      m_Values.resize(tick.m_ValueStart);
+      m_Ticks.resize(m_NextTick);
+
+      // New results are ORed into the last byte, so clear the dropped ones
+      if(m_ResultCount & 7)
+      {
+        m_Results.back() &= static_cast<uint8_t>((1 << (m_ResultCount & 7)) - 1);
+      }
+    }
+
+    m_Replaying = false;
+  }
+
+  bool IsReplaying() const
+  {
+    return m_Replaying;
+  }
+
+  int GetTickCount() const
+  {
+    return static_cast<int>(m_Ticks.size());
+  }
+
+  // First replayed tick that didn't consume exactly what was recorded for it, or -1.  The last tick replayed
+  // so far is included once StopReplay is called
+  int GetDivergentTick() const
+  {
+    return m_DivergentTick;
+  }
+
+  std::size_t GetSize() const
+  {
+    return m_Results.size() + m_Values.size() + m_Ticks.size() * sizeof(Tick);
+  }
+
+  // The tick index is written as deltas, so a saved log is usually smaller than GetSize
+  void Save(StormBehaviorTreeWriteBuffer & buffer) const
+  {
+    buffer.WriteVarInt(m_Ticks.size());
+
+    Tick prev_tick = {};
+    for(auto & tick : m_Ticks)
+    {
+      buffer.WriteVarInt(tick.m_ResultStart - prev_tick.m_ResultStart);
+      buffer.WriteVarInt(tick.m_ValueStart - prev_tick.m_ValueStart);
+      prev_tick = tick;
+    }
+
+    buffer.WriteVarInt(m_ResultCount);
+    buffer.Write(m_Results.data(), m_Results.size());
+    buffer.WriteVarInt(m_Values.size());
+    buffer.Write(m_Values.data(), m_Values.size());
+  }
+
+  bool Load(StormBehaviorTreeReadBuffer & buffer)
+  {
+    Clear();
+
+    auto tick_count = buffer.ReadVarInt();
+    if(tick_count > buffer.GetRemaining())
+    {
+      return false;
+    }
+
+    Tick tick = {};
+    for(uint64_t index = 0; index < tick_count; ++index)
+    {
+      tick.m_ResultStart += buffer.ReadVarInt();
+      tick.m_ValueStart += buffer.ReadVarInt();
+      m_Ticks.push_back(tick);
+    }
+
+    m_ResultCount = buffer.ReadVarInt();
+    auto result_bytes = buffer.Skip((m_ResultCount + 7) / 8);
+    if(result_bytes == nullptr)
+    {
+      return false;
+    }
+
+    m_Results.assign(result_bytes, result_bytes + (m_ResultCount + 7) / 8);
+
+    auto value_size = buffer.ReadVarInt();
+    auto value_bytes = buffer.Skip(value_size);
+    if(value_bytes == nullptr)
+    {
+      return false;
+    }
+
+    m_Values.assign(value_bytes, value_bytes + value_size);
+
+    for(auto & elem : m_Ticks)
+    {
+      if(elem.m_ResultStart > m_ResultCount || elem.m_ValueStart > m_Values.size())
+      {
+        Clear();
+        return false;
+      }
+    }
+
+    return buffer.HasFailed() == false;
+  }
+
+private:
+
+  template <typename DataType, typename ContextType>
+  friend class StormBehaviorTree;
+
+  struct Tick
+  {
+    uint64_t m_ResultStart;
+    std::size_t m_ValueStart;
+  };
+
+  void BeginTick()
+  {
+    if(m_Replaying == false)
+    {
+      m_Ticks.push_back(Tick{ m_ResultCount, m_Values.size() });
+      return;
+    }
+
+    // Resynchronize on every tick so one divergence doesn't shift everything after it
+    CheckTickConsumed();
+
+    m_CurrentTick = m_NextTick++;
+    if(m_CurrentTick < GetTickCount())
+    {
+      m_ResultCursor = m_Ticks[m_CurrentTick].m_ResultStart;
+      m_ValueCursor = m_Ticks[m_CurrentTick].m_ValueStart;
+    }
+    else
+    {
+      m_ResultCursor = m_ResultCount;
+      m_ValueCursor = m_Values.size();
+    }
+  }
+
+  void WriteResult(bool result)
+  {
+    if((m_ResultCount & 7) == 0)
+    {
+      m_Results.push_back(0);
+    }
+
+    m_Results.back() |= static_cast<uint8_t>(result ? 1 : 0) << (m_ResultCount & 7);
+    m_ResultCount++;
+  }
+
+  bool ReadResult()
+  {
+    if(m_ResultCursor >= GetResultEnd(m_CurrentTick))
+    {
+      MarkDivergent(m_CurrentTick);
+      return false;
+    }
+
+    auto result = (m_Results[m_ResultCursor >> 3] >> (m_ResultCursor & 7)) & 1;
+    m_ResultCursor++;
+    return result != 0;
+  }
+
+  void WriteDraw(int draw)
+  {
+    StormBehaviorWriteVarInt(m_Values, StormBehaviorZigZag(draw));
+  }
+
+  int ReadDraw()
+  {
+    uint64_t draw;
+    const uint8_t * ptr = m_Values.data() + m_ValueCursor;
+    if(StormBehaviorReadVarInt(ptr, m_Values.data() + GetValueEnd(m_CurrentTick), draw) == false)
+    {
+      MarkDivergent(m_CurrentTick);
+      return 0;
+    }
+
+    m_ValueCursor = static_cast<std::size_t>(ptr - m_Values.data());
+    return static_cast<int>(StormBehaviorUnZigZag(draw));
+  }
+
+  void WriteKey(int key)
+  {
+    WriteDraw(key);
+  }
+
+  int ReadKey()
+  {
+    return ReadDraw();
+  }
+
+  void WriteScore(float score)
+  {
+    auto bytes = reinterpret_cast<const uint8_t *>(&score);
+    m_Values.insert(m_Values.end(), bytes, bytes + sizeof(float));
+  }
+
+  float ReadScore()
+  {
+    float score = 0.0f;
+    if(m_ValueCursor + sizeof(float) > GetValueEnd(m_CurrentTick))
+    {
+      MarkDivergent(m_CurrentTick);
+      return score;
+    }
+
+    memcpy(&score, m_Values.data() + m_ValueCursor, sizeof(float));
+    m_ValueCursor += sizeof(float);
+    return score;
+  }
+
+  uint64_t GetResultEnd(int tick) const
+  {
+    return tick + 1 < GetTickCount() ? m_Ticks[tick + 1].m_ResultStart : m_ResultCount;
+  }
+
+  std::size_t GetValueEnd(int tick) const
+  {
+    return tick + 1 < GetTickCount() ? m_Ticks[tick + 1].m_ValueStart : m_Values.size();
+  }
+
+  // Marks the current tick divergent if it didn't consume exactly what was recorded for it
+  void CheckTickConsumed()
+  {
+    if(m_CurrentTick != -1 && m_CurrentTick < GetTickCount())
+    {
+      if(m_ResultCursor != GetResultEnd(m_CurrentTick) || m_ValueCursor != GetValueEnd(m_CurrentTick))
+      {
+        MarkDivergent(m_CurrentTick);
+      }
+    }
+  }
+
+  void MarkDivergent(int tick)
+  {
+    if(m_DivergentTick == -1)
+    {
+      m_DivergentTick = tick;
+    }
+  }
+
+  std::vector<uint8_t> m_Results;
+  uint64_t m_ResultCount = 0;
+  std::vector<uint8_t> m_Values;
+  std::vector<Tick> m_Ticks;
+
+  bool m_Replaying = false;
+  int m_CurrentTick = -1;
+  int m_NextTick = 0;
+  int m_DivergentTick = -1;
+  uint64_t m_ResultCursor = 0;
+  std::size_t m_ValueCursor = 0;
+};
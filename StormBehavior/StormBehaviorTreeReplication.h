@@ -0,0 +1,420 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "StormBehaviorTree.h"
+
+// Delta replication of which leaf each instance is in, plus the node memory of elements declared with
+// static constexpr bool kReplicated = true.  Each frame is:
+//
+//   varint sequence, varint record count, records...
+//   record: varint instance id, uint8 flags,
+//           zigzag varint node                                  if kStormBehaviorReplicateNode
+//           dirty block bitset, then the bytes of each dirty block  if kStormBehaviorReplicateMemory
+//           every block                                         if kStormBehaviorReplicateFull
+//
+// Replicated memory is split into blocks of kStormBehaviorReplicationBlockSize bytes.  The encoder keeps what it
+// last sent for each instance and only sends blocks that differ, so it needs one encoder per client and a
+// reliable, ordered connection.  Active services follow from the leaf, so the client gets them from its own copy
+// of the template.  Creating the client side instance with the right template is left to the game
+
+static const int kStormBehaviorReplicationBlockSize = 8;
+
+enum StormBehaviorReplicationFlags : uint8_t
+{
+  kStormBehaviorReplicateNode = 1,
+  kStormBehaviorReplicateMemory = 2,
+  kStormBehaviorReplicateFull = 4,
+  kStormBehaviorReplicateRemoved = 8,
+};
+
+// Replicated regions of a template cut into blocks, in the order they are sent
+class StormBehaviorTreeReplicationLayout
+{
+public:
+
+  StormBehaviorTreeReplicationLayout(const void * bt, const std::vector<StormBehaviorTreeMemoryRegion> & regions,
+    const StormBehaviorTreeMemoryRegion & state_slot) :
+    m_Template(bt)
+  {
+    for(auto & region : regions)
+    {
+      if(region.m_Size > 0 && region.m_Offset == state_slot.m_Offset && region.m_Size == state_slot.m_Size)
+      {
+        m_StateSlotBlockStart = GetBlockCount();
+        m_StateSlotBlockEnd = m_StateSlotBlockStart + (region.m_Size + kStormBehaviorReplicationBlockSize - 1) / kStormBehaviorReplicationBlockSize;
+      }
+
+      for(int offset = 0; offset < region.m_Size; offset += kStormBehaviorReplicationBlockSize)
+      {
+        auto size = std::min(kStormBehaviorReplicationBlockSize, region.m_Size - offset);
+        m_Blocks.emplace_back(StormBehaviorTreeMemoryRegion{ region.m_Offset + offset, size });
+        m_TotalSize += size;
+      }
+    }
+  }
+
+  const void * GetTemplate() const
+  {
+    return m_Template;
+  }
+
+  int GetBlockCount() const
+  {
+    return static_cast<int>(m_Blocks.size());
+  }
+
+  const StormBehaviorTreeMemoryRegion & GetBlock(int index) const
+  {
+    return m_Blocks[index];
+  }
+
+  int GetBitsetSize() const
+  {
+    return (GetBlockCount() + 7) / 8;
+  }
+
+  // Blocks of the lazy state slot, which hold a different state after every leaf change
+  bool IsStateSlotBlock(int index) const
+  {
+    return index >= m_StateSlotBlockStart && index < m_StateSlotBlockEnd;
+  }
+
+  // Bytes of replicated memory per instance
+  int GetTotalSize() const
+  {
+    return m_TotalSize;
+  }
+
+  // Layouts are built once per template and kept for the lifetime of the encoder or decoder
+  template <typename DataType, typename ContextType>
+  static const StormBehaviorTreeReplicationLayout & Find(std::vector<StormBehaviorTreeReplicationLayout> & layouts,
+    const StormBehaviorTreeTemplate<DataType, ContextType> * bt)
+  {
+    for(auto & elem : layouts)
+    {
+      if(elem.GetTemplate() == bt)
+      {
+        return elem;
+      }
+    }
+
+    layouts.emplace_back(bt, bt->GetReplicatedRegions(), bt->GetReplicatedStateSlot());
+    return layouts.back();
+  }
+
+private:
+  const void * m_Template;
+  std::vector<StormBehaviorTreeMemoryRegion> m_Blocks;
+  int m_TotalSize = 0;
+  int m_StateSlotBlockStart = 0;
+  int m_StateSlotBlockEnd = 0;
+};
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeReplicationEncoder
+{
+public:
+
+  using TreeType = StormBehaviorTree<DataType, ContextType>;
+  using TemplateType = StormBehaviorTreeTemplate<DataType, ContextType>;
+
+  void BeginFrame()
+  {
+    m_Records.Clear();
+    m_RecordCount = 0;
+  }
+
+  // Adds a record for the instance if its leaf or replicated memory changed since the last frame it was sent in
+  void Record(int instance_id, const TreeType & tree)
+  {
+    auto bt = tree.GetBehaviorTree();
+    if(bt == nullptr)
+    {
+      RecordRemoved(instance_id);
+      return;
+    }
+
+    if(instance_id >= static_cast<int>(m_Baselines.size()))
+    {
+      m_Baselines.resize(instance_id + 1);
+    }
+
+    auto & baseline = m_Baselines[instance_id];
+    auto & layout = StormBehaviorTreeReplicationLayout::Find(m_Layouts, bt);
+    auto memory = static_cast<const uint8_t *>(tree.GetNodeMemory());
+    auto node = tree.GetCurrentNode();
+
+    // New instances and instances that switched templates get everything
+    if(baseline.m_Template != bt)
+    {
+      baseline.m_Template = bt;
+      baseline.m_Node = node;
+      baseline.m_Memory.resize(layout.GetTotalSize());
+      CopyBlocks(layout, memory, baseline.m_Memory.data());
+
+      BeginRecord(instance_id, kStormBehaviorReplicateNode | kStormBehaviorReplicateFull);
+      StormBehaviorWriteVarInt(m_Records.GetData(), StormBehaviorZigZag(node));
+      m_Records.Write(baseline.m_Memory.data(), baseline.m_Memory.size());
+      return;
+    }
+
+    m_DirtyBits.assign(layout.GetBitsetSize(), 0);
+    bool memory_dirty = false;
+
+    // The client constructs a fresh state on a leaf change, so the baseline no longer says what it has in the slot
+    bool state_changed = node != baseline.m_Node;
+
+    auto baseline_memory = baseline.m_Memory.data();
+    for(int index = 0; index < layout.GetBlockCount(); ++index)
+    {
+      auto & block = layout.GetBlock(index);
+      if((state_changed && layout.IsStateSlotBlock(index)) || BlockDiffers(baseline_memory, memory + block.m_Offset, block.m_Size))
+      {
+        m_DirtyBits[index / 8] |= static_cast<uint8_t>(1 << (index % 8));
+        memory_dirty = true;
+      }
+
+      baseline_memory += block.m_Size;
+    }
+
+    if(memory_dirty == false && node == baseline.m_Node)
+    {
+      return;
+    }
+
+    uint8_t flags = (node != baseline.m_Node ? kStormBehaviorReplicateNode : 0) | (memory_dirty ? kStormBehaviorReplicateMemory : 0);
+    BeginRecord(instance_id, flags);
+
+    if(node != baseline.m_Node)
+    {
+      StormBehaviorWriteVarInt(m_Records.GetData(), StormBehaviorZigZag(node));
+      baseline.m_Node = node;
+    }
+
+    if(memory_dirty)
+    {
+      m_Records.Write(m_DirtyBits.data(), m_DirtyBits.size());
+
+      baseline_memory = baseline.m_Memory.data();
+      for(int index = 0; index < layout.GetBlockCount(); ++index)
+      {
+        auto & block = layout.GetBlock(index);
+        if(m_DirtyBits[index / 8] & (1 << (index % 8)))
+        {
+          memcpy(baseline_memory, memory + block.m_Offset, block.m_Size);
+          m_Records.Write(baseline_memory, block.m_Size);
+        }
+
+        baseline_memory += block.m_Size;
+      }
+    }
+  }
+
+  void RecordRemoved(int instance_id)
+  {
+    if(instance_id >= static_cast<int>(m_Baselines.size()) || m_Baselines[instance_id].m_Template == nullptr)
+    {
+      return;
+    }
+
+    m_Baselines[instance_id].m_Template = nullptr;
+    m_Baselines[instance_id].m_Memory.clear();
+    BeginRecord(instance_id, kStormBehaviorReplicateRemoved);
+  }
+
+  // Appends the frame to buffer.  Returns the number of instances in it
+  int EndFrame(StormBehaviorTreeWriteBuffer & buffer)
+  {
+    buffer.WriteVarInt(m_Sequence);
+    buffer.WriteVarInt(static_cast<uint64_t>(m_RecordCount));
+    buffer.Write(m_Records.GetData().data(), m_Records.GetSize());
+
+    m_Sequence++;
+    return m_RecordCount;
+  }
+
+  template <typename World>
+  int EncodeWorld(const World & world, StormBehaviorTreeWriteBuffer & buffer)
+  {
+    BeginFrame();
+    for(int handle = 0; handle < world.GetHandleCount(); ++handle)
+    {
+      auto tree = world.GetInstance(handle);
+      if(tree)
+      {
+        Record(handle, *tree);
+      }
+      else
+      {
+        RecordRemoved(handle);
+      }
+    }
+
+    return EndFrame(buffer);
+  }
+
+  // Forgets everything that was sent, so the next frame carries the full state of every instance again
+  void Reset()
+  {
+    m_Baselines.clear();
+  }
+
+private:
+
+  void BeginRecord(int instance_id, uint8_t flags)
+  {
+    m_Records.WriteVarInt(static_cast<uint64_t>(instance_id));
+    m_Records.Write(flags);
+    m_RecordCount++;
+  }
+
+  // Almost every block is a whole word, which is cheaper to compare directly than through memcmp
+  static bool BlockDiffers(const uint8_t * a, const uint8_t * b, int size)
+  {
+    if(size == sizeof(uint64_t))
+    {
+      uint64_t a_val, b_val;
+      memcpy(&a_val, a, sizeof(uint64_t));
+      memcpy(&b_val, b, sizeof(uint64_t));
+      return a_val != b_val;
+    }
+
+    return memcmp(a, b, size) != 0;
+  }
+
+  static void CopyBlocks(const StormBehaviorTreeReplicationLayout & layout, const uint8_t * memory, uint8_t * dst)
+  {
+    for(int index = 0; index < layout.GetBlockCount(); ++index)
+    {
+      auto & block = layout.GetBlock(index);
+      memcpy(dst, memory + block.m_Offset, block.m_Size);
+      dst += block.m_Size;
+    }
+  }
+
+  struct Baseline
+  {
+    const TemplateType * m_Template = nullptr;
+    int m_Node = -1;
+    std::vector<uint8_t> m_Memory;
+  };
+
+  std::vector<Baseline> m_Baselines;
+  std::vector<StormBehaviorTreeReplicationLayout> m_Layouts;
+  std::vector<uint8_t> m_DirtyBits;
+  StormBehaviorTreeWriteBuffer m_Records;
+  int m_RecordCount = 0;
+  uint64_t m_Sequence = 0;
+};
+
+class StormBehaviorTreeReplicationDecoder
+{
+public:
+
+  // Applies one frame.  tree_lookup(instance_id) must return the client instance for the id, created from the same
+  // template as on the server.  on_node_changed(instance_id, tree, prev_node) runs after a leaf change is applied,
+  // and on_removed(instance_id) for instances the server no longer has.  Returns false if the frame is malformed
+  // or out of sequence
+  template <typename TreeLookup, typename OnNodeChanged, typename OnRemoved>
+  bool Decode(const void * data, std::size_t size, TreeLookup && tree_lookup, OnNodeChanged && on_node_changed, OnRemoved && on_removed)
+  {
+    StormBehaviorTreeReadBuffer buffer(data, size);
+    if(buffer.ReadVarInt() != m_Sequence)
+    {
+      return false;
+    }
+
+    auto record_count = buffer.ReadVarInt();
+    for(uint64_t record = 0; record < record_count && buffer.HasFailed() == false; ++record)
+    {
+      auto instance_id = static_cast<int>(buffer.ReadVarInt());
+      auto flags = buffer.Read<uint8_t>();
+
+      if(flags & kStormBehaviorReplicateRemoved)
+      {
+        on_removed(instance_id);
+        continue;
+      }
+
+      auto tree = tree_lookup(instance_id);
+      if(tree == nullptr || tree->GetBehaviorTree() == nullptr)
+      {
+        return false;
+      }
+
+      auto bt = tree->GetBehaviorTree();
+      auto & layout = StormBehaviorTreeReplicationLayout::Find(m_Layouts, bt);
+      auto memory = static_cast<uint8_t *>(tree->GetNodeMemory());
+
+      auto prev_node = tree->GetCurrentNode();
+      auto node = prev_node;
+      if(flags & kStormBehaviorReplicateNode)
+      {
+        node = static_cast<int>(StormBehaviorUnZigZag(buffer.ReadVarInt()));
+        if(node < -1 || node >= tree->GetNodeCount())
+        {
+          return false;
+        }
+      }
+
+      // Switch before reading memory, so a state constructed on activation is in place before its bytes arrive
+      if(node != prev_node)
+      {
+        tree->SetReplicatedNode(node);
+      }
+
+      if(flags & kStormBehaviorReplicateFull)
+      {
+        for(int index = 0; index < layout.GetBlockCount(); ++index)
+        {
+          auto & block = layout.GetBlock(index);
+          buffer.Read(memory + block.m_Offset, block.m_Size);
+        }
+      }
+      else if(flags & kStormBehaviorReplicateMemory)
+      {
+        auto dirty_bits = buffer.Skip(layout.GetBitsetSize());
+        if(dirty_bits == nullptr)
+        {
+          return false;
+        }
+
+        for(int index = 0; index < layout.GetBlockCount(); ++index)
+        {
+          if(dirty_bits[index / 8] & (1 << (index % 8)))
+          {
+            auto & block = layout.GetBlock(index);
+            buffer.Read(memory + block.m_Offset, block.m_Size);
+          }
+        }
+      }
+
+      if(node != prev_node)
+      {
+        on_node_changed(instance_id, *tree, prev_node);
+      }
+    }
+
+    if(buffer.HasFailed())
+    {
+      return false;
+    }
+
+    m_Sequence++;
+    return true;
+  }
+
+  template <typename TreeLookup>
+  bool Decode(const void * data, std::size_t size, TreeLookup && tree_lookup)
+  {
+    return Decode(data, size, tree_lookup, [](int, auto &, int) {}, [](int) {});
+  }
+
+private:
+  std::vector<StormBehaviorTreeReplicationLayout> m_Layouts;
+  uint64_t m_Sequence = 0;
+};
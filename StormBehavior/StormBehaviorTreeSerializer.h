@@ -0,0 +1,275 @@
+#pragma once
+
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+inline void StormBehaviorWriteVarInt(std::vector<uint8_t> & buffer, uint64_t val)
+{
+  while(val >= 0x80)
+  {
+    buffer.push_back(static_cast<uint8_t>(val | 0x80));
+    val >>= 7;
+  }
+
+  buffer.push_back(static_cast<uint8_t>(val));
+}
+
+inline bool StormBehaviorReadVarInt(const uint8_t *& ptr, const uint8_t * end, uint64_t & val)
+{
+  val = 0;
+  for(int shift = 0; shift < 64; shift += 7)
+  {
+    if(ptr == end)
+    {
+      return false;
+    }
+
+    auto byte = *ptr++;
+    val |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline uint64_t StormBehaviorZigZag(int64_t val)
+{
+  return (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63);
+}
+
+inline int64_t StormBehaviorUnZigZag(uint64_t val)
+{
+  return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+}
+
+class StormBehaviorTreeWriteBuffer
+{
+public:
+
+  // Empty writes and reads may pass a null pointer, such as the data of an empty vector
+  void Write(const void * data, std::size_t size)
+  {
+    if(size == 0)
+    {
+      return;
+    }
+
+    auto bytes = static_cast<const uint8_t *>(data);
+    m_Data.insert(m_Data.end(), bytes, bytes + size);
+  }
+
+  template <typename T>
+  void Write(const T & val)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written directly");
+    Write(&val, sizeof(T));
+  }
+
+  void WriteVarInt(uint64_t val)
+  {
+    StormBehaviorWriteVarInt(m_Data, val);
+  }
+
+  std::vector<uint8_t> & GetData()
+  {
+    return m_Data;
+  }
+
+  std::size_t GetSize() const
+  {
+    return m_Data.size();
+  }
+
+  void Clear()
+  {
+    m_Data.clear();
+  }
+
+private:
+  std::vector<uint8_t> m_Data;
+};
+
+// Reads past the end of the buffer fail, zero fill the destination and leave the buffer failed, so loading
+// code can read everything it needs and check HasFailed once at the end
+class StormBehaviorTreeReadBuffer
+{
+public:
+
+  StormBehaviorTreeReadBuffer(const void * data, std::size_t size) :
+    m_Ptr(static_cast<const uint8_t *>(data)),
+    m_End(static_cast<const uint8_t *>(data) + size)
+  {
+
+  }
+
+  bool Read(void * data, std::size_t size)
+  {
+    if(size == 0)
+    {
+      return true;
+    }
+
+    if(GetRemaining() < size)
+    {
+      memset(data, 0, size);
+      m_Failed = true;
+      m_Ptr = m_End;
+      return false;
+    }
+
+    memcpy(data, m_Ptr, size);
+    m_Ptr += size;
+    return true;
+  }
+
+  template <typename T>
+  T Read()
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read directly");
+
+    T val;
+    Read(&val, sizeof(T));
+    return val;
+  }
+
+  uint64_t ReadVarInt()
+  {
+    uint64_t val;
+    if(StormBehaviorReadVarInt(m_Ptr, m_End, val) == false)
+    {
+      m_Failed = true;
+      m_Ptr = m_End;
+      return 0;
+    }
+
+    return val;
+  }
+
+  // Returns the skipped bytes, or nullptr if there are not enough left
+  const uint8_t * Skip(std::size_t size)
+  {
+    if(GetRemaining() < size)
+    {
+      m_Failed = true;
+      m_Ptr = m_End;
+      return nullptr;
+    }
+
+    auto ptr = m_Ptr;
+    m_Ptr += size;
+    return ptr;
+  }
+
+  std::size_t GetRemaining() const
+  {
+    return static_cast<std::size_t>(m_End - m_Ptr);
+  }
+
+  bool HasFailed() const
+  {
+    return m_Failed;
+  }
+
+private:
+  const uint8_t * m_Ptr;
+  const uint8_t * m_End;
+  bool m_Failed = false;
+};
+
+// Saves and restores elements that are not trivially copyable.  By default it calls a Save(StormBehaviorTreeWriteBuffer &) const
+// member to save and a T(StormBehaviorTreeReadBuffer &) constructor to load, which builds the element straight from the
+// saved data instead of running its normal init.  Specialize it for types that can't have those members.  Trivially copyable
+// elements without either are saved as raw bytes
+template <typename T>
+struct StormBehaviorTreeSerializer
+{
+  template <typename U = T>
+  static auto Save(const U & val, StormBehaviorTreeWriteBuffer & buffer) -> decltype(val.Save(buffer), void())
+  {
+    val.Save(buffer);
+  }
+
+  template <typename U = T>
+  static auto Load(void * mem, StormBehaviorTreeReadBuffer & buffer) -> decltype(U(buffer), void())
+  {
+    new (mem) U(buffer);
+  }
+};
+
+template <typename T>
+struct StormBehaviorHasSerializer
+{
+public:
+  template <typename C>
+  static char test(decltype(StormBehaviorTreeSerializer<C>::Save(std::declval<const C &>(), std::declval<StormBehaviorTreeWriteBuffer &>()),
+                            StormBehaviorTreeSerializer<C>::Load(nullptr, std::declval<StormBehaviorTreeReadBuffer &>())) *);
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+constexpr bool StormBehaviorIsRawSerializable()
+{
+  return StormBehaviorHasSerializer<T>::value == false && std::is_trivially_copyable<T>::value;
+}
+
+template <typename T>
+void StormBehaviorSave(const void * ptr, StormBehaviorTreeWriteBuffer & buffer)
+{
+  if constexpr(StormBehaviorIsRawSerializable<T>())
+  {
+    buffer.Write(ptr, sizeof(T));
+  }
+  else
+  {
+    StormBehaviorTreeSerializer<T>::Save(*static_cast<const T *>(ptr), buffer);
+  }
+}
+
+template <typename T>
+void StormBehaviorLoad(void * mem, StormBehaviorTreeReadBuffer & buffer)
+{
+  if constexpr(StormBehaviorIsRawSerializable<T>())
+  {
+    buffer.Read(mem, sizeof(T));
+  }
+  else
+  {
+    StormBehaviorTreeSerializer<T>::Load(mem, buffer);
+  }
+}
+
+template <typename T>
+constexpr auto StormBehaviorGetSave() -> void(*)(const void *, StormBehaviorTreeWriteBuffer &)
+{
+  if constexpr(StormBehaviorHasSerializer<T>::value || std::is_trivially_copyable<T>::value)
+  {
+    return &StormBehaviorSave<T>;
+  }
+  else
+  {
+    return nullptr;
+  }
+}
+
+template <typename T>
+constexpr auto StormBehaviorGetLoad() -> void(*)(void *, StormBehaviorTreeReadBuffer &)
+{
+  if constexpr(StormBehaviorHasSerializer<T>::value || std::is_trivially_copyable<T>::value)
+  {
+    return &StormBehaviorLoad<T>;
+  }
+  else
+  {
+    return nullptr;
+  }
+}
@@ -0,0 +1,774 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "StormBehaviorTree.h"
+
+// Binary telemetry of live tree state.  The stream starts with kStormBehaviorTelemetryMagic followed by one
+// frame per sampled tick:
+//
+//   kFrame or kKeyFrame, varint tick
+//   kInstance, varint instance id, zigzag varint current node, varint service count, varint service indices...,
+//              varint node memory size, node memory bytes
+//   kRemove, varint instance id
+//   kFrameEnd
+//
+// Frames only carry the instances that changed since the previous frame.  A key frame carries every sampled
+// instance and replaces the reader's state, and is sent first, after dropped frames and every key frame interval
+
+static const uint32_t kStormBehaviorTelemetryMagic = 0x54544253;
+
+enum class StormBehaviorTelemetryTag : uint8_t
+{
+  kFrame = 1,
+  kKeyFrame,
+  kInstance,
+  kRemove,
+  kFrameEnd,
+};
+
+// Sinks accept as much of a write as they can and return the number of bytes taken.  Taking less than
+// everything applies backpressure to the writer, which holds on to the rest and drops frames once it
+// has too much pending
+
+// Appends to a vector, up to an optional capacity
+class StormBehaviorTelemetryBufferSink
+{
+public:
+  std::size_t Write(const void * data, std::size_t size)
+  {
+    if(m_Capacity > 0)
+    {
+      size = std::min(size, m_Capacity - std::min(m_Capacity, m_Data.size()));
+    }
+
+    auto bytes = static_cast<const uint8_t *>(data);
+    m_Data.insert(m_Data.end(), bytes, bytes + size);
+    return size;
+  }
+
+  std::vector<uint8_t> m_Data;
+  std::size_t m_Capacity = 0;
+};
+
+#if !defined(_WIN32)
+
+// Writes into a fixed size memory mapped file.  The first kHeaderSize bytes hold the number of stream bytes
+// written so far, so a reader can map the same file and follow it while it is being written
+class StormBehaviorTelemetryMappedFileSink
+{
+public:
+  static const std::size_t kHeaderSize = sizeof(uint64_t);
+
+  StormBehaviorTelemetryMappedFileSink() = default;
+  StormBehaviorTelemetryMappedFileSink(const StormBehaviorTelemetryMappedFileSink & rhs) = delete;
+  StormBehaviorTelemetryMappedFileSink & operator = (const StormBehaviorTelemetryMappedFileSink & rhs) = delete;
+
+  ~StormBehaviorTelemetryMappedFileSink()
+  {
+    Close();
+  }
+
+  bool Open(const char * path, std::size_t capacity)
+  {
+    Close();
+
+    auto fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1)
+    {
+      return false;
+    }
+
+    m_Size = kHeaderSize + capacity;
+    if(ftruncate(fd, static_cast<off_t>(m_Size)) != 0)
+    {
+      close(fd);
+      return false;
+    }
+
+    auto memory = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(memory == MAP_FAILED)
+    {
+      return false;
+    }
+
+    m_Memory = static_cast<uint8_t *>(memory);
+    m_Used = 0;
+    PublishUsed();
+    return true;
+  }
+
+  void Close()
+  {
+    if(m_Memory)
+    {
+      msync(m_Memory, m_Size, MS_ASYNC);
+      munmap(m_Memory, m_Size);
+      m_Memory = nullptr;
+    }
+  }
+
+  std::size_t Write(const void * data, std::size_t size)
+  {
+    if(m_Memory == nullptr)
+    {
+      return 0;
+    }
+
+    size = std::min(size, m_Size - kHeaderSize - m_Used);
+    memcpy(m_Memory + kHeaderSize + m_Used, data, size);
+    m_Used += size;
+
+    PublishUsed();
+    return size;
+  }
+
+private:
+
+  void PublishUsed()
+  {
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t used = m_Used;
+    memcpy(m_Memory, &used, sizeof(used));
+  }
+
+  uint8_t * m_Memory = nullptr;
+  std::size_t m_Size = 0;
+  std::size_t m_Used = 0;
+};
+
+// Streams to a Unix domain socket without blocking.  A full socket buffer pushes back on the writer
+class StormBehaviorTelemetrySocketSink
+{
+public:
+  StormBehaviorTelemetrySocketSink() = default;
+  StormBehaviorTelemetrySocketSink(const StormBehaviorTelemetrySocketSink & rhs) = delete;
+  StormBehaviorTelemetrySocketSink & operator = (const StormBehaviorTelemetrySocketSink & rhs) = delete;
+
+  ~StormBehaviorTelemetrySocketSink()
+  {
+    Close();
+  }
+
+  bool Connect(const char * path)
+  {
+    Close();
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+      return false;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    m_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_Socket == -1)
+    {
+      return false;
+    }
+
+#if defined(SO_NOSIGPIPE)
+    int no_sigpipe = 1;
+    setsockopt(m_Socket, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+    if(connect(m_Socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+      Close();
+      return false;
+    }
+
+    fcntl(m_Socket, F_SETFL, fcntl(m_Socket, F_GETFL) | O_NONBLOCK);
+    return true;
+  }
+
+  void Close()
+  {
+    if(m_Socket != -1)
+    {
+      close(m_Socket);
+      m_Socket = -1;
+    }
+  }
+
+  bool IsConnected() const
+  {
+    return m_Socket != -1;
+  }
+
+  std::size_t Write(const void * data, std::size_t size)
+  {
+    if(m_Socket == -1)
+    {
+      return 0;
+    }
+
+#if defined(MSG_NOSIGNAL)
+    auto result = send(m_Socket, data, size, MSG_NOSIGNAL);
+#else
+    auto result = send(m_Socket, data, size, 0);
+#endif
+
+    if(result < 0)
+    {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        Close();
+      }
+
+      return 0;
+    }
+
+    return static_cast<std::size_t>(result);
+  }
+
+private:
+  int m_Socket = -1;
+};
+
+#endif
+
+template <typename Sink>
+class StormBehaviorTreeTelemetryWriter
+{
+public:
+  StormBehaviorTreeTelemetryWriter(Sink & sink) :
+    m_Sink(sink)
+  {
+    for(int index = 0; index < 4; ++index)
+    {
+      m_Pending.push_back(static_cast<uint8_t>(kStormBehaviorTelemetryMagic >> (index * 8)));
+    }
+  }
+
+  // Only every Nth tick is recorded
+  void SetSampleInterval(int ticks)
+  {
+    m_SampleInterval = std::max(ticks, 1);
+  }
+
+  // Only instances whose id is a multiple of one_in are recorded
+  void SetInstanceSampleRate(int one_in)
+  {
+    m_InstanceSampleRate = std::max(one_in, 1);
+  }
+
+  // Sends the raw node memory of an instance whenever it changes.  Much larger streams, and the reader needs the
+  // same build to make sense of the bytes
+  void SetIncludeNodeMemory(bool include_node_memory)
+  {
+    m_IncludeNodeMemory = include_node_memory;
+  }
+
+  // The sink is only written to once this many bytes are pending
+  void SetBatchBytes(std::size_t batch_bytes)
+  {
+    m_BatchBytes = batch_bytes;
+  }
+
+  // Frames that would take the pending bytes over this limit are dropped, and the next frame is a key frame
+  void SetMaxPendingBytes(std::size_t max_pending_bytes)
+  {
+    m_MaxPendingBytes = max_pending_bytes;
+  }
+
+  // Sends a key frame every N recorded frames so readers that join late can pick up the state.  Zero only sends
+  // key frames at the start and after dropped frames
+  void SetKeyFrameInterval(int frames)
+  {
+    m_KeyFrameInterval = frames;
+  }
+
+  void BeginTick(uint64_t tick)
+  {
+    m_Recording = (tick % m_SampleInterval) == 0;
+    if(m_Recording == false)
+    {
+      return;
+    }
+
+    m_KeyFrame = m_Resync || (m_KeyFrameInterval > 0 && m_FramesSinceKeyFrame >= m_KeyFrameInterval);
+    m_Resync = false;
+
+    if(m_KeyFrame)
+    {
+      m_FramesSinceKeyFrame = 0;
+      for(auto & elem : m_LastStates)
+      {
+        elem.m_Known = false;
+      }
+    }
+
+    m_Frame.clear();
+    m_Frame.push_back(static_cast<uint8_t>(m_KeyFrame ? StormBehaviorTelemetryTag::kKeyFrame : StormBehaviorTelemetryTag::kFrame));
+    StormBehaviorWriteVarInt(m_Frame, tick);
+  }
+
+  template <typename DataType, typename ContextType>
+  void Record(int instance_id, const StormBehaviorTree<DataType, ContextType> & tree)
+  {
+    if(m_Recording == false || (instance_id % m_InstanceSampleRate) != 0)
+    {
+      return;
+    }
+
+    if(instance_id >= static_cast<int>(m_LastStates.size()))
+    {
+      m_LastStates.resize(instance_id + 1);
+    }
+
+    auto & last_state = m_LastStates[instance_id];
+    auto current_node = tree.GetCurrentNode();
+
+    const uint8_t * node_memory = nullptr;
+    std::size_t node_memory_size = 0;
+    uint64_t memory_hash = 0;
+
+    if(m_IncludeNodeMemory && tree.GetBehaviorTree())
+    {
+      node_memory = static_cast<const uint8_t *>(tree.GetNodeMemory());
+      node_memory_size = tree.GetBehaviorTree()->GetInstanceMemorySize();
+      memory_hash = GetHash(node_memory, node_memory_size);
+    }
+
+    if(last_state.m_Known && last_state.m_Node == current_node && last_state.m_MemoryHash == memory_hash)
+    {
+      return;
+    }
+
+    last_state.m_Known = true;
+    last_state.m_Node = current_node;
+    last_state.m_MemoryHash = memory_hash;
+
+    m_Frame.push_back(static_cast<uint8_t>(StormBehaviorTelemetryTag::kInstance));
+    StormBehaviorWriteVarInt(m_Frame, static_cast<uint64_t>(instance_id));
+    StormBehaviorWriteVarInt(m_Frame, StormBehaviorZigZag(current_node));
+
+    m_Services.clear();
+    tree.VisitActiveServices([&](int service_index) { m_Services.push_back(service_index); });
+
+    StormBehaviorWriteVarInt(m_Frame, m_Services.size());
+    for(auto & elem : m_Services)
+    {
+      StormBehaviorWriteVarInt(m_Frame, static_cast<uint64_t>(elem));
+    }
+
+    StormBehaviorWriteVarInt(m_Frame, node_memory_size);
+    m_Frame.insert(m_Frame.end(), node_memory, node_memory + node_memory_size);
+  }
+
+  void RecordRemoved(int instance_id)
+  {
+    if(m_Recording == false || instance_id >= static_cast<int>(m_LastStates.size()) || m_LastStates[instance_id].m_Known == false)
+    {
+      return;
+    }
+
+    m_LastStates[instance_id].m_Known = false;
+    m_Frame.push_back(static_cast<uint8_t>(StormBehaviorTelemetryTag::kRemove));
+    StormBehaviorWriteVarInt(m_Frame, static_cast<uint64_t>(instance_id));
+  }
+
+  // Queues the frame and writes to the sink if a full batch is pending.  Returns false if the frame had to be dropped
+  bool EndTick()
+  {
+    if(m_Recording == false)
+    {
+      Flush(false);
+      return true;
+    }
+
+    m_Recording = false;
+    m_Frame.push_back(static_cast<uint8_t>(StormBehaviorTelemetryTag::kFrameEnd));
+
+    if(GetPendingBytes() + m_Frame.size() > m_MaxPendingBytes)
+    {
+      Flush(true);
+      if(GetPendingBytes() + m_Frame.size() > m_MaxPendingBytes)
+      {
+        m_DroppedFrames++;
+        m_Resync = true;
+        return false;
+      }
+    }
+
+    m_Pending.insert(m_Pending.end(), m_Frame.begin(), m_Frame.end());
+    m_FramesSinceKeyFrame++;
+
+    Flush(false);
+    return true;
+  }
+
+  // Records one frame of every instance in a StormBehaviorTreeWorld, using the handles as instance ids
+  template <typename World>
+  bool RecordWorld(const World & world)
+  {
+    BeginTick(world.GetTick());
+    if(m_Recording)
+    {
+      for(int handle = 0; handle < world.GetHandleCount(); ++handle)
+      {
+        auto tree = world.GetInstance(handle);
+        if(tree)
+        {
+          Record(handle, *tree);
+        }
+        else
+        {
+          RecordRemoved(handle);
+        }
+      }
+    }
+
+    return EndTick();
+  }
+
+  // Writes everything pending, or as much as the sink will take
+  void Flush()
+  {
+    Flush(true);
+  }
+
+  std::size_t GetPendingBytes() const
+  {
+    return m_Pending.size() - m_PendingOffset;
+  }
+
+  uint64_t GetWrittenBytes() const
+  {
+    return m_WrittenBytes;
+  }
+
+  uint64_t GetDroppedFrames() const
+  {
+    return m_DroppedFrames;
+  }
+
+private:
+
+  static uint64_t GetHash(const uint8_t * data, std::size_t size)
+  {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for(std::size_t index = 0; index < size; ++index)
+    {
+      hash = (hash ^ data[index]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+  }
+
+  void Flush(bool force)
+  {
+    if(GetPendingBytes() == 0 || (force == false && GetPendingBytes() < m_BatchBytes))
+    {
+      return;
+    }
+
+    while(m_PendingOffset < m_Pending.size())
+    {
+      auto written = m_Sink.Write(m_Pending.data() + m_PendingOffset, m_Pending.size() - m_PendingOffset);
+      if(written == 0)
+      {
+        break;
+      }
+
+      m_PendingOffset += written;
+      m_WrittenBytes += written;
+    }
+
+    if(m_PendingOffset == m_Pending.size())
+    {
+      m_Pending.clear();
+      m_PendingOffset = 0;
+    }
+    else if(m_PendingOffset > m_Pending.size() / 2)
+    {
+      m_Pending.erase(m_Pending.begin(), m_Pending.begin() + m_PendingOffset);
+      m_PendingOffset = 0;
+    }
+  }
+
+  Sink & m_Sink;
+
+  struct LastState
+  {
+    int m_Node = -1;
+    uint64_t m_MemoryHash = 0;
+    bool m_Known = false;
+  };
+
+  std::vector<LastState> m_LastStates;
+  std::vector<uint8_t> m_Frame;
+  std::vector<uint8_t> m_Pending;
+  std::size_t m_PendingOffset = 0;
+  std::vector<int> m_Services;
+
+  int m_SampleInterval = 1;
+  int m_InstanceSampleRate = 1;
+  bool m_IncludeNodeMemory = false;
+  std::size_t m_BatchBytes = 64 * 1024;
+  std::size_t m_MaxPendingBytes = 4 * 1024 * 1024;
+  int m_KeyFrameInterval = 0;
+
+  bool m_Recording = false;
+  bool m_KeyFrame = false;
+  bool m_Resync = true;
+  int m_FramesSinceKeyFrame = 0;
+  uint64_t m_WrittenBytes = 0;
+  uint64_t m_DroppedFrames = 0;
+};
+
+// Rebuilds the state of every recorded instance from a telemetry stream.  Bytes can be fed in any sized pieces
+class StormBehaviorTreeTelemetryReader
+{
+public:
+
+  struct InstanceState
+  {
+    int m_Node = -1;
+    std::vector<int> m_Services;
+    std::vector<uint8_t> m_NodeMemory;
+  };
+
+  bool Feed(const void * data, std::size_t size)
+  {
+    return Feed(data, size, [](const StormBehaviorTreeTelemetryReader &) {});
+  }
+
+  // Calls on_frame(reader) after each complete frame has been applied.  Returns false if the stream is malformed
+  template <typename Callback>
+  bool Feed(const void * data, std::size_t size, Callback && on_frame)
+  {
+    if(m_Error)
+    {
+      return false;
+    }
+
+    auto bytes = static_cast<const uint8_t *>(data);
+    m_Buffer.insert(m_Buffer.end(), bytes, bytes + size);
+
+    const uint8_t * ptr = m_Buffer.data();
+    const uint8_t * end = m_Buffer.data() + m_Buffer.size();
+
+    if(m_ReadMagic == false)
+    {
+      if(end - ptr < 4)
+      {
+        return true;
+      }
+
+      uint32_t magic = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+      if(magic != kStormBehaviorTelemetryMagic)
+      {
+        m_Error = true;
+        return false;
+      }
+
+      ptr += 4;
+      m_ReadMagic = true;
+    }
+
+    while(ptr != end)
+    {
+      auto frame_start = ptr;
+      auto result = ReadFrame(ptr, end);
+      if(result == kIncomplete)
+      {
+        ptr = frame_start;
+        break;
+      }
+
+      if(result == kMalformed)
+      {
+        m_Error = true;
+        return false;
+      }
+
+      ApplyFrame();
+      on_frame(*this);
+    }
+
+    m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + (ptr - m_Buffer.data()));
+    return true;
+  }
+
+  uint64_t GetTick() const
+  {
+    return m_Tick;
+  }
+
+  uint64_t GetFrameCount() const
+  {
+    return m_FrameCount;
+  }
+
+  bool IsKeyFrame() const
+  {
+    return m_KeyFrame;
+  }
+
+  // Number of instance and remove records in the last frame
+  int GetFrameRecordCount() const
+  {
+    return static_cast<int>(m_Records.size());
+  }
+
+  const std::unordered_map<int, InstanceState> & GetInstances() const
+  {
+    return m_Instances;
+  }
+
+private:
+
+  enum ReadResult
+  {
+    kComplete,
+    kIncomplete,
+    kMalformed,
+  };
+
+  ReadResult ReadFrame(const uint8_t *& ptr, const uint8_t * end)
+  {
+    m_Records.clear();
+
+    if(ptr == end)
+    {
+      return kIncomplete;
+    }
+
+    auto tag = static_cast<StormBehaviorTelemetryTag>(*ptr++);
+    if(tag != StormBehaviorTelemetryTag::kFrame && tag != StormBehaviorTelemetryTag::kKeyFrame)
+    {
+      return kMalformed;
+    }
+
+    m_FrameIsKey = tag == StormBehaviorTelemetryTag::kKeyFrame;
+    if(StormBehaviorReadVarInt(ptr, end, m_FrameTick) == false)
+    {
+      return kIncomplete;
+    }
+
+    while(true)
+    {
+      if(ptr == end)
+      {
+        return kIncomplete;
+      }
+
+      tag = static_cast<StormBehaviorTelemetryTag>(*ptr++);
+      if(tag == StormBehaviorTelemetryTag::kFrameEnd)
+      {
+        return kComplete;
+      }
+
+      uint64_t instance_id;
+      if(StormBehaviorReadVarInt(ptr, end, instance_id) == false)
+      {
+        return kIncomplete;
+      }
+
+      m_Records.emplace_back();
+      auto & record = m_Records.back();
+      record.m_InstanceId = static_cast<int>(instance_id);
+
+      if(tag == StormBehaviorTelemetryTag::kRemove)
+      {
+        record.m_Removed = true;
+        continue;
+      }
+
+      if(tag != StormBehaviorTelemetryTag::kInstance)
+      {
+        return kMalformed;
+      }
+
+      uint64_t node, service_count, memory_size;
+      if(StormBehaviorReadVarInt(ptr, end, node) == false || StormBehaviorReadVarInt(ptr, end, service_count) == false)
+      {
+        return kIncomplete;
+      }
+
+      record.m_State.m_Node = static_cast<int>(StormBehaviorUnZigZag(node));
+      for(uint64_t index = 0; index < service_count; ++index)
+      {
+        uint64_t service_index;
+        if(StormBehaviorReadVarInt(ptr, end, service_index) == false)
+        {
+          return kIncomplete;
+        }
+
+        record.m_State.m_Services.push_back(static_cast<int>(service_index));
+      }
+
+      if(StormBehaviorReadVarInt(ptr, end, memory_size) == false || static_cast<uint64_t>(end - ptr) < memory_size)
+      {
+        return kIncomplete;
+      }
+
+      record.m_State.m_NodeMemory.assign(ptr, ptr + memory_size);
+      ptr += memory_size;
+    }
+  }
+
+  void ApplyFrame()
+  {
+    if(m_FrameIsKey)
+    {
+      m_Instances.clear();
+    }
+
+    for(auto & elem : m_Records)
+    {
+      if(elem.m_Removed)
+      {
+        m_Instances.erase(elem.m_InstanceId);
+      }
+      else
+      {
+        m_Instances[elem.m_InstanceId] = elem.m_State;
+      }
+    }
+
+    m_Tick = m_FrameTick;
+    m_KeyFrame = m_FrameIsKey;
+    m_FrameCount++;
+  }
+
+  struct Record
+  {
+    int m_InstanceId;
+    bool m_Removed = false;
+    InstanceState m_State;
+  };
+
+  std::vector<uint8_t> m_Buffer;
+  std::vector<Record> m_Records;
+  std::unordered_map<int, InstanceState> m_Instances;
+
+  bool m_ReadMagic = false;
+  bool m_Error = false;
+  bool m_FrameIsKey = false;
+  bool m_KeyFrame = false;
+  uint64_t m_FrameTick = 0;
+  uint64_t m_Tick = 0;
+  uint64_t m_FrameCount = 0;
+};
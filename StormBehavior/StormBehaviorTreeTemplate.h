@@ -1,393 +1,1841 @@
-#pragma once
-
-#include "StormBehaviorTreeTemplateBuilder.h"
-
-struct StormBehaviorTreeTemplateNode
-{
-  StormBehaviorNodeType m_Type;
-  int m_ConditionalStart;
-  int m_ConditionalEnd;
-  int m_ChildStart;
-  int m_ChildEnd;
-
-  union
-  {
-    int m_RandomStart;
-    int m_LeafIndex;
-  };
-};
-
-struct StormBehaviorTreeTemplateLeaf
-{
-  int m_ContinuousConditionalStart;
-  int m_ContinuousConditionalEnd;
-  int m_PreemptConditionalStart;
-  int m_PreemptConditionalEnd;
-  int m_ServiceStart;
-  int m_ServiceEnd;
-  int m_NextInSequence;
-};
-
-template <typename DataType, typename ContextType>
-class StormBehaviorTree;
-
-template <typename DataType, typename ContextType>
-class StormBehaviorTreeTemplate
-{
-public:
-  StormBehaviorTreeTemplate(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt)
-  {
-    std::vector<int> next_in_sequence_nodes;
-    std::vector<int> continuous_conditionals;
-    std::vector<int> preempt_conditionals;
-    std::vector<int> services;
-
-    int init_data_size = 0;
-    CalculateInitDataSize(bt, init_data_size);
-    m_InitDataMemory = std::make_unique<uint8_t[]>(init_data_size);
-
-    int copy_size = 0;
-    ProcessNode(bt, next_in_sequence_nodes, continuous_conditionals, preempt_conditionals, services, false, copy_size);
-  }
-
-  StormBehaviorTreeTemplate() = delete;
-  StormBehaviorTreeTemplate(const StormBehaviorTreeTemplate & rhs) = default;
-  StormBehaviorTreeTemplate(StormBehaviorTreeTemplate && rhs) = default;
-
-  StormBehaviorTreeTemplate & operator = (const StormBehaviorTreeTemplate & rhs) = default;
-  StormBehaviorTreeTemplate & operator = (StormBehaviorTreeTemplate && rhs) = default;
-
-  ~StormBehaviorTreeTemplate()
-  {
-    for(auto & elem : m_InitInfo)
-    {
-      auto * mem = m_InitDataMemory.get() + elem.m_InitOffset;
-      
-      if(elem.m_DestroyInitInfo)
-      {
-        elem.m_DestroyInitInfo(mem);
-      }
-    }
-  }
-
-  void DebugPrint()
-  {
-    if(m_Nodes.size() > 0)
-    {
-      DebugPrint(0, 0);
-    }
-  }
-
-private:
-
-  void AlignSize(int & size, int align)
-  {
-    // Implement this if alignment becomes a problem
-  }
-
-  template <typename Type>
-  void PushMemInit(const Type & val, const StormBehaviorTreeTemplateInitInfo & init_info, int mem_offset)
-  {    
-    m_InitInfo.emplace_back(MemInitInfo{ 
-      val.m_Allocate, 
-      val.m_Deallocate, 
-      init_info.m_Destructor,
-      val.m_Offset, 
-      mem_offset });
-
-    if(init_info.m_Copier)
-    {
-      void * dst_mem = m_InitDataMemory.get() + mem_offset;
-      init_info.m_Copier(init_info.m_Memory.get(), dst_mem);
-    }
-  }
-
-  void CalculateInitDataSize(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt, int & size)
-  {
-    for(auto & elem : bt.m_ConditionInitInfo)
-    {
-      AlignSize(size, static_cast<int>(elem.m_Alignment));
-      size += static_cast<int>(elem.m_Size);
-    }
-    
-    for(auto & elem : bt.m_ServiceInitInfo)
-    {
-      AlignSize(size, static_cast<int>(elem.m_Alignment));
-      size += static_cast<int>(elem.m_Size);
-    }  
-
-    if(bt.m_StateInitInfo.has_value())
-    {
-      AlignSize(size, static_cast<int>(bt.m_StateInitInfo->m_Alignment));
-      size += static_cast<int>(bt.m_StateInitInfo->m_Size);
-    }
-
-    for(auto & subtree : bt.m_Subtrees)
-    {
-      CalculateInitDataSize(*subtree.m_SubTree, size);
-    }
-  }
-
-  int ProcessNode(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt,
-    std::vector<int> & next_in_sequence_nodes, std::vector<int> & continuous_conditionals, 
-    std::vector<int> & preempt_conditionals, std::vector<int> & services, bool can_preempt, int & init_mem_offset)
-  {
-    auto node_index = static_cast<int>(m_Nodes.size());
-    m_Nodes.emplace_back();
-
-    auto & node = m_Nodes.back();
-    node.m_Type = bt.m_Type;
-
-    auto current_continuous_conditional_count = continuous_conditionals.size();
-    node.m_ConditionalStart = static_cast<int>(m_Conditionals.size());
-    for(int index = 0; index < static_cast<int>(bt.m_Conditionals.size()); ++index)
-    {
-      auto & elem = bt.m_Conditionals[index];
-      auto conditional_index = static_cast<int>(m_Conditionals.size());
-      m_Conditionals.emplace_back(elem);
-      AlignSize(m_TotalSize, m_Conditionals.back().m_Align);
-      m_Conditionals.back().m_Offset = m_TotalSize;
-      m_TotalSize += elem.m_Size;
-      
-      auto & init_info = bt.m_ConditionInitInfo[index];
-      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
-      PushMemInit(m_Conditionals.back(), init_info, init_mem_offset);
-      init_mem_offset += static_cast<int>(init_info.m_Size);
-
-      if(m_Conditionals.back().m_Continuous)
-      {
-        continuous_conditionals.push_back(conditional_index);
-      }
-    }
-    node.m_ConditionalEnd = static_cast<int>(m_Conditionals.size());
-
-    auto current_service_count = services.size();
-    for(int index = 0; index < static_cast<int>(bt.m_Services.size()); ++index)
-    {
-      auto & elem = bt.m_Services[index];
-      auto service_index = static_cast<int>(m_Services.size());
-      m_Services.emplace_back(elem);
-      AlignSize(m_TotalSize, m_Services.back().m_Align);
-      m_Services.back().m_Offset = m_TotalSize;
-      m_TotalSize += elem.m_Size;
-      
-      auto & init_info = bt.m_ServiceInitInfo[index];
-      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
-      PushMemInit(m_Services.back(), init_info, init_mem_offset);
-      init_mem_offset += static_cast<int>(init_info.m_Size);
-
-      services.emplace_back(service_index);
-    }
-
-    if(bt.m_Type == StormBehaviorNodeType::kLeaf)
-    {
-      auto leaf_index = static_cast<int>(m_Leaves.size());
-
-      node.m_ChildStart = -1;
-      node.m_ChildEnd = -1;
-      node.m_LeafIndex = leaf_index;
-      
-      m_States.emplace_back(bt.m_State.value());
-      AlignSize(m_TotalSize, m_States.back().m_Align);
-      m_States.back().m_Offset = m_TotalSize;
-      m_TotalSize += m_States.back().m_Size;
-
-      auto & init_info = bt.m_StateInitInfo.value();
-      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
-      PushMemInit(m_States.back(), init_info, init_mem_offset);
-      init_mem_offset += static_cast<int>(init_info.m_Size);
-
-      m_Leaves.emplace_back();
-      auto & leaf = m_Leaves.back();
-      leaf.m_NextInSequence = -1;
-      next_in_sequence_nodes.push_back(leaf_index);
-
-      leaf.m_ContinuousConditionalStart = static_cast<int>(m_ConditionalLookup.size());
-      for(auto & conditional_index : continuous_conditionals)
-      {
-        m_ConditionalLookup.emplace_back(conditional_index);
-      }
-      leaf.m_ContinuousConditionalEnd = static_cast<int>(m_ConditionalLookup.size());
-
-      leaf.m_PreemptConditionalStart = static_cast<int>(m_ConditionalLookup.size());
-      for(auto & conditional_index : preempt_conditionals)
-      {
-        m_ConditionalLookup.emplace_back(conditional_index);
-      }
-      leaf.m_PreemptConditionalEnd = static_cast<int>(m_ConditionalLookup.size());
-
-      leaf.m_ServiceStart = static_cast<int>(m_ServiceLookup.size());
-      for(auto & service_index : services)
-      {
-        m_ServiceLookup.emplace_back(service_index);
-      }
-      leaf.m_ServiceEnd = static_cast<int>(m_ServiceLookup.size());
-    }
-    else if(bt.m_Type == StormBehaviorNodeType::kSequence)
-    {
-      node.m_LeafIndex = -1;
-      node.m_ChildStart = static_cast<int>(m_ChildNodeLookup.size());
-      m_ChildNodeLookup.resize(m_ChildNodeLookup.size() + bt.m_Subtrees.size());
-      node.m_ChildEnd = static_cast<int>(m_ChildNodeLookup.size());
-
-      auto child_index = node.m_ChildStart;
-      std::vector<int> pending_next_in_sequence_nodes;
-
-      for(auto & elem : bt.m_Subtrees)
-      {
-        std::vector<int> new_next_in_sequence_nodes;
-        auto child_node_index = ProcessNode(*elem.m_SubTree, new_next_in_sequence_nodes, 
-          continuous_conditionals, preempt_conditionals, services, false, init_mem_offset);
-        m_ChildNodeLookup[child_index] = child_node_index;
-
-        for (auto & leaf_index : pending_next_in_sequence_nodes)
-        {
-          m_Leaves[leaf_index].m_NextInSequence = child_node_index;
-        }
-
-        pending_next_in_sequence_nodes = new_next_in_sequence_nodes;
-        child_index++;
-      }
-    }
-    else
-    {
-      node.m_LeafIndex = -1;
-      node.m_ChildStart = static_cast<int>(m_ChildNodeLookup.size());
-      m_ChildNodeLookup.resize(m_ChildNodeLookup.size() + bt.m_Subtrees.size());
-      node.m_ChildEnd = static_cast<int>(m_ChildNodeLookup.size());
-      
-      auto current_preempt_conditionals_size = static_cast<int>(preempt_conditionals.size());
-
-      auto child_index = node.m_ChildStart;
-      for(auto & elem : bt.m_Subtrees)
-      {
-        std::vector<int> new_next_in_sequence_nodes;
-        m_ChildNodeLookup[child_index] = ProcessNode(*elem.m_SubTree, next_in_sequence_nodes, 
-          continuous_conditionals, preempt_conditionals, services, bt.m_Type == StormBehaviorNodeType::kSelect, init_mem_offset);
-
-        child_index++;
-      }
-
-      preempt_conditionals.resize(current_preempt_conditionals_size);
-
-      if(bt.m_Type == StormBehaviorNodeType::kRandom)
-      {
-        node.m_RandomStart = static_cast<int>(m_RandomValues.size());
-
-        for(auto & elem : bt.m_Subtrees)
-        {
-          m_RandomValues.push_back(elem.m_RandomWeight);
-        }
-      }
-    }
-
-    continuous_conditionals.resize(current_continuous_conditional_count);
-    services.resize(current_service_count);
-
-    if(can_preempt)
-    {
-      for(int conditional_index = node.m_ConditionalStart; conditional_index < node.m_ConditionalEnd; ++conditional_index)
-      {
-        auto & conditional_info = m_Conditionals[conditional_index];
-
-        if(conditional_info.m_Preempt)
-        {
-          preempt_conditionals.push_back(conditional_index);
-        }
-      }
-  }
-
-    return node_index;
-  }
-
-  void DebugPrintIndent(int indent) const
-  {
-    for(int index = 0; index < indent; ++index)
-    {
-      printf(" ");
-    }
-  }
-
-  void DebugPrint(int indent, int node_index) const
-  {
-    DebugPrintIndent(indent);
-    auto & node = m_Nodes[node_index];
-
-    printf("- (%d) ", node_index);
-    switch(node.m_Type)
-    {
-      case StormBehaviorNodeType::kSelect:
-        printf("Select\n");
-        break;
-      case StormBehaviorNodeType::kSequence:
-        printf("Sequence\n");
-        break;
-      case StormBehaviorNodeType::kRandom:
-        printf("Random\n");
-        break;
-      case StormBehaviorNodeType::kLeaf:
-        {
-          auto & state_info = m_States[node.m_LeafIndex];
-          auto & leaf_info = m_Leaves[node.m_LeafIndex];
-          printf("Leaf (%d) (%s) -> (%d)\n", node.m_LeafIndex, state_info.m_DebugName, leaf_info.m_NextInSequence);
-        }
-        break;
-    }
-
-    for(int index = node.m_ConditionalStart; index < node.m_ConditionalEnd; ++index)
-    {
-      auto conditional_lookup = m_ConditionalLookup[index];
-      auto & conditional = m_Conditionals[conditional_lookup];
-
-      DebugPrintIndent(indent);
-      printf("|   (%d) Conditional (%s)\n", conditional_lookup, conditional.m_DebugName);
-    }
-
-    if(node.m_Type == StormBehaviorNodeType::kLeaf)
-    {
-      auto & leaf_info = m_Leaves[node.m_LeafIndex];
-      for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
-      {
-        auto service_lookup = m_ServiceLookup[index];
-        auto & service = m_Services[service_lookup];
-
-        DebugPrintIndent(indent);
-        printf("|   (%d) Service (%s)\n", service_lookup, service.m_DebugName);
-      }
-    }
-
-    for(int index = node.m_ChildStart; index < node.m_ChildEnd; ++index)
-    {
-      auto child_lookup = m_ChildNodeLookup[index];
-      DebugPrint(indent + 2, child_lookup);
-    }
-  }
-
-private:
-
-  friend class StormBehaviorTree<DataType, ContextType>;
-
-  std::vector<StormBehaviorTreeTemplateNode> m_Nodes;
-  std::vector<StormBehaviorTreeTemplateLeaf> m_Leaves;
-  std::vector<StormBehaviorTreeTemplateState<DataType, ContextType>> m_States;
-  std::vector<StormBehaviorTreeTemplateService<DataType, ContextType>> m_Services;
-  std::vector<StormBehaviorTreeTemplateConditional<DataType, ContextType>> m_Conditionals;
-  std::vector<int> m_ChildNodeLookup;
-  std::vector<int> m_ServiceLookup;
-  std::vector<int> m_ConditionalLookup;
-  std::vector<int> m_RandomValues;
-
-  struct MemInitInfo
-  {
-    void (*m_Allocate)(void *, void *);
-    void (*m_Deallocate)(void *);
-    void (*m_DestroyInitInfo)(void *);
-    int m_TargetOffset;
-    int m_InitOffset;
-  };
-
-  std::vector<MemInitInfo> m_InitInfo;
-  std::unique_ptr<uint8_t[]> m_InitDataMemory;
-  int m_TotalSize = 0;
-};
-
+#pragma once
+
+#include <cstring>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+#include "StormBehaviorTreeTemplateBuilder.h"
+#include "StormBehaviorTreeMemoryStats.h"
+#include "StormBehaviorTreeTransitionStats.h"
+
+struct StormBehaviorTreeTemplateNode
+{
+  StormBehaviorNodeType m_Type;
+  int m_ConditionalStart;
+  int m_ConditionalEnd;
+  int m_ChildStart;
+  int m_ChildEnd;
+
+  union
+  {
+    int m_RandomStart;
+    int m_ScorerStart;
+    int m_SwitchIndex;
+    int m_LeafIndex;
+  };
+};
+
+struct StormBehaviorTreeTemplateLeaf
+{
+  int m_ContinuousConditionalStart;
+  int m_ContinuousConditionalEnd;
+  int m_PreemptConditionalStart;
+  int m_PreemptConditionalEnd;
+  int m_ServiceStart;
+  int m_TimedServiceStart;
+  int m_ServiceEnd;
+  int m_NextInSequence;
+  bool m_PollWhileSleeping;
+};
+
+// Cases of a switch node whose keys are close enough together are a jump table indexed by key - m_KeyMin, with -1
+// for keys without a case.  Otherwise the cases are kept sorted by key and binary searched
+struct StormBehaviorTreeTemplateSwitch
+{
+  int m_KeyMin;
+  int m_CaseStart;
+  int m_CaseEnd;
+  int m_DefaultChild;
+  bool m_Dense;
+};
+
+struct StormBehaviorTreeTemplateSwitchCase
+{
+  int m_Key;
+  int m_Child;
+};
+
+// Hit counts recorded by instances that have a profile attached.  m_NodeHits counts traversal visits plus
+// ticks spent in each leaf, m_LeafTransitions is a leaf count x leaf count matrix indexed [from * count + to].
+// Counters are not atomic, so give each thread its own profile and Merge them afterwards
+struct StormBehaviorTreeProfile
+{
+  StormBehaviorTreeProfile() = default;
+  StormBehaviorTreeProfile(int node_count, int leaf_count) :
+    m_NodeHits(node_count), 
+    m_LeafTransitions(static_cast<std::size_t>(leaf_count) * leaf_count),
+    m_LeafCount(leaf_count)
+  {
+
+  }
+
+  void Merge(const StormBehaviorTreeProfile & rhs)
+  {
+    assert(m_NodeHits.size() == rhs.m_NodeHits.size() && m_LeafCount == rhs.m_LeafCount);
+    for(std::size_t index = 0; index < m_NodeHits.size(); ++index)
+    {
+      m_NodeHits[index] += rhs.m_NodeHits[index];
+    }
+
+    for(std::size_t index = 0; index < m_LeafTransitions.size(); ++index)
+    {
+      m_LeafTransitions[index] += rhs.m_LeafTransitions[index];
+    }
+  }
+
+  uint64_t GetTransitionCount(int from_leaf, int to_leaf) const
+  {
+    return m_LeafTransitions[static_cast<std::size_t>(from_leaf) * m_LeafCount + to_leaf];
+  }
+
+  std::vector<uint64_t> m_NodeHits;
+  std::vector<uint64_t> m_LeafTransitions;
+  int m_LeafCount = 0;
+};
+
+// Every Nth check of a conditional is timed while conditional stats are enabled
+static const int kStormBehaviorConditionalTimingInterval = 16;
+
+// Per conditional counters shared by every instance of a template.  Updated with relaxed atomics
+// from Evaluate, so the numbers are only approximate while instances are running
+struct alignas(64) StormBehaviorTreeConditionalStats
+{
+  StormBehaviorTreeConditionalStats() = default;
+  StormBehaviorTreeConditionalStats(const StormBehaviorTreeConditionalStats & rhs)
+  {
+    *this = rhs;
+  }
+
+  StormBehaviorTreeConditionalStats & operator = (const StormBehaviorTreeConditionalStats & rhs)
+  {
+    m_Evaluations.store(rhs.m_Evaluations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_Passes.store(rhs.m_Passes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_TimedEvaluations.store(rhs.m_TimedEvaluations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_TimedNanoseconds.store(rhs.m_TimedNanoseconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_DeclarationIndex = rhs.m_DeclarationIndex;
+    return *this;
+  }
+
+  double GetAverageCost() const
+  {
+    auto timed = m_TimedEvaluations.load(std::memory_order_relaxed);
+    return timed ? static_cast<double>(m_TimedNanoseconds.load(std::memory_order_relaxed)) / timed : 0.0;
+  }
+
+  double GetPassRate() const
+  {
+    auto evaluations = m_Evaluations.load(std::memory_order_relaxed);
+    return evaluations ? static_cast<double>(m_Passes.load(std::memory_order_relaxed)) / evaluations : 0.5;
+  }
+
+  std::atomic<uint64_t> m_Evaluations = { 0 };
+  std::atomic<uint64_t> m_Passes = { 0 };
+  std::atomic<uint64_t> m_TimedEvaluations = { 0 };
+  std::atomic<uint64_t> m_TimedNanoseconds = { 0 };
+  int m_DeclarationIndex = 0;
+};
+
+// Estimated conditional cost in nanoseconds over all recorded group evaluations, for the groups in the 
+// order they were declared and in the order they are evaluated now
+struct StormBehaviorTreeConditionalOrderReport
+{
+  double m_DeclaredCost = 0.0;
+  double m_CurrentCost = 0.0;
+  int m_ReorderedGroups = 0;
+
+  double GetSavings() const
+  {
+    return m_DeclaredCost - m_CurrentCost;
+  }
+};
+
+struct StormBehaviorTreeMemoryRegion
+{
+  int m_Offset;
+  int m_Size;
+};
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTree;
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeTemplate
+{
+public:
+
+  using ScorerType = StormBehaviorTreeTemplateScorer<DataType, ContextType>;
+  using SwitchKeyType = StormBehaviorTreeTemplateSwitchKey<DataType, ContextType>;
+  StormBehaviorTreeTemplate(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt)
+  {
+    std::vector<int> next_in_sequence_nodes;
+    std::vector<int> continuous_conditionals;
+    std::vector<int> preempt_conditionals;
+    std::vector<int> services;
+
+    int init_data_size = 0;
+    CalculateInitDataSize(bt, init_data_size);
+    m_InitDataMemory = std::make_unique<uint8_t[]>(init_data_size);
+    m_InitDataSize = init_data_size;
+
+    int copy_size = 0;
+    ProcessNode(bt, next_in_sequence_nodes, continuous_conditionals, preempt_conditionals, services, false, copy_size);
+
+    std::stable_sort(m_EventNodes.begin(), m_EventNodes.end(), [](auto & a, auto & b) { return a.m_EventId < b.m_EventId; });
+    AssignConditionalMemoSlots();
+  }
+
+  StormBehaviorTreeTemplate() = delete;
+  StormBehaviorTreeTemplate(const StormBehaviorTreeTemplate & rhs) = default;
+  StormBehaviorTreeTemplate(StormBehaviorTreeTemplate && rhs) = default;
+
+  StormBehaviorTreeTemplate & operator = (const StormBehaviorTreeTemplate & rhs) = default;
+  StormBehaviorTreeTemplate & operator = (StormBehaviorTreeTemplate && rhs) = default;
+
+  ~StormBehaviorTreeTemplate()
+  {
+    for(auto & elem : m_InitInfo)
+    {
+      auto * mem = m_InitDataMemory.get() + elem.m_InitOffset;
+      
+      if(elem.m_DestroyInitInfo)
+      {
+        elem.m_DestroyInitInfo(mem);
+      }
+    }
+
+    for(auto & elem : m_StateInitInfo)
+    {
+      if(elem.m_DestroyInitInfo)
+      {
+        elem.m_DestroyInitInfo(m_InitDataMemory.get() + elem.m_InitOffset);
+      }
+    }
+
+    for(auto & elem : m_Scorers)
+    {
+      if(elem.m_Destroy)
+      {
+        elem.m_Destroy(m_InitDataMemory.get() + elem.m_InitDataOffset);
+      }
+    }
+
+    for(auto & elem : m_SwitchKeys)
+    {
+      if(elem.m_Destroy)
+      {
+        elem.m_Destroy(m_InitDataMemory.get() + elem.m_InitDataOffset);
+      }
+    }
+  }
+
+  void DebugPrint()
+  {
+    if(m_Nodes.size() > 0)
+    {
+      DebugPrint(0, 0);
+    }
+  }
+
+  StormBehaviorTreeTemplateMemoryStats GetMemoryStats() const
+  {
+    StormBehaviorTreeTemplateMemoryStats stats;
+    stats.m_NodeBytes = StormBehaviorGetVectorBytes(m_Nodes) + StormBehaviorGetVectorBytes(m_Leaves);
+    stats.m_ElementBytes = StormBehaviorGetVectorBytes(m_States) + StormBehaviorGetVectorBytes(m_Services) + 
+      StormBehaviorGetVectorBytes(m_Conditionals) + StormBehaviorGetVectorBytes(m_ConditionalTerms);
+    stats.m_LookupBytes = StormBehaviorGetVectorBytes(m_ChildNodeLookup) + StormBehaviorGetVectorBytes(m_ServiceLookup) +
+      StormBehaviorGetVectorBytes(m_ConditionalLookup) + StormBehaviorGetVectorBytes(m_RandomValues) +
+      StormBehaviorGetVectorBytes(m_Scorers) + StormBehaviorGetVectorBytes(m_NodeNames) + StormBehaviorGetVectorBytes(m_EventNodes) +
+      StormBehaviorGetVectorBytes(m_ParamSlots) + StormBehaviorGetVectorBytes(m_ParamDefaults) +
+      StormBehaviorGetVectorBytes(m_ConditionalProgram) + StormBehaviorGetVectorBytes(m_Switches) +
+      StormBehaviorGetVectorBytes(m_SwitchKeys) + StormBehaviorGetVectorBytes(m_SwitchTable) + StormBehaviorGetVectorBytes(m_SwitchCases);
+    stats.m_InitInfoBytes = StormBehaviorGetVectorBytes(m_InitInfo) + StormBehaviorGetVectorBytes(m_StateInitInfo);
+    stats.m_InitDataBytes = static_cast<std::size_t>(m_InitDataSize);
+    stats.m_SlackBytes = 
+      StormBehaviorGetVectorSlack(m_Nodes) + StormBehaviorGetVectorSlack(m_Leaves) +
+      StormBehaviorGetVectorSlack(m_States) + StormBehaviorGetVectorSlack(m_Services) + StormBehaviorGetVectorSlack(m_Conditionals) +
+      StormBehaviorGetVectorSlack(m_ChildNodeLookup) + StormBehaviorGetVectorSlack(m_ServiceLookup) +
+      StormBehaviorGetVectorSlack(m_ConditionalLookup) + StormBehaviorGetVectorSlack(m_RandomValues) +
+      StormBehaviorGetVectorSlack(m_Scorers) + StormBehaviorGetVectorSlack(m_NodeNames) + StormBehaviorGetVectorSlack(m_EventNodes) +
+      StormBehaviorGetVectorSlack(m_InitInfo) + StormBehaviorGetVectorSlack(m_StateInitInfo) + StormBehaviorGetVectorSlack(m_ConditionalTerms) +
+      StormBehaviorGetVectorSlack(m_ConditionalProgram) + StormBehaviorGetVectorSlack(m_Switches) + StormBehaviorGetVectorSlack(m_SwitchKeys) +
+      StormBehaviorGetVectorSlack(m_SwitchTable) + StormBehaviorGetVectorSlack(m_SwitchCases);
+    stats.m_InstanceBytes = static_cast<std::size_t>(m_TotalSize);
+
+    AddTypeMemoryStats(stats.m_Types, m_States, StormBehaviorTreeElementType::kState);
+    AddTypeMemoryStats(stats.m_Types, m_Services, StormBehaviorTreeElementType::kService);
+    AddTypeMemoryStats(stats.m_Types, m_Conditionals, StormBehaviorTreeElementType::kConditional);
+    return stats;
+  }
+
+  // Parameter blocks point at the template's slot table, so they are only valid while the template is alive
+  StormBehaviorTreeParamBlock CreateParamBlock() const
+  {
+    return StormBehaviorTreeParamBlock(&m_ParamSlots, m_ParamDefaults);
+  }
+
+  int GetParamCount() const
+  {
+    return static_cast<int>(m_ParamSlots.size());
+  }
+
+  int FindParam(const char * name) const
+  {
+    for(int index = 0; index < static_cast<int>(m_ParamSlots.size()); ++index)
+    {
+      if(strcmp(m_ParamSlots[index].m_Name, name) == 0)
+      {
+        return index;
+      }
+    }
+
+    return -1;
+  }
+
+  const StormBehaviorTreeParamSlot & GetParamSlot(int slot) const
+  {
+    return m_ParamSlots[slot];
+  }
+
+  int FindNode(const char * name) const
+  {
+    for(int index = 0; index < static_cast<int>(m_NodeNames.size()); ++index)
+    {
+      if(m_NodeNames[index] && strcmp(m_NodeNames[index], name) == 0)
+      {
+        return index;
+      }
+    }
+
+    return -1;
+  }
+
+  int GetScorerCount() const
+  {
+    return static_cast<int>(m_Scorers.size());
+  }
+
+  // Scores a batch of instances against one scorer, writing one score per instance
+  void ScoreBatch(int scorer_index, const DataType * const * data_types, int count, const ContextType & context, float * out_scores) const
+  {
+    auto & scorer = m_Scorers[scorer_index];
+    if(scorer.m_ScoreBatch == nullptr)
+    {
+      std::fill(out_scores, out_scores + count, 0.0f);
+      return;
+    }
+
+    scorer.m_ScoreBatch(m_InitDataMemory.get() + scorer.m_InitDataOffset, data_types, count, context, out_scores);
+  }
+
+  // True if the conditional has its own CheckBatch kernel
+  bool HasCheckBatch(int conditional_index) const
+  {
+    return m_Conditionals[conditional_index].m_CheckBatch != nullptr;
+  }
+
+  // Checks one conditional for a batch of instances.  ptrs[i] is the conditional in the node memory of instance i,
+  // and the result for instance i goes in bit i % 64 of out_bits[i / 64].  Conditionals without a CheckBatch are
+  // checked one at a time
+  void CheckBatch(int conditional_index, void * const * ptrs, const DataType * const * data_types, int count, 
+    const ContextType & context, uint64_t * out_bits) const
+  {
+    auto & conditional = m_Conditionals[conditional_index];
+    if(conditional.m_CheckBatch)
+    {
+      conditional.m_CheckBatch(ptrs, data_types, count, context, out_bits);
+      return;
+    }
+
+    std::fill(out_bits, out_bits + (count + 63) / 64, 0);
+    for(int index = 0; index < count; ++index)
+    {
+      if(RunConditional(conditional, ptrs[index], *data_types[index], context))
+      {
+        out_bits[index / 64] |= 1ULL << (index % 64);
+      }
+    }
+  }
+
+  bool HasEventNodes() const
+  {
+    return m_EventNodes.size() > 0;
+  }
+
+  bool ListensToEvent(int event_id) const
+  {
+    auto itr = std::lower_bound(m_EventNodes.begin(), m_EventNodes.end(), event_id, 
+      [](auto & elem, int event_id) { return elem.m_EventId < event_id; });
+    return itr != m_EventNodes.end() && itr->m_EventId == event_id;
+  }
+
+  template <typename Callback>
+  void VisitEventNodes(int event_id, Callback && callback) const
+  {
+    auto itr = std::lower_bound(m_EventNodes.begin(), m_EventNodes.end(), event_id, 
+      [](auto & elem, int event_id) { return elem.m_EventId < event_id; });
+
+    for(; itr != m_EventNodes.end() && itr->m_EventId == event_id; ++itr)
+    {
+      callback(itr->m_NodeIndex);
+    }
+  }
+
+  // Number of distinct pure conditionals that appear more than once in the template, plus the conditionals
+  // with a CheckBatch.  Each is checked at most once per Evaluate and the result is shared by every occurrence
+  int GetConditionalMemoSlotCount() const
+  {
+    return m_ConditionalMemoSlotCount;
+  }
+
+  // Services added with AddTimedService.  Each instance keeps the tick each one is next due on
+  int GetTimedServiceCount() const
+  {
+    return m_TimedServiceCount;
+  }
+
+  StormBehaviorTreeProfile CreateProfile() const
+  {
+    return StormBehaviorTreeProfile(static_cast<int>(m_Nodes.size()), static_cast<int>(m_Leaves.size()));
+  }
+
+  // Reorders the node array, the child lookup table and the instance memory layout from recorded hit counts
+  // so that hot nodes, and the conditionals, state and services of leaves that are evaluated together, end 
+  // up next to each other.  The order of children within each node is unchanged, so traversal results are 
+  // identical.  Must be run before any instances are created from the template, and invalidates the node 
+  // indices in the profile
+  void ApplyProfileLayout(const StormBehaviorTreeProfile & profile)
+  {
+    auto node_count = static_cast<int>(m_Nodes.size());
+    assert(static_cast<int>(profile.m_NodeHits.size()) == node_count && profile.m_LeafCount == static_cast<int>(m_Leaves.size()));
+
+    if(node_count == 0)
+    {
+      return;
+    }
+
+    std::vector<int> leaf_nodes(m_Leaves.size());
+    for(int node_index = 0; node_index < node_count; ++node_index)
+    {
+      if(m_Nodes[node_index].m_Type == StormBehaviorNodeType::kLeaf)
+      {
+        leaf_nodes[m_Nodes[node_index].m_LeafIndex] = node_index;
+      }
+    }
+
+    // Hottest nodes first, with the root pinned at zero.  After a leaf is placed, follow its most common 
+    // transition so leaves that run back to back sit together
+    std::vector<int> hot_nodes;
+    for(int node_index = 1; node_index < node_count; ++node_index)
+    {
+      hot_nodes.push_back(node_index);
+    }
+
+    std::stable_sort(hot_nodes.begin(), hot_nodes.end(), [&](int a, int b) { return profile.m_NodeHits[a] > profile.m_NodeHits[b]; });
+
+    std::vector<int> node_order = { 0 };
+    std::vector<bool> placed(node_count, false);
+    placed[0] = true;
+
+    for(auto hot_node : hot_nodes)
+    {
+      auto node_index = hot_node;
+      while(node_index != -1 && placed[node_index] == false)
+      {
+        node_order.push_back(node_index);
+        placed[node_index] = true;
+
+        auto & node = m_Nodes[node_index];
+        if(node.m_Type != StormBehaviorNodeType::kLeaf)
+        {
+          break;
+        }
+
+        node_index = -1;
+        uint64_t best_count = 0;
+        for(int leaf_index = 0; leaf_index < profile.m_LeafCount; ++leaf_index)
+        {
+          auto count = profile.GetTransitionCount(node.m_LeafIndex, leaf_index);
+          if(count > best_count && placed[leaf_nodes[leaf_index]] == false)
+          {
+            best_count = count;
+            node_index = leaf_nodes[leaf_index];
+          }
+        }
+      }
+    }
+
+    std::vector<int> node_remap(node_count);
+    for(int index = 0; index < node_count; ++index)
+    {
+      node_remap[node_order[index]] = index;
+    }
+
+    // Lay out the instance memory in the same order
+    LayoutInstanceMemory(node_order);
+
+    // Rebuild the node array and child lookups in the new order
+    std::vector<StormBehaviorTreeTemplateNode> nodes;
+    std::vector<int> child_node_lookup;
+    nodes.reserve(m_Nodes.size());
+    child_node_lookup.reserve(m_ChildNodeLookup.size());
+
+    for(auto node_index : node_order)
+    {
+      auto node = m_Nodes[node_index];
+      if(node.m_ChildStart != -1)
+      {
+        auto child_start = static_cast<int>(child_node_lookup.size());
+        for(int index = node.m_ChildStart; index < node.m_ChildEnd; ++index)
+        {
+          child_node_lookup.push_back(node_remap[m_ChildNodeLookup[index]]);
+        }
+
+        node.m_ChildStart = child_start;
+        node.m_ChildEnd = static_cast<int>(child_node_lookup.size());
+      }
+
+      nodes.push_back(node);
+    }
+
+    for(auto & elem : m_Leaves)
+    {
+      if(elem.m_NextInSequence != -1)
+      {
+        elem.m_NextInSequence = node_remap[elem.m_NextInSequence];
+      }
+    }
+
+    std::vector<const char *> node_names;
+    for(auto node_index : node_order)
+    {
+      node_names.push_back(m_NodeNames[node_index]);
+    }
+
+    for(auto & elem : m_EventNodes)
+    {
+      elem.m_NodeIndex = node_remap[elem.m_NodeIndex];
+    }
+
+    for(auto & elem : m_Switches)
+    {
+      if(elem.m_DefaultChild != -1)
+      {
+        elem.m_DefaultChild = node_remap[elem.m_DefaultChild];
+      }
+    }
+
+    for(auto & elem : m_SwitchTable)
+    {
+      if(elem != -1)
+      {
+        elem = node_remap[elem];
+      }
+    }
+
+    for(auto & elem : m_SwitchCases)
+    {
+      elem.m_Child = node_remap[elem.m_Child];
+    }
+
+    m_Nodes = std::move(nodes);
+    m_ChildNodeLookup = std::move(child_node_lookup);
+    m_NodeNames = std::move(node_names);
+  }
+
+  // Constructs each leaf's state when the leaf is activated and destroys it when the leaf is left, instead of
+  // keeping every state alive for the life of the instance.  Only one leaf is active at a time, so all states
+  // share one slot in node memory the size of the largest state.  Conditionals and services are still built
+  // up front.  States are constructed with the param block the instance was made with, which then has to
+  // outlive the instance.  Must be run before any instances are created from the template.  Fails if some states
+  // are replicated and others aren't, since the shared slot is replicated as raw bytes whichever state is in it
+  bool EnableLazyStates()
+  {
+    if(m_LazyStates)
+    {
+      return true;
+    }
+
+    if(m_Nodes.empty())
+    {
+      return false;
+    }
+
+    auto replicated = std::count_if(m_States.begin(), m_States.end(), [](auto & elem) { return elem.m_Replicated; });
+    if(replicated != 0 && replicated != static_cast<std::ptrdiff_t>(m_States.size()))
+    {
+      return false;
+    }
+
+    m_LazyStates = true;
+    m_StateInitInfo.resize(m_States.size());
+
+    for(int leaf_index = 0; leaf_index < static_cast<int>(m_States.size()); ++leaf_index)
+    {
+      auto & state = m_States[leaf_index];
+      auto itr = std::find_if(m_InitInfo.begin(), m_InitInfo.end(), [&](auto & elem) { return elem.m_TargetOffset == state.m_Offset; });
+      assert(itr != m_InitInfo.end());
+
+      m_StateInitInfo[leaf_index] = *itr;
+      m_InitInfo.erase(itr);
+
+      m_StateSlotSize = std::max(m_StateSlotSize, state.m_Size);
+      m_StateSlotAlign = std::max(m_StateSlotAlign, state.m_Align);
+    }
+
+    std::vector<int> node_order(m_Nodes.size());
+    for(int index = 0; index < static_cast<int>(node_order.size()); ++index)
+    {
+      node_order[index] = index;
+    }
+
+    LayoutInstanceMemory(node_order);
+    return true;
+  }
+
+  bool HasLazyStates() const
+  {
+    return m_LazyStates;
+  }
+
+  // Starts recording the cost and pass rate of every conditional.  Instances pick this up on their next Evaluate
+  void EnableConditionalStats()
+  {
+    if(m_ConditionalStats.size() == m_Conditionals.size())
+    {
+      return;
+    }
+
+    m_ConditionalStats = std::vector<StormBehaviorTreeConditionalStats>(m_Conditionals.size());
+    for(int index = 0; index < static_cast<int>(m_ConditionalStats.size()); ++index)
+    {
+      m_ConditionalStats[index].m_DeclarationIndex = index;
+    }
+  }
+
+  bool HasConditionalStats() const
+  {
+    return m_ConditionalStats.empty() == false;
+  }
+
+  const StormBehaviorTreeConditionalStats & GetConditionalStats(int conditional_index) const
+  {
+    return m_ConditionalStats[conditional_index];
+  }
+
+  // Starts recording leaf transitions, leaf dwell times and which conditionals knock instances out of their leaf.
+  // Dwell times are counted in updates, plus the ticks spent asleep when the instance runs in a world.  Must
+  // not be called while instances of the template are updating
+  void EnableTransitionStats(int shard_count = 16)
+  {
+    if(m_TransitionStats)
+    {
+      return;
+    }
+
+    m_TransitionStats = std::make_unique<StormBehaviorTreeTransitionStats>(
+      static_cast<int>(m_Leaves.size()), static_cast<int>(m_Conditionals.size()), shard_count);
+  }
+
+  bool HasTransitionStats() const
+  {
+    return m_TransitionStats != nullptr;
+  }
+
+  StormBehaviorTreeTransitionSnapshot GetTransitionSnapshot() const
+  {
+    return m_TransitionStats ? m_TransitionStats->GetSnapshot() : StormBehaviorTreeTransitionSnapshot{};
+  }
+
+  void ResetTransitionStats()
+  {
+    if(m_TransitionStats)
+    {
+      m_TransitionStats->Reset();
+    }
+  }
+
+  int GetLeafCount() const
+  {
+    return static_cast<int>(m_Leaves.size());
+  }
+
+  int GetConditionalCount() const
+  {
+    return static_cast<int>(m_Conditionals.size());
+  }
+
+  // Index the conditional had when the template was built.  Unlike the conditional index it does not change 
+  // when UpdateConditionalOrder reorders the conditionals
+  int GetConditionalDeclarationIndex(int conditional_index) const
+  {
+    return m_Conditionals[conditional_index].m_DeclarationIndex;
+  }
+
+  int GetConditionalMemoSlot(int conditional_index) const
+  {
+    return m_Conditionals[conditional_index].m_MemoSlot;
+  }
+
+  // True if both conditionals are pure, of the same type and built from equal init data, so they always return 
+  // the same result for the same data and context.  other can be this template
+  bool IsSameConditional(int conditional_index, const StormBehaviorTreeTemplate & other, int other_index) const
+  {
+    auto & conditional = m_Conditionals[conditional_index];
+    auto & other_conditional = other.m_Conditionals[other_index];
+
+    if(conditional.m_Pure == false || other_conditional.m_Pure == false || conditional.m_InitDataEqual == nullptr ||
+       conditional.m_TypeId != other_conditional.m_TypeId || conditional.m_InitDataEqual != other_conditional.m_InitDataEqual)
+    {
+      return false;
+    }
+
+    return conditional.m_InitDataEqual(m_InitDataMemory.get() + conditional.m_InitDataOffset, 
+                                       other.m_InitDataMemory.get() + other_conditional.m_InitDataOffset);
+  }
+
+  // Reorders each group of conditionals that is checked with short circuiting (a node's conditionals, a leaf's
+  // continuous conditionals and a leaf's preempt conditionals) so the conditional with the lowest cost per
+  // chance of ending the group runs first.  Groups are only reordered when every conditional in them is
+  // declared pure (static constexpr bool kPure = true), since skipping a check could otherwise change
+  // behavior.  Must not run while instances of the template are being evaluated
+  void UpdateConditionalOrder()
+  {
+    if(m_ConditionalStats.empty())
+    {
+      return;
+    }
+
+    auto conditional_count = static_cast<int>(m_Conditionals.size());
+    std::vector<int> order(conditional_count);
+    for(int index = 0; index < conditional_count; ++index)
+    {
+      order[index] = index;
+    }
+
+    for(auto & node : m_Nodes)
+    {
+      SortConditionalGroup(order.begin() + node.m_ConditionalStart, order.begin() + node.m_ConditionalEnd, false);
+    }
+
+    std::vector<int> conditional_remap(conditional_count);
+    for(int index = 0; index < conditional_count; ++index)
+    {
+      conditional_remap[order[index]] = index;
+    }
+
+    // Node conditionals are stored in evaluation order, so move the descriptors and their stats around
+    std::vector<StormBehaviorTreeTemplateConditional<DataType, ContextType>> conditionals;
+    std::vector<StormBehaviorTreeConditionalStats> conditional_stats;
+    conditionals.reserve(conditional_count);
+    conditional_stats.reserve(conditional_count);
+
+    for(auto index : order)
+    {
+      conditionals.emplace_back(std::move(m_Conditionals[index]));
+      conditional_stats.emplace_back(m_ConditionalStats[index]);
+    }
+
+    m_Conditionals = std::move(conditionals);
+    m_ConditionalStats = std::move(conditional_stats);
+
+    if(m_TransitionStats)
+    {
+      m_TransitionStats->RemapConditionals(order);
+    }
+
+    for(auto & elem : m_ConditionalLookup)
+    {
+      elem = conditional_remap[elem];
+    }
+
+    for(auto & leaf : m_Leaves)
+    {
+      SortConditionalGroup(m_ConditionalLookup.begin() + leaf.m_ContinuousConditionalStart, 
+        m_ConditionalLookup.begin() + leaf.m_ContinuousConditionalEnd, false);
+      SortConditionalGroup(m_ConditionalLookup.begin() + leaf.m_PreemptConditionalStart, 
+        m_ConditionalLookup.begin() + leaf.m_PreemptConditionalEnd, true);
+    }
+  }
+
+  StormBehaviorTreeConditionalOrderReport GetConditionalOrderReport() const
+  {
+    StormBehaviorTreeConditionalOrderReport report;
+    if(m_ConditionalStats.empty())
+    {
+      return report;
+    }
+
+    std::vector<int> group;
+    auto add_group = [&](bool stop_on_pass)
+    {
+      if(group.size() < 2)
+      {
+        return;
+      }
+
+      // Every evaluation of the group checks its first conditional, so the highest evaluation count is the group count
+      uint64_t group_evaluations = 0;
+      for(auto index : group)
+      {
+        group_evaluations = std::max(group_evaluations, m_ConditionalStats[index].m_Evaluations.load(std::memory_order_relaxed));
+      }
+
+      auto current_cost = GetExpectedGroupCost(group, stop_on_pass);
+      std::sort(group.begin(), group.end(), 
+        [&](int a, int b) { return m_ConditionalStats[a].m_DeclarationIndex < m_ConditionalStats[b].m_DeclarationIndex; });
+      auto declared_cost = GetExpectedGroupCost(group, stop_on_pass);
+
+      report.m_CurrentCost += current_cost * group_evaluations;
+      report.m_DeclaredCost += declared_cost * group_evaluations;
+
+      if(current_cost != declared_cost)
+      {
+        report.m_ReorderedGroups++;
+      }
+    };
+
+    for(auto & node : m_Nodes)
+    {
+      group.clear();
+      for(int index = node.m_ConditionalStart; index < node.m_ConditionalEnd; ++index)
+      {
+        group.push_back(index);
+      }
+
+      add_group(false);
+    }
+
+    for(auto & leaf : m_Leaves)
+    {
+      group.assign(m_ConditionalLookup.begin() + leaf.m_ContinuousConditionalStart, m_ConditionalLookup.begin() + leaf.m_ContinuousConditionalEnd);
+      add_group(false);
+
+      group.assign(m_ConditionalLookup.begin() + leaf.m_PreemptConditionalStart, m_ConditionalLookup.begin() + leaf.m_PreemptConditionalEnd);
+      add_group(true);
+    }
+
+    return report;
+  }
+
+  std::size_t GetInstanceMemorySize() const
+  {
+    return static_cast<std::size_t>(m_TotalSize);
+  }
+
+  bool IsTriviallyRelocatable() const
+  {
+    return m_TriviallyRelocatable;
+  }
+
+  // True if every element can be moved to a new address, either with memcpy or with its move constructor
+  bool IsRelocatable() const
+  {
+    auto relocatable = [](auto & elem) { return elem.m_Relocate != nullptr; };
+    return m_TriviallyRelocatable || (std::all_of(m_InitInfo.begin(), m_InitInfo.end(), relocatable) &&
+      std::all_of(m_StateInitInfo.begin(), m_StateInitInfo.end(), relocatable));
+  }
+
+  // Moves the elements of one instance's node memory from src to dst.  The memory at src is left unconstructed
+  void RelocateInstanceMemory(void * dst, void * src) const
+  {
+    if(m_TriviallyRelocatable)
+    {
+      memcpy(dst, src, m_TotalSize);
+      return;
+    }
+
+    for(auto & elem : m_InitInfo)
+    {
+      assert(elem.m_Relocate);
+      elem.m_Relocate(static_cast<uint8_t *>(dst) + elem.m_TargetOffset, static_cast<uint8_t *>(src) + elem.m_TargetOffset);
+    }
+  }
+
+  // The shared lazy state slot if its states are replicated, otherwise an empty region
+  StormBehaviorTreeMemoryRegion GetReplicatedStateSlot() const
+  {
+    if(m_LazyStates == false || m_States.empty() || m_States[0].m_Replicated == false)
+    {
+      return StormBehaviorTreeMemoryRegion{ 0, 0 };
+    }
+
+    return StormBehaviorTreeMemoryRegion{ m_StateInitInfo[0].m_TargetOffset, m_StateSlotSize };
+  }
+
+  // Node memory of the elements declared with kReplicated, in memory order
+  std::vector<StormBehaviorTreeMemoryRegion> GetReplicatedRegions() const
+  {
+    std::vector<StormBehaviorTreeMemoryRegion> regions;
+    auto add_regions = [&](auto & elements)
+    {
+      for(auto & elem : elements)
+      {
+        if(elem.m_Replicated)
+        {
+          regions.emplace_back(StormBehaviorTreeMemoryRegion{ elem.m_Offset, elem.m_Size });
+        }
+      }
+    };
+
+    if(m_LazyStates)
+    {
+      // The slot holds whichever state is active, and either every state is replicated or none are
+      auto slot = GetReplicatedStateSlot();
+      if(slot.m_Size > 0)
+      {
+        regions.emplace_back(slot);
+      }
+    }
+    else
+    {
+      add_regions(m_States);
+    }
+
+    add_regions(m_Services);
+    add_regions(m_Conditionals);
+
+    std::sort(regions.begin(), regions.end(), [](auto & a, auto & b) { return a.m_Offset < b.m_Offset; });
+    return regions;
+  }
+
+  // True if every element is trivially copyable or has a StormBehaviorTreeSerializer
+  bool IsSerializable() const
+  {
+    auto serializable = [](auto & elem) { return elem.m_Save != nullptr; };
+    return std::all_of(m_InitInfo.begin(), m_InitInfo.end(), serializable) && 
+      std::all_of(m_StateInitInfo.begin(), m_StateInitInfo.end(), serializable);
+  }
+
+  // Appends the elements in node memory to buffer.  When every element is saved as raw bytes the whole block 
+  // is written with one copy
+  void SaveInstanceMemory(const void * memory, StormBehaviorTreeWriteBuffer & buffer) const
+  {
+    if(m_RawSerializable)
+    {
+      buffer.Write(memory, m_TotalSize);
+      return;
+    }
+
+    for(auto & elem : m_InitInfo)
+    {
+      assert(elem.m_Save);
+      elem.m_Save(static_cast<const uint8_t *>(memory) + elem.m_TargetOffset, buffer);
+    }
+  }
+
+  // Constructs every element in memory from data written by SaveInstanceMemory on the same template, without 
+  // running the normal init
+  void LoadInstanceMemory(void * memory, StormBehaviorTreeReadBuffer & buffer) const
+  {
+    if(m_RawSerializable)
+    {
+      buffer.Read(memory, m_TotalSize);
+      return;
+    }
+
+    for(auto & elem : m_InitInfo)
+    {
+      assert(elem.m_Load);
+      elem.m_Load(static_cast<uint8_t *>(memory) + elem.m_TargetOffset, buffer);
+    }
+  }
+
+  std::size_t GetInstancePaddingBytes() const
+  {
+    std::size_t element_size = m_LazyStates ? m_StateSlotSize : 0;
+    for(auto & elem : m_States)
+    {
+      element_size += m_LazyStates ? 0 : elem.m_Size;
+    }
+
+    for(auto & elem : m_Services)
+    {
+      element_size += elem.m_Size;
+    }
+
+    for(auto & elem : m_Conditionals)
+    {
+      element_size += elem.m_Size;
+    }
+
+    return static_cast<std::size_t>(m_TotalSize) - element_size;
+  }
+
+private:
+
+  // Checks a conditional in its node memory.  Expressions run their program, which pushes each term's result
+  // onto a bit stack and combines the top two bits with bit operations
+  bool RunConditional(const StormBehaviorTreeTemplateConditional<DataType, ContextType> & conditional, void * ptr,
+    const DataType & data, const ContextType & context) const
+  {
+    if(conditional.m_ProgramStart == conditional.m_ProgramEnd)
+    {
+      return conditional.m_Check(ptr, data, context);
+    }
+
+    auto terms = m_ConditionalTerms.data() + conditional.m_TermStart;
+    uint64_t stack = 0;
+    for(int index = conditional.m_ProgramStart; index < conditional.m_ProgramEnd; ++index)
+    {
+      auto & op = m_ConditionalProgram[index];
+      auto top = stack & 1;
+
+      switch(op.m_Op)
+      {
+        case StormBehaviorConditionalOp::kCheck:
+        {
+          auto & term = terms[op.m_Term];
+          stack = (stack << 1) | (term.m_Check(static_cast<uint8_t *>(ptr) + term.m_Offset, data, context) ? 1 : 0);
+          break;
+        }
+        case StormBehaviorConditionalOp::kNot:
+          stack ^= 1;
+          break;
+        case StormBehaviorConditionalOp::kAnd:
+          stack = (stack >> 1) & (~1ULL | top);
+          break;
+        case StormBehaviorConditionalOp::kOr:
+          stack = (stack >> 1) | top;
+          break;
+      }
+    }
+
+    return (stack & 1) != 0;
+  }
+
+  // Packs the instance memory in node order.  Elements of each node are placed together, leaf conditionals
+  // first, then the state and the leaf's services
+  void LayoutInstanceMemory(const std::vector<int> & node_order)
+  {
+    std::vector<int> offset_remap(m_TotalSize, -1);
+    int total_size = 0;
+
+    auto place_element = [&](const auto & elem)
+    {
+      if(offset_remap[elem.m_Offset] != -1)
+      {
+        return;
+      }
+
+      AlignSize(total_size, elem.m_Align);
+      offset_remap[elem.m_Offset] = total_size;
+      total_size += elem.m_Size;
+    };
+
+    // Lazy states all go in one slot, placed where the first state would have been
+    int state_slot = -1;
+    auto place_state = [&](const auto & elem)
+    {
+      if(m_LazyStates == false)
+      {
+        place_element(elem);
+        return;
+      }
+
+      if(state_slot == -1)
+      {
+        AlignSize(total_size, m_StateSlotAlign);
+        state_slot = total_size;
+        total_size += m_StateSlotSize;
+      }
+
+      offset_remap[elem.m_Offset] = state_slot;
+    };
+
+    for(auto node_index : node_order)
+    {
+      auto & node = m_Nodes[node_index];
+      if(node.m_Type == StormBehaviorNodeType::kLeaf)
+      {
+        auto & leaf = m_Leaves[node.m_LeafIndex];
+        for(int index = leaf.m_ContinuousConditionalStart; index < leaf.m_PreemptConditionalEnd; ++index)
+        {
+          place_element(m_Conditionals[m_ConditionalLookup[index]]);
+        }
+      }
+
+      for(int index = node.m_ConditionalStart; index < node.m_ConditionalEnd; ++index)
+      {
+        place_element(m_Conditionals[index]);
+      }
+
+      if(node.m_Type == StormBehaviorNodeType::kLeaf)
+      {
+        auto & leaf = m_Leaves[node.m_LeafIndex];
+        place_state(m_States[node.m_LeafIndex]);
+
+        for(int index = leaf.m_ServiceStart; index < leaf.m_ServiceEnd; ++index)
+        {
+          place_element(m_Services[m_ServiceLookup[index]]);
+        }
+      }
+    }
+
+    for(auto & elem : m_Services)
+    {
+      place_element(elem);
+    }
+
+    // Expression terms move with their expression
+    for(auto & elem : m_Conditionals)
+    {
+      for(int index = elem.m_TermStart; index < elem.m_TermEnd; ++index)
+      {
+        auto term_offset = m_ConditionalTerms[index].m_Offset;
+        offset_remap[elem.m_Offset + term_offset] = offset_remap[elem.m_Offset] + term_offset;
+      }
+    }
+
+    for(auto & elem : m_InitInfo)
+    {
+      elem.m_TargetOffset = offset_remap[elem.m_TargetOffset];
+    }
+
+    for(auto & elem : m_StateInitInfo)
+    {
+      elem.m_TargetOffset = offset_remap[elem.m_TargetOffset];
+    }
+
+    for(auto & elem : m_States)
+    {
+      elem.m_Offset = offset_remap[elem.m_Offset];
+    }
+
+    for(auto & elem : m_Services)
+    {
+      elem.m_Offset = offset_remap[elem.m_Offset];
+    }
+
+    for(auto & elem : m_Conditionals)
+    {
+      elem.m_Offset = offset_remap[elem.m_Offset];
+    }
+
+    m_TotalSize = total_size;
+  }
+
+  template <typename ElementType>
+  static void AddTypeMemoryStats(std::vector<StormBehaviorTreeTypeMemoryStats> & types, 
+    const std::vector<ElementType> & elements, StormBehaviorTreeElementType element_type)
+  {
+    for(auto & elem : elements)
+    {
+      auto itr = std::find_if(types.begin(), types.end(), [&](auto & type) 
+        { return type.m_TypeId == elem.m_TypeId && type.m_ElementType == element_type; });
+
+      if(itr == types.end())
+      {
+        types.emplace_back();
+        itr = types.end() - 1;
+        itr->m_TypeId = elem.m_TypeId;
+        itr->m_DebugName = elem.m_DebugName;
+        itr->m_ElementType = element_type;
+      }
+
+      itr->m_Count++;
+      itr->m_InstanceBytes += elem.m_Size;
+    }
+  }
+
+  // Pure conditionals of the same type with equal init data always return the same result for the same data
+  // and context, so they can share a memo slot
+  void AssignConditionalMemoSlots()
+  {
+    for(int index = 0; index < static_cast<int>(m_Conditionals.size()); ++index)
+    {
+      auto & conditional = m_Conditionals[index];
+      if(conditional.m_Pure == false || conditional.m_InitDataEqual == nullptr)
+      {
+        continue;
+      }
+
+      for(int prev_index = 0; prev_index < index; ++prev_index)
+      {
+        auto & prev_conditional = m_Conditionals[prev_index];
+        if(IsSameConditional(prev_index, *this, index) == false)
+        {
+          continue;
+        }
+
+        if(prev_conditional.m_MemoSlot == -1)
+        {
+          prev_conditional.m_MemoSlot = m_ConditionalMemoSlotCount;
+          m_ConditionalMemoSlotCount++;
+        }
+
+        conditional.m_MemoSlot = prev_conditional.m_MemoSlot;
+        break;
+      }
+    }
+
+    // Batched results are handed to instances through the memo
+    for(auto & conditional : m_Conditionals)
+    {
+      if(conditional.m_CheckBatch && conditional.m_MemoSlot == -1)
+      {
+        conditional.m_MemoSlot = m_ConditionalMemoSlotCount;
+        m_ConditionalMemoSlotCount++;
+      }
+    }
+  }
+
+  // Expected cost of checking a group in order, where the group stops at the first pass (preempt conditionals)
+  // or at the first failure (everything else)
+  double GetExpectedGroupCost(const std::vector<int> & group, bool stop_on_pass) const
+  {
+    double cost = 0.0;
+    double reach_chance = 1.0;
+    for(auto index : group)
+    {
+      auto & stats = m_ConditionalStats[index];
+      cost += reach_chance * stats.GetAverageCost();
+
+      auto pass_rate = stats.GetPassRate();
+      reach_chance *= stop_on_pass ? 1.0 - pass_rate : pass_rate;
+    }
+
+    return cost;
+  }
+
+  template <typename Itr>
+  void SortConditionalGroup(Itr start, Itr end, bool stop_on_pass)
+  {
+    if(end - start < 2)
+    {
+      return;
+    }
+
+    for(auto itr = start; itr != end; ++itr)
+    {
+      if(m_Conditionals[*itr].m_Pure == false)
+      {
+        return;
+      }
+    }
+
+    auto get_rank = [&](int index)
+    {
+      auto & stats = m_ConditionalStats[index];
+      auto stop_chance = stop_on_pass ? stats.GetPassRate() : 1.0 - stats.GetPassRate();
+      return stop_chance > 0.0 ? stats.GetAverageCost() / stop_chance : std::numeric_limits<double>::infinity();
+    };
+
+    std::stable_sort(start, end, [&](int a, int b) { return get_rank(a) < get_rank(b); });
+  }
+
+  void AlignSize(int & size, int align)
+  {
+    assert(align > 0);
+    size = (size + align - 1) / align * align;
+  }
+
+  template <typename Type>
+  void PushMemInit(const Type & val, const StormBehaviorTreeTemplateInitInfo & init_info, int mem_offset)
+  {    
+    m_InitInfo.emplace_back(MemInitInfo{ 
+      val.m_Allocate, 
+      val.m_Deallocate, 
+      init_info.m_Destructor,
+      val.m_Relocate,
+      val.m_Save,
+      val.m_Load,
+      val.m_Offset, 
+      mem_offset });
+
+    m_TriviallyRelocatable &= val.m_TriviallyRelocatable;
+    m_RawSerializable &= val.m_RawSerializable;
+
+    if(init_info.m_Copier)
+    {
+      void * dst_mem = m_InitDataMemory.get() + mem_offset;
+      init_info.m_Copier(init_info.m_Memory.get(), dst_mem);
+
+      if(init_info.m_VisitParams)
+      {
+        init_info.m_VisitParams(dst_mem, this, &RegisterParam);
+      }
+    }
+  }
+
+  static void RegisterParam(void * user, StormBehaviorParamBase & param, const void * default_val)
+  {
+    auto bt = static_cast<StormBehaviorTreeTemplate<DataType, ContextType> *>(user);
+    param.m_Slot = bt->FindParam(param.m_Name);
+
+    if(param.m_Slot != -1)
+    {
+      // Placeholders sharing a name must agree on the type
+      assert(bt->m_ParamSlots[param.m_Slot].m_TypeId == param.m_TypeId);
+      return;
+    }
+
+    assert(param.m_Align <= static_cast<int>(alignof(uint64_t)));
+
+    auto offset = (bt->m_ParamDataSize + param.m_Align - 1) / param.m_Align * param.m_Align;
+    bt->m_ParamDataSize = offset + param.m_Size;
+    bt->m_ParamDefaults.resize((bt->m_ParamDataSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    memcpy(reinterpret_cast<uint8_t *>(bt->m_ParamDefaults.data()) + offset, default_val, param.m_Size);
+
+    param.m_Slot = static_cast<int>(bt->m_ParamSlots.size());
+    bt->m_ParamSlots.emplace_back(StormBehaviorTreeParamSlot{ param.m_Name, param.m_TypeId, offset, param.m_Size });
+  }
+
+  void CalculateInitDataSize(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt, int & size)
+  {
+    for(auto & elem : bt.m_ConditionInitInfo)
+    {
+      AlignSize(size, static_cast<int>(elem.m_Alignment));
+      size += static_cast<int>(elem.m_Size);
+    }
+
+    for(auto & elem : bt.m_ConditionalTermInitInfo)
+    {
+      AlignSize(size, static_cast<int>(elem.m_Alignment));
+      size += static_cast<int>(elem.m_Size);
+    }
+    
+    for(auto & elem : bt.m_ServiceInitInfo)
+    {
+      AlignSize(size, static_cast<int>(elem.m_Alignment));
+      size += static_cast<int>(elem.m_Size);
+    }  
+
+    if(bt.m_StateInitInfo.has_value())
+    {
+      AlignSize(size, static_cast<int>(bt.m_StateInitInfo->m_Alignment));
+      size += static_cast<int>(bt.m_StateInitInfo->m_Size);
+    }
+
+    for(auto & elem : bt.m_ScorerInitInfo)
+    {
+      AlignSize(size, static_cast<int>(elem.m_Alignment));
+      size += static_cast<int>(elem.m_Size);
+    }
+
+    for(auto & elem : bt.m_SwitchKeyInitInfo)
+    {
+      AlignSize(size, static_cast<int>(elem.m_Alignment));
+      size += static_cast<int>(elem.m_Size);
+    }
+
+    for(auto & subtree : bt.m_Subtrees)
+    {
+      CalculateInitDataSize(*subtree.m_SubTree, size);
+    }
+  }
+
+  // Lays the expression's terms out one after another in node memory.  Term offsets are relative to the
+  // expression, so the program only needs the expression's memory
+  void ProcessConditionalExpression(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt,
+    StormBehaviorTreeTemplateConditional<DataType, ContextType> & conditional, int & init_mem_offset)
+  {
+    auto term_start = conditional.m_TermStart;
+    auto term_end = conditional.m_TermEnd;
+
+    // Term offsets are kept relative, so the expression has to be aligned for its largest term
+    AlignSize(m_TotalSize, conditional.m_Align);
+    conditional.m_Offset = m_TotalSize;
+    conditional.m_InitDataOffset = init_mem_offset;
+    conditional.m_TermStart = static_cast<int>(m_ConditionalTerms.size());
+
+    for(int index = term_start; index < term_end; ++index)
+    {
+      auto term = bt.m_ConditionalTerms[index];
+      AlignSize(m_TotalSize, term.m_Align);
+      term.m_Offset = m_TotalSize;
+      m_TotalSize += term.m_Size;
+
+      auto & init_info = bt.m_ConditionalTermInitInfo[index];
+      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
+      term.m_InitDataOffset = init_mem_offset;
+      PushMemInit(term, init_info, init_mem_offset);
+      init_mem_offset += static_cast<int>(init_info.m_Size);
+
+      term.m_Offset -= conditional.m_Offset;
+      m_ConditionalTerms.emplace_back(std::move(term));
+    }
+
+    conditional.m_TermEnd = static_cast<int>(m_ConditionalTerms.size());
+    conditional.m_Size = m_TotalSize - conditional.m_Offset;
+
+    auto program_start = conditional.m_ProgramStart;
+    auto program_end = conditional.m_ProgramEnd;
+    conditional.m_ProgramStart = static_cast<int>(m_ConditionalProgram.size());
+    m_ConditionalProgram.insert(m_ConditionalProgram.end(), bt.m_ConditionalProgram.begin() + program_start, bt.m_ConditionalProgram.begin() + program_end);
+    conditional.m_ProgramEnd = static_cast<int>(m_ConditionalProgram.size());
+  }
+
+  int ProcessNode(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt,
+    std::vector<int> & next_in_sequence_nodes, std::vector<int> & continuous_conditionals, 
+    std::vector<int> & preempt_conditionals, std::vector<int> & services, bool can_preempt, int & init_mem_offset)
+  {
+    auto node_index = static_cast<int>(m_Nodes.size());
+    m_Nodes.emplace_back();
+
+    auto & node = m_Nodes.back();
+    node.m_Type = bt.m_Type;
+    m_NodeNames.push_back(bt.m_DebugName);
+
+    for(auto & elem : bt.m_InterruptEvents)
+    {
+      m_EventNodes.emplace_back(EventNode{ elem, node_index });
+    }
+
+    auto current_continuous_conditional_count = continuous_conditionals.size();
+    node.m_ConditionalStart = static_cast<int>(m_Conditionals.size());
+    for(int index = 0; index < static_cast<int>(bt.m_Conditionals.size()); ++index)
+    {
+      auto & elem = bt.m_Conditionals[index];
+      auto conditional_index = static_cast<int>(m_Conditionals.size());
+      m_Conditionals.emplace_back(elem);
+      m_Conditionals.back().m_DeclarationIndex = conditional_index;
+
+      if(elem.m_ProgramStart != elem.m_ProgramEnd)
+      {
+        ProcessConditionalExpression(bt, m_Conditionals.back(), init_mem_offset);
+      }
+      else
+      {
+        AlignSize(m_TotalSize, m_Conditionals.back().m_Align);
+        m_Conditionals.back().m_Offset = m_TotalSize;
+        m_TotalSize += elem.m_Size;
+
+        auto & init_info = bt.m_ConditionInitInfo[index];
+        AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
+        m_Conditionals.back().m_InitDataOffset = init_mem_offset;
+        PushMemInit(m_Conditionals.back(), init_info, init_mem_offset);
+        init_mem_offset += static_cast<int>(init_info.m_Size);
+      }
+
+      if(m_Conditionals.back().m_Continuous)
+      {
+        continuous_conditionals.push_back(conditional_index);
+      }
+    }
+    node.m_ConditionalEnd = static_cast<int>(m_Conditionals.size());
+
+    auto current_service_count = services.size();
+    for(int index = 0; index < static_cast<int>(bt.m_Services.size()); ++index)
+    {
+      auto & elem = bt.m_Services[index];
+      auto service_index = static_cast<int>(m_Services.size());
+      m_Services.emplace_back(elem);
+      if(elem.m_Interval > 0)
+      {
+        m_Services.back().m_TimedIndex = m_TimedServiceCount;
+        m_TimedServiceCount++;
+      }
+
+      AlignSize(m_TotalSize, m_Services.back().m_Align);
+      m_Services.back().m_Offset = m_TotalSize;
+      m_TotalSize += elem.m_Size;
+      
+      auto & init_info = bt.m_ServiceInitInfo[index];
+      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
+      PushMemInit(m_Services.back(), init_info, init_mem_offset);
+      init_mem_offset += static_cast<int>(init_info.m_Size);
+
+      services.emplace_back(service_index);
+    }
+
+    if(bt.m_Type == StormBehaviorNodeType::kLeaf)
+    {
+      auto leaf_index = static_cast<int>(m_Leaves.size());
+
+      node.m_ChildStart = -1;
+      node.m_ChildEnd = -1;
+      node.m_LeafIndex = leaf_index;
+      
+      m_States.emplace_back(bt.m_State.value());
+      AlignSize(m_TotalSize, m_States.back().m_Align);
+      m_States.back().m_Offset = m_TotalSize;
+      m_TotalSize += m_States.back().m_Size;
+
+      auto & init_info = bt.m_StateInitInfo.value();
+      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
+      PushMemInit(m_States.back(), init_info, init_mem_offset);
+      init_mem_offset += static_cast<int>(init_info.m_Size);
+
+      m_Leaves.emplace_back();
+      auto & leaf = m_Leaves.back();
+      leaf.m_NextInSequence = -1;
+      next_in_sequence_nodes.push_back(leaf_index);
+
+      leaf.m_ContinuousConditionalStart = static_cast<int>(m_ConditionalLookup.size());
+      for(auto & conditional_index : continuous_conditionals)
+      {
+        m_ConditionalLookup.emplace_back(conditional_index);
+      }
+      leaf.m_ContinuousConditionalEnd = static_cast<int>(m_ConditionalLookup.size());
+
+      leaf.m_PreemptConditionalStart = static_cast<int>(m_ConditionalLookup.size());
+      for(auto & conditional_index : preempt_conditionals)
+      {
+        m_ConditionalLookup.emplace_back(conditional_index);
+      }
+      leaf.m_PreemptConditionalEnd = static_cast<int>(m_ConditionalLookup.size());
+
+      leaf.m_PollWhileSleeping = false;
+      for(int index = leaf.m_ContinuousConditionalStart; index < leaf.m_PreemptConditionalEnd; ++index)
+      {
+        leaf.m_PollWhileSleeping |= m_Conditionals[m_ConditionalLookup[index]].m_PollWhileSleeping;
+      }
+
+      // Timed services go last so the services updated every tick are one contiguous run
+      leaf.m_ServiceStart = static_cast<int>(m_ServiceLookup.size());
+      for(auto & service_index : services)
+      {
+        if(m_Services[service_index].m_TimedIndex == -1)
+        {
+          m_ServiceLookup.emplace_back(service_index);
+        }
+      }
+
+      leaf.m_TimedServiceStart = static_cast<int>(m_ServiceLookup.size());
+      for(auto & service_index : services)
+      {
+        if(m_Services[service_index].m_TimedIndex != -1)
+        {
+          m_ServiceLookup.emplace_back(service_index);
+        }
+      }
+      leaf.m_ServiceEnd = static_cast<int>(m_ServiceLookup.size());
+    }
+    else if(bt.m_Type == StormBehaviorNodeType::kSequence)
+    {
+      node.m_LeafIndex = -1;
+      node.m_ChildStart = static_cast<int>(m_ChildNodeLookup.size());
+      m_ChildNodeLookup.resize(m_ChildNodeLookup.size() + bt.m_Subtrees.size());
+      node.m_ChildEnd = static_cast<int>(m_ChildNodeLookup.size());
+
+      auto child_index = node.m_ChildStart;
+      std::vector<int> pending_next_in_sequence_nodes;
+
+      for(auto & elem : bt.m_Subtrees)
+      {
+        std::vector<int> new_next_in_sequence_nodes;
+        auto child_node_index = ProcessNode(*elem.m_SubTree, new_next_in_sequence_nodes, 
+          continuous_conditionals, preempt_conditionals, services, false, init_mem_offset);
+        m_ChildNodeLookup[child_index] = child_node_index;
+
+        for (auto & leaf_index : pending_next_in_sequence_nodes)
+        {
+          m_Leaves[leaf_index].m_NextInSequence = child_node_index;
+        }
+
+        pending_next_in_sequence_nodes = new_next_in_sequence_nodes;
+        child_index++;
+      }
+    }
+    else
+    {
+      node.m_LeafIndex = -1;
+      node.m_ChildStart = static_cast<int>(m_ChildNodeLookup.size());
+      m_ChildNodeLookup.resize(m_ChildNodeLookup.size() + bt.m_Subtrees.size());
+      node.m_ChildEnd = static_cast<int>(m_ChildNodeLookup.size());
+      
+      auto current_preempt_conditionals_size = static_cast<int>(preempt_conditionals.size());
+
+      auto child_index = node.m_ChildStart;
+      for(auto & elem : bt.m_Subtrees)
+      {
+        std::vector<int> new_next_in_sequence_nodes;
+        m_ChildNodeLookup[child_index] = ProcessNode(*elem.m_SubTree, next_in_sequence_nodes, 
+          continuous_conditionals, preempt_conditionals, services, bt.m_Type == StormBehaviorNodeType::kSelect, init_mem_offset);
+
+        child_index++;
+      }
+
+      preempt_conditionals.resize(current_preempt_conditionals_size);
+
+      if(bt.m_Type == StormBehaviorNodeType::kRandom)
+      {
+        m_Nodes[node_index].m_RandomStart = static_cast<int>(m_RandomValues.size());
+
+        for(auto & elem : bt.m_Subtrees)
+        {
+          m_RandomValues.push_back(elem.m_RandomWeight);
+        }
+      }
+      else if(bt.m_Type == StormBehaviorNodeType::kUtility)
+      {
+        m_Nodes[node_index].m_ScorerStart = static_cast<int>(m_Scorers.size());
+
+        for(auto & elem : bt.m_Subtrees)
+        {
+          if(elem.m_ScorerIndex == -1)
+          {
+            m_Scorers.emplace_back(ScorerType{ 0, 0, "None", nullptr, nullptr, nullptr });
+            continue;
+          }
+
+          auto & init_info = bt.m_ScorerInitInfo[elem.m_ScorerIndex];
+          AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
+
+          m_Scorers.emplace_back(bt.m_Scorers[elem.m_ScorerIndex]);
+          m_Scorers.back().m_InitDataOffset = init_mem_offset;
+          init_info.m_Copier(init_info.m_Memory.get(), m_InitDataMemory.get() + init_mem_offset);
+          init_mem_offset += static_cast<int>(init_info.m_Size);
+        }
+      }
+      else if(bt.m_Type == StormBehaviorNodeType::kSwitch)
+      {
+        m_Nodes[node_index].m_SwitchIndex = ProcessSwitch(bt, m_Nodes[node_index].m_ChildStart, init_mem_offset);
+      }
+    }
+
+    continuous_conditionals.resize(current_continuous_conditional_count);
+    services.resize(current_service_count);
+
+    if(can_preempt)
+    {
+      // Processing the children can reallocate m_Nodes, so look the node up again
+      auto & node_info = m_Nodes[node_index];
+      for(int conditional_index = node_info.m_ConditionalStart; conditional_index < node_info.m_ConditionalEnd; ++conditional_index)
+      {
+        auto & conditional_info = m_Conditionals[conditional_index];
+
+        if(conditional_info.m_Preempt)
+        {
+          preempt_conditionals.push_back(conditional_index);
+        }
+      }
+  }
+
+    return node_index;
+  }
+
+  int ProcessSwitch(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & bt, int child_start, int & init_mem_offset)
+  {
+    auto switch_index = static_cast<int>(m_Switches.size());
+    if(bt.m_SwitchKeys.size() > 0)
+    {
+      auto & init_info = bt.m_SwitchKeyInitInfo[0];
+      AlignSize(init_mem_offset, static_cast<int>(init_info.m_Alignment));
+
+      m_SwitchKeys.emplace_back(bt.m_SwitchKeys[0]);
+      m_SwitchKeys.back().m_InitDataOffset = init_mem_offset;
+      init_info.m_Copier(init_info.m_Memory.get(), m_InitDataMemory.get() + init_mem_offset);
+      init_mem_offset += static_cast<int>(init_info.m_Size);
+    }
+    else
+    {
+      m_SwitchKeys.emplace_back(SwitchKeyType{ 0, 0, "None", nullptr, nullptr });
+    }
+
+    StormBehaviorTreeTemplateSwitch switch_info;
+    switch_info.m_DefaultChild = -1;
+
+    std::vector<StormBehaviorTreeTemplateSwitchCase> cases;
+    for(int index = 0; index < static_cast<int>(bt.m_Subtrees.size()); ++index)
+    {
+      auto & elem = bt.m_Subtrees[index];
+      auto child_node = m_ChildNodeLookup[child_start + index];
+      if(elem.m_HasCaseKey)
+      {
+        cases.emplace_back(StormBehaviorTreeTemplateSwitchCase{ elem.m_CaseKey, child_node });
+      }
+      else if(switch_info.m_DefaultChild == -1)
+      {
+        switch_info.m_DefaultChild = child_node;
+      }
+    }
+
+    // The first child added for a key wins
+    std::stable_sort(cases.begin(), cases.end(), [](auto & a, auto & b) { return a.m_Key < b.m_Key; });
+    cases.erase(std::unique(cases.begin(), cases.end(), [](auto & a, auto & b) { return a.m_Key == b.m_Key; }), cases.end());
+
+    auto key_range = cases.size() > 0 ? static_cast<int64_t>(cases.back().m_Key) - cases.front().m_Key + 1 : 0;
+    switch_info.m_KeyMin = cases.size() > 0 ? cases.front().m_Key : 0;
+    switch_info.m_Dense = key_range <= static_cast<int64_t>(cases.size()) * 4 + 16;
+
+    if(switch_info.m_Dense)
+    {
+      switch_info.m_CaseStart = static_cast<int>(m_SwitchTable.size());
+      m_SwitchTable.resize(m_SwitchTable.size() + static_cast<std::size_t>(key_range), -1);
+      for(auto & elem : cases)
+      {
+        m_SwitchTable[switch_info.m_CaseStart + (elem.m_Key - switch_info.m_KeyMin)] = elem.m_Child;
+      }
+
+      switch_info.m_CaseEnd = static_cast<int>(m_SwitchTable.size());
+    }
+    else
+    {
+      switch_info.m_CaseStart = static_cast<int>(m_SwitchCases.size());
+      m_SwitchCases.insert(m_SwitchCases.end(), cases.begin(), cases.end());
+      switch_info.m_CaseEnd = static_cast<int>(m_SwitchCases.size());
+    }
+
+    m_Switches.emplace_back(switch_info);
+    return switch_index;
+  }
+
+  // Returns the child node for key, or -1 if the switch has no case for it
+  int FindSwitchChild(const StormBehaviorTreeTemplateSwitch & switch_info, int key) const
+  {
+    if(switch_info.m_Dense)
+    {
+      auto offset = static_cast<int64_t>(key) - switch_info.m_KeyMin;
+      if(offset < 0 || offset >= switch_info.m_CaseEnd - switch_info.m_CaseStart)
+      {
+        return -1;
+      }
+
+      return m_SwitchTable[switch_info.m_CaseStart + static_cast<int>(offset)];
+    }
+
+    auto begin = m_SwitchCases.begin() + switch_info.m_CaseStart;
+    auto end = m_SwitchCases.begin() + switch_info.m_CaseEnd;
+    auto itr = std::lower_bound(begin, end, key, [](auto & elem, int key) { return elem.m_Key < key; });
+    return itr != end && itr->m_Key == key ? itr->m_Child : -1;
+  }
+
+  void DebugPrintIndent(int indent) const
+  {
+    for(int index = 0; index < indent; ++index)
+    {
+      printf(" ");
+    }
+  }
+
+  void DebugPrint(int indent, int node_index) const
+  {
+    DebugPrintIndent(indent);
+    auto & node = m_Nodes[node_index];
+
+    printf("- (%d) ", node_index);
+    switch(node.m_Type)
+    {
+      case StormBehaviorNodeType::kSelect:
+        printf("Select\n");
+        break;
+      case StormBehaviorNodeType::kSequence:
+        printf("Sequence\n");
+        break;
+      case StormBehaviorNodeType::kRandom:
+        printf("Random\n");
+        break;
+      case StormBehaviorNodeType::kUtility:
+        printf("Utility\n");
+        break;
+      case StormBehaviorNodeType::kSwitch:
+        {
+          auto & switch_info = m_Switches[node.m_SwitchIndex];
+          printf("Switch (%s) %s, %d entries -> (%d)\n", m_SwitchKeys[node.m_SwitchIndex].m_DebugName, switch_info.m_Dense ? "table" : "sorted",
+            switch_info.m_CaseEnd - switch_info.m_CaseStart, switch_info.m_DefaultChild);
+        }
+        break;
+      case StormBehaviorNodeType::kLeaf:
+        {
+          auto & state_info = m_States[node.m_LeafIndex];
+          auto & leaf_info = m_Leaves[node.m_LeafIndex];
+          printf("Leaf (%d) (%s) -> (%d)\n", node.m_LeafIndex, state_info.m_DebugName, leaf_info.m_NextInSequence);
+        }
+        break;
+    }
+
+    for(int index = node.m_ConditionalStart; index < node.m_ConditionalEnd; ++index)
+    {
+      auto conditional_lookup = m_ConditionalLookup[index];
+      auto & conditional = m_Conditionals[conditional_lookup];
+
+      DebugPrintIndent(indent);
+      printf("|   (%d) Conditional (%s)\n", conditional_lookup, conditional.m_DebugName);
+
+      for(int term_index = conditional.m_TermStart; term_index < conditional.m_TermEnd; ++term_index)
+      {
+        DebugPrintIndent(indent);
+        printf("|       Term (%s)\n", m_ConditionalTerms[term_index].m_DebugName);
+      }
+    }
+
+    if(node.m_Type == StormBehaviorNodeType::kLeaf)
+    {
+      auto & leaf_info = m_Leaves[node.m_LeafIndex];
+      for(int index = leaf_info.m_ServiceStart; index < leaf_info.m_ServiceEnd; ++index)
+      {
+        auto service_lookup = m_ServiceLookup[index];
+        auto & service = m_Services[service_lookup];
+
+        DebugPrintIndent(indent);
+        if(service.m_TimedIndex != -1)
+        {
+          printf("|   (%d) Service (%s) every %d +/- %d ticks\n", service_lookup, service.m_DebugName, service.m_Interval, service.m_Deviation);
+        }
+        else
+        {
+          printf("|   (%d) Service (%s)\n", service_lookup, service.m_DebugName);
+        }
+      }
+    }
+
+    for(int index = node.m_ChildStart; index < node.m_ChildEnd; ++index)
+    {
+      auto child_lookup = m_ChildNodeLookup[index];
+      DebugPrint(indent + 2, child_lookup);
+    }
+  }
+
+private:
+
+  friend class StormBehaviorTree<DataType, ContextType>;
+
+  std::vector<StormBehaviorTreeTemplateNode> m_Nodes;
+  std::vector<StormBehaviorTreeTemplateLeaf> m_Leaves;
+  std::vector<StormBehaviorTreeTemplateState<DataType, ContextType>> m_States;
+  std::vector<StormBehaviorTreeTemplateService<DataType, ContextType>> m_Services;
+  std::vector<StormBehaviorTreeTemplateConditional<DataType, ContextType>> m_Conditionals;
+  std::vector<StormBehaviorTreeTemplateConditional<DataType, ContextType>> m_ConditionalTerms;
+  std::vector<StormBehaviorTreeTemplateConditionalOp> m_ConditionalProgram;
+  std::vector<int> m_ChildNodeLookup;
+  std::vector<int> m_ServiceLookup;
+  std::vector<int> m_ConditionalLookup;
+  std::vector<int> m_RandomValues;
+  std::vector<ScorerType> m_Scorers;
+  std::vector<StormBehaviorTreeTemplateSwitch> m_Switches;
+  std::vector<SwitchKeyType> m_SwitchKeys;
+  std::vector<int> m_SwitchTable;
+  std::vector<StormBehaviorTreeTemplateSwitchCase> m_SwitchCases;
+  std::vector<const char *> m_NodeNames;
+  std::vector<StormBehaviorTreeConditionalStats> m_ConditionalStats;
+  std::unique_ptr<StormBehaviorTreeTransitionStats> m_TransitionStats;
+
+  struct EventNode
+  {
+    int m_EventId;
+    int m_NodeIndex;
+  };
+
+  std::vector<EventNode> m_EventNodes;
+
+  struct MemInitInfo
+  {
+    void (*m_Allocate)(void *, void *, const StormBehaviorTreeParamBlock *);
+    void (*m_Deallocate)(void *);
+    void (*m_DestroyInitInfo)(void *);
+    void (*m_Relocate)(void *, void *);
+    void (*m_Save)(const void *, StormBehaviorTreeWriteBuffer &);
+    void (*m_Load)(void *, StormBehaviorTreeReadBuffer &);
+    int m_TargetOffset;
+    int m_InitOffset;
+  };
+
+  std::vector<MemInitInfo> m_InitInfo;
+  std::vector<MemInitInfo> m_StateInitInfo;
+  std::unique_ptr<uint8_t[]> m_InitDataMemory;
+  int m_InitDataSize = 0;
+  std::vector<StormBehaviorTreeParamSlot> m_ParamSlots;
+  std::vector<uint64_t> m_ParamDefaults;
+  int m_ParamDataSize = 0;
+  int m_TotalSize = 0;
+  int m_ConditionalMemoSlotCount = 0;
+  int m_TimedServiceCount = 0;
+  bool m_TriviallyRelocatable = true;
+  bool m_RawSerializable = true;
+  bool m_LazyStates = false;
+  int m_StateSlotSize = 0;
+  int m_StateSlotAlign = 1;
+};
+
@@ -1,492 +1,1488 @@
-#pragma once
-
-#include <memory>
-#include <vector>
-#include <optional>
-#include <tuple>
-#include <cassert>
-#include <cstdio>
-
-template <typename DataType, typename ContextType>
-class StormBehaviorTreeTemplate;
-
-
-enum class StormBehaviorNodeType
-{
-  kSelect,
-  kSequence,
-  kRandom,
-  kLeaf,
-};
-
-template <typename T>
-struct StormBehaviorHasActivate
-{
-public:
-  template <typename C>
-  static char test(decltype(&C::Activate));
-
-  template <typename C> static long test(...);
-
-  static const bool value = sizeof(test<T>(0)) == sizeof(char);
-};
-
-template <typename T>
-struct StormBehaviorHasDeactivate
-{
-public:
-  template <typename C>
-  static char test(decltype(&C::Deactivate));
-
-  template <typename C> static long test(...);
-
-  static const bool value = sizeof(test<T>(0)) == sizeof(char);
-};
-
-template <typename T>
-struct StormBehaviorHasUpdate
-{
-public:
-  template <typename C>
-  static char test(decltype(&C::Update));
-
-  template <typename C> static long test(...);
-
-  static const bool value = sizeof(test<T>(0)) == sizeof(char);
-};
-
-
-template <typename DataType, typename ContextType>
-struct StormBehaviorTreeTemplateState
-{
-  std::size_t m_TypeId;
-  int m_Size;
-  int m_Offset;
-  int m_Align;
-  int m_InitDataOffset;
-  const char * m_DebugName;
-  void(*m_Allocate)(void * memory, void * init_info);
-  void(*m_Deallocate)(void * ptr);
-  void(*m_Activate)(void * ptr, DataType & data_type, ContextType & context_type);
-  void(*m_Deactivate)(void * ptr, DataType & data_type, ContextType & context_type);
-  bool(*m_Update)(void * ptr, DataType & data_type, ContextType & context_type);
-};
-
-template <typename DataType, typename ContextType>
-struct StormBehaviorTreeTemplateConditional
-{
-  std::size_t m_TypeId;
-  int m_Size;
-  int m_Offset;
-  int m_Align;
-  int m_InitDataOffset;
-  const char * m_DebugName;
-  void(*m_Allocate)(void * memory, void * init_info);
-  void(*m_Deallocate)(void * ptr);
-  bool(*m_Check)(void * ptr, const DataType & data_type, const ContextType & context_type);
-  bool m_Preempt;
-  bool m_Continuous;
-};
-
-template <typename DataType, typename ContextType>
-struct StormBehaviorTreeTemplateService
-{
-  std::size_t m_TypeId;
-  int m_Size;
-  int m_Offset;
-  int m_Align;
-  int m_InitDataOffset;
-  const char * m_DebugName;
-  void(*m_Allocate)(void * memory, void * init_info);
-  void(*m_Deallocate)(void * ptr);
-  void(*m_Activate)(void * ptr, DataType & data_type, ContextType & context_type);
-  void(*m_Deactivate)(void * ptr, DataType & data_type, ContextType & context_type);
-  void(*m_Update)(void * ptr, DataType & data_type, ContextType & context_type);
-};
-
-struct StormBehaviorTreeTemplateInitInfo
-{
-  std::unique_ptr<uint8_t[]> m_Memory;
-  std::size_t m_Size = 0;
-  std::size_t m_Alignment = 0;
-
-  void (*m_Destructor)(void * src) = nullptr;
-  void (*m_Copier)(const void * src, void * dst) = nullptr;
-};
-
-template <class T, class Tuple, std::size_t... I>
-void StormBehaviorMakeFromTupleImpl(void * mem, Tuple&& t, std::index_sequence<I...>)
-{
-  new (mem) T(std::get<I>(std::forward<Tuple>(t))...);
-}
- 
-template <class T, class Tuple>
-void StormBehaviorMakeFromTuple(void * mem, Tuple&& t)
-{
-   StormBehaviorMakeFromTupleImpl<T>(mem, std::forward<Tuple>(t),
-      std::make_index_sequence<std::tuple_size<std::remove_reference_t<Tuple>>::value>{});
-}
-
-template <typename UpdaterType>
-struct StormBehaviorTreeTemplateStateMarker
-{
-
-};
-
-template <typename DataType, typename ContextType>
-class StormBehaviorTreeTemplateBuilder
-{
-public:
-
-  using SubtreeType = StormBehaviorTreeTemplateBuilder<DataType, ContextType>;
-  using ServiceType = StormBehaviorTreeTemplateService<DataType, ContextType>;
-  using StateType = StormBehaviorTreeTemplateState<DataType, ContextType>;
-  using ConditionalType = StormBehaviorTreeTemplateConditional<DataType, ContextType>;
-
-  template <typename ... Args>
-  StormBehaviorTreeTemplateBuilder(StormBehaviorNodeType type) :
-    m_Type(type)
-  {
-    assert(m_Type != StormBehaviorNodeType::kLeaf);
-  }
-
-  template <typename State, typename ... Args>
-  StormBehaviorTreeTemplateBuilder(const StormBehaviorTreeTemplateStateMarker<State> &, Args && ... args) :
-    m_Type(StormBehaviorNodeType::kLeaf)
-  {
-    StateType updater;
-    updater.m_TypeId = typeid(State).hash_code();
-    updater.m_DebugName = typeid(State).name();
-    updater.m_Size = sizeof(State);
-    updater.m_Align = alignof(State);
-
-    if constexpr(sizeof...(Args) > 0)
-    {
-      using InitData = std::tuple<Args...>;
-
-      updater.m_Allocate = [](void * mem, void * init_info)
-      { 
-        auto * init_data = static_cast<InitData *>(init_info);
-        StormBehaviorMakeFromTuple<State>(mem, *init_data);
-      };
-
-      m_StateInitInfo.emplace(
-        StormBehaviorTreeTemplateInitInfo{ 
-          std::make_unique<uint8_t[]>(sizeof(InitData)), 
-          sizeof(InitData),
-          alignof(InitData),
-          [](void * mem){ InitData * i = static_cast<InitData *>(mem); i->~InitData(); },
-          [](const void * src, void * dst){ auto i = static_cast<const InitData *>(src); new(dst) InitData(*i); }});
-      
-      new (m_StateInitInfo->m_Memory.get()) InitData(std::make_tuple(std::forward<Args>(args)...));
-    }
-    else
-    {
-      updater.m_Allocate = [](void * mem, void * init_info) { new(mem) State(); };
-    }
-
-    updater.m_Deallocate = [](void * mem) { auto ptr = static_cast<State *>(mem); ptr->~State(); };
-
-    if constexpr(StormBehaviorHasActivate<State>::value)
-    {
-      updater.m_Activate = [](void * ptr, DataType & data_type, ContextType & context_type)
-      {
-        State * updater = reinterpret_cast<State *>(ptr);
-        updater->Activate(data_type, context_type);
-      };
-    }
-
-    if constexpr(StormBehaviorHasDeactivate<State>::value)
-    {
-      updater.m_Deactivate = [](void * ptr, DataType & data_type, ContextType & context_type)
-      {
-        State * updater = reinterpret_cast<State *>(ptr);
-        updater->Deactivate(data_type, context_type);
-      };
-    }
-
-    updater.m_Update = [](void * ptr, DataType & data_type, ContextType & context_type)
-    {
-      State * updater = reinterpret_cast<State *>(ptr);
-      return updater->Update(data_type, context_type);
-    };
-
-    m_State.emplace(updater);
-  }
-
-  StormBehaviorTreeTemplateBuilder(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & rhs) = delete;
-  StormBehaviorTreeTemplateBuilder & operator = (const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & rhs) = delete;
-
-  StormBehaviorTreeTemplateBuilder(StormBehaviorTreeTemplateBuilder<DataType, ContextType> && rhs) = default;
-  StormBehaviorTreeTemplateBuilder & operator = (StormBehaviorTreeTemplateBuilder<DataType, ContextType> && rhs) = default;
-
-  ~StormBehaviorTreeTemplateBuilder()
-  {
-    for(auto & elem : m_ServiceInitInfo)
-    {
-      if(elem.m_Destructor)
-      {
-        elem.m_Destructor(elem.m_Memory.get());
-      }
-    }
-
-    for(auto & elem : m_ConditionInitInfo)
-    {
-      if(elem.m_Destructor)
-      {
-        elem.m_Destructor(elem.m_Memory.get());
-      }
-    }
-
-    if(m_StateInitInfo.has_value())
-    {
-      if(m_StateInitInfo->m_Destructor)
-      {
-        m_StateInitInfo->m_Destructor(m_StateInitInfo->m_Memory.get());
-      }
-    }
-  }
-
-  SubtreeType && AddChild(SubtreeType && sub_tree) &&
-  {
-    m_OwnedSubtrees.emplace_back(std::make_unique<SubtreeType>(std::move(sub_tree)));
-    m_Subtrees.emplace_back(SubtreeInfo{ m_OwnedSubtrees.back().get(), 100 });
-    
-    return std::forward<SubtreeType>(*this);
-  }
-
-  SubtreeType && AddChild(int random_weight, StormBehaviorTreeTemplateBuilder && sub_tree) &&
-  {
-    m_OwnedSubtrees.emplace_back(std::make_unique<SubtreeType>(std::move(sub_tree)));
-    m_Subtrees.emplace_back(SubtreeInfo{ m_OwnedSubtrees.back().get(), random_weight });
-    
-    return std::forward<SubtreeType>(*this);
-  }
-
-  SubtreeType && AddChildSubTree(const StormBehaviorTreeTemplateBuilder & sub_tree) &&
-  {
-    m_Subtrees.emplace_back(SubtreeInfo{ &sub_tree, 100 });
-    
-    return std::forward<SubtreeType>(*this);
-  }
-
-  SubtreeType && AddChildSubTree(int random_weight, const StormBehaviorTreeTemplateBuilder & sub_tree) &&
-  {
-    m_Subtrees.emplace_back(SubtreeInfo{ &sub_tree, random_weight });
-    
-    return std::forward<SubtreeType>(*this);
-  }
-
-  template <typename Service, typename ... Args>
-  SubtreeType && AddService(Args && ... args) &&
-  {
-    AddServiceInternal<Service>(std::forward<Args>(args)...);
-    return std::forward<SubtreeType>(*this);
-  }
-
-  template <typename Conditional, typename ... Args>
-  SubtreeType && AddConditional(bool preempt, bool continuous, Args && ... args) &&
-  {
-    AddConditionalInternal<Conditional>(preempt, continuous, std::forward<Args>(args)...);
-    return std::forward<SubtreeType>(*this);
-  }
-
-  void DebugPrint() const
-  {
-    DebugPrint(0);
-  }
-
-private:
-
-  template <typename Service, typename ... Args>
-  void AddServiceInternal(Args && ... args)
-  {
-    ServiceType service;
-    service.m_TypeId = typeid(Service).hash_code();
-    service.m_DebugName = typeid(Service).name();
-    service.m_Size = sizeof(Service);    
-    service.m_Align = alignof(Service);
-
-    if constexpr(sizeof...(Args) > 0)
-    {
-      using InitData = std::tuple<Args...>;
-
-      service.m_Allocate = [](void * mem, void * init_info) 
-      { 
-        auto * init_data = static_cast<InitData *>(init_info);
-        StormBehaviorMakeFromTuple<Service>(mem, *init_data);
-      };
-
-      m_ServiceInitInfo.emplace_back(
-        StormBehaviorTreeTemplateInitInfo{ 
-          std::make_unique<uint8_t[]>(sizeof(InitData)), 
-          sizeof(InitData),
-          alignof(InitData),
-          [](void * mem){ InitData * i = static_cast<InitData *>(mem); i->~InitData(); },
-          [](const void * src, void * dst){ auto i = static_cast<const InitData *>(src); new(dst) InitData(*i); }});
-      
-      new (m_ServiceInitInfo.back().m_Memory.get()) InitData(std::make_tuple(std::forward<Args>(args)...));
-    }
-    else
-    {
-      service.m_Allocate = [](void * mem, void * init_info) { new(mem) Service(); };
-      m_ServiceInitInfo.emplace_back();
-    }
-
-    service.m_Deallocate = [](void * mem) { auto ptr = static_cast<Service *>(mem); ptr->~Service(); };
-
-    service.m_Activate = nullptr;
-    service.m_Deactivate = nullptr;
-    service.m_Update = nullptr;
-
-    if constexpr(StormBehaviorHasActivate<Service>::value)
-    {
-      service.m_Activate = [](void * ptr, DataType & data_type, ContextType & context_type)
-      {
-        Service * service = reinterpret_cast<Service *>(ptr);
-        service->Activate(data_type, context_type);
-      };
-    }
-
-    if constexpr(StormBehaviorHasDeactivate<Service>::value)
-    {
-      service.m_Deactivate = [](void * ptr, DataType & data_type, ContextType & context_type)
-      {
-        Service * service = reinterpret_cast<Service *>(ptr);
-        service->Deactivate(data_type, context_type);
-      };
-    }
-
-    if constexpr(StormBehaviorHasUpdate<Service>::value)
-    {
-      service.m_Update = [](void * ptr, DataType & data_type, ContextType & context_type)
-      {
-        Service * service = reinterpret_cast<Service *>(ptr);
-        service->Update(data_type, context_type);
-      };
-    }
-
-    m_Services.emplace_back(std::move(service));
-
-    
-  }
-
-  template <typename Conditional, typename ... Args>
-  void AddConditionalInternal(bool preempt, bool continuous, Args && ... args)
-  {
-    ConditionalType conditional;
-    conditional.m_TypeId = typeid(Conditional).hash_code();
-    conditional.m_DebugName = typeid(Conditional).name();
-    conditional.m_Size = sizeof(Conditional);
-    conditional.m_Align = alignof(Conditional);
-
-    if constexpr(sizeof...(Args) > 0)
-    {
-      using InitData = std::tuple<Args...>;
-
-      conditional.m_Allocate = [](void * mem, void * init_info)
-      { 
-        auto * init_data = static_cast<InitData *>(init_info);
-        StormBehaviorMakeFromTuple<Conditional>(mem, *init_data);
-      };
-
-      m_ConditionInitInfo.emplace_back(
-        StormBehaviorTreeTemplateInitInfo{ 
-          std::make_unique<uint8_t[]>(sizeof(InitData)), 
-          sizeof(InitData),
-          alignof(InitData),
-          [](void * mem){ InitData * i = static_cast<InitData *>(mem); i->~InitData(); },
-          [](const void * src, void * dst){ auto i = static_cast<const InitData *>(src); new(dst) InitData(*i); }});
-
-      new (m_ConditionInitInfo.back().m_Memory.get()) InitData(std::make_tuple(std::forward<Args>(args)...));
-    }
-    else
-    {
-      conditional.m_Allocate = [](void * mem, void * init_info) { new(mem) Conditional(); };
-      m_ConditionInitInfo.emplace_back();
-    }
-
-    conditional.m_Deallocate = [](void * mem) { auto ptr = static_cast<Conditional*>(mem); ptr->~Conditional(); };
-
-    conditional.m_Check = [](void * ptr, const DataType & data_type, const ContextType & context_type)
-    {
-      Conditional * conditional = reinterpret_cast<Conditional *>(ptr);
-      return conditional->Check(data_type, context_type);
-    };
-
-    conditional.m_Preempt = preempt;
-    conditional.m_Continuous = continuous;
-    m_Conditionals.emplace_back(std::move(conditional));
-  }
-
-  struct SubtreeInfo
-  {
-    const SubtreeType * m_SubTree;
-    int m_RandomWeight;
-  };
-  
-  void DebugPrintIndent(int indent) const
-  {
-    for(int index = 0; index < indent; ++index)
-    {
-      printf(" ");
-    }
-  }
-
-  void DebugPrint(int indent) const
-  {
-    DebugPrintIndent(indent);
-
-    printf("-");
-    switch(m_Type)
-    {
-      case StormBehaviorNodeType::kSelect:
-        printf("Select\n");
-        break;
-      case StormBehaviorNodeType::kSequence:
-        printf("Sequence\n");
-        break;
-      case StormBehaviorNodeType::kRandom:
-        printf("Random\n");
-        break;
-      case StormBehaviorNodeType::kLeaf:
-        printf("Leaf (%s)\n", m_State->m_DebugName);
-        break;
-    }
-
-    for(auto & elem : m_Conditionals)
-    {
-      DebugPrintIndent(indent);
-      printf("| Conditional (%s)\n", elem.m_DebugName);
-    }
-
-    for(auto & elem : m_Services)
-    {
-      DebugPrintIndent(indent);
-      printf("| Service (%s)\n", elem.m_DebugName);
-    }
-
-    for(auto & elem : m_Subtrees)
-    {
-      elem.m_SubTree->DebugPrint(indent + 2);
-    }
-  }
-
-private:
-
-  friend class StormBehaviorTreeTemplate<DataType, ContextType>;
-
-  StormBehaviorNodeType m_Type;
-
-  std::vector<ServiceType> m_Services;
-  std::vector<StormBehaviorTreeTemplateInitInfo> m_ServiceInitInfo;
-  std::vector<ConditionalType> m_Conditionals;
-  std::vector<StormBehaviorTreeTemplateInitInfo> m_ConditionInitInfo;
-  std::optional<StateType> m_State;
-  std::optional<StormBehaviorTreeTemplateInitInfo> m_StateInitInfo;
-
-  const char * m_DebugName;
-
-  std::vector<SubtreeInfo> m_Subtrees;
-  std::vector<std::unique_ptr<SubtreeType>> m_OwnedSubtrees;
-};
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+#include "StormBehaviorTreeParams.h"
+#include "StormBehaviorTreeSerializer.h"
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeTemplate;
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeConditionalExpression;
+
+enum class StormBehaviorNodeType
+{
+  kSelect,
+  kSequence,
+  kRandom,
+  kLeaf,
+  kUtility,
+  kSwitch,
+};
+
+enum class StormBehaviorTreeElementType
+{
+  kConditional,
+  kService,
+  kState,
+};
+
+enum class StormBehaviorConditionalOp
+{
+  kCheck,
+  kNot,
+  kAnd,
+  kOr,
+};
+
+// One step of a conditional expression's postfix program.  m_Term is the term checked by kCheck, counted from
+// the expression's first term
+struct StormBehaviorTreeTemplateConditionalOp
+{
+  StormBehaviorConditionalOp m_Op;
+  int m_Term;
+};
+
+template <typename T>
+struct StormBehaviorHasActivate
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::Activate));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasDeactivate
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::Deactivate));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasUpdate
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::Update));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasGetSleepTicks
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::GetSleepTicks));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasPollWhileSleeping
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::kPollWhileSleeping));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasPure
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::kPure));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasScoreBatch
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::ScoreBatch));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasCheckBatch
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::CheckBatch));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasEqual
+{
+public:
+  template <typename C>
+  static char test(decltype(std::declval<const C &>() == std::declval<const C &>()) *);
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+// std::hash is only usable for types that enable it
+template <typename T>
+struct StormBehaviorHasHash
+{
+  static const bool value = std::is_default_constructible<std::hash<T>>::value;
+};
+
+inline void StormBehaviorHashCombine(uint64_t & hash, uint64_t val)
+{
+  hash ^= val + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+}
+
+// Hashes parameter placeholders by name and default and the init arguments that have a std::hash, the rest are
+// left to the equality check
+template <typename ... Args>
+uint64_t StormBehaviorHashInitData(const void * ptr)
+{
+  uint64_t hash = 0;
+  auto hash_arg = [&](auto & arg)
+  {
+    using ArgType = std::decay_t<decltype(arg)>;
+    if constexpr(std::is_base_of<StormBehaviorParamBase, ArgType>::value)
+    {
+      StormBehaviorHashCombine(hash, static_cast<uint64_t>(std::hash<std::string_view>{}(arg.m_Name)));
+      StormBehaviorHashCombine(hash, static_cast<uint64_t>(std::hash<std::string_view>{}(
+        std::string_view(reinterpret_cast<const char *>(&arg.m_Default), sizeof(arg.m_Default)))));
+    }
+    else if constexpr(StormBehaviorHasHash<ArgType>::value)
+    {
+      StormBehaviorHashCombine(hash, static_cast<uint64_t>(std::hash<ArgType>{}(arg)));
+    }
+  };
+
+  std::apply([&](auto & ... args) { (hash_arg(args), ...); }, *static_cast<const std::tuple<Args...> *>(ptr));
+  return hash;
+}
+
+// nullptr unless every init argument can be compared with ==
+template <typename ... Args>
+bool(*StormBehaviorGetInitDataEqual())(const void * a, const void * b)
+{
+  if constexpr((StormBehaviorHasEqual<Args>::value && ...))
+  {
+    return [](const void * a, const void * b)
+    {
+      return *static_cast<const std::tuple<Args...> *>(a) == *static_cast<const std::tuple<Args...> *>(b);
+    };
+  }
+  else
+  {
+    return nullptr;
+  }
+}
+
+template <typename T>
+struct StormBehaviorHasTriviallyRelocatable
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::kTriviallyRelocatable));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+template <typename T>
+struct StormBehaviorHasReplicated
+{
+public:
+  template <typename C>
+  static char test(decltype(&C::kReplicated));
+
+  template <typename C> static long test(...);
+
+  static const bool value = sizeof(test<T>(0)) == sizeof(char);
+};
+
+// Elements with static constexpr bool kReplicated = true have their node memory sent to clients by the replication
+// encoder.  They are copied byte for byte, so they must be trivially copyable
+template <typename T>
+constexpr bool StormBehaviorIsReplicated()
+{
+  if constexpr(StormBehaviorHasReplicated<T>::value)
+  {
+    static_assert(T::kReplicated == false || std::is_trivially_copyable<T>::value, "Replicated elements must be trivially copyable");
+    return T::kReplicated;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+// Trivially relocatable elements can be moved to a new address with memcpy, skipping the move constructor and
+// destructor.  Trivially copyable types always are, anything else can opt in with
+// static constexpr bool kTriviallyRelocatable = true
+template <typename T>
+constexpr bool StormBehaviorIsTriviallyRelocatable()
+{
+  if constexpr(StormBehaviorHasTriviallyRelocatable<T>::value)
+  {
+    return T::kTriviallyRelocatable;
+  }
+  else
+  {
+    return std::is_trivially_copyable<T>::value;
+  }
+}
+
+template <typename T>
+void StormBehaviorRelocate(void * dst, void * src)
+{
+  auto ptr = static_cast<T *>(src);
+  new (dst) T(std::move(*ptr));
+  ptr->~T();
+}
+
+template <typename T>
+constexpr auto StormBehaviorGetRelocate() -> void(*)(void *, void *)
+{
+  if constexpr(std::is_move_constructible<T>::value)
+  {
+    return &StormBehaviorRelocate<T>;
+  }
+  else
+  {
+    return nullptr;
+  }
+}
+
+// Returned from a state's GetSleepTicks to sleep until the instance is explicitly woken
+static const int kStormBehaviorSleepUntilWoken = -1;
+
+template <typename DataType, typename ContextType>
+struct StormBehaviorTreeTemplateState
+{
+  std::size_t m_TypeId;
+  int m_Size;
+  int m_Offset;
+  int m_Align;
+  int m_InitDataOffset;
+  const char * m_DebugName = nullptr;
+  std::vector<int> m_InterruptEvents;
+  void(*m_Allocate)(void * memory, void * init_info, const StormBehaviorTreeParamBlock * params);
+  void(*m_Deallocate)(void * ptr);
+  void(*m_Relocate)(void * dst, void * src);
+  bool m_TriviallyRelocatable;
+  void(*m_Save)(const void * ptr, StormBehaviorTreeWriteBuffer & buffer);
+  void(*m_Load)(void * mem, StormBehaviorTreeReadBuffer & buffer);
+  bool m_RawSerializable;
+  bool m_Replicated;
+  void(*m_Activate)(void * ptr, DataType & data_type, ContextType & context_type);
+  void(*m_Deactivate)(void * ptr, DataType & data_type, ContextType & context_type);
+  bool(*m_Update)(void * ptr, DataType & data_type, ContextType & context_type);
+  int(*m_GetSleepTicks)(void * ptr, const DataType & data_type, const ContextType & context_type);
+};
+
+template <typename DataType, typename ContextType>
+struct StormBehaviorTreeTemplateConditional
+{
+  std::size_t m_TypeId;
+  int m_Size;
+  int m_Offset;
+  int m_Align;
+  int m_InitDataOffset;
+  const char * m_DebugName = nullptr;
+  std::vector<int> m_InterruptEvents;
+  void(*m_Allocate)(void * memory, void * init_info, const StormBehaviorTreeParamBlock * params);
+  void(*m_Deallocate)(void * ptr);
+  void(*m_Relocate)(void * dst, void * src);
+  bool m_TriviallyRelocatable;
+  void(*m_Save)(const void * ptr, StormBehaviorTreeWriteBuffer & buffer);
+  void(*m_Load)(void * mem, StormBehaviorTreeReadBuffer & buffer);
+  bool m_RawSerializable;
+  bool m_Replicated;
+  bool(*m_Check)(void * ptr, const DataType & data_type, const ContextType & context_type);
+  void(*m_CheckBatch)(const void * const * ptrs, const DataType * const * data_types, int count, const ContextType & context_type, uint64_t * out_bits);
+  bool(*m_InitDataEqual)(const void * a, const void * b);
+  int m_MemoSlot = -1;
+  int m_DeclarationIndex = -1;
+  int m_TermStart = 0;
+  int m_TermEnd = 0;
+  int m_ProgramStart = 0;
+  int m_ProgramEnd = 0;
+  bool m_Preempt;
+  bool m_Continuous;
+  bool m_PollWhileSleeping;
+  bool m_Pure;
+};
+
+template <typename DataType, typename ContextType>
+struct StormBehaviorTreeTemplateService
+{
+  std::size_t m_TypeId;
+  int m_Size;
+  int m_Offset;
+  int m_Align;
+  int m_InitDataOffset;
+  const char * m_DebugName = nullptr;
+  std::vector<int> m_InterruptEvents;
+  void(*m_Allocate)(void * memory, void * init_info, const StormBehaviorTreeParamBlock * params);
+  void(*m_Deallocate)(void * ptr);
+  void(*m_Relocate)(void * dst, void * src);
+  bool m_TriviallyRelocatable;
+  void(*m_Save)(const void * ptr, StormBehaviorTreeWriteBuffer & buffer);
+  void(*m_Load)(void * mem, StormBehaviorTreeReadBuffer & buffer);
+  bool m_RawSerializable;
+  bool m_Replicated;
+  void(*m_Activate)(void * ptr, DataType & data_type, ContextType & context_type);
+  void(*m_Deactivate)(void * ptr, DataType & data_type, ContextType & context_type);
+  void(*m_Update)(void * ptr, DataType & data_type, ContextType & context_type);
+  int m_Interval = 0;
+  int m_Deviation = 0;
+  int m_TimedIndex = -1;
+};
+
+// Scorers live in the template rather than in instance memory, so a batch of instances can be scored with
+// one call.  m_ScoreBatch is the scorer's own ScoreBatch if it has one, otherwise a loop over Score
+template <typename DataType, typename ContextType>
+struct StormBehaviorTreeTemplateScorer
+{
+  std::size_t m_TypeId;
+  int m_InitDataOffset;
+  const char * m_DebugName;
+  void(*m_Destroy)(void * ptr);
+  float(*m_Score)(const void * ptr, const DataType & data_type, const ContextType & context_type);
+  void(*m_ScoreBatch)(const void * ptr, const DataType * const * data_types, int count, const ContextType & context_type, float * out_scores);
+};
+
+// The key extractor of a switch node, which lives in the template like a scorer.  m_GetKey calls the extractor's
+// GetKey(data, context), which returns an integer or enum
+template <typename DataType, typename ContextType>
+struct StormBehaviorTreeTemplateSwitchKey
+{
+  std::size_t m_TypeId;
+  int m_InitDataOffset;
+  const char * m_DebugName;
+  void(*m_Destroy)(void * ptr);
+  int(*m_GetKey)(const void * ptr, const DataType & data_type, const ContextType & context_type);
+};
+
+struct StormBehaviorTreeTemplateInitInfo
+{
+  std::unique_ptr<uint8_t[]> m_Memory;
+  std::size_t m_Size = 0;
+  std::size_t m_Alignment = 1;
+
+  void (*m_Destructor)(void * src) = nullptr;
+  void (*m_Copier)(const void * src, void * dst) = nullptr;
+  void (*m_VisitParams)(void * src, void * user, StormBehaviorParamCallback callback) = nullptr;
+  uint64_t (*m_Hash)(const void * src) = nullptr;
+  bool (*m_Equal)(const void * a, const void * b) = nullptr;
+};
+
+template <class T, class Tuple, std::size_t... I>
+void StormBehaviorMakeFromTupleImpl(void * mem, Tuple&& t, std::index_sequence<I...>)
+{
+  new (mem) T(std::get<I>(std::forward<Tuple>(t))...);
+}
+ 
+template <class T, class Tuple>
+void StormBehaviorMakeFromTuple(void * mem, Tuple&& t)
+{
+   StormBehaviorMakeFromTupleImpl<T>(mem, std::forward<Tuple>(t),
+      std::make_index_sequence<std::tuple_size<std::remove_reference_t<Tuple>>::value>{});
+}
+
+template <typename UpdaterType>
+struct StormBehaviorTreeTemplateStateMarker
+{
+
+};
+
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeTemplateBuilder
+{
+public:
+
+  using SubtreeType = StormBehaviorTreeTemplateBuilder<DataType, ContextType>;
+  using ServiceType = StormBehaviorTreeTemplateService<DataType, ContextType>;
+  using StateType = StormBehaviorTreeTemplateState<DataType, ContextType>;
+  using ConditionalType = StormBehaviorTreeTemplateConditional<DataType, ContextType>;
+  using ScorerType = StormBehaviorTreeTemplateScorer<DataType, ContextType>;
+  using SwitchKeyType = StormBehaviorTreeTemplateSwitchKey<DataType, ContextType>;
+  using ExpressionType = StormBehaviorTreeConditionalExpression<DataType, ContextType>;
+
+  template <typename ... Args>
+  StormBehaviorTreeTemplateBuilder(StormBehaviorNodeType type) :
+    m_Type(type)
+  {
+    assert(m_Type != StormBehaviorNodeType::kLeaf);
+    AddContentHash(static_cast<uint64_t>(m_Type));
+  }
+
+  template <typename State, typename ... Args>
+  StormBehaviorTreeTemplateBuilder(const StormBehaviorTreeTemplateStateMarker<State> &, Args && ... args) :
+    m_Type(StormBehaviorNodeType::kLeaf)
+  {
+    StateType updater = {};
+    updater.m_TypeId = typeid(State).hash_code();
+    updater.m_DebugName = typeid(State).name();
+    updater.m_Size = sizeof(State);
+    updater.m_Align = alignof(State);
+
+    if constexpr(sizeof...(Args) > 0)
+    {
+      using InitData = std::tuple<std::decay_t<Args>...>;
+
+      updater.m_Allocate = [](void * mem, void * init_info, const StormBehaviorTreeParamBlock * params)
+      { 
+        auto * init_data = static_cast<InitData *>(init_info);
+        StormBehaviorMakeFromTupleWithParams<State>(mem, *init_data, params);
+      };
+
+      m_StateInitInfo.emplace(
+        StormBehaviorTreeTemplateInitInfo{ 
+          std::make_unique<uint8_t[]>(sizeof(InitData)), 
+          sizeof(InitData),
+          alignof(InitData),
+          [](void * mem){ InitData * i = static_cast<InitData *>(mem); i->~InitData(); },
+          [](const void * src, void * dst){ auto i = static_cast<const InitData *>(src); new(dst) InitData(*i); }});
+      
+      new (m_StateInitInfo->m_Memory.get()) InitData(std::make_tuple(std::forward<Args>(args)...));
+      m_StateInitInfo->m_VisitParams = StormBehaviorGetParamVisitor<std::decay_t<Args>...>();
+      m_StateInitInfo->m_Hash = &StormBehaviorHashInitData<std::decay_t<Args>...>;
+      m_StateInitInfo->m_Equal = StormBehaviorGetInitDataEqual<std::decay_t<Args>...>();
+    }
+    else
+    {
+      updater.m_Allocate = [](void * mem, void * init_info, const StormBehaviorTreeParamBlock *) { new(mem) State(); };
+      m_StateInitInfo.emplace();
+    }
+
+    updater.m_Deallocate = [](void * mem) { auto ptr = static_cast<State *>(mem); ptr->~State(); };
+    updater.m_Relocate = StormBehaviorGetRelocate<State>();
+    updater.m_TriviallyRelocatable = StormBehaviorIsTriviallyRelocatable<State>();
+    updater.m_Save = StormBehaviorGetSave<State>();
+    updater.m_Load = StormBehaviorGetLoad<State>();
+    updater.m_RawSerializable = StormBehaviorIsRawSerializable<State>();
+    updater.m_Replicated = StormBehaviorIsReplicated<State>();
+
+    updater.m_Activate = nullptr;
+    updater.m_Deactivate = nullptr;
+
+    if constexpr(StormBehaviorHasActivate<State>::value)
+    {
+      updater.m_Activate = [](void * ptr, DataType & data_type, ContextType & context_type)
+      {
+        State * updater = reinterpret_cast<State *>(ptr);
+        updater->Activate(data_type, context_type);
+      };
+    }
+
+    if constexpr(StormBehaviorHasDeactivate<State>::value)
+    {
+      updater.m_Deactivate = [](void * ptr, DataType & data_type, ContextType & context_type)
+      {
+        State * updater = reinterpret_cast<State *>(ptr);
+        updater->Deactivate(data_type, context_type);
+      };
+    }
+
+    updater.m_Update = [](void * ptr, DataType & data_type, ContextType & context_type)
+    {
+      State * updater = reinterpret_cast<State *>(ptr);
+      return updater->Update(data_type, context_type);
+    };
+
+    updater.m_GetSleepTicks = nullptr;
+    if constexpr(StormBehaviorHasGetSleepTicks<State>::value)
+    {
+      updater.m_GetSleepTicks = [](void * ptr, const DataType & data_type, const ContextType & context_type)
+      {
+        State * updater = reinterpret_cast<State *>(ptr);
+        return static_cast<int>(updater->GetSleepTicks(data_type, context_type));
+      };
+    }
+
+    m_State.emplace(updater);
+
+    AddContentHash(static_cast<uint64_t>(m_Type));
+    AddContentHash(static_cast<uint64_t>(m_State->m_TypeId));
+    AddContentHash(*m_StateInitInfo);
+  }
+
+  StormBehaviorTreeTemplateBuilder(const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & rhs) = delete;
+  StormBehaviorTreeTemplateBuilder & operator = (const StormBehaviorTreeTemplateBuilder<DataType, ContextType> & rhs) = delete;
+
+  StormBehaviorTreeTemplateBuilder(StormBehaviorTreeTemplateBuilder<DataType, ContextType> && rhs) = default;
+  StormBehaviorTreeTemplateBuilder & operator = (StormBehaviorTreeTemplateBuilder<DataType, ContextType> && rhs) = default;
+
+  ~StormBehaviorTreeTemplateBuilder()
+  {
+    for(auto & elem : m_ServiceInitInfo)
+    {
+      if(elem.m_Destructor)
+      {
+        elem.m_Destructor(elem.m_Memory.get());
+      }
+    }
+
+    for(auto & elem : m_ConditionInitInfo)
+    {
+      if(elem.m_Destructor)
+      {
+        elem.m_Destructor(elem.m_Memory.get());
+      }
+    }
+
+    for(auto & elem : m_ConditionalTermInitInfo)
+    {
+      if(elem.m_Destructor)
+      {
+        elem.m_Destructor(elem.m_Memory.get());
+      }
+    }
+
+    if(m_StateInitInfo.has_value())
+    {
+      if(m_StateInitInfo->m_Destructor)
+      {
+        m_StateInitInfo->m_Destructor(m_StateInitInfo->m_Memory.get());
+      }
+    }
+
+    for(auto & elem : m_ScorerInitInfo)
+    {
+      if(elem.m_Destructor)
+      {
+        elem.m_Destructor(elem.m_Memory.get());
+      }
+    }
+
+    for(auto & elem : m_SwitchKeyInitInfo)
+    {
+      if(elem.m_Destructor)
+      {
+        elem.m_Destructor(elem.m_Memory.get());
+      }
+    }
+  }
+
+  SubtreeType && AddChild(SubtreeType && sub_tree) &&
+  {
+    m_OwnedSubtrees.emplace_back(std::make_unique<SubtreeType>(std::move(sub_tree)));
+    m_Subtrees.emplace_back(SubtreeInfo{ m_OwnedSubtrees.back().get(), 100 });
+    AddContentHash(m_Subtrees.back());
+    
+    return std::forward<SubtreeType>(*this);
+  }
+
+  SubtreeType && AddChild(int random_weight, StormBehaviorTreeTemplateBuilder && sub_tree) &&
+  {
+    m_OwnedSubtrees.emplace_back(std::make_unique<SubtreeType>(std::move(sub_tree)));
+    m_Subtrees.emplace_back(SubtreeInfo{ m_OwnedSubtrees.back().get(), random_weight });
+    AddContentHash(m_Subtrees.back());
+    
+    return std::forward<SubtreeType>(*this);
+  }
+
+  SubtreeType && AddChildSubTree(const StormBehaviorTreeTemplateBuilder & sub_tree) &&
+  {
+    m_Subtrees.emplace_back(SubtreeInfo{ &sub_tree, 100 });
+    AddContentHash(m_Subtrees.back());
+    
+    return std::forward<SubtreeType>(*this);
+  }
+
+  SubtreeType && AddChildSubTree(int random_weight, const StormBehaviorTreeTemplateBuilder & sub_tree) &&
+  {
+    m_Subtrees.emplace_back(SubtreeInfo{ &sub_tree, random_weight });
+    AddContentHash(m_Subtrees.back());
+    
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Adds a child to a utility node.  The Scorer is constructed from args and its Score(data, context) decides
+  // the order the children are tried in, highest first
+  template <typename Scorer, typename ... Args>
+  SubtreeType && AddScoredChild(SubtreeType && sub_tree, Args && ... args) &&
+  {
+    m_OwnedSubtrees.emplace_back(std::make_unique<SubtreeType>(std::move(sub_tree)));
+    m_Subtrees.emplace_back(SubtreeInfo{ m_OwnedSubtrees.back().get(), 100, static_cast<int>(m_Scorers.size()) });
+    AddContentHash(m_Subtrees.back());
+    AddScorerInternal<Scorer>(std::forward<Args>(args)...);
+
+    return std::forward<SubtreeType>(*this);
+  }
+
+  template <typename Scorer, typename ... Args>
+  SubtreeType && AddScoredChildSubTree(const StormBehaviorTreeTemplateBuilder & sub_tree, Args && ... args) &&
+  {
+    m_Subtrees.emplace_back(SubtreeInfo{ &sub_tree, 100, static_cast<int>(m_Scorers.size()) });
+    AddContentHash(m_Subtrees.back());
+    AddScorerInternal<Scorer>(std::forward<Args>(args)...);
+
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Sets how a switch node reads its key.  KeyType is constructed from args and its GetKey(data, context) returns
+  // an integer or enum
+  template <typename KeyType, typename ... Args>
+  SubtreeType && SetSwitchKey(Args && ... args) &&
+  {
+    SetSwitchKeyInternal<KeyType>(std::forward<Args>(args)...);
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Adds the child a switch node goes to when its key is case_key.  A child added to a switch node with AddChild is
+  // the default, which is used for keys without a case and when the case's child has no valid leaf
+  template <typename CaseKey>
+  SubtreeType && AddCaseChild(CaseKey case_key, SubtreeType && sub_tree) &&
+  {
+    assert(m_Type == StormBehaviorNodeType::kSwitch);
+    m_OwnedSubtrees.emplace_back(std::make_unique<SubtreeType>(std::move(sub_tree)));
+    m_Subtrees.emplace_back(SubtreeInfo{ m_OwnedSubtrees.back().get(), 100, -1, true, static_cast<int>(case_key) });
+    AddContentHash(m_Subtrees.back());
+
+    return std::forward<SubtreeType>(*this);
+  }
+
+  template <typename CaseKey>
+  SubtreeType && AddCaseChildSubTree(CaseKey case_key, const StormBehaviorTreeTemplateBuilder & sub_tree) &&
+  {
+    assert(m_Type == StormBehaviorNodeType::kSwitch);
+    m_Subtrees.emplace_back(SubtreeInfo{ &sub_tree, 100, -1, true, static_cast<int>(case_key) });
+    AddContentHash(m_Subtrees.back());
+
+    return std::forward<SubtreeType>(*this);
+  }
+
+  template <typename Service, typename ... Args>
+  SubtreeType && AddService(Args && ... args) &&
+  {
+    AddServiceInternal<Service>(0, 0, std::forward<Args>(args)...);
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Adds a service that is updated once on activation and then every interval ticks, plus or minus up to 
+  // deviation ticks drawn separately each time, so services that start on the same tick spread out over frames.  
+  // Services that aren't due are skipped without being touched
+  template <typename Service, typename ... Args>
+  SubtreeType && AddTimedService(int interval, int deviation, Args && ... args) &&
+  {
+    assert(interval > 0 && deviation >= 0 && deviation < interval);
+    AddServiceInternal<Service>(interval, deviation, std::forward<Args>(args)...);
+    return std::forward<SubtreeType>(*this);
+  }
+
+  template <typename Conditional, typename ... Args>
+  SubtreeType && AddConditional(bool preempt, bool continuous, Args && ... args) &&
+  {
+    AddConditionalInternal<Conditional>(preempt, continuous, std::forward<Args>(args)...);
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Adds an AND / OR / NOT expression over conditionals that behaves like a single conditional, including for
+  // preempt and continuous checks
+  SubtreeType && AddConditionalExpression(bool preempt, bool continuous, ExpressionType && expression) &&
+  {
+    AddConditionalExpressionInternal(preempt, continuous, std::move(expression));
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Names the node so it can be found with StormBehaviorTreeTemplate::FindNode and targeted by interrupts
+  SubtreeType && SetName(const char * name) &&
+  {
+    m_DebugName = name;
+    AddContentHash(static_cast<uint64_t>(std::hash<std::string_view>{}(name)));
+    return std::forward<SubtreeType>(*this);
+  }
+
+  // Posting or broadcasting event_id to an instance makes it immediately re-select from this node
+  SubtreeType && InterruptOn(int event_id) &&
+  {
+    m_InterruptEvents.push_back(event_id);
+    AddContentHash(static_cast<uint64_t>(event_id));
+    return std::forward<SubtreeType>(*this);
+  }
+
+  void DebugPrint() const
+  {
+    DebugPrint(0);
+  }
+
+  // Hash of the node structure, names, element types and init arguments of this builder and its subtrees, built
+  // up as elements are added, so builders with the same content added in the same order hash the same.  Returns
+  // false if an init argument can't be compared with ==, in which case the builder can't be matched against
+  // other builders
+  bool GetContentHash(uint64_t & hash) const
+  {
+    hash = m_ContentHash;
+    return m_Hashable;
+  }
+
+  // True if both builders compile to the same template
+  bool IsSameContent(const StormBehaviorTreeTemplateBuilder & rhs) const
+  {
+    if(m_Type != rhs.m_Type || IsSameName(m_DebugName, rhs.m_DebugName) == false || m_InterruptEvents != rhs.m_InterruptEvents ||
+       m_Conditionals.size() != rhs.m_Conditionals.size() || m_Services.size() != rhs.m_Services.size() ||
+       m_State.has_value() != rhs.m_State.has_value() || m_Scorers.size() != rhs.m_Scorers.size() || 
+       m_SwitchKeys.size() != rhs.m_SwitchKeys.size() ||
+       m_Subtrees.size() != rhs.m_Subtrees.size())
+    {
+      return false;
+    }
+
+    for(std::size_t index = 0; index < m_Conditionals.size(); ++index)
+    {
+      auto & conditional = m_Conditionals[index];
+      auto & rhs_conditional = rhs.m_Conditionals[index];
+      if(conditional.m_TypeId != rhs_conditional.m_TypeId || conditional.m_Preempt != rhs_conditional.m_Preempt ||
+         conditional.m_Continuous != rhs_conditional.m_Continuous || 
+         IsSameInitInfo(m_ConditionInitInfo[index], rhs.m_ConditionInitInfo[index]) == false ||
+         IsSameExpression(conditional, rhs, rhs_conditional) == false)
+      {
+        return false;
+      }
+    }
+
+    for(std::size_t index = 0; index < m_Services.size(); ++index)
+    {
+      if(m_Services[index].m_TypeId != rhs.m_Services[index].m_TypeId || 
+         m_Services[index].m_Interval != rhs.m_Services[index].m_Interval ||
+         m_Services[index].m_Deviation != rhs.m_Services[index].m_Deviation ||
+         IsSameInitInfo(m_ServiceInitInfo[index], rhs.m_ServiceInitInfo[index]) == false)
+      {
+        return false;
+      }
+    }
+
+    if(m_State.has_value() && (m_State->m_TypeId != rhs.m_State->m_TypeId || IsSameInitInfo(*m_StateInitInfo, *rhs.m_StateInitInfo) == false))
+    {
+      return false;
+    }
+
+    for(std::size_t index = 0; index < m_Scorers.size(); ++index)
+    {
+      if(m_Scorers[index].m_TypeId != rhs.m_Scorers[index].m_TypeId || 
+         IsSameInitInfo(m_ScorerInitInfo[index], rhs.m_ScorerInitInfo[index]) == false)
+      {
+        return false;
+      }
+    }
+
+    for(std::size_t index = 0; index < m_SwitchKeys.size(); ++index)
+    {
+      if(m_SwitchKeys[index].m_TypeId != rhs.m_SwitchKeys[index].m_TypeId ||
+         IsSameInitInfo(m_SwitchKeyInitInfo[index], rhs.m_SwitchKeyInitInfo[index]) == false)
+      {
+        return false;
+      }
+    }
+
+    for(std::size_t index = 0; index < m_Subtrees.size(); ++index)
+    {
+      auto & subtree = m_Subtrees[index];
+      auto & rhs_subtree = rhs.m_Subtrees[index];
+      if(subtree.m_RandomWeight != rhs_subtree.m_RandomWeight || subtree.m_ScorerIndex != rhs_subtree.m_ScorerIndex ||
+         subtree.m_HasCaseKey != rhs_subtree.m_HasCaseKey || subtree.m_CaseKey != rhs_subtree.m_CaseKey ||
+         subtree.m_SubTree->IsSameContent(*rhs_subtree.m_SubTree) == false)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+private:
+
+  static bool IsSameName(const char * a, const char * b)
+  {
+    return a == b || (a && b && strcmp(a, b) == 0);
+  }
+
+  // Elements without init arguments have no init memory
+  static bool IsSameInitInfo(const StormBehaviorTreeTemplateInitInfo & a, const StormBehaviorTreeTemplateInitInfo & b)
+  {
+    if(a.m_Memory == nullptr || b.m_Memory == nullptr)
+    {
+      return a.m_Memory == b.m_Memory;
+    }
+
+    return a.m_Equal && a.m_Equal == b.m_Equal && a.m_Equal(a.m_Memory.get(), b.m_Memory.get());
+  }
+
+  bool IsSameExpression(const ConditionalType & conditional, const StormBehaviorTreeTemplateBuilder & rhs, const ConditionalType & rhs_conditional) const
+  {
+    if(conditional.m_TermEnd - conditional.m_TermStart != rhs_conditional.m_TermEnd - rhs_conditional.m_TermStart ||
+       conditional.m_ProgramEnd - conditional.m_ProgramStart != rhs_conditional.m_ProgramEnd - rhs_conditional.m_ProgramStart)
+    {
+      return false;
+    }
+
+    for(int index = 0; index < conditional.m_TermEnd - conditional.m_TermStart; ++index)
+    {
+      auto term_index = conditional.m_TermStart + index;
+      auto rhs_term_index = rhs_conditional.m_TermStart + index;
+      if(m_ConditionalTerms[term_index].m_TypeId != rhs.m_ConditionalTerms[rhs_term_index].m_TypeId ||
+         IsSameInitInfo(m_ConditionalTermInitInfo[term_index], rhs.m_ConditionalTermInitInfo[rhs_term_index]) == false)
+      {
+        return false;
+      }
+    }
+
+    for(int index = 0; index < conditional.m_ProgramEnd - conditional.m_ProgramStart; ++index)
+    {
+      auto & op = m_ConditionalProgram[conditional.m_ProgramStart + index];
+      auto & rhs_op = rhs.m_ConditionalProgram[rhs_conditional.m_ProgramStart + index];
+      if(op.m_Op != rhs_op.m_Op || op.m_Term != rhs_op.m_Term)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  template <typename Service, typename ... Args>
+  void AddServiceInternal(int interval, int deviation, Args && ... args)
+  {
+    ServiceType service = {};
+    service.m_TypeId = typeid(Service).hash_code();
+    service.m_DebugName = typeid(Service).name();
+    service.m_Size = sizeof(Service);    
+    service.m_Align = alignof(Service);
+    service.m_Interval = interval;
+    service.m_Deviation = deviation;
+
+    if constexpr(sizeof...(Args) > 0)
+    {
+      using InitData = std::tuple<std::decay_t<Args>...>;
+
+      service.m_Allocate = [](void * mem, void * init_info, const StormBehaviorTreeParamBlock * params)
+      { 
+        auto * init_data = static_cast<InitData *>(init_info);
+        StormBehaviorMakeFromTupleWithParams<Service>(mem, *init_data, params);
+      };
+
+      m_ServiceInitInfo.emplace_back(
+        StormBehaviorTreeTemplateInitInfo{ 
+          std::make_unique<uint8_t[]>(sizeof(InitData)), 
+          sizeof(InitData),
+          alignof(InitData),
+          [](void * mem){ InitData * i = static_cast<InitData *>(mem); i->~InitData(); },
+          [](const void * src, void * dst){ auto i = static_cast<const InitData *>(src); new(dst) InitData(*i); }});
+      
+      new (m_ServiceInitInfo.back().m_Memory.get()) InitData(std::make_tuple(std::forward<Args>(args)...));
+      m_ServiceInitInfo.back().m_VisitParams = StormBehaviorGetParamVisitor<std::decay_t<Args>...>();
+      m_ServiceInitInfo.back().m_Hash = &StormBehaviorHashInitData<std::decay_t<Args>...>;
+      m_ServiceInitInfo.back().m_Equal = StormBehaviorGetInitDataEqual<std::decay_t<Args>...>();
+    }
+    else
+    {
+      service.m_Allocate = [](void * mem, void * init_info, const StormBehaviorTreeParamBlock *) { new(mem) Service(); };
+      m_ServiceInitInfo.emplace_back();
+    }
+
+    service.m_Deallocate = [](void * mem) { auto ptr = static_cast<Service *>(mem); ptr->~Service(); };
+    service.m_Relocate = StormBehaviorGetRelocate<Service>();
+    service.m_TriviallyRelocatable = StormBehaviorIsTriviallyRelocatable<Service>();
+    service.m_Save = StormBehaviorGetSave<Service>();
+    service.m_Load = StormBehaviorGetLoad<Service>();
+    service.m_RawSerializable = StormBehaviorIsRawSerializable<Service>();
+    service.m_Replicated = StormBehaviorIsReplicated<Service>();
+
+    service.m_Activate = nullptr;
+    service.m_Deactivate = nullptr;
+    service.m_Update = nullptr;
+
+    if constexpr(StormBehaviorHasActivate<Service>::value)
+    {
+      service.m_Activate = [](void * ptr, DataType & data_type, ContextType & context_type)
+      {
+        Service * service = reinterpret_cast<Service *>(ptr);
+        service->Activate(data_type, context_type);
+      };
+    }
+
+    if constexpr(StormBehaviorHasDeactivate<Service>::value)
+    {
+      service.m_Deactivate = [](void * ptr, DataType & data_type, ContextType & context_type)
+      {
+        Service * service = reinterpret_cast<Service *>(ptr);
+        service->Deactivate(data_type, context_type);
+      };
+    }
+
+    if constexpr(StormBehaviorHasUpdate<Service>::value)
+    {
+      service.m_Update = [](void * ptr, DataType & data_type, ContextType & context_type)
+      {
+        Service * service = reinterpret_cast<Service *>(ptr);
+        service->Update(data_type, context_type);
+      };
+    }
+
+    AddContentHash(static_cast<uint64_t>(service.m_TypeId));
+    AddContentHash((static_cast<uint64_t>(interval) << 32) | static_cast<uint32_t>(deviation));
+    AddContentHash(m_ServiceInitInfo.back());
+    m_Services.emplace_back(std::move(service));
+
+    
+  }
+
+  template <typename Conditional, typename ... Args>
+  void AddConditionalInternal(bool preempt, bool continuous, Args && ... args)
+  {
+    m_ConditionInitInfo.emplace_back();
+    auto conditional = CreateConditional<Conditional>(m_ConditionInitInfo.back(), std::forward<Args>(args)...);
+    conditional.m_Preempt = preempt;
+    conditional.m_Continuous = continuous;
+
+    AddContentHash(static_cast<uint64_t>(conditional.m_TypeId));
+    AddContentHash((preempt ? 1 : 0) | (continuous ? 2 : 0));
+    AddContentHash(m_ConditionInitInfo.back());
+    m_Conditionals.emplace_back(std::move(conditional));
+  }
+
+  void AddConditionalExpressionInternal(bool preempt, bool continuous, ExpressionType && expression)
+  {
+    ConditionalType conditional = {};
+    conditional.m_TypeId = typeid(ExpressionType).hash_code();
+    conditional.m_DebugName = "Expression";
+    conditional.m_TriviallyRelocatable = true;
+    conditional.m_RawSerializable = true;
+    conditional.m_Replicated = false;
+    conditional.m_Preempt = preempt;
+    conditional.m_Continuous = continuous;
+    conditional.m_PollWhileSleeping = false;
+    conditional.m_Pure = true;
+    conditional.m_Align = 1;
+
+    // The terms live inside the expression's node memory, the template lays them out
+    conditional.m_TermStart = static_cast<int>(m_ConditionalTerms.size());
+    for(auto & term : expression.m_Terms)
+    {
+      conditional.m_Align = std::max(conditional.m_Align, term.m_Align);
+      conditional.m_TriviallyRelocatable &= term.m_TriviallyRelocatable;
+      conditional.m_RawSerializable &= term.m_RawSerializable;
+      conditional.m_Replicated |= term.m_Replicated;
+      conditional.m_PollWhileSleeping |= term.m_PollWhileSleeping;
+      conditional.m_Pure &= term.m_Pure;
+      m_ConditionalTerms.emplace_back(std::move(term));
+    }
+    conditional.m_TermEnd = static_cast<int>(m_ConditionalTerms.size());
+
+    for(auto & init_info : expression.m_TermInitInfo)
+    {
+      m_ConditionalTermInitInfo.emplace_back(std::move(init_info));
+    }
+    expression.m_TermInitInfo.clear();
+
+    conditional.m_ProgramStart = static_cast<int>(m_ConditionalProgram.size());
+    m_ConditionalProgram.insert(m_ConditionalProgram.end(), expression.m_Program.begin(), expression.m_Program.end());
+    conditional.m_ProgramEnd = static_cast<int>(m_ConditionalProgram.size());
+
+    AddContentHash(static_cast<uint64_t>(conditional.m_TypeId));
+    AddContentHash((preempt ? 1 : 0) | (continuous ? 2 : 0));
+    for(int index = conditional.m_TermStart; index < conditional.m_TermEnd; ++index)
+    {
+      AddContentHash(static_cast<uint64_t>(m_ConditionalTerms[index].m_TypeId));
+      AddContentHash(m_ConditionalTermInitInfo[index]);
+    }
+
+    for(int index = conditional.m_ProgramStart; index < conditional.m_ProgramEnd; ++index)
+    {
+      auto & op = m_ConditionalProgram[index];
+      AddContentHash((static_cast<uint64_t>(op.m_Op) << 32) | static_cast<uint32_t>(op.m_Term));
+    }
+
+    m_ConditionInitInfo.emplace_back();
+    m_Conditionals.emplace_back(std::move(conditional));
+  }
+
+  template <typename Conditional, typename ... Args>
+  static ConditionalType CreateConditional(StormBehaviorTreeTemplateInitInfo & init_info, Args && ... args)
+  {
+    ConditionalType conditional = {};
+    conditional.m_TypeId = typeid(Conditional).hash_code();
+    conditional.m_DebugName = typeid(Conditional).name();
+    conditional.m_Size = sizeof(Conditional);
+    conditional.m_Align = alignof(Conditional);
+
+    if constexpr(sizeof...(Args) > 0)
+    {
+      using InitData = std::tuple<std::decay_t<Args>...>;
+
+      conditional.m_Allocate = [](void * mem, void * init_info, const StormBehaviorTreeParamBlock * params)
+      { 
+        auto * init_data = static_cast<InitData *>(init_info);
+        StormBehaviorMakeFromTupleWithParams<Conditional>(mem, *init_data, params);
+      };
+
+      init_info = StormBehaviorTreeTemplateInitInfo{ 
+        std::make_unique<uint8_t[]>(sizeof(InitData)), 
+        sizeof(InitData),
+        alignof(InitData),
+        [](void * mem){ InitData * i = static_cast<InitData *>(mem); i->~InitData(); },
+        [](const void * src, void * dst){ auto i = static_cast<const InitData *>(src); new(dst) InitData(*i); }};
+
+      new (init_info.m_Memory.get()) InitData(std::make_tuple(std::forward<Args>(args)...));
+      init_info.m_VisitParams = StormBehaviorGetParamVisitor<std::decay_t<Args>...>();
+      init_info.m_Hash = &StormBehaviorHashInitData<std::decay_t<Args>...>;
+      init_info.m_Equal = StormBehaviorGetInitDataEqual<std::decay_t<Args>...>();
+      conditional.m_InitDataEqual = init_info.m_Equal;
+    }
+    else
+    {
+      conditional.m_Allocate = [](void * mem, void * init_info, const StormBehaviorTreeParamBlock *) { new(mem) Conditional(); };
+      conditional.m_InitDataEqual = [](const void * a, const void * b) { return true; };
+    }
+
+    conditional.m_Deallocate = [](void * mem) { auto ptr = static_cast<Conditional*>(mem); ptr->~Conditional(); };
+    conditional.m_Relocate = StormBehaviorGetRelocate<Conditional>();
+    conditional.m_TriviallyRelocatable = StormBehaviorIsTriviallyRelocatable<Conditional>();
+    conditional.m_Save = StormBehaviorGetSave<Conditional>();
+    conditional.m_Load = StormBehaviorGetLoad<Conditional>();
+    conditional.m_RawSerializable = StormBehaviorIsRawSerializable<Conditional>();
+    conditional.m_Replicated = StormBehaviorIsReplicated<Conditional>();
+
+    conditional.m_Check = [](void * ptr, const DataType & data_type, const ContextType & context_type)
+    {
+      Conditional * conditional = reinterpret_cast<Conditional *>(ptr);
+      return conditional->Check(data_type, context_type);
+    };
+
+    conditional.m_CheckBatch = nullptr;
+    if constexpr(StormBehaviorHasCheckBatch<Conditional>::value)
+    {
+      conditional.m_CheckBatch = [](const void * const * ptrs, const DataType * const * data_types, int count, const ContextType & context_type, uint64_t * out_bits)
+      {
+        Conditional::CheckBatch(reinterpret_cast<const Conditional * const *>(ptrs), data_types, count, context_type, out_bits);
+      };
+    }
+
+    conditional.m_Preempt = false;
+    conditional.m_Continuous = false;
+    conditional.m_PollWhileSleeping = false;
+    conditional.m_Pure = false;
+
+    if constexpr(StormBehaviorHasPollWhileSleeping<Conditional>::value)
+    {
+      conditional.m_PollWhileSleeping = Conditional::kPollWhileSleeping;
+    }
+
+    if constexpr(StormBehaviorHasPure<Conditional>::value)
+    {
+      conditional.m_Pure = Conditional::kPure;
+    }
+    return conditional;
+  }
+
+  template <typename Scorer, typename ... Args>
+  void AddScorerInternal(Args && ... args)
+  {
+    assert(m_Type == StormBehaviorNodeType::kUtility);
+
+    ScorerType scorer;
+    scorer.m_TypeId = typeid(Scorer).hash_code();
+    scorer.m_DebugName = typeid(Scorer).name();
+    scorer.m_InitDataOffset = 0;
+    scorer.m_Destroy = [](void * mem) { auto ptr = static_cast<Scorer *>(mem); ptr->~Scorer(); };
+
+    scorer.m_Score = [](const void * ptr, const DataType & data_type, const ContextType & context_type)
+    {
+      const Scorer * scorer = reinterpret_cast<const Scorer *>(ptr);
+      return static_cast<float>(scorer->Score(data_type, context_type));
+    };
+
+    if constexpr(StormBehaviorHasScoreBatch<Scorer>::value)
+    {
+      scorer.m_ScoreBatch = [](const void * ptr, const DataType * const * data_types, int count, const ContextType & context_type, float * out_scores)
+      {
+        const Scorer * scorer = reinterpret_cast<const Scorer *>(ptr);
+        scorer->ScoreBatch(data_types, count, context_type, out_scores);
+      };
+    }
+    else
+    {
+      scorer.m_ScoreBatch = [](const void * ptr, const DataType * const * data_types, int count, const ContextType & context_type, float * out_scores)
+      {
+        const Scorer * scorer = reinterpret_cast<const Scorer *>(ptr);
+        for(int index = 0; index < count; ++index)
+        {
+          out_scores[index] = static_cast<float>(scorer->Score(*data_types[index], context_type));
+        }
+      };
+    }
+
+    m_ScorerInitInfo.emplace_back(
+      StormBehaviorTreeTemplateInitInfo{ 
+        std::make_unique<uint8_t[]>(sizeof(Scorer)), 
+        sizeof(Scorer),
+        alignof(Scorer),
+        [](void * mem){ Scorer * i = static_cast<Scorer *>(mem); i->~Scorer(); },
+        [](const void * src, void * dst){ auto i = static_cast<const Scorer *>(src); new(dst) Scorer(*i); }});
+
+    new (m_ScorerInitInfo.back().m_Memory.get()) Scorer(std::forward<Args>(args)...);
+
+    if constexpr(StormBehaviorHasEqual<Scorer>::value)
+    {
+      m_ScorerInitInfo.back().m_Hash = [](const void * ptr) 
+      { 
+        uint64_t hash = 0;
+        if constexpr(StormBehaviorHasHash<Scorer>::value)
+        {
+          StormBehaviorHashCombine(hash, static_cast<uint64_t>(std::hash<Scorer>{}(*static_cast<const Scorer *>(ptr))));
+        }
+
+        return hash;
+      };
+      m_ScorerInitInfo.back().m_Equal = [](const void * a, const void * b) { return *static_cast<const Scorer *>(a) == *static_cast<const Scorer *>(b); };
+    }
+    AddContentHash(static_cast<uint64_t>(scorer.m_TypeId));
+    AddContentHash(m_ScorerInitInfo.back());
+    m_Scorers.emplace_back(std::move(scorer));
+  }
+
+  template <typename KeyType, typename ... Args>
+  void SetSwitchKeyInternal(Args && ... args)
+  {
+    assert(m_Type == StormBehaviorNodeType::kSwitch && m_SwitchKeys.size() == 0);
+
+    SwitchKeyType switch_key;
+    switch_key.m_TypeId = typeid(KeyType).hash_code();
+    switch_key.m_DebugName = typeid(KeyType).name();
+    switch_key.m_InitDataOffset = 0;
+    switch_key.m_Destroy = [](void * mem) { auto ptr = static_cast<KeyType *>(mem); ptr->~KeyType(); };
+
+    switch_key.m_GetKey = [](const void * ptr, const DataType & data_type, const ContextType & context_type)
+    {
+      const KeyType * switch_key = reinterpret_cast<const KeyType *>(ptr);
+      return static_cast<int>(switch_key->GetKey(data_type, context_type));
+    };
+
+    m_SwitchKeyInitInfo.emplace_back(
+      StormBehaviorTreeTemplateInitInfo{
+        std::make_unique<uint8_t[]>(sizeof(KeyType)),
+        sizeof(KeyType),
+        alignof(KeyType),
+        [](void * mem){ KeyType * i = static_cast<KeyType *>(mem); i->~KeyType(); },
+        [](const void * src, void * dst){ auto i = static_cast<const KeyType *>(src); new(dst) KeyType(*i); }});
+
+    new (m_SwitchKeyInitInfo.back().m_Memory.get()) KeyType(std::forward<Args>(args)...);
+
+    if constexpr(StormBehaviorHasEqual<KeyType>::value)
+    {
+      m_SwitchKeyInitInfo.back().m_Hash = [](const void * ptr)
+      {
+        uint64_t hash = 0;
+        if constexpr(StormBehaviorHasHash<KeyType>::value)
+        {
+          StormBehaviorHashCombine(hash, static_cast<uint64_t>(std::hash<KeyType>{}(*static_cast<const KeyType *>(ptr))));
+        }
+
+        return hash;
+      };
+      m_SwitchKeyInitInfo.back().m_Equal = [](const void * a, const void * b) { return *static_cast<const KeyType *>(a) == *static_cast<const KeyType *>(b); };
+    }
+
+    AddContentHash(static_cast<uint64_t>(switch_key.m_TypeId));
+    AddContentHash(m_SwitchKeyInitInfo.back());
+    m_SwitchKeys.emplace_back(std::move(switch_key));
+  }
+
+  struct SubtreeInfo
+  {
+    const SubtreeType * m_SubTree;
+    int m_RandomWeight;
+    int m_ScorerIndex = -1;
+    bool m_HasCaseKey = false;
+    int m_CaseKey = 0;
+  };
+
+  void AddContentHash(uint64_t val)
+  {
+    StormBehaviorHashCombine(m_ContentHash, val);
+  }
+
+  // Init arguments without a std::hash only show up in IsSameContent
+  void AddContentHash(const StormBehaviorTreeTemplateInitInfo & init_info)
+  {
+    if(init_info.m_Memory == nullptr)
+    {
+      return;
+    }
+
+    if(init_info.m_Equal == nullptr)
+    {
+      m_Hashable = false;
+      return;
+    }
+
+    AddContentHash(init_info.m_Hash ? init_info.m_Hash(init_info.m_Memory.get()) : 0);
+  }
+
+  void AddContentHash(const SubtreeInfo & subtree)
+  {
+    AddContentHash((static_cast<uint64_t>(static_cast<uint32_t>(subtree.m_RandomWeight)) << 32) | static_cast<uint32_t>(subtree.m_ScorerIndex));
+    if(subtree.m_HasCaseKey)
+    {
+      AddContentHash(static_cast<uint64_t>(static_cast<uint32_t>(subtree.m_CaseKey)));
+    }
+
+    AddContentHash(subtree.m_SubTree->m_ContentHash);
+    m_Hashable &= subtree.m_SubTree->m_Hashable;
+  }
+  
+  void DebugPrintIndent(int indent) const
+  {
+    for(int index = 0; index < indent; ++index)
+    {
+      printf(" ");
+    }
+  }
+
+  void DebugPrint(int indent) const
+  {
+    DebugPrintIndent(indent);
+
+    printf("-");
+    switch(m_Type)
+    {
+      case StormBehaviorNodeType::kSelect:
+        printf("Select\n");
+        break;
+      case StormBehaviorNodeType::kSequence:
+        printf("Sequence\n");
+        break;
+      case StormBehaviorNodeType::kRandom:
+        printf("Random\n");
+        break;
+      case StormBehaviorNodeType::kUtility:
+        printf("Utility\n");
+        break;
+      case StormBehaviorNodeType::kSwitch:
+        printf("Switch (%s)\n", m_SwitchKeys.size() > 0 ? m_SwitchKeys[0].m_DebugName : "None");
+        break;
+      case StormBehaviorNodeType::kLeaf:
+        printf("Leaf (%s)\n", m_State->m_DebugName);
+        break;
+    }
+
+    for(auto & elem : m_Conditionals)
+    {
+      DebugPrintIndent(indent);
+      printf("| Conditional (%s)\n", elem.m_DebugName);
+
+      for(int index = elem.m_TermStart; index < elem.m_TermEnd; ++index)
+      {
+        DebugPrintIndent(indent);
+        printf("|   Term (%s)\n", m_ConditionalTerms[index].m_DebugName);
+      }
+    }
+
+    for(auto & elem : m_Services)
+    {
+      DebugPrintIndent(indent);
+      printf("| Service (%s)\n", elem.m_DebugName);
+    }
+
+    for(auto & elem : m_Subtrees)
+    {
+      elem.m_SubTree->DebugPrint(indent + 2);
+    }
+  }
+
+private:
+
+  friend class StormBehaviorTreeTemplate<DataType, ContextType>;
+  friend class StormBehaviorTreeConditionalExpression<DataType, ContextType>;
+
+  StormBehaviorNodeType m_Type;
+
+  std::vector<ServiceType> m_Services;
+  std::vector<StormBehaviorTreeTemplateInitInfo> m_ServiceInitInfo;
+  std::vector<ConditionalType> m_Conditionals;
+  std::vector<StormBehaviorTreeTemplateInitInfo> m_ConditionInitInfo;
+  std::vector<ConditionalType> m_ConditionalTerms;
+  std::vector<StormBehaviorTreeTemplateInitInfo> m_ConditionalTermInitInfo;
+  std::vector<StormBehaviorTreeTemplateConditionalOp> m_ConditionalProgram;
+  std::optional<StateType> m_State;
+  std::optional<StormBehaviorTreeTemplateInitInfo> m_StateInitInfo;
+  std::vector<ScorerType> m_Scorers;
+  std::vector<StormBehaviorTreeTemplateInitInfo> m_ScorerInitInfo;
+  std::vector<SwitchKeyType> m_SwitchKeys;
+  std::vector<StormBehaviorTreeTemplateInitInfo> m_SwitchKeyInitInfo;
+
+  const char * m_DebugName = nullptr;
+  std::vector<int> m_InterruptEvents;
+
+  uint64_t m_ContentHash = 0;
+  bool m_Hashable = true;
+
+  std::vector<SubtreeInfo> m_Subtrees;
+  std::vector<std::unique_ptr<SubtreeType>> m_OwnedSubtrees;
+};
+
+// AND, OR and NOT over conditionals, added to a node with AddConditionalExpression.  (A && !B) || C is
+//
+//   using Expr = StormBehaviorTreeConditionalExpression<DataType, ContextType>;
+//   Expr::Or(Expr::And(Expr::Check<A>(), Expr::Not(Expr::Check<B>())), Expr::Check<C>())
+//
+// The template stores the expression as a postfix program and checks it in one call.  Every term is checked
+// each time, there is no short circuiting, and the results are combined on a bit stack
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeConditionalExpression
+{
+public:
+
+  using ExpressionType = StormBehaviorTreeConditionalExpression<DataType, ContextType>;
+  using BuilderType = StormBehaviorTreeTemplateBuilder<DataType, ContextType>;
+  using ConditionalType = StormBehaviorTreeTemplateConditional<DataType, ContextType>;
+
+  // Deepest the bit stack can get while the program runs
+  static const int kMaxDepth = 64;
+
+  StormBehaviorTreeConditionalExpression(const ExpressionType & rhs) = delete;
+  StormBehaviorTreeConditionalExpression & operator = (const ExpressionType & rhs) = delete;
+
+  StormBehaviorTreeConditionalExpression(ExpressionType && rhs) = default;
+
+  ~StormBehaviorTreeConditionalExpression()
+  {
+    for(auto & elem : m_TermInitInfo)
+    {
+      if(elem.m_Destructor)
+      {
+        elem.m_Destructor(elem.m_Memory.get());
+      }
+    }
+  }
+
+  template <typename Conditional, typename ... Args>
+  static ExpressionType Check(Args && ... args)
+  {
+    ExpressionType expression;
+    expression.m_TermInitInfo.emplace_back();
+    expression.m_Terms.emplace_back(BuilderType::template CreateConditional<Conditional>(expression.m_TermInitInfo.back(), std::forward<Args>(args)...));
+    expression.m_Program.emplace_back(StormBehaviorTreeTemplateConditionalOp{ StormBehaviorConditionalOp::kCheck, 0 });
+    expression.m_Depth = 1;
+    return expression;
+  }
+
+  static ExpressionType Not(ExpressionType && expression)
+  {
+    expression.m_Program.emplace_back(StormBehaviorTreeTemplateConditionalOp{ StormBehaviorConditionalOp::kNot, -1 });
+    return std::move(expression);
+  }
+
+  template <typename ... Rest>
+  static ExpressionType And(ExpressionType && a, ExpressionType && b, Rest && ... rest)
+  {
+    auto expression = Combine(std::move(a), std::move(b), StormBehaviorConditionalOp::kAnd);
+    if constexpr(sizeof...(Rest) > 0)
+    {
+      return And(std::move(expression), std::forward<Rest>(rest)...);
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+  template <typename ... Rest>
+  static ExpressionType Or(ExpressionType && a, ExpressionType && b, Rest && ... rest)
+  {
+    auto expression = Combine(std::move(a), std::move(b), StormBehaviorConditionalOp::kOr);
+    if constexpr(sizeof...(Rest) > 0)
+    {
+      return Or(std::move(expression), std::forward<Rest>(rest)...);
+    }
+    else
+    {
+      return expression;
+    }
+  }
+
+private:
+
+  StormBehaviorTreeConditionalExpression() = default;
+
+  // Appends b's program after a's, so b's result ends up on top of a's, then combines the two
+  static ExpressionType Combine(ExpressionType && a, ExpressionType && b, StormBehaviorConditionalOp op)
+  {
+    auto term_offset = static_cast<int>(a.m_Terms.size());
+    for(auto & term : b.m_Terms)
+    {
+      a.m_Terms.emplace_back(std::move(term));
+    }
+
+    for(auto & init_info : b.m_TermInitInfo)
+    {
+      a.m_TermInitInfo.emplace_back(std::move(init_info));
+    }
+    b.m_TermInitInfo.clear();
+
+    for(auto elem : b.m_Program)
+    {
+      if(elem.m_Op == StormBehaviorConditionalOp::kCheck)
+      {
+        elem.m_Term += term_offset;
+      }
+
+      a.m_Program.push_back(elem);
+    }
+
+    a.m_Program.emplace_back(StormBehaviorTreeTemplateConditionalOp{ op, -1 });
+    a.m_Depth = std::max(a.m_Depth, b.m_Depth + 1);
+    assert(a.m_Depth <= kMaxDepth);
+    return std::move(a);
+  }
+
+  std::vector<ConditionalType> m_Terms;
+  std::vector<StormBehaviorTreeTemplateInitInfo> m_TermInitInfo;
+  std::vector<StormBehaviorTreeTemplateConditionalOp> m_Program;
+  int m_Depth = 0;
+
+  friend class StormBehaviorTreeTemplateBuilder<DataType, ContextType>;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "StormBehaviorTreeTemplate.h"
+#include "StormBehaviorParallel.h"
+
+// Compiles builders into templates in bulk.  Builders with the same structure, element types and init arguments,
+// such as prefab variants that only differ in data the tree doesn't use, compile once and share the template.
+// The cache owns every template it hands out and keeps the builders it compiled so later builders can be
+// matched against them, so subtrees added with AddChildSubTree must outlive the cache
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeTemplateCache
+{
+public:
+
+  using BuilderType = StormBehaviorTreeTemplateBuilder<DataType, ContextType>;
+  using TemplateType = StormBehaviorTreeTemplate<DataType, ContextType>;
+
+  StormBehaviorTreeTemplateCache() = default;
+  StormBehaviorTreeTemplateCache(const StormBehaviorTreeTemplateCache & rhs) = delete;
+  StormBehaviorTreeTemplateCache & operator = (const StormBehaviorTreeTemplateCache & rhs) = delete;
+
+  // Returns a template for each builder, in order.  Builders that match one already in the cache, or an earlier
+  // one in the list, reuse its template and the rest are compiled on up to thread_count threads.  Builders with
+  // init arguments that can't be compared with == are always compiled on their own.  The threads only live for
+  // the call, which is fine for a load time batch where each one compiles many templates
+  std::vector<TemplateType *> Compile(std::vector<BuilderType> && builders, int thread_count = 1)
+  {
+    // Builders keep their hash up to date as they are built, so this isn't worth spreading over threads
+    auto builder_count = static_cast<int>(builders.size());
+    std::vector<uint64_t> hashes(builder_count);
+    std::vector<uint8_t> hashable(builder_count);
+    for(int index = 0; index < builder_count; ++index)
+    {
+      hashable[index] = builders[index].GetContentHash(hashes[index]) ? 1 : 0;
+    }
+
+    // Match against the cache, then against the builders that are new in this call
+    std::vector<TemplateType *> templates(builder_count, nullptr);
+    std::vector<int> entry_indices(builder_count, -1);
+    auto first_new_entry = static_cast<int>(m_Entries.size());
+
+    for(int index = 0; index < builder_count; ++index)
+    {
+      if(hashable[index])
+      {
+        auto range = m_EntryLookup.equal_range(hashes[index]);
+        for(auto itr = range.first; itr != range.second; ++itr)
+        {
+          if(m_Entries[itr->second].m_Builder->IsSameContent(builders[index]))
+          {
+            entry_indices[index] = itr->second;
+            break;
+          }
+        }
+      }
+
+      if(entry_indices[index] == -1)
+      {
+        entry_indices[index] = static_cast<int>(m_Entries.size());
+        m_Entries.emplace_back(Entry{ std::make_unique<BuilderType>(std::move(builders[index])), nullptr });
+
+        if(hashable[index])
+        {
+          m_EntryLookup.emplace(hashes[index], entry_indices[index]);
+        }
+      }
+      else
+      {
+        m_Hits++;
+      }
+    }
+
+    auto new_entry_count = static_cast<int>(m_Entries.size()) - first_new_entry;
+    StormBehaviorParallelFor(new_entry_count, thread_count, [&](int index)
+    {
+      auto & entry = m_Entries[first_new_entry + index];
+      entry.m_Template = std::make_unique<TemplateType>(*entry.m_Builder);
+    });
+
+    for(int index = 0; index < builder_count; ++index)
+    {
+      templates[index] = m_Entries[entry_indices[index]].m_Template.get();
+    }
+
+    return templates;
+  }
+
+  TemplateType * Compile(BuilderType && builder)
+  {
+    std::vector<BuilderType> builders;
+    builders.emplace_back(std::move(builder));
+    return Compile(std::move(builders))[0];
+  }
+
+  int GetTemplateCount() const
+  {
+    return static_cast<int>(m_Entries.size());
+  }
+
+  // Builders that were matched to an existing template instead of being compiled
+  uint64_t GetHitCount() const
+  {
+    return m_Hits;
+  }
+
+private:
+
+  struct Entry
+  {
+    std::unique_ptr<BuilderType> m_Builder;
+    std::unique_ptr<TemplateType> m_Template;
+  };
+
+  std::vector<Entry> m_Entries;
+  std::unordered_multimap<uint64_t, int> m_EntryLookup;
+  uint64_t m_Hits = 0;
+};
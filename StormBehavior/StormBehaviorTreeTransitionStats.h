@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+// Dwell times are bucketed by powers of two, bucket b counts stays of [2^b, 2^(b+1)) ticks and the last bucket
+// also counts everything longer
+static const int kStormBehaviorDwellBucketCount = 16;
+
+inline int StormBehaviorGetDwellBucket(uint64_t ticks)
+{
+  int bucket = 0;
+  while(ticks > 1 && bucket < kStormBehaviorDwellBucketCount - 1)
+  {
+    ticks >>= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+
+// Small per thread index used to spread counter updates over shards
+inline int StormBehaviorGetThreadShard()
+{
+  static std::atomic<int> s_NextShard = { 0 };
+  thread_local int s_Shard = s_NextShard.fetch_add(1, std::memory_order_relaxed);
+  return s_Shard;
+}
+
+// Totals summed over every shard at the time of the snapshot.  Leaves are indexed by leaf index and conditionals
+// by their index in the template
+struct StormBehaviorTreeTransitionSnapshot
+{
+  uint64_t GetTransitionCount(int from_leaf, int to_leaf) const
+  {
+    return m_Transitions[static_cast<std::size_t>(from_leaf) * m_LeafCount + to_leaf];
+  }
+
+  uint64_t GetDwellCount(int leaf, int bucket) const
+  {
+    return m_DwellHistograms[static_cast<std::size_t>(leaf) * kStormBehaviorDwellBucketCount + bucket];
+  }
+
+  double GetAverageDwell(int leaf) const
+  {
+    uint64_t count = 0;
+    for(int bucket = 0; bucket < kStormBehaviorDwellBucketCount; ++bucket)
+    {
+      count += GetDwellCount(leaf, bucket);
+    }
+
+    return count ? static_cast<double>(m_DwellTicks[leaf]) / count : 0.0;
+  }
+
+  uint64_t GetPreemptionCount(int conditional_index) const
+  {
+    return m_Preemptions[conditional_index];
+  }
+
+  int m_LeafCount = 0;
+  std::vector<uint64_t> m_Transitions;
+  std::vector<uint64_t> m_DwellHistograms;
+  std::vector<uint64_t> m_DwellTicks;
+  std::vector<uint64_t> m_Preemptions;
+};
+
+// Population wide leaf transition matrix, leaf dwell time histograms and per conditional preemption counts for
+// one template.  Counters are relaxed atomics split into shards by thread, each shard on its own cache lines, so
+// instances updated in parallel rarely touch the same line.  Snapshots taken while instances are updating are
+// approximate
+class StormBehaviorTreeTransitionStats
+{
+public:
+
+  StormBehaviorTreeTransitionStats(int leaf_count, int conditional_count, int shard_count) :
+    m_LeafCount(leaf_count),
+    m_ConditionalCount(conditional_count),
+    m_ShardCount(shard_count)
+  {
+    assert(shard_count > 0);
+
+    m_TransitionStart = 0;
+    m_DwellHistogramStart = m_TransitionStart + leaf_count * leaf_count;
+    m_DwellTicksStart = m_DwellHistogramStart + leaf_count * kStormBehaviorDwellBucketCount;
+    m_PreemptionStart = m_DwellTicksStart + leaf_count;
+
+    // Round every shard up to a whole number of cache lines
+    auto counter_count = m_PreemptionStart + conditional_count;
+    m_ShardStride = (counter_count + kCountersPerLine - 1) / kCountersPerLine * kCountersPerLine;
+    m_Lines = std::make_unique<CounterLine[]>(static_cast<std::size_t>(m_ShardStride / kCountersPerLine) * shard_count);
+  }
+
+  void RecordTransition(int from_leaf, int to_leaf)
+  {
+    GetCounter(GetShard() + m_TransitionStart + from_leaf * m_LeafCount + to_leaf).fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void RecordDwell(int leaf, uint64_t ticks)
+  {
+    auto shard = GetShard();
+    GetCounter(shard + m_DwellHistogramStart + leaf * kStormBehaviorDwellBucketCount + StormBehaviorGetDwellBucket(ticks)).fetch_add(1, std::memory_order_relaxed);
+    GetCounter(shard + m_DwellTicksStart + leaf).fetch_add(ticks, std::memory_order_relaxed);
+  }
+
+  void RecordPreemption(int conditional_index)
+  {
+    GetCounter(GetShard() + m_PreemptionStart + conditional_index).fetch_add(1, std::memory_order_relaxed);
+  }
+
+  StormBehaviorTreeTransitionSnapshot GetSnapshot() const
+  {
+    StormBehaviorTreeTransitionSnapshot snapshot;
+    snapshot.m_LeafCount = m_LeafCount;
+    snapshot.m_Transitions = SumCounters(m_TransitionStart, m_LeafCount * m_LeafCount);
+    snapshot.m_DwellHistograms = SumCounters(m_DwellHistogramStart, m_LeafCount * kStormBehaviorDwellBucketCount);
+    snapshot.m_DwellTicks = SumCounters(m_DwellTicksStart, m_LeafCount);
+    snapshot.m_Preemptions = SumCounters(m_PreemptionStart, m_ConditionalCount);
+    return snapshot;
+  }
+
+  // Safe to call while instances are updating, but counts recorded during the reset may be lost
+  void Reset()
+  {
+    for(std::size_t index = 0; index < static_cast<std::size_t>(m_ShardStride) * m_ShardCount; ++index)
+    {
+      GetCounter(index).store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Moves the preemption counters along with the conditionals when the template reorders them.  The new
+  // conditional at index i was previously at order[i]
+  void RemapConditionals(const std::vector<int> & order)
+  {
+    std::vector<uint64_t> counts(m_ConditionalCount);
+    for(int shard = 0; shard < m_ShardCount; ++shard)
+    {
+      auto start = static_cast<std::size_t>(shard) * m_ShardStride + m_PreemptionStart;
+      for(int index = 0; index < m_ConditionalCount; ++index)
+      {
+        counts[index] = GetCounter(start + order[index]).load(std::memory_order_relaxed);
+      }
+
+      for(int index = 0; index < m_ConditionalCount; ++index)
+      {
+        GetCounter(start + index).store(counts[index], std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+
+  static const int kCountersPerLine = 64 / sizeof(uint64_t);
+
+  // new[] only guarantees the alignment of the element type, so the counters are allocated as whole lines
+  struct alignas(64) CounterLine
+  {
+    std::atomic<uint64_t> m_Counters[kCountersPerLine];
+  };
+
+  std::atomic<uint64_t> & GetCounter(std::size_t index) const
+  {
+    return m_Lines[index / kCountersPerLine].m_Counters[index % kCountersPerLine];
+  }
+
+  // Index of the first counter in this thread's shard
+  std::size_t GetShard() const
+  {
+    return static_cast<std::size_t>(StormBehaviorGetThreadShard() % m_ShardCount) * m_ShardStride;
+  }
+
+  std::vector<uint64_t> SumCounters(int start, int count) const
+  {
+    std::vector<uint64_t> sums(count);
+    for(int shard = 0; shard < m_ShardCount; ++shard)
+    {
+      auto shard_start = static_cast<std::size_t>(shard) * m_ShardStride + start;
+      for(int index = 0; index < count; ++index)
+      {
+        sums[index] += GetCounter(shard_start + index).load(std::memory_order_relaxed);
+      }
+    }
+
+    return sums;
+  }
+
+  int m_LeafCount;
+  int m_ConditionalCount;
+  int m_ShardCount;
+  int m_ShardStride;
+  int m_TransitionStart;
+  int m_DwellHistogramStart;
+  int m_DwellTicksStart;
+  int m_PreemptionStart;
+  std::unique_ptr<CounterLine[]> m_Lines;
+};
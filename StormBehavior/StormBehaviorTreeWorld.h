@@ -0,0 +1,624 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "StormBehaviorTree.h"
+#include "StormBehaviorParallel.h"
+#include "StormBehaviorTimerWheel.h"
+
+// Runs a population of behavior tree instances as a two phase tick.  Evaluate does the traversal and
+// conditional checks for every instance with read-only access to the data and context and can be
+// spread across threads.  Apply then runs the activate / deactivate / update callbacks, either in
+// parallel or serialized in instance order when the callbacks touch shared state
+//
+// Instances whose active state asks to sleep are taken out of the awake list and skipped entirely
+// until their deadline comes up on the timer wheel, they are woken explicitly, they are sent an event 
+// that their template listens for, or one of their leaf's polling conditionals changes
+template <typename DataType, typename ContextType>
+class StormBehaviorTreeWorld
+{
+public:
+
+  using TreeType = StormBehaviorTree<DataType, ContextType>;
+  using TemplateType = StormBehaviorTreeTemplate<DataType, ContextType>;
+
+  int AddInstance(TreeType * tree, DataType * data)
+  {
+    int handle;
+    if(m_FreeHandles.size() > 0)
+    {
+      handle = m_FreeHandles.back();
+      m_FreeHandles.pop_back();
+    }
+    else
+    {
+      handle = static_cast<int>(m_Instances.size());
+      m_Instances.emplace_back();
+      m_TargetNodes.emplace_back(-1);
+    }
+
+    m_Instances[handle] = InstanceInfo{ tree, data };
+    m_Instances[handle].m_LastApplyTick = m_TimerWheel.GetTick();
+    m_TargetNodes[handle] = -1;
+    tree->SetBroadcast(&m_Broadcast);
+    tree->SetServiceSeed(static_cast<uint64_t>(handle));
+
+    if(m_ConditionalOrderInterval > 0 && tree->GetBehaviorTree())
+    {
+      tree->GetBehaviorTree()->EnableConditionalStats();
+    }
+
+    m_PendingWake.push_back(handle);
+    MergePendingWake();
+    return handle;
+  }
+
+  void RemoveInstance(int handle)
+  {
+    assert(m_Instances[handle].m_Tree != nullptr);
+
+    if(m_Instances[handle].m_Sleeping == false)
+    {
+      m_AwakeHandles.erase(std::lower_bound(m_AwakeHandles.begin(), m_AwakeHandles.end(), handle));
+    }
+    else if(m_Instances[handle].m_Polling)
+    {
+      m_PollingHandles.erase(std::find(m_PollingHandles.begin(), m_PollingHandles.end(), handle));
+    }
+
+    m_Instances[handle].m_Tree->SetBroadcast(nullptr);
+    m_Instances[handle] = InstanceInfo{};
+    m_FreeHandles.push_back(handle);
+  }
+
+  TreeType * GetInstance(int handle) const
+  {
+    return m_Instances[handle].m_Tree;
+  }
+
+  // One past the highest handle in use.  GetInstance returns nullptr for free handles below it
+  int GetHandleCount() const
+  {
+    return static_cast<int>(m_Instances.size());
+  }
+
+  int GetInstanceCount() const
+  {
+    return static_cast<int>(m_Instances.size() - m_FreeHandles.size());
+  }
+
+  int GetAwakeInstanceCount() const
+  {
+    return static_cast<int>(m_AwakeHandles.size());
+  }
+
+  bool IsSleeping(int handle) const
+  {
+    return m_Instances[handle].m_Sleeping;
+  }
+
+  uint64_t GetTick() const
+  {
+    return m_TimerWheel.GetTick();
+  }
+
+  // Wakes a sleeping instance so it is updated on the next tick.  Not safe to call during Evaluate or Apply
+  void Wake(int handle)
+  {
+    if(m_Instances[handle].m_Sleeping)
+    {
+      WakeInternal(handle);
+      MergePendingWake();
+    }
+  }
+
+  // Posts an event to a single instance and wakes it if it's sleeping.  Safe to call from any thread, including 
+  // from inside Evaluate and Apply, in which case it is picked up on the next tick
+  void PostEvent(int handle, int event_id)
+  {
+    m_Instances[handle].m_Tree->PostEvent(event_id);
+    m_WakeQueue.Push(handle);
+  }
+
+  void Interrupt(int handle, int node_index)
+  {
+    m_Instances[handle].m_Tree->Interrupt(node_index);
+    m_WakeQueue.Push(handle);
+  }
+
+  // Sends event_id to every instance in the world in O(1).  Instances pick it up on their next Evaluate and
+  // sleeping instances whose template listens for the event are woken.  Safe to call from any thread
+  void Broadcast(int event_id)
+  {
+    m_Broadcast.Broadcast(event_id);
+  }
+
+  // Scores every utility node child for all awake instances up front, one ScoreBatch call per template scorer,
+  // instead of calling the scorers one instance at a time during traversal.  Worth it when most instances
+  // reach their utility nodes every tick
+  void SetBatchUtilityScoring(bool batch_utility_scoring)
+  {
+    m_BatchUtilityScoring = batch_utility_scoring;
+  }
+
+  // Checks the conditionals that keep each awake instance in its leaf up front, one CheckBatch call per template
+  // conditional, instead of one Check call per instance during traversal.  Only conditionals with a
+  //
+  //   static void CheckBatch(const Conditional * const * conditionals, const DataType * const * datas, int count,
+  //                          const ContextType & context, uint64_t * out_bits)
+  //
+  // are batched.  It must write all (count + 63) / 64 words of out_bits, with the result for instance i in bit 
+  // i % 64 of out_bits[i / 64].  The kernel also runs for instances that would have stopped at an earlier conditional, 
+  // so it must not have side effects
+  void SetBatchConditionals(bool batch_conditionals)
+  {
+    m_BatchConditionals = batch_conditionals;
+  }
+
+  // Records conditional cost and pass rates for every template in the world and reorders the pure conditional
+  // groups of each template every interval ticks, after Apply.  Zero stops reordering, but leaves the stats enabled
+  void SetConditionalOrderInterval(int interval)
+  {
+    m_ConditionalOrderInterval = interval;
+    if(interval > 0)
+    {
+      VisitTemplates([](TemplateType & bt) { bt.EnableConditionalStats(); });
+    }
+  }
+
+  // random_provider(handle) must return the random source for that instance.  Sharing one generator
+  // between instances makes the result depend on thread scheduling
+  template <typename RandomProvider>
+  void Evaluate(const ContextType & context, RandomProvider && random_provider, int thread_count = 1)
+  {
+    m_TimerWheel.Advance([&](int handle)
+    {
+      auto & instance = m_Instances[handle];
+      if(instance.m_Tree && instance.m_Sleeping && instance.m_WakeTick == m_TimerWheel.GetTick())
+      {
+        WakeInternal(handle);
+      }
+    });
+
+    m_WakeQueue.Drain([&](int handle)
+    {
+      auto & instance = m_Instances[handle];
+      if(instance.m_Tree && instance.m_Sleeping)
+      {
+        WakeInternal(handle);
+      }
+    });
+
+    WakeBroadcastListeners();
+    PollSleepingInstances(context, thread_count);
+    MergePendingWake();
+
+    if(m_BatchUtilityScoring)
+    {
+      PrecomputeUtilityScores(context, thread_count);
+    }
+
+    if(m_BatchConditionals)
+    {
+      PrecomputeConditionals(context, thread_count);
+    }
+
+    m_ThreadPool.ParallelFor(static_cast<int>(m_AwakeHandles.size()), thread_count, [&](int index)
+    {
+      auto handle = m_AwakeHandles[index];
+      auto & instance = m_Instances[handle];
+
+      auto && random = random_provider(handle);
+      m_TargetNodes[handle] = instance.m_Tree->Evaluate(*instance.m_Data, context, random);
+    });
+
+    for(auto & group : m_ScoreGroups)
+    {
+      for(auto & handle : group.m_Handles)
+      {
+        m_Instances[handle].m_Tree->SetUtilityScores(nullptr, 0);
+      }
+
+      group.m_Handles.clear();
+    }
+  }
+
+  // A thread_count of 1 applies the instances in handle order, which keeps ticks deterministic when the
+  // callbacks write to the shared context
+  void Apply(ContextType & context, int thread_count = 1)
+  {
+    m_ThreadPool.ParallelFor(static_cast<int>(m_AwakeHandles.size()), thread_count, [&](int index)
+    {
+      auto handle = m_AwakeHandles[index];
+      auto & instance = m_Instances[handle];
+
+      // Ticks spent asleep still count as time in the leaf
+      auto tick = m_TimerWheel.GetTick();
+      if(tick > instance.m_LastApplyTick + 1)
+      {
+        instance.m_Tree->AddDwellTicks(static_cast<int>(tick - instance.m_LastApplyTick - 1));
+      }
+
+      instance.m_LastApplyTick = tick;
+      instance.m_Tree->Apply(m_TargetNodes[handle], *instance.m_Data, context);
+    });
+
+    auto awake_end = std::remove_if(m_AwakeHandles.begin(), m_AwakeHandles.end(), [&](int handle)
+    {
+      auto & instance = m_Instances[handle];
+      auto sleep_ticks = instance.m_Tree->GetSleepTicks();
+      if(sleep_ticks == 0)
+      {
+        return false;
+      }
+
+      instance.m_Sleeping = true;
+      instance.m_WakeTick = 0;
+      if(sleep_ticks > 0)
+      {
+        instance.m_WakeTick = m_TimerWheel.GetTick() + sleep_ticks;
+        m_TimerWheel.Schedule(handle, instance.m_WakeTick);
+      }
+
+      instance.m_Polling = instance.m_Tree->HasPollingConditionals();
+      if(instance.m_Polling)
+      {
+        m_PollingHandles.push_back(handle);
+      }
+
+      return true;
+    });
+
+    m_AwakeHandles.erase(awake_end, m_AwakeHandles.end());
+
+    if(m_ConditionalOrderInterval > 0 && m_TimerWheel.GetTick() % m_ConditionalOrderInterval == 0)
+    {
+      VisitTemplates([](TemplateType & bt) { bt.UpdateConditionalOrder(); });
+    }
+  }
+
+  template <typename RandomProvider>
+  void Update(ContextType & context, RandomProvider && random_provider, int evaluate_thread_count = 1, int apply_thread_count = 1)
+  {
+    Evaluate(context, std::forward<RandomProvider>(random_provider), evaluate_thread_count);
+    Apply(context, apply_thread_count);
+  }
+
+  // The workers every phase of Evaluate and Apply runs on.  They are started the first time a phase runs with
+  // more than one thread and sleep between phases, so other per-tick work can share them
+  StormBehaviorThreadPool & GetThreadPool()
+  {
+    return m_ThreadPool;
+  }
+
+  StormBehaviorTreePopulationMemoryStats GetMemoryStats() const
+  {
+    StormBehaviorTreePopulationMemoryStats stats;
+    for(auto & elem : m_Instances)
+    {
+      if(elem.m_Tree)
+      {
+        stats.AddInstance(*elem.m_Tree);
+      }
+    }
+
+    stats.AddExternalBytes(sizeof(*this) + StormBehaviorGetVectorBytes(m_Instances) + StormBehaviorGetVectorBytes(m_TargetNodes) +
+      StormBehaviorGetVectorBytes(m_FreeHandles) + StormBehaviorGetVectorBytes(m_AwakeHandles) + StormBehaviorGetVectorBytes(m_PollingHandles));
+    return stats;
+  }
+
+  int GetTargetNode(int handle) const
+  {
+    return m_TargetNodes[handle];
+  }
+
+private:
+
+  template <typename Visitor>
+  void VisitTemplates(Visitor && visitor)
+  {
+    std::vector<TemplateType *> templates;
+    for(auto & elem : m_Instances)
+    {
+      if(elem.m_Tree && elem.m_Tree->GetBehaviorTree() && 
+         std::find(templates.begin(), templates.end(), elem.m_Tree->GetBehaviorTree()) == templates.end())
+      {
+        templates.push_back(elem.m_Tree->GetBehaviorTree());
+      }
+    }
+
+    for(auto & elem : templates)
+    {
+      visitor(*elem);
+    }
+  }
+
+  void WakeInternal(int handle)
+  {
+    auto & instance = m_Instances[handle];
+    instance.m_Sleeping = false;
+    instance.m_Polling = false;
+    m_PendingWake.push_back(handle);
+  }
+
+  void WakeBroadcastListeners()
+  {
+    if(m_Broadcast.GetSequence() == m_BroadcastSequence)
+    {
+      return;
+    }
+
+    m_BroadcastEvents.clear();
+    auto complete = m_Broadcast.Read(m_BroadcastSequence, [&](int event_id) { m_BroadcastEvents.push_back(event_id); });
+
+    for(int handle = 0; handle < static_cast<int>(m_Instances.size()); ++handle)
+    {
+      auto & instance = m_Instances[handle];
+      if(instance.m_Tree == nullptr || instance.m_Sleeping == false)
+      {
+        continue;
+      }
+
+      auto bt = instance.m_Tree->GetBehaviorTree();
+      if(bt->HasEventNodes() == false)
+      {
+        continue;
+      }
+
+      auto listens = complete == false || std::any_of(m_BroadcastEvents.begin(), m_BroadcastEvents.end(), 
+        [&](int event_id) { return bt->ListensToEvent(event_id); });
+
+      if(listens)
+      {
+        WakeInternal(handle);
+      }
+    }
+  }
+
+  void PrecomputeUtilityScores(const ContextType & context, int thread_count)
+  {
+    m_ScoreGroupLookup.clear();
+    for(auto & group : m_ScoreGroups)
+    {
+      group.m_Handles.clear();
+      group.m_Data.clear();
+    }
+
+    int group_count = 0;
+    for(auto & handle : m_AwakeHandles)
+    {
+      auto & instance = m_Instances[handle];
+      auto bt = instance.m_Tree->GetBehaviorTree();
+      if(bt == nullptr || bt->GetScorerCount() == 0)
+      {
+        continue;
+      }
+
+      auto result = m_ScoreGroupLookup.emplace(bt, group_count);
+      if(result.second)
+      {
+        if(group_count == static_cast<int>(m_ScoreGroups.size()))
+        {
+          m_ScoreGroups.emplace_back();
+        }
+
+        m_ScoreGroups[group_count].m_Template = bt;
+        group_count++;
+      }
+
+      auto & group = m_ScoreGroups[result.first->second];
+      group.m_Handles.push_back(handle);
+      group.m_Data.push_back(instance.m_Data);
+    }
+
+    m_ScoreGroups.resize(group_count);
+    m_ScoreTasks.clear();
+
+    for(int group_index = 0; group_index < group_count; ++group_index)
+    {
+      auto & group = m_ScoreGroups[group_index];
+      group.m_Scores.resize(static_cast<std::size_t>(group.m_Template->GetScorerCount()) * group.m_Handles.size());
+
+      for(int scorer_index = 0; scorer_index < group.m_Template->GetScorerCount(); ++scorer_index)
+      {
+        m_ScoreTasks.emplace_back(group_index, scorer_index);
+      }
+    }
+
+    m_ThreadPool.ParallelFor(static_cast<int>(m_ScoreTasks.size()), thread_count, [&](int task_index)
+    {
+      auto & group = m_ScoreGroups[m_ScoreTasks[task_index].first];
+      auto scorer_index = m_ScoreTasks[task_index].second;
+      auto count = static_cast<int>(group.m_Handles.size());
+
+      group.m_Template->ScoreBatch(scorer_index, group.m_Data.data(), count, context, 
+        group.m_Scores.data() + static_cast<std::size_t>(scorer_index) * count);
+    });
+
+    for(auto & group : m_ScoreGroups)
+    {
+      auto count = static_cast<int>(group.m_Handles.size());
+      for(int index = 0; index < count; ++index)
+      {
+        m_Instances[group.m_Handles[index]].m_Tree->SetUtilityScores(group.m_Scores.data() + index, count);
+      }
+    }
+  }
+
+  void PrecomputeConditionals(const ContextType & context, int thread_count)
+  {
+    m_ConditionalGroupLookup.clear();
+    m_ConditionalGroupIndices.clear();
+    for(auto & group : m_ConditionalGroups)
+    {
+      group.m_Handles.clear();
+      group.m_Conditionals.clear();
+      group.m_Data.clear();
+    }
+
+    int group_count = 0;
+    for(auto & handle : m_AwakeHandles)
+    {
+      auto & instance = m_Instances[handle];
+      auto bt = instance.m_Tree->GetBehaviorTree();
+      if(bt == nullptr)
+      {
+        continue;
+      }
+
+      // Each template gets a run of group indices, one per conditional
+      auto result = m_ConditionalGroupLookup.emplace(bt, static_cast<int>(m_ConditionalGroupIndices.size()));
+      if(result.second)
+      {
+        m_ConditionalGroupIndices.resize(m_ConditionalGroupIndices.size() + bt->GetConditionalCount(), -1);
+      }
+
+      auto group_start = result.first->second;
+      instance.m_Tree->VisitBatchConditionals([&](int conditional_index, void * conditional_mem)
+      {
+        auto & group_index = m_ConditionalGroupIndices[group_start + conditional_index];
+        if(group_index == -1)
+        {
+          if(group_count == static_cast<int>(m_ConditionalGroups.size()))
+          {
+            m_ConditionalGroups.emplace_back();
+          }
+
+          m_ConditionalGroups[group_count].m_Template = bt;
+          m_ConditionalGroups[group_count].m_ConditionalIndex = conditional_index;
+          group_index = group_count;
+          group_count++;
+        }
+
+        auto & group = m_ConditionalGroups[group_index];
+        group.m_Handles.push_back(handle);
+        group.m_Conditionals.push_back(conditional_mem);
+        group.m_Data.push_back(instance.m_Data);
+      });
+    }
+
+    m_ConditionalGroups.resize(group_count);
+
+    m_ThreadPool.ParallelFor(group_count, thread_count, [&](int group_index)
+    {
+      auto & group = m_ConditionalGroups[group_index];
+      auto count = static_cast<int>(group.m_Handles.size());
+      group.m_Results.resize((group.m_Handles.size() + 63) / 64);
+
+      group.m_Template->CheckBatch(group.m_ConditionalIndex, group.m_Conditionals.data(), group.m_Data.data(), count, 
+        context, group.m_Results.data());
+    });
+
+    for(auto & group : m_ConditionalGroups)
+    {
+      for(std::size_t index = 0; index < group.m_Handles.size(); ++index)
+      {
+        auto result = (group.m_Results[index / 64] >> (index % 64)) & 1;
+        m_Instances[group.m_Handles[index]].m_Tree->SetConditionalResult(group.m_ConditionalIndex, result != 0);
+      }
+    }
+  }
+
+  void PollSleepingInstances(const ContextType & context, int thread_count)
+  {
+    if(m_PollingHandles.size() == 0)
+    {
+      return;
+    }
+
+    m_PollResults.resize(m_PollingHandles.size());
+    m_ThreadPool.ParallelFor(static_cast<int>(m_PollingHandles.size()), thread_count, [&](int index)
+    {
+      auto handle = m_PollingHandles[index];
+      auto & instance = m_Instances[handle];
+      m_PollResults[index] = instance.m_Sleeping == false || instance.m_Tree->CheckPollingConditionals(*instance.m_Data, context);
+    });
+
+    for(std::size_t index = 0; index < m_PollingHandles.size(); ++index)
+    {
+      if(m_PollResults[index] == false)
+      {
+        WakeInternal(m_PollingHandles[index]);
+      }
+    }
+
+    auto polling_end = std::remove_if(m_PollingHandles.begin(), m_PollingHandles.end(),
+      [&](int handle) { return m_Instances[handle].m_Polling == false; });
+    m_PollingHandles.erase(polling_end, m_PollingHandles.end());
+  }
+
+  // Keeps the awake list sorted so serialized applies always run in handle order
+  void MergePendingWake()
+  {
+    if(m_PendingWake.size() == 0)
+    {
+      return;
+    }
+
+    std::sort(m_PendingWake.begin(), m_PendingWake.end());
+
+    auto mid = m_AwakeHandles.size();
+    m_AwakeHandles.insert(m_AwakeHandles.end(), m_PendingWake.begin(), m_PendingWake.end());
+    std::inplace_merge(m_AwakeHandles.begin(), m_AwakeHandles.begin() + mid, m_AwakeHandles.end());
+    m_PendingWake.clear();
+  }
+
+  struct InstanceInfo
+  {
+    TreeType * m_Tree = nullptr;
+    DataType * m_Data = nullptr;
+    uint64_t m_WakeTick = 0;
+    uint64_t m_LastApplyTick = 0;
+    bool m_Sleeping = false;
+    bool m_Polling = false;
+  };
+
+  std::vector<InstanceInfo> m_Instances;
+  std::vector<int> m_TargetNodes;
+  std::vector<int> m_FreeHandles;
+
+  std::vector<int> m_AwakeHandles;
+  std::vector<int> m_PendingWake;
+  std::vector<int> m_PollingHandles;
+  std::vector<uint8_t> m_PollResults;
+  StormBehaviorTimerWheel m_TimerWheel;
+
+  struct ScoreGroup
+  {
+    const TemplateType * m_Template = nullptr;
+    std::vector<int> m_Handles;
+    std::vector<const DataType *> m_Data;
+    std::vector<float> m_Scores;
+  };
+
+  bool m_BatchUtilityScoring = false;
+  std::vector<ScoreGroup> m_ScoreGroups;
+  std::unordered_map<const TemplateType *, int> m_ScoreGroupLookup;
+  std::vector<std::pair<int, int>> m_ScoreTasks;
+
+  struct ConditionalGroup
+  {
+    const TemplateType * m_Template = nullptr;
+    int m_ConditionalIndex = 0;
+    std::vector<int> m_Handles;
+    std::vector<void *> m_Conditionals;
+    std::vector<const DataType *> m_Data;
+    std::vector<uint64_t> m_Results;
+  };
+
+  bool m_BatchConditionals = false;
+  std::vector<ConditionalGroup> m_ConditionalGroups;
+  std::unordered_map<const TemplateType *, int> m_ConditionalGroupLookup;
+  std::vector<int> m_ConditionalGroupIndices;
+
+  int m_ConditionalOrderInterval = 0;
+
+  StormBehaviorMpscQueue<int> m_WakeQueue;
+  StormBehaviorTreeBroadcast m_Broadcast;
+  uint64_t m_BroadcastSequence = 0;
+  std::vector<int> m_BroadcastEvents;
+
+  StormBehaviorThreadPool m_ThreadPool;
+};
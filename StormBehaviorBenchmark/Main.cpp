@@ -0,0 +1,616 @@
+
+#include "StormBehavior/StormBehaviorTree.h"
+#include "StormBehavior/StormBehaviorTreeWorld.h"
+#include "StormBehavior/StormBehaviorTreePersistence.h"
+#include "StormBehavior/StormBehaviorTreeReplication.h"
+#include "StormBehavior/StormBehaviorTreeTemplateCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Crowd simulation benchmark.  Builds a handful of random multi-hundred node templates from the seed, runs
+// a world of agents over them for a number of ticks while their data drifts, and reports throughput, per
+// tick latency percentiles, transitions per tick, memory use, replication bandwidth against full snapshots,
+// how fast the population saves and loads, the size and speed of replay logs for a sample of agents, how fast
+// a prefab library compiles at startup and how a wide select compares to a switch.  Everything is derived from the seed, so the checksum at the end must
+// match between runs with the same arguments
+//
+// Usage: StormBehaviorBenchmarkExe [agents] [ticks] [seed] [threads] [templates] [batch conditionals]
+
+static const int kBenchmarkFieldCount = 8;
+
+struct BenchmarkContext
+{
+  uint64_t m_Transitions = 0;
+};
+
+struct BenchmarkData
+{
+  float m_Fields[kBenchmarkFieldCount];
+};
+
+struct BenchmarkState
+{
+  static constexpr bool kReplicated = true;
+
+  BenchmarkState(int duration, int field, float cost)
+  {
+    m_Duration = duration;
+    m_Field = field;
+    m_Cost = cost;
+  }
+
+  void Activate(BenchmarkData & data, BenchmarkContext & context)
+  {
+    m_Ticks = 0;
+    context.m_Transitions++;
+  }
+
+  bool Update(BenchmarkData & data, BenchmarkContext & context)
+  {
+    data.m_Fields[m_Field] = std::max(0.0f, data.m_Fields[m_Field] - m_Cost);
+    m_Ticks++;
+    return m_Ticks >= m_Duration;
+  }
+
+  int m_Duration;
+  int m_Field;
+  float m_Cost;
+  int m_Ticks = 0;
+};
+
+struct BenchmarkService
+{
+  BenchmarkService(int field, float delta)
+  {
+    m_Field = field;
+    m_Delta = delta;
+  }
+
+  void Update(BenchmarkData & data, BenchmarkContext & context)
+  {
+    data.m_Fields[m_Field] = std::min(1.0f, data.m_Fields[m_Field] + m_Delta);
+  }
+
+  int m_Field;
+  float m_Delta;
+};
+
+struct BenchmarkConditional
+{
+  static constexpr bool kPure = true;
+
+  BenchmarkConditional(int field, float threshold, bool greater)
+  {
+    m_Field = field;
+    m_Threshold = threshold;
+    m_Greater = greater;
+  }
+
+  bool Check(const BenchmarkData & data, const BenchmarkContext & context)
+  {
+    return m_Greater ? data.m_Fields[m_Field] > m_Threshold : data.m_Fields[m_Field] <= m_Threshold;
+  }
+
+  // Branch free so the compiler can vectorize the compares
+  static void CheckBatch(const BenchmarkConditional * const * conditionals, const BenchmarkData * const * datas, int count,
+    const BenchmarkContext & context, uint64_t * out_bits)
+  {
+    for(int word = 0; word < (count + 63) / 64; ++word)
+    {
+      uint64_t bits = 0;
+      auto word_count = std::min(count - word * 64, 64);
+      for(int bit = 0; bit < word_count; ++bit)
+      {
+        auto conditional = conditionals[word * 64 + bit];
+        auto val = datas[word * 64 + bit]->m_Fields[conditional->m_Field];
+        auto greater = val > conditional->m_Threshold;
+        bits |= static_cast<uint64_t>(greater == conditional->m_Greater) << bit;
+      }
+
+      out_bits[word] = bits;
+    }
+  }
+
+  int m_Field;
+  float m_Threshold;
+  bool m_Greater;
+};
+
+// Wide dispatch on a key read from the data, once as a select with a "key == case" conditional on every child and
+// once as a switch
+static const int kDispatchCaseCount = 48;
+
+static int GetDispatchKey(const BenchmarkData & data)
+{
+  return std::min(static_cast<int>(data.m_Fields[0] * kDispatchCaseCount), kDispatchCaseCount - 1);
+}
+
+struct BenchmarkDispatchConditional
+{
+  static constexpr bool kPure = true;
+
+  BenchmarkDispatchConditional(int key)
+  {
+    m_Key = key;
+  }
+
+  bool Check(const BenchmarkData & data, const BenchmarkContext & context)
+  {
+    return GetDispatchKey(data) == m_Key;
+  }
+
+  int m_Key;
+};
+
+struct BenchmarkDispatchKey
+{
+  int GetKey(const BenchmarkData & data, const BenchmarkContext & context) const
+  {
+    return GetDispatchKey(data);
+  }
+};
+
+using BenchmarkBuilder = StormBehaviorTreeTemplateBuilder<BenchmarkData, BenchmarkContext>;
+using BenchmarkTemplate = StormBehaviorTreeTemplate<BenchmarkData, BenchmarkContext>;
+using BenchmarkTree = StormBehaviorTree<BenchmarkData, BenchmarkContext>;
+using BenchmarkWorld = StormBehaviorTreeWorld<BenchmarkData, BenchmarkContext>;
+
+// The distributions in <random> differ between standard libraries, so draw straight from the engine
+static int RandomRange(std::mt19937 & rng, int min, int max)
+{
+  return min + static_cast<int>(rng() % static_cast<uint32_t>(max - min + 1));
+}
+
+static void AddRandomConditionals(BenchmarkBuilder & node, std::mt19937 & rng, int max_count)
+{
+  auto count = RandomRange(rng, 0, max_count);
+  for(int index = 0; index < count; ++index)
+  {
+    // Draw a small set of thresholds so identical conditionals show up on several nodes like they do in real trees
+    auto field = RandomRange(rng, 0, kBenchmarkFieldCount - 1);
+    auto threshold = RandomRange(rng, 1, 4) * 0.2f;
+    auto greater = RandomRange(rng, 0, 1) == 1;
+    auto kind = RandomRange(rng, 0, 9);
+
+    std::move(node).AddConditional<BenchmarkConditional>(kind == 0, kind <= 3, field, threshold, greater);
+  }
+}
+
+static BenchmarkBuilder GenerateNode(std::mt19937 & rng, int depth, int & node_budget)
+{
+  node_budget--;
+
+  auto type_roll = RandomRange(rng, 0, 99);
+  if(depth > 0 && (depth >= 5 || node_budget <= 0 || type_roll < 20))
+  {
+    BenchmarkBuilder leaf(StormBehaviorTreeTemplateStateMarker<BenchmarkState>{},
+      RandomRange(rng, 1, 20), RandomRange(rng, 0, kBenchmarkFieldCount - 1), RandomRange(rng, 0, 5) * 0.01f);
+
+    AddRandomConditionals(leaf, rng, 2);
+
+    auto service_count = RandomRange(rng, 0, 2);
+    for(int index = 0; index < service_count; ++index)
+    {
+      std::move(leaf).AddService<BenchmarkService>(RandomRange(rng, 0, kBenchmarkFieldCount - 1), RandomRange(rng, 1, 5) * 0.01f);
+    }
+
+    return leaf;
+  }
+
+  auto type = type_roll < 55 ? StormBehaviorNodeType::kSelect : type_roll < 80 ? StormBehaviorNodeType::kSequence : StormBehaviorNodeType::kRandom;
+  BenchmarkBuilder node(type);
+  AddRandomConditionals(node, rng, 2);
+
+  if(RandomRange(rng, 0, 3) == 0)
+  {
+    std::move(node).AddService<BenchmarkService>(RandomRange(rng, 0, kBenchmarkFieldCount - 1), RandomRange(rng, 1, 5) * 0.01f);
+  }
+
+  auto child_count = RandomRange(rng, 2, 6);
+  for(int index = 0; index < child_count; ++index)
+  {
+    if(type == StormBehaviorNodeType::kRandom)
+    {
+      std::move(node).AddChild(RandomRange(rng, 1, 10), GenerateNode(rng, depth + 1, node_budget));
+    }
+    else
+    {
+      std::move(node).AddChild(GenerateNode(rng, depth + 1, node_budget));
+    }
+  }
+
+  // Always leave a fallback leaf so the root can be entered
+  if(depth == 0)
+  {
+    std::move(node).AddChild(BenchmarkBuilder(StormBehaviorTreeTemplateStateMarker<BenchmarkState>{}, 1, 0, 0.0f));
+  }
+
+  return node;
+}
+
+struct BenchmarkMemorySink
+{
+  std::size_t Write(const void * data, std::size_t size)
+  {
+    auto bytes = static_cast<const uint8_t *>(data);
+    m_Data.insert(m_Data.end(), bytes, bytes + size);
+    return size;
+  }
+
+  std::vector<uint8_t> m_Data;
+};
+
+static std::size_t GetResidentBytes()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    return counters.PeakWorkingSetSize;
+  }
+
+  return 0;
+#else
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Agents that record a replay log during the run
+static const int kReplayAgentCount = 64;
+
+// Startup prefab library: every design shows up in several prefab variants that build the same tree
+static const int kStartupPrefabCount = 256;
+static const int kStartupDesignCount = 64;
+
+static std::vector<BenchmarkBuilder> GeneratePrefabs(uint64_t seed)
+{
+  std::vector<BenchmarkBuilder> prefabs;
+  for(int index = 0; index < kStartupPrefabCount; ++index)
+  {
+    std::mt19937 rng(static_cast<uint32_t>(seed * kStartupDesignCount + index % kStartupDesignCount));
+    int node_budget = RandomRange(rng, 200, 500);
+    prefabs.emplace_back(GenerateNode(rng, 0, node_budget));
+  }
+
+  return prefabs;
+}
+
+static double GetPercentile(const std::vector<double> & sorted_vals, double percentile)
+{
+  auto index = static_cast<std::size_t>(percentile * (sorted_vals.size() - 1) + 0.5);
+  return sorted_vals[std::min(index, sorted_vals.size() - 1)];
+}
+
+int main(int argc, char ** argv)
+{
+  int agent_count = argc > 1 ? atoi(argv[1]) : 10000;
+  int tick_count = argc > 2 ? atoi(argv[2]) : 1000;
+  uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+  int thread_count = argc > 4 ? atoi(argv[4]) : 1;
+  int template_count = argc > 5 ? atoi(argv[5]) : 4;
+  bool batch_conditionals = argc > 6 ? atoi(argv[6]) != 0 : false;
+
+  if(agent_count <= 0 || tick_count <= 0 || thread_count <= 0 || template_count <= 0)
+  {
+    printf("Usage: %s [agents] [ticks] [seed] [threads] [templates] [batch conditionals]\n", argv[0]);
+    return 1;
+  }
+
+  std::mt19937 rng(static_cast<uint32_t>(seed));
+
+  std::vector<std::unique_ptr<BenchmarkTemplate>> templates;
+  for(int index = 0; index < template_count; ++index)
+  {
+    int node_budget = RandomRange(rng, 200, 500);
+    templates.emplace_back(std::make_unique<BenchmarkTemplate>(GenerateNode(rng, 0, node_budget)));
+  }
+
+  std::vector<BenchmarkData> datas(agent_count);
+  std::vector<std::unique_ptr<BenchmarkTree>> trees;
+  trees.reserve(agent_count);
+
+  BenchmarkWorld world;
+  world.SetBatchConditionals(batch_conditionals);
+
+  for(int index = 0; index < agent_count; ++index)
+  {
+    for(auto & field : datas[index].m_Fields)
+    {
+      field = RandomRange(rng, 0, 1000) * 0.001f;
+    }
+
+    trees.emplace_back(std::make_unique<BenchmarkTree>(*templates[index % template_count]));
+    world.AddInstance(trees.back().get(), &datas[index]);
+  }
+
+  printf("agents %d, ticks %d, seed %llu, threads %d, batch conditionals %s\n", agent_count, tick_count, 
+    static_cast<unsigned long long>(seed), thread_count, batch_conditionals ? "on" : "off");
+  for(int index = 0; index < std::min(template_count, agent_count); ++index)
+  {
+    printf("template %d: %d nodes\n", index, trees[index]->GetNodeCount());
+  }
+
+  // A sample of agents records replay logs, replayed at the end from a copy of their starting data
+  int replay_agent_count = std::min(agent_count, kReplayAgentCount);
+  std::vector<StormBehaviorTreeReplayLog> replay_logs(replay_agent_count);
+  std::vector<BenchmarkData> replay_datas(datas.begin(), datas.begin() + replay_agent_count);
+  for(int index = 0; index < replay_agent_count; ++index)
+  {
+    trees[index]->SetReplayLog(&replay_logs[index]);
+  }
+
+  // Clients mirror every agent from a delta stream
+  std::vector<std::unique_ptr<BenchmarkTree>> client_trees;
+  client_trees.reserve(agent_count);
+  for(int index = 0; index < agent_count; ++index)
+  {
+    client_trees.emplace_back(std::make_unique<BenchmarkTree>(*templates[index % template_count]));
+  }
+
+  StormBehaviorTreeReplicationEncoder<BenchmarkData, BenchmarkContext> encoder;
+  StormBehaviorTreeReplicationDecoder decoder;
+  StormBehaviorTreeWriteBuffer replication_buffer;
+  uint64_t delta_bytes = 0;
+  uint64_t snapshot_bytes = 0;
+  double encode_time = 0.0;
+  bool replication_failed = false;
+
+  std::vector<std::vector<StormBehaviorTreeMemoryRegion>> replicated_regions;
+  for(auto & elem : templates)
+  {
+    replicated_regions.emplace_back(elem->GetReplicatedRegions());
+  }
+
+  BenchmarkContext context;
+  std::vector<double> tick_times;
+  tick_times.reserve(tick_count);
+
+  for(int tick = 0; tick < tick_count; ++tick)
+  {
+    // The world outside of the behavior trees moves the data around a little every tick
+    world.GetThreadPool().ParallelFor(agent_count, thread_count, [&](int index)
+    {
+      StormBehaviorCounterRandom random(seed ^ 0xDA7AULL, index, tick);
+      for(auto & field : datas[index].m_Fields)
+      {
+        auto drift = (static_cast<int>(random.Bounded(101)) - 50) * 0.001f;
+        field = std::min(1.0f, std::max(0.0f, field + drift));
+      }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    world.Update(context, [&](int handle) { return StormBehaviorCounterRandom(seed, handle, tick); }, thread_count);
+    auto end = std::chrono::steady_clock::now();
+
+    tick_times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+    replication_buffer.Clear();
+    encoder.EncodeWorld(world, replication_buffer);
+    encode_time += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - end).count();
+    delta_bytes += replication_buffer.GetSize();
+
+    replication_failed |= decoder.Decode(replication_buffer.GetData().data(), replication_buffer.GetSize(),
+      [&](int handle) { return client_trees[handle].get(); }) == false;
+
+    // A naive snapshot sends the id, the node and all of the replicated memory of every agent every tick
+    replication_buffer.Clear();
+    for(int index = 0; index < agent_count; ++index)
+    {
+      replication_buffer.WriteVarInt(static_cast<uint64_t>(index));
+      replication_buffer.WriteVarInt(StormBehaviorZigZag(trees[index]->GetCurrentNode()));
+
+      auto memory = static_cast<const uint8_t *>(trees[index]->GetNodeMemory());
+      for(auto & region : replicated_regions[index % template_count])
+      {
+        replication_buffer.Write(memory + region.m_Offset, region.m_Size);
+      }
+    }
+
+    snapshot_bytes += replication_buffer.GetSize();
+  }
+
+  int replication_mismatches = 0;
+  for(int index = 0; index < agent_count; ++index)
+  {
+    replication_mismatches += client_trees[index]->GetCurrentNode() != trees[index]->GetCurrentNode();
+  }
+
+  double total_time = 0.0;
+  for(auto & elem : tick_times)
+  {
+    total_time += elem;
+  }
+
+  std::sort(tick_times.begin(), tick_times.end());
+
+  uint64_t checksum = 0;
+  for(auto & elem : trees)
+  {
+    checksum = StormBehaviorSplitMix64(checksum ^ static_cast<uint64_t>(elem->GetCurrentNode()));
+  }
+
+  checksum = StormBehaviorSplitMix64(checksum ^ context.m_Transitions);
+
+  BenchmarkMemorySink sink;
+  sink.m_Data.reserve(static_cast<std::size_t>(agent_count) * templates[0]->GetInstanceMemorySize() * 2);
+
+  auto save_start = std::chrono::steady_clock::now();
+  StormBehaviorTreePopulationWriter<BenchmarkMemorySink> writer(sink);
+  for(int index = 0; index < agent_count; ++index)
+  {
+    writer.Write(index % template_count, *trees[index]);
+  }
+
+  writer.Finish();
+  auto save_end = std::chrono::steady_clock::now();
+
+  std::vector<BenchmarkTree> loaded_trees(agent_count);
+  StormBehaviorTreePopulationReader reader(sink.m_Data.data(), sink.m_Data.size());
+
+  int template_id;
+  int loaded_count = 0;
+  while(reader.NextInstance(template_id))
+  {
+    reader.Load(loaded_trees[loaded_count], *templates[template_id]);
+    loaded_count++;
+  }
+
+  auto load_end = std::chrono::steady_clock::now();
+
+  auto population_mb = sink.m_Data.size() / (1024.0 * 1024.0);
+  auto save_seconds = std::chrono::duration<double>(save_end - save_start).count();
+  auto load_seconds = std::chrono::duration<double>(load_end - save_end).count();
+
+  printf("ticks/sec: %.1f\n", tick_count / (total_time / 1000000.0));
+  printf("tick latency (us): p50 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+    GetPercentile(tick_times, 0.5), GetPercentile(tick_times, 0.99), GetPercentile(tick_times, 0.999), tick_times.back());
+  printf("transitions/tick: %.1f\n", static_cast<double>(context.m_Transitions) / tick_count);
+  printf("awake agents: %d\n", world.GetAwakeInstanceCount());
+  printf("peak rss (MB): %.1f\n", GetResidentBytes() / (1024.0 * 1024.0));
+  printf("replication bytes/tick: delta %.0f, snapshot %.0f (%.1fx), encode %.1f us/tick, %d mismatches%s\n",
+    static_cast<double>(delta_bytes) / tick_count, static_cast<double>(snapshot_bytes) / tick_count,
+    delta_bytes ? static_cast<double>(snapshot_bytes) / delta_bytes : 0.0, encode_time / tick_count, replication_mismatches,
+    replication_failed ? ", decode failed" : "");
+  printf("population save: %.1f MB in %.1f ms (%.0f MB/s), load: %d agents in %.1f ms (%.0f MB/s)%s\n", population_mb,
+    save_seconds * 1000.0, population_mb / save_seconds, loaded_count, load_seconds * 1000.0, population_mb / load_seconds,
+    reader.HasFailed() ? ", failed" : "");
+
+  // Replay the sampled agents from their logs alone, without the data drifting underneath them
+  {
+    std::size_t replay_bytes = 0;
+    for(auto & elem : replay_logs)
+    {
+      StormBehaviorTreeWriteBuffer log_buffer;
+      elem.Save(log_buffer);
+      replay_bytes += log_buffer.GetSize();
+    }
+
+    BenchmarkContext replay_context;
+    uint64_t replay_ticks = 0;
+    int replay_mismatches = 0;
+
+    auto replay_start = std::chrono::steady_clock::now();
+    for(int index = 0; index < replay_agent_count; ++index)
+    {
+      auto & replay_log = replay_logs[index];
+      replay_log.StartReplay();
+
+      BenchmarkTree replay_tree(*templates[index % template_count]);
+      replay_tree.SetReplayLog(&replay_log);
+
+      StormBehaviorCounterRandom random(0, 0, 0);
+      for(int tick = 0; tick < replay_log.GetTickCount(); ++tick)
+      {
+        replay_tree.Update(replay_datas[index], replay_context, random);
+      }
+
+      replay_ticks += replay_log.GetTickCount();
+      replay_mismatches += replay_log.GetDivergentTick() != -1 || replay_tree.GetCurrentNode() != trees[index]->GetCurrentNode();
+    }
+
+    auto replay_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+    printf("replay: %d agents, %.1f bytes/agent/tick, %.0f agent ticks/sec, %d mismatches\n", replay_agent_count,
+      replay_agent_count ? static_cast<double>(replay_bytes) / (static_cast<double>(replay_agent_count) * tick_count) : 0.0,
+      replay_seconds > 0.0 ? replay_ticks / replay_seconds : 0.0, replay_mismatches);
+  }
+
+  // Compile the prefab library one template at a time on this thread, then in bulk through the cache
+  {
+    auto serial_prefabs = GeneratePrefabs(seed);
+    auto bulk_prefabs = GeneratePrefabs(seed);
+
+    auto serial_start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<BenchmarkTemplate>> serial_templates;
+    for(auto & prefab : serial_prefabs)
+    {
+      serial_templates.emplace_back(std::make_unique<BenchmarkTemplate>(prefab));
+    }
+
+    auto bulk_start = std::chrono::steady_clock::now();
+    StormBehaviorTreeTemplateCache<BenchmarkData, BenchmarkContext> cache;
+    auto bulk_templates = cache.Compile(std::move(bulk_prefabs), thread_count);
+    auto bulk_end = std::chrono::steady_clock::now();
+
+    auto serial_ms = std::chrono::duration<double, std::milli>(bulk_start - serial_start).count();
+    auto bulk_ms = std::chrono::duration<double, std::milli>(bulk_end - bulk_start).count();
+    printf("template compile: %d prefabs, one by one %.1f ms, bulk %.1f ms (%.1fx), %d compiled\n", kStartupPrefabCount,
+      serial_ms, bulk_ms, bulk_ms > 0.0 ? serial_ms / bulk_ms : 0.0, cache.GetTemplateCount());
+  }
+
+  // Dispatch every agent's final data through the wide select and the switch, which have their cases in the same order
+  {
+    BenchmarkBuilder select_builder(StormBehaviorNodeType::kSelect);
+    BenchmarkBuilder switch_builder(StormBehaviorNodeType::kSwitch);
+    std::move(switch_builder).SetSwitchKey<BenchmarkDispatchKey>();
+
+    for(int key = 0; key < kDispatchCaseCount; ++key)
+    {
+      std::move(select_builder).AddChild(
+        BenchmarkBuilder(StormBehaviorTreeTemplateStateMarker<BenchmarkState>{}, 1, 0, 0.0f)
+        .AddConditional<BenchmarkDispatchConditional>(false, false, key));
+      std::move(switch_builder).AddCaseChild(key, BenchmarkBuilder(StormBehaviorTreeTemplateStateMarker<BenchmarkState>{}, 1, 0, 0.0f));
+    }
+
+    BenchmarkTemplate select_template(select_builder);
+    BenchmarkTemplate switch_template(switch_builder);
+    BenchmarkTree select_tree(select_template);
+    BenchmarkTree switch_tree(switch_template);
+
+    BenchmarkContext dispatch_context;
+    StormBehaviorCounterRandom random(0, 0, 0);
+    static const int kDispatchPasses = 20;
+
+    auto select_start = std::chrono::steady_clock::now();
+    uint64_t select_nodes = 0;
+    for(int pass = 0; pass < kDispatchPasses; ++pass)
+    {
+      for(auto & elem : datas)
+      {
+        select_tree.Update(elem, dispatch_context, random);
+        select_nodes += select_tree.GetCurrentNode();
+      }
+    }
+
+    auto switch_start = std::chrono::steady_clock::now();
+    uint64_t switch_nodes = 0;
+    for(int pass = 0; pass < kDispatchPasses; ++pass)
+    {
+      for(auto & elem : datas)
+      {
+        switch_tree.Update(elem, dispatch_context, random);
+        switch_nodes += switch_tree.GetCurrentNode();
+      }
+    }
+
+    auto switch_end = std::chrono::steady_clock::now();
+    auto dispatch_count = static_cast<double>(datas.size()) * kDispatchPasses;
+    auto select_ns = std::chrono::duration<double, std::nano>(switch_start - select_start).count() / dispatch_count;
+    auto switch_ns = std::chrono::duration<double, std::nano>(switch_end - switch_start).count() / dispatch_count;
+    printf("dispatch: %d cases, select %.1f ns, switch %.1f ns (%.1fx)%s\n", kDispatchCaseCount, select_ns, switch_ns,
+      switch_ns > 0.0 ? select_ns / switch_ns : 0.0, select_nodes != switch_nodes ? ", mismatch" : "");
+  }
+
+  printf("checksum: %016llx\n", static_cast<unsigned long long>(checksum));
+  return 0;
+}
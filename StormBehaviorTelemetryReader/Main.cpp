@@ -0,0 +1,212 @@
+
+#include "StormBehavior/StormBehaviorTreeTelemetry.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <chrono>
+
+// Reads a telemetry stream written by StormBehaviorTreeTelemetryWriter and prints what the instances are doing
+//
+// Usage: StormBehaviorTelemetryReaderExe <file> [--follow] [--instances]
+//        StormBehaviorTelemetryReaderExe --listen <socket path> [--instances]
+//
+// Files are expected to come from StormBehaviorTelemetryMappedFileSink.  --follow keeps polling the file for
+// new frames, --listen accepts one writer on a Unix domain socket.  --instances dumps every instance per frame
+// instead of a summary
+
+static bool s_PrintInstances = false;
+
+static void PrintFrame(const StormBehaviorTreeTelemetryReader & reader)
+{
+  auto & instances = reader.GetInstances();
+  printf("tick %llu%s: %d instances, %d changed\n", static_cast<unsigned long long>(reader.GetTick()),
+    reader.IsKeyFrame() ? " (key)" : "", static_cast<int>(instances.size()), reader.GetFrameRecordCount());
+
+  if(s_PrintInstances)
+  {
+    std::map<int, const StormBehaviorTreeTelemetryReader::InstanceState *> sorted_instances;
+    for(auto & elem : instances)
+    {
+      sorted_instances[elem.first] = &elem.second;
+    }
+
+    for(auto & elem : sorted_instances)
+    {
+      printf("  %d: node %d, services [", elem.first, elem.second->m_Node);
+      for(std::size_t index = 0; index < elem.second->m_Services.size(); ++index)
+      {
+        printf(index == 0 ? "%d" : " %d", elem.second->m_Services[index]);
+      }
+
+      printf("], %d memory bytes\n", static_cast<int>(elem.second->m_NodeMemory.size()));
+    }
+  }
+}
+
+static void PrintSummary(const StormBehaviorTreeTelemetryReader & reader)
+{
+  std::map<int, int> node_counts;
+  for(auto & elem : reader.GetInstances())
+  {
+    node_counts[elem.second.m_Node]++;
+  }
+
+  printf("%llu frames, %d instances at tick %llu\n", static_cast<unsigned long long>(reader.GetFrameCount()),
+    static_cast<int>(reader.GetInstances().size()), static_cast<unsigned long long>(reader.GetTick()));
+
+  for(auto & elem : node_counts)
+  {
+    printf("  node %d: %d\n", elem.first, elem.second);
+  }
+}
+
+static int ReadFile(const char * path, bool follow)
+{
+  StormBehaviorTreeTelemetryReader reader;
+  std::size_t read_bytes = 0;
+
+  while(true)
+  {
+    auto file = fopen(path, "rb");
+    if(file == nullptr)
+    {
+      printf("Could not open %s\n", path);
+      return 1;
+    }
+
+    uint64_t used = 0;
+    if(fread(&used, sizeof(used), 1, file) == 1 && used > read_bytes)
+    {
+      std::vector<uint8_t> buffer(static_cast<std::size_t>(used) - read_bytes);
+      fseek(file, static_cast<long>(sizeof(used) + read_bytes), SEEK_SET);
+
+      auto count = fread(buffer.data(), 1, buffer.size(), file);
+      read_bytes += count;
+
+      if(reader.Feed(buffer.data(), count, PrintFrame) == false)
+      {
+        printf("Malformed telemetry stream\n");
+        fclose(file);
+        return 1;
+      }
+    }
+
+    fclose(file);
+
+    if(follow == false)
+    {
+      break;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  PrintSummary(reader);
+  return 0;
+}
+
+#if !defined(_WIN32)
+
+static int ReadSocket(const char * path)
+{
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr.sun_path))
+  {
+    printf("Socket path is too long\n");
+    return 1;
+  }
+
+  strcpy(addr.sun_path, path);
+  unlink(path);
+
+  auto listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listen_socket == -1 || bind(listen_socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_socket, 1) != 0)
+  {
+    printf("Could not listen on %s\n", path);
+    return 1;
+  }
+
+  auto connection = accept(listen_socket, nullptr, nullptr);
+  close(listen_socket);
+  unlink(path);
+
+  if(connection == -1)
+  {
+    printf("Accept failed\n");
+    return 1;
+  }
+
+  StormBehaviorTreeTelemetryReader reader;
+  uint8_t buffer[64 * 1024];
+
+  while(true)
+  {
+    auto count = recv(connection, buffer, sizeof(buffer), 0);
+    if(count <= 0)
+    {
+      break;
+    }
+
+    if(reader.Feed(buffer, static_cast<std::size_t>(count), PrintFrame) == false)
+    {
+      printf("Malformed telemetry stream\n");
+      close(connection);
+      return 1;
+    }
+  }
+
+  close(connection);
+  PrintSummary(reader);
+  return 0;
+}
+
+#endif
+
+int main(int argc, char ** argv)
+{
+  const char * path = nullptr;
+  bool follow = false;
+  bool listen_socket = false;
+
+  for(int index = 1; index < argc; ++index)
+  {
+    if(strcmp(argv[index], "--follow") == 0)
+    {
+      follow = true;
+    }
+    else if(strcmp(argv[index], "--instances") == 0)
+    {
+      s_PrintInstances = true;
+    }
+    else if(strcmp(argv[index], "--listen") == 0)
+    {
+      listen_socket = true;
+    }
+    else
+    {
+      path = argv[index];
+    }
+  }
+
+  if(path == nullptr)
+  {
+    printf("Usage: %s <file> [--follow] [--instances]\n", argv[0]);
+    printf("       %s --listen <socket path> [--instances]\n", argv[0]);
+    return 1;
+  }
+
+  if(listen_socket)
+  {
+#if !defined(_WIN32)
+    return ReadSocket(path);
+#else
+    printf("--listen is not supported on this platform\n");
+    return 1;
+#endif
+  }
+
+  return ReadFile(path, follow);
+}
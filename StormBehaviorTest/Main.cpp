@@ -1,235 +1,2423 @@
-
-#include "StormBehavior/StormBehaviorTree.h"
-
-#include <cstdio>
-#include <random>
-
-#include <gtest/gtest.h>
-
-struct TestContext
-{
-
-};
-
-struct TestData
-{
-  int m_UpdaterId = 0;
-  bool m_ServiceActive = false;
-  int m_SerivceUpdated = false;
-  bool m_ToggleActive = true;
-};
-
-struct TestUpdater
-{
-  TestUpdater(int id, bool success = true)
-  {
-    m_Id = id;
-    m_Success = success;
-  }
-
-  bool Update(TestData & test, TestContext & context)
-  {
-    test.m_UpdaterId = m_Id;
-    return m_Success;
-  }
-
-  int m_Id;
-  bool m_Success;
-};
-
-struct TestService
-{
-  void Activate(TestData & test, TestContext & context)
-  {
-    test.m_ServiceActive = true;
-  }
-
-  void Deactivate(TestData & test, TestContext & context)
-  {
-    test.m_ServiceActive = false;
-  }
-
-  void Update(TestData & test, TestContext & context)
-  {
-    test.m_SerivceUpdated++;
-  }
-};
-
-struct TestConditional
-{
-  TestConditional(bool success = true)
-  {
-    m_Success = success;
-  }
-
-  bool Check(const TestData & data, const TestContext & context)
-  {
-    return m_Success;
-  }
-
-  bool m_Success;
-};
-
-struct TestConditionalToggle
-{
-  bool Check(const TestData & data, const TestContext & context)
-  {
-    return data.m_ToggleActive;
-  }
-};
-
-using BT = StormBehaviorTreeTemplateBuilder<TestData, TestContext>;
-using BTInst = StormBehaviorTree<TestData, TestContext>;
-
-template <typename StateUpdater, typename ... Args>
-inline BT State(Args && ... args)
-{
-  return BT(StormBehaviorTreeTemplateStateMarker<StateUpdater>{}, std::forward<Args>(args)...);
-}
-
-struct StormBehaviorTestFixture : testing::Test
-{
-  TestData data = {};
-  TestContext context = {};
-
-  std::mt19937 r = std::mt19937(0);
-};
-
-TEST_F(StormBehaviorTestFixture, SelectNode)
-{
-  auto TestTreeTemplate = StormBehaviorTreeTemplate(
-    BT(StormBehaviorNodeType::kSelect)
-      .AddChild(
-        State<TestUpdater>(1)
-        .AddConditional<TestConditional>(false, false, false)
-      )
-      .AddChild(
-        State<TestUpdater>(2)
-      )
-      .AddChild(
-        State<TestUpdater>(3)
-      ));  
-
-  StormBehaviorTree test_tree(TestTreeTemplate);
-  EXPECT_EQ(data.m_UpdaterId, 0);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-}
-
-TEST_F(StormBehaviorTestFixture, SequenceNode)
-{
-  auto TestTreeTemplate = StormBehaviorTreeTemplate(
-    BT(StormBehaviorNodeType::kSequence)
-      .AddChild(
-        State<TestUpdater>(1)
-      )
-      .AddChild(
-        State<TestUpdater>(2)
-      )
-      .AddChild(
-        State<TestUpdater>(3)
-      ));  
-
-  StormBehaviorTree test_tree(TestTreeTemplate);
-  EXPECT_EQ(data.m_UpdaterId, 0);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 3);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 3);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-}
-
-TEST_F(StormBehaviorTestFixture, Service)
-{
-  auto TestTreeTemplate = StormBehaviorTreeTemplate(
-    BT(StormBehaviorNodeType::kSequence)
-      .AddChild(
-        State<TestUpdater>(1)
-      )
-      .AddChild(
-        State<TestUpdater>(2)
-        .AddService<TestService>()
-      )
-      .AddChild(
-        State<TestUpdater>(3)
-      ));  
-
-  StormBehaviorTree test_tree(TestTreeTemplate);
-  EXPECT_EQ(data.m_ServiceActive, false);
-  EXPECT_EQ(data.m_SerivceUpdated, 0);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, false);
-  EXPECT_EQ(data.m_SerivceUpdated, 0);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, true);
-  EXPECT_EQ(data.m_SerivceUpdated, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, false);
-  EXPECT_EQ(data.m_SerivceUpdated, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, false);
-  EXPECT_EQ(data.m_SerivceUpdated, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, true);
-  EXPECT_EQ(data.m_SerivceUpdated, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, false);
-  EXPECT_EQ(data.m_SerivceUpdated, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_ServiceActive, false);
-  EXPECT_EQ(data.m_SerivceUpdated, 2);
-}
-
-TEST_F(StormBehaviorTestFixture, Conditional)
-{
-  auto TestTreeTemplate = StormBehaviorTreeTemplate(
-    BT(StormBehaviorNodeType::kSelect)
-      .AddChild(
-        State<TestUpdater>(1, false)
-        .AddConditional<TestConditionalToggle>(true, true)
-      )
-      .AddChild(
-        State<TestUpdater>(2, false)
-      )
-      .AddChild(
-        State<TestUpdater>(3)
-      ));  
-
-  StormBehaviorTree test_tree(TestTreeTemplate);
-  EXPECT_EQ(data.m_UpdaterId, 0);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-  data.m_ToggleActive = false;
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 2);
-  data.m_ToggleActive = true;
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-  test_tree.Update(data, context, r);
-  EXPECT_EQ(data.m_UpdaterId, 1);
-}
-
-int main(int argc, char ** argv)
-{
-  testing::InitGoogleTest(&argc, argv);
-  return RUN_ALL_TESTS();
-}
-
-
+
+#include "StormBehavior/StormBehaviorTree.h"
+#include "StormBehavior/StormBehaviorTreeWorld.h"
+#include "StormBehavior/StormBehaviorTreePool.h"
+#include "StormBehavior/StormBehaviorTreeTelemetry.h"
+#include "StormBehavior/StormBehaviorTreePersistence.h"
+#include "StormBehavior/StormBehaviorTreeReplication.h"
+#include "StormBehavior/StormBehaviorTreeLayered.h"
+#include "StormBehavior/StormBehaviorTreeTemplateCache.h"
+
+#include <cstdio>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+struct TestContext
+{
+
+};
+
+struct TestData
+{
+  int m_UpdaterId = 0;
+  float m_Health = 1.0f;
+  bool m_ServiceActive = false;
+  int m_SerivceUpdated = false;
+  bool m_ToggleActive = true;
+  int m_Flags = 0;
+};
+
+struct TestUpdater
+{
+  TestUpdater(int id, bool success = true)
+  {
+    m_Id = id;
+    m_Success = success;
+  }
+
+  bool Update(TestData & test, TestContext & context)
+  {
+    test.m_UpdaterId = m_Id;
+    return m_Success;
+  }
+
+  int m_Id;
+  bool m_Success;
+};
+
+struct TestService
+{
+  void Activate(TestData & test, TestContext & context)
+  {
+    test.m_ServiceActive = true;
+  }
+
+  void Deactivate(TestData & test, TestContext & context)
+  {
+    test.m_ServiceActive = false;
+  }
+
+  void Update(TestData & test, TestContext & context)
+  {
+    test.m_SerivceUpdated++;
+  }
+};
+
+struct TestActivateUpdater
+{
+  void Activate(TestData & test, TestContext & context)
+  {
+    test.m_ServiceActive = true;
+  }
+
+  void Deactivate(TestData & test, TestContext & context)
+  {
+    test.m_ServiceActive = false;
+  }
+
+  bool Update(TestData & test, TestContext & context)
+  {
+    return true;
+  }
+};
+
+struct TestSleepUpdater
+{
+  TestSleepUpdater(int id, int sleep_ticks)
+  {
+    m_Id = id;
+    m_SleepTicks = sleep_ticks;
+  }
+
+  bool Update(TestData & test, TestContext & context)
+  {
+    test.m_UpdaterId = m_Id;
+    test.m_SerivceUpdated++;
+    return false;
+  }
+
+  int GetSleepTicks(const TestData & test, const TestContext & context)
+  {
+    return m_SleepTicks;
+  }
+
+  int m_Id;
+  int m_SleepTicks;
+};
+
+struct TestHistoryUpdater
+{
+  TestHistoryUpdater() = default;
+  TestHistoryUpdater(StormBehaviorTreeReadBuffer & buffer)
+  {
+    m_History.resize(static_cast<std::size_t>(buffer.ReadVarInt()));
+    buffer.Read(m_History.data(), m_History.size() * sizeof(int));
+  }
+
+  void Save(StormBehaviorTreeWriteBuffer & buffer) const
+  {
+    buffer.WriteVarInt(m_History.size());
+    buffer.Write(m_History.data(), m_History.size() * sizeof(int));
+  }
+
+  bool Update(TestData & test, TestContext & context)
+  {
+    m_History.push_back(static_cast<int>(m_History.size()));
+    test.m_UpdaterId = static_cast<int>(m_History.size());
+    return false;
+  }
+
+  std::vector<int> m_History;
+};
+
+struct TestCharUpdater
+{
+  bool Update(TestData & test, TestContext & context)
+  {
+    test.m_UpdaterId = m_Val;
+    return false;
+  }
+
+  char m_Val = 1;
+};
+
+struct TestWideUpdater
+{
+  bool Update(TestData & test, TestContext & context)
+  {
+    test.m_UpdaterId = 2;
+    test.m_Flags = reinterpret_cast<uintptr_t>(&m_Val) % alignof(uint64_t) == 0;
+    return false;
+  }
+
+  uint64_t m_Val = 0;
+};
+
+struct TestReplicatedUpdater
+{
+  static constexpr bool kReplicated = true;
+
+  bool Update(TestData & test, TestContext & context)
+  {
+    m_Ticks++;
+    return false;
+  }
+
+  int m_Ticks = 0;
+  int m_Unchanged[3] = {};
+};
+
+struct TestConditional
+{
+  TestConditional(bool success = true)
+  {
+    m_Success = success;
+  }
+
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    return m_Success;
+  }
+
+  bool m_Success;
+};
+
+struct TestConditionalToggle
+{
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    return data.m_ToggleActive;
+  }
+};
+
+struct TestConditionalFlag
+{
+  TestConditionalFlag(int flag)
+  {
+    m_Flag = flag;
+  }
+
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    return (data.m_Flags >> m_Flag) & 1;
+  }
+
+  int m_Flag;
+};
+
+struct TestSwitchKey
+{
+  int GetKey(const TestData & data, const TestContext & context) const
+  {
+    return data.m_Flags;
+  }
+};
+
+struct TestConditionalExpensive
+{
+  static constexpr bool kPure = true;
+  static inline int s_CheckCount = 0;
+
+  TestConditionalExpensive(bool success = true)
+  {
+    m_Success = success;
+  }
+
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    s_CheckCount++;
+
+    volatile int work = 0;
+    for(int index = 0; index < 1000; ++index)
+    {
+      work = work + index;
+    }
+
+    return m_Success;
+  }
+
+  bool m_Success;
+};
+
+struct TestConditionalPureToggle
+{
+  static constexpr bool kPure = true;
+
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    return data.m_ToggleActive;
+  }
+};
+
+struct TestConditionalPollingToggle
+{
+  static constexpr bool kPollWhileSleeping = true;
+
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    return data.m_ToggleActive;
+  }
+};
+
+struct TestConditionalBatchHealth
+{
+  static constexpr bool kPure = true;
+  static inline std::atomic<int> s_CheckCount = { 0 };
+  static inline std::atomic<int> s_BatchCount = { 0 };
+
+  TestConditionalBatchHealth(float threshold)
+  {
+    m_Threshold = threshold;
+  }
+
+  bool Check(const TestData & data, const TestContext & context)
+  {
+    s_CheckCount++;
+    return data.m_Health >= m_Threshold;
+  }
+
+  static void CheckBatch(const TestConditionalBatchHealth * const * conditionals, const TestData * const * datas, int count, 
+    const TestContext & context, uint64_t * out_bits)
+  {
+    s_BatchCount++;
+    std::fill(out_bits, out_bits + (count + 63) / 64, 0);
+    for(int index = 0; index < count; ++index)
+    {
+      if(datas[index]->m_Health >= conditionals[index]->m_Threshold)
+      {
+        out_bits[index / 64] |= 1ULL << (index % 64);
+      }
+    }
+  }
+
+  float m_Threshold;
+};
+
+struct TestScorerHealth
+{
+  float Score(const TestData & data, const TestContext & context) const
+  {
+    return data.m_Health;
+  }
+
+  void ScoreBatch(const TestData * const * datas, int count, const TestContext & context, float * out_scores) const
+  {
+    for(int index = 0; index < count; ++index)
+    {
+      out_scores[index] = datas[index]->m_Health;
+    }
+  }
+};
+
+struct TestScorerConstant
+{
+  TestScorerConstant(float score)
+  {
+    m_Score = score;
+  }
+
+  float Score(const TestData & data, const TestContext & context) const
+  {
+    return m_Score;
+  }
+
+  float m_Score;
+};
+
+using BT = StormBehaviorTreeTemplateBuilder<TestData, TestContext>;
+using BTInst = StormBehaviorTree<TestData, TestContext>;
+
+template <typename StateUpdater, typename ... Args>
+inline BT State(Args && ... args)
+{
+  return BT(StormBehaviorTreeTemplateStateMarker<StateUpdater>{}, std::forward<Args>(args)...);
+}
+
+struct StormBehaviorTestFixture : testing::Test
+{
+  TestData data = {};
+  TestContext context = {};
+
+  std::mt19937 r = std::mt19937(0);
+};
+
+TEST_F(StormBehaviorTestFixture, SelectNode)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1)
+        .AddConditional<TestConditional>(false, false, false)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+      )
+      .AddChild(
+        State<TestUpdater>(3)
+      ));  
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  EXPECT_EQ(data.m_UpdaterId, 0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+}
+
+TEST_F(StormBehaviorTestFixture, SequenceNode)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSequence)
+      .AddChild(
+        State<TestUpdater>(1)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+      )
+      .AddChild(
+        State<TestUpdater>(3)
+      ));  
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  EXPECT_EQ(data.m_UpdaterId, 0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+}
+
+TEST_F(StormBehaviorTestFixture, Service)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSequence)
+      .AddChild(
+        State<TestUpdater>(1)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+        .AddService<TestService>()
+      )
+      .AddChild(
+        State<TestUpdater>(3)
+      ));  
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  EXPECT_EQ(data.m_SerivceUpdated, 0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  EXPECT_EQ(data.m_SerivceUpdated, 0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, true);
+  EXPECT_EQ(data.m_SerivceUpdated, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  EXPECT_EQ(data.m_SerivceUpdated, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  EXPECT_EQ(data.m_SerivceUpdated, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, true);
+  EXPECT_EQ(data.m_SerivceUpdated, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  EXPECT_EQ(data.m_SerivceUpdated, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  EXPECT_EQ(data.m_SerivceUpdated, 2);
+}
+
+TEST_F(StormBehaviorTestFixture, Conditional)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalToggle>(true, true)
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+      )
+      .AddChild(
+        State<TestUpdater>(3)
+      ));  
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  EXPECT_EQ(data.m_UpdaterId, 0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  data.m_ToggleActive = false;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  data.m_ToggleActive = true;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+}
+
+TEST_F(StormBehaviorTestFixture, StateActivate)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSequence)
+      .AddChild(
+        State<TestUpdater>(1)
+      )
+      .AddChild(
+        State<TestActivateUpdater>()
+      ));  
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, true);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_ServiceActive, false);
+}
+
+TEST_F(StormBehaviorTestFixture, WorldTwoPhaseUpdate)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalToggle>(true, true)
+      )
+      .AddChild(
+        BT(StormBehaviorNodeType::kSequence)
+        .AddChild(
+          State<TestUpdater>(2)
+        )
+        .AddChild(
+          State<TestUpdater>(3)
+          .AddService<TestService>()
+        )
+      ));
+
+  static const int kInstanceCount = 64;
+  std::vector<std::unique_ptr<BTInst>> trees;
+  std::vector<TestData> datas(kInstanceCount);
+  std::vector<std::unique_ptr<BTInst>> reference_trees;
+  std::vector<TestData> reference_datas(kInstanceCount);
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  for(int index = 0; index < kInstanceCount; ++index)
+  {
+    datas[index].m_ToggleActive = (index % 3) != 0;
+    reference_datas[index].m_ToggleActive = (index % 3) != 0;
+
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    reference_trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    EXPECT_EQ(world.AddInstance(trees.back().get(), &datas[index]), index);
+  }
+
+  for(int tick = 0; tick < 8; ++tick)
+  {
+    if(tick == 4)
+    {
+      for(int index = 0; index < kInstanceCount; ++index)
+      {
+        datas[index].m_ToggleActive = !datas[index].m_ToggleActive;
+        reference_datas[index].m_ToggleActive = !reference_datas[index].m_ToggleActive;
+      }
+    }
+
+    world.Update(context, [&](int handle) -> std::mt19937 & { return r; }, 4, 1);
+
+    for(int index = 0; index < kInstanceCount; ++index)
+    {
+      reference_trees[index]->Update(reference_datas[index], context, r);
+      EXPECT_EQ(trees[index]->GetCurrentNode(), reference_trees[index]->GetCurrentNode());
+      EXPECT_EQ(datas[index].m_UpdaterId, reference_datas[index].m_UpdaterId);
+      EXPECT_EQ(datas[index].m_ServiceActive, reference_datas[index].m_ServiceActive);
+      EXPECT_EQ(datas[index].m_SerivceUpdated, reference_datas[index].m_SerivceUpdated);
+    }
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, CounterRandom)
+{
+  StormBehaviorCounterRandom random_a(7, 3, 100);
+  StormBehaviorCounterRandom random_b(7, 3, 100);
+  StormBehaviorCounterRandom random_c(7, 4, 100);
+
+  random_a.SetNode(5);
+  random_b.SetNode(5);
+  random_c.SetNode(5);
+
+  bool all_equal = true;
+  for(int index = 0; index < 16; ++index)
+  {
+    auto val = random_a();
+    EXPECT_EQ(val, random_b());
+    all_equal = all_equal && (val == random_c());
+  }
+
+  EXPECT_FALSE(all_equal);
+
+  int counts[3] = {};
+  for(int index = 0; index < 30000; ++index)
+  {
+    auto val = random_a.Bounded(3);
+    ASSERT_LT(val, 3u);
+    counts[val]++;
+  }
+
+  for(auto count : counts)
+  {
+    EXPECT_GT(count, 9000);
+    EXPECT_LT(count, 11000);
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, ThreadPool)
+{
+  StormBehaviorThreadPool pool;
+  std::vector<int> hits(100);
+
+  // Thread counts go up and down between jobs, and past the number of items
+  int thread_counts[] = { 4, 1, 2, 8, 3, 200 };
+  for(auto thread_count : thread_counts)
+  {
+    for(int job = 0; job < 50; ++job)
+    {
+      pool.ParallelFor(static_cast<int>(hits.size()), thread_count, [&](int index) { hits[index]++; });
+    }
+  }
+
+  for(auto & elem : hits)
+  {
+    EXPECT_EQ(elem, 300);
+  }
+
+  EXPECT_EQ(pool.GetWorkerCount(), 99);
+
+  pool.ParallelFor(0, 4, [&](int index) { hits[index]++; });
+  EXPECT_EQ(hits[0], 300);
+}
+
+TEST_F(StormBehaviorTestFixture, WorldCounterRandomDeterminism)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kRandom)
+      .AddChild(10, State<TestUpdater>(1))
+      .AddChild(20, State<TestUpdater>(2))
+      .AddChild(30, State<TestUpdater>(3))
+      .AddChild(40, State<TestUpdater>(4)));
+
+  static const int kInstanceCount = 256;
+  auto run_world = [&](int thread_count)
+  {
+    std::vector<std::unique_ptr<BTInst>> trees;
+    std::vector<TestData> datas(kInstanceCount);
+    std::vector<int> results;
+
+    StormBehaviorTreeWorld<TestData, TestContext> world;
+    for(int index = 0; index < kInstanceCount; ++index)
+    {
+      trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+      world.AddInstance(trees.back().get(), &datas[index]);
+    }
+
+    for(int tick = 0; tick < 4; ++tick)
+    {
+      world.Update(context, [&](int handle) { return StormBehaviorCounterRandom(1234, handle, tick); }, thread_count);
+      for(auto & elem : datas)
+      {
+        results.push_back(elem.m_UpdaterId);
+      }
+    }
+
+    // Every phase of every tick ran on the same workers
+    EXPECT_EQ(world.GetThreadPool().GetWorkerCount(), thread_count - 1);
+    return results;
+  };
+
+  auto single_thread = run_world(1);
+  auto multi_thread = run_world(8);
+  EXPECT_EQ(single_thread, multi_thread);
+
+  int counts[5] = {};
+  for(auto & elem : single_thread)
+  {
+    counts[elem]++;
+  }
+
+  EXPECT_EQ(counts[0], 0);
+  EXPECT_LT(counts[1], counts[4]);
+}
+
+TEST_F(StormBehaviorTestFixture, MemoryStats)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1)
+        .AddConditional<TestConditional>(false, false, false)
+        .AddService<TestService>()
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+        .AddConditional<TestConditional>(false, false, true)
+      )
+      .AddChild(State<TestWideUpdater>()));
+
+  // The one byte conditionals and service sit between elements with wider alignment, so the block is padded
+  auto element_bytes = 2 * sizeof(TestUpdater) + 2 * sizeof(TestConditional) + sizeof(TestService) + sizeof(TestWideUpdater);
+  auto padding_bytes = TestTreeTemplate.GetInstancePaddingBytes();
+  auto template_stats = TestTreeTemplate.GetMemoryStats();
+  EXPECT_GT(padding_bytes, 0u);
+  EXPECT_EQ(template_stats.m_InstanceBytes, element_bytes + padding_bytes);
+  EXPECT_GE(template_stats.m_InitDataBytes, 2 * sizeof(std::tuple<int>) + 2 * sizeof(std::tuple<bool>));
+  EXPECT_GT(template_stats.GetStaticBytes(), template_stats.m_InitDataBytes);
+  ASSERT_EQ(template_stats.m_Types.size(), 4u);
+  EXPECT_EQ(template_stats.m_Types[0].m_ElementType, StormBehaviorTreeElementType::kState);
+  EXPECT_EQ(template_stats.m_Types[0].m_Count, 2);
+  EXPECT_EQ(template_stats.m_Types[0].m_InstanceBytes, 2 * sizeof(TestUpdater));
+
+  std::vector<std::unique_ptr<BTInst>> trees;
+  StormBehaviorTreePopulationMemoryStats population_stats;
+  for(int index = 0; index < 10; ++index)
+  {
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    population_stats.AddInstance(*trees.back());
+  }
+
+  EXPECT_EQ(population_stats.GetTemplateCount(), 1);
+  EXPECT_EQ(population_stats.GetInstanceCount(), 10);
+  EXPECT_EQ(population_stats.GetStaticBytes(), template_stats.GetStaticBytes());
+  EXPECT_GE(population_stats.GetInstanceBytes(), 10 * template_stats.m_InstanceBytes);
+  EXPECT_GE(population_stats.GetPaddingBytes(), 10 * padding_bytes);
+  EXPECT_EQ(trees[0]->GetMemoryStats().m_PaddingBytes, padding_bytes);
+
+  auto type_stats = population_stats.GetTypeStats();
+  ASSERT_EQ(type_stats.size(), 4u);
+  EXPECT_EQ(type_stats[0].m_InstanceBytes, 20 * sizeof(TestUpdater));
+}
+
+TEST_F(StormBehaviorTestFixture, ProfileLayout)
+{
+  auto make_builder = []()
+  {
+    return BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditional>(false, false, false)
+      )
+      .AddChild(
+        BT(StormBehaviorNodeType::kSequence)
+        .AddChild(
+          State<TestUpdater>(2)
+          .AddService<TestService>()
+        )
+        .AddChild(
+          BT(StormBehaviorNodeType::kRandom)
+          .AddChild(State<TestUpdater>(3))
+          .AddChild(State<TestUpdater>(4))
+        )
+      )
+      .AddChild(
+        State<TestUpdater>(5)
+        .AddConditional<TestConditionalToggle>(true, true)
+      );
+  };
+
+  auto ReferenceTemplate = StormBehaviorTreeTemplate(make_builder());
+  auto LayoutTemplate = StormBehaviorTreeTemplate(make_builder());
+
+  auto profile = LayoutTemplate.CreateProfile();
+  {
+    TestData profile_data = {};
+    std::mt19937 profile_random(0);
+    StormBehaviorTree profile_tree(LayoutTemplate);
+    profile_tree.SetProfile(&profile);
+
+    for(int tick = 0; tick < 100; ++tick)
+    {
+      profile_tree.Update(profile_data, context, profile_random);
+    }
+  }
+
+  EXPECT_GT(profile.m_NodeHits[0], 0u);
+  LayoutTemplate.ApplyProfileLayout(profile);
+
+  auto reference_stats = ReferenceTemplate.GetMemoryStats();
+  auto layout_stats = LayoutTemplate.GetMemoryStats();
+  EXPECT_EQ(reference_stats.m_InstanceBytes, layout_stats.m_InstanceBytes);
+
+  StormBehaviorTree reference_tree(ReferenceTemplate);
+  StormBehaviorTree layout_tree(LayoutTemplate);
+  TestData reference_data = {};
+  std::mt19937 reference_random(5);
+  std::mt19937 layout_random(5);
+
+  for(int tick = 0; tick < 100; ++tick)
+  {
+    reference_tree.Update(reference_data, context, reference_random);
+    layout_tree.Update(data, context, layout_random);
+
+    EXPECT_EQ(reference_data.m_UpdaterId, data.m_UpdaterId);
+    EXPECT_EQ(reference_data.m_ServiceActive, data.m_ServiceActive);
+    EXPECT_EQ(reference_data.m_SerivceUpdated, data.m_SerivceUpdated);
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, TimerWheel)
+{
+  StormBehaviorTimerWheel timer_wheel;
+  std::vector<uint64_t> deadlines = { 1, 5, 63, 64, 65, 4095, 4096, 4097, 300000, 16777216, 16777300, 17000000 };
+  for(int index = 0; index < static_cast<int>(deadlines.size()); ++index)
+  {
+    timer_wheel.Schedule(index, deadlines[index]);
+  }
+
+  std::vector<uint64_t> fired(deadlines.size(), 0);
+  while(timer_wheel.GetTick() < 17000001)
+  {
+    timer_wheel.Advance([&](int handle) { fired[handle] = timer_wheel.GetTick(); });
+  }
+
+  EXPECT_EQ(fired, deadlines);
+}
+
+TEST_F(StormBehaviorTestFixture, WorldSleep)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestSleepUpdater>(1, 10)
+        .AddConditional<TestConditionalPollingToggle>(false, true)
+      )
+      .AddChild(
+        State<TestSleepUpdater>(2, kStormBehaviorSleepUntilWoken)
+      ));
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  auto handle = world.AddInstance(&test_tree, &data);
+
+  auto tick = [&]() { world.Update(context, [&](int) -> std::mt19937 & { return r; }); };
+
+  tick();
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  EXPECT_EQ(data.m_SerivceUpdated, 1);
+  EXPECT_TRUE(world.IsSleeping(handle));
+  EXPECT_EQ(world.GetAwakeInstanceCount(), 0);
+
+  for(int index = 0; index < 9; ++index)
+  {
+    tick();
+  }
+
+  EXPECT_EQ(data.m_SerivceUpdated, 1);
+  tick();
+  EXPECT_EQ(data.m_SerivceUpdated, 2);
+
+  tick();
+  data.m_ToggleActive = false;
+  tick();
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  EXPECT_EQ(data.m_SerivceUpdated, 3);
+
+  for(int index = 0; index < 100; ++index)
+  {
+    tick();
+  }
+
+  EXPECT_EQ(data.m_SerivceUpdated, 3);
+  EXPECT_TRUE(world.IsSleeping(handle));
+
+  world.Wake(handle);
+  tick();
+  EXPECT_EQ(data.m_SerivceUpdated, 4);
+}
+
+TEST_F(StormBehaviorTestFixture, MpscQueue)
+{
+  StormBehaviorMpscQueue<std::pair<int, int>> queue;
+
+  std::vector<std::thread> threads;
+  for(int thread_index = 0; thread_index < 4; ++thread_index)
+  {
+    threads.emplace_back([&queue, thread_index]()
+    {
+      for(int index = 0; index < 10000; ++index)
+      {
+        queue.Push(std::make_pair(thread_index, index));
+      }
+    });
+  }
+
+  for(auto & elem : threads)
+  {
+    elem.join();
+  }
+
+  int count = 0;
+  int last_index[4] = { -1, -1, -1, -1 };
+  queue.Drain([&](const std::pair<int, int> & val)
+  {
+    EXPECT_EQ(last_index[val.first] + 1, val.second);
+    last_index[val.first] = val.second;
+    count++;
+  });
+
+  EXPECT_EQ(count, 40000);
+  EXPECT_TRUE(queue.IsEmpty());
+}
+
+TEST_F(StormBehaviorTestFixture, WorldEvents)
+{
+  static const int kAlarmEvent = 7;
+
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestSleepUpdater>(1, kStormBehaviorSleepUntilWoken)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+        .SetName("alarm")
+        .InterruptOn(kAlarmEvent)
+      ));
+
+  EXPECT_TRUE(TestTreeTemplate.ListensToEvent(kAlarmEvent));
+  EXPECT_FALSE(TestTreeTemplate.ListensToEvent(kAlarmEvent + 1));
+  EXPECT_EQ(TestTreeTemplate.FindNode("alarm"), 2);
+  EXPECT_EQ(TestTreeTemplate.FindNode("missing"), -1);
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  std::vector<std::unique_ptr<BTInst>> trees;
+  std::vector<TestData> datas(100);
+  for(auto & elem : datas)
+  {
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    world.AddInstance(trees.back().get(), &elem);
+  }
+
+  auto tick = [&]() { world.Update(context, [&](int) -> std::mt19937 & { return r; }); };
+  auto count_updater = [&](int updater_id) 
+  { 
+    return std::count_if(datas.begin(), datas.end(), [&](auto & elem) { return elem.m_UpdaterId == updater_id; }); 
+  };
+
+  tick();
+  tick();
+  EXPECT_EQ(count_updater(1), 100);
+  EXPECT_EQ(world.GetAwakeInstanceCount(), 0);
+
+  world.Broadcast(kAlarmEvent);
+  tick();
+  EXPECT_EQ(count_updater(2), 100);
+
+  tick();
+  EXPECT_EQ(count_updater(1), 100);
+  EXPECT_EQ(world.GetAwakeInstanceCount(), 0);
+
+  std::thread poster([&]() { world.PostEvent(10, kAlarmEvent); });
+  poster.join();
+  world.Interrupt(20, TestTreeTemplate.FindNode("alarm"));
+  world.PostEvent(30, kAlarmEvent + 1);
+
+  tick();
+  EXPECT_EQ(count_updater(2), 2);
+  EXPECT_EQ(datas[10].m_UpdaterId, 2);
+  EXPECT_EQ(datas[20].m_UpdaterId, 2);
+  EXPECT_EQ(datas[30].m_UpdaterId, 1);
+}
+
+TEST_F(StormBehaviorTestFixture, BroadcastOverflow)
+{
+  static const int kAlarmEvent = 7;
+
+  auto ListenerTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestSleepUpdater>(1, kStormBehaviorSleepUntilWoken)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+        .InterruptOn(kAlarmEvent)
+      ));
+
+  auto SleeperTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestSleepUpdater>(3, kStormBehaviorSleepUntilWoken)
+      ));
+
+  EXPECT_TRUE(ListenerTemplate.HasEventNodes());
+  EXPECT_FALSE(SleeperTemplate.HasEventNodes());
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  BTInst listener_tree(ListenerTemplate);
+  BTInst sleeper_tree(SleeperTemplate);
+  TestData listener_data;
+  TestData sleeper_data;
+  auto listener_handle = world.AddInstance(&listener_tree, &listener_data);
+  auto sleeper_handle = world.AddInstance(&sleeper_tree, &sleeper_data);
+
+  auto tick = [&]() { world.Update(context, [&](int) -> std::mt19937 & { return r; }); };
+  tick();
+  tick();
+  EXPECT_TRUE(world.IsSleeping(listener_handle));
+  EXPECT_TRUE(world.IsSleeping(sleeper_handle));
+
+  // Overrunning the ring replans instances that listen to events, but can't have interrupted one that doesn't
+  auto sleeper_updates = sleeper_data.m_SerivceUpdated;
+  for(int index = 0; index < 300; ++index)
+  {
+    world.Broadcast(kAlarmEvent + 1);
+  }
+
+  tick();
+  EXPECT_TRUE(world.IsSleeping(sleeper_handle));
+  EXPECT_EQ(sleeper_data.m_SerivceUpdated, sleeper_updates);
+  EXPECT_EQ(sleeper_data.m_UpdaterId, 3);
+  EXPECT_EQ(listener_data.m_UpdaterId, 1);
+
+  // A running sequence in a tree without event nodes keeps going after an overrun
+  auto SequenceTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSequence)
+      .AddChild(State<TestUpdater>(1))
+      .AddChild(State<TestUpdater>(2, false)));
+
+  StormBehaviorTreeBroadcast broadcast;
+  StormBehaviorTree test_tree(SequenceTemplate);
+  test_tree.SetBroadcast(&broadcast);
+  test_tree.Update(data, context, r);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+
+  for(int index = 0; index < 257; ++index)
+  {
+    broadcast.Broadcast(kAlarmEvent);
+  }
+
+  data.m_UpdaterId = 0;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+}
+
+TEST_F(StormBehaviorTestFixture, UtilityNode)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kUtility)
+      .AddScoredChild<TestScorerConstant>(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalToggle>(false, false), 0.9f
+      )
+      .AddScoredChild<TestScorerConstant>(
+        State<TestUpdater>(2, false), 0.5f
+      )
+      .AddScoredChild<TestScorerHealth>(
+        State<TestUpdater>(3, false)
+      ));
+
+  EXPECT_EQ(TestTreeTemplate.GetScorerCount(), 3);
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+
+  data.m_Health = 0.1f;
+  test_tree.Interrupt(0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+
+  data.m_ToggleActive = false;
+  test_tree.Interrupt(0);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+
+  static const int kInstanceCount = 50;
+  std::vector<std::unique_ptr<BTInst>> trees;
+  std::vector<std::unique_ptr<BTInst>> reference_trees;
+  std::vector<TestData> datas(kInstanceCount);
+  std::vector<TestData> reference_datas(kInstanceCount);
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  world.SetBatchUtilityScoring(true);
+
+  for(int index = 0; index < kInstanceCount; ++index)
+  {
+    datas[index].m_Health = reference_datas[index].m_Health = index / static_cast<float>(kInstanceCount);
+    datas[index].m_ToggleActive = reference_datas[index].m_ToggleActive = (index % 2) == 0;
+
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    reference_trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    world.AddInstance(trees.back().get(), &datas[index]);
+  }
+
+  world.Update(context, [&](int) -> std::mt19937 & { return r; }, 4);
+  for(int index = 0; index < kInstanceCount; ++index)
+  {
+    reference_trees[index]->Update(reference_datas[index], context, r);
+    EXPECT_EQ(datas[index].m_UpdaterId, reference_datas[index].m_UpdaterId);
+  }
+
+  EXPECT_EQ(datas[kInstanceCount - 1].m_UpdaterId, 3);
+  EXPECT_EQ(datas[0].m_UpdaterId, 1);
+  EXPECT_EQ(datas[1].m_UpdaterId, 2);
+}
+
+TEST_F(StormBehaviorTestFixture, ConditionalOrder)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1)
+        .AddConditional<TestConditionalExpensive>(false, false)
+        .AddConditional<TestConditionalPureToggle>(false, false)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+      ));
+
+  TestTreeTemplate.EnableConditionalStats();
+  StormBehaviorTree test_tree(TestTreeTemplate);
+
+  data.m_ToggleActive = false;
+  TestConditionalExpensive::s_CheckCount = 0;
+  for(int index = 0; index < 32; ++index)
+  {
+    test_tree.Update(data, context, r);
+  }
+
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 32);
+  EXPECT_EQ(TestTreeTemplate.GetConditionalOrderReport().m_ReorderedGroups, 0);
+
+  // The toggle always fails, so it should be checked first and the expensive conditional skipped
+  TestTreeTemplate.UpdateConditionalOrder();
+  auto report = TestTreeTemplate.GetConditionalOrderReport();
+  EXPECT_EQ(report.m_ReorderedGroups, 1);
+  EXPECT_GT(report.GetSavings(), 0.0);
+
+  TestConditionalExpensive::s_CheckCount = 0;
+  for(int index = 0; index < 32; ++index)
+  {
+    test_tree.Update(data, context, r);
+  }
+
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 0);
+
+  data.m_ToggleActive = true;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 1);
+}
+
+TEST_F(StormBehaviorTestFixture, ConditionalMemo)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1)
+        .AddConditional<TestConditionalExpensive>(false, false, true)
+        .AddConditional<TestConditionalPureToggle>(false, false)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+        .AddConditional<TestConditionalExpensive>(false, false, true)
+        .AddConditional<TestConditionalPureToggle>(false, false)
+      )
+      .AddChild(
+        State<TestUpdater>(3)
+        .AddConditional<TestConditionalExpensive>(false, false, false)
+      )
+      .AddChild(
+        State<TestUpdater>(4)
+        .AddConditional<TestConditional>(false, false, true)
+      ));
+
+  EXPECT_EQ(TestTreeTemplate.GetConditionalMemoSlotCount(), 2);
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  data.m_ToggleActive = false;
+
+  // The first two expensive conditionals share a result, the third has different init data
+  TestConditionalExpensive::s_CheckCount = 0;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 4);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 2);
+
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 4);
+
+  data.m_ToggleActive = true;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 5);
+}
+
+TEST_F(StormBehaviorTestFixture, MoveInstances)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestHistoryUpdater>()
+        .AddService<TestService>()
+      ));
+
+  EXPECT_FALSE(TestTreeTemplate.IsTriviallyRelocatable());
+  EXPECT_TRUE(TestTreeTemplate.IsRelocatable());
+
+  std::vector<BTInst> trees;
+  for(int index = 0; index < 8; ++index)
+  {
+    trees.emplace_back(TestTreeTemplate);
+    trees.back().Update(data, context, r);
+  }
+
+  EXPECT_EQ(data.m_UpdaterId, 1);
+
+  trees.erase(trees.begin());
+  trees[0].Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+
+  BTInst moved_tree(std::move(trees[0]));
+  EXPECT_EQ(trees[0].GetBehaviorTree(), nullptr);
+  moved_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+
+  moved_tree.Relocate(nullptr);
+  moved_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 4);
+}
+
+TEST_F(StormBehaviorTestFixture, PoolCompaction)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestHistoryUpdater>()
+      ));
+
+  auto TrivialTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(7)
+      ));
+
+  EXPECT_TRUE(TrivialTreeTemplate.IsTriviallyRelocatable());
+
+  StormBehaviorTreePool<TestData, TestContext> pool;
+  std::vector<int> handles;
+  for(int index = 0; index < 64; ++index)
+  {
+    auto handle = pool.Create(index % 4 == 0 ? TrivialTreeTemplate : TestTreeTemplate);
+    pool.Get(handle).Update(data, context, r);
+    handles.push_back(handle);
+  }
+
+  for(int index = 0; index < 64; index += 2)
+  {
+    pool.Destroy(handles[index]);
+  }
+
+  EXPECT_EQ(pool.GetCount(), 32);
+  EXPECT_GT(pool.GetFragmentedBytes(), 0u);
+
+  pool.Compact();
+  EXPECT_EQ(pool.GetFragmentedBytes(), 0u);
+  EXPECT_EQ(pool.GetLiveBytes(), pool.GetArenaCapacity());
+
+  for(int index = 1; index < 64; index += 2)
+  {
+    pool.Get(handles[index]).Update(data, context, r);
+    EXPECT_EQ(data.m_UpdaterId, 2);
+  }
+
+  for(int index = 0; index < 64; ++index)
+  {
+    pool.Create(TrivialTreeTemplate);
+  }
+
+  for(int index = 1; index < 64; index += 2)
+  {
+    pool.Get(handles[index]).Update(data, context, r);
+    EXPECT_EQ(data.m_UpdaterId, 3);
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, Telemetry)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalToggle>(true, true)
+        .AddService<TestService>()
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+      ));
+
+  static const int kInstanceCount = 8;
+  std::vector<std::unique_ptr<BTInst>> trees;
+  std::vector<TestData> datas(kInstanceCount);
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  for(int index = 0; index < kInstanceCount; ++index)
+  {
+    datas[index].m_ToggleActive = (index % 2) == 0;
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    world.AddInstance(trees.back().get(), &datas[index]);
+  }
+
+  StormBehaviorTelemetryBufferSink sink;
+  StormBehaviorTreeTelemetryWriter<StormBehaviorTelemetryBufferSink> writer(sink);
+  writer.SetBatchBytes(0);
+
+  StormBehaviorTreeTelemetryReader reader;
+  std::size_t read_offset = 0;
+  auto tick = [&]()
+  {
+    world.Update(context, [&](int) -> std::mt19937 & { return r; });
+    writer.RecordWorld(world);
+    EXPECT_TRUE(reader.Feed(sink.m_Data.data() + read_offset, sink.m_Data.size() - read_offset));
+    read_offset = sink.m_Data.size();
+  };
+
+  auto check_instances = [&]()
+  {
+    ASSERT_EQ(static_cast<int>(reader.GetInstances().size()), world.GetInstanceCount());
+    for(auto & elem : reader.GetInstances())
+    {
+      auto tree = world.GetInstance(elem.first);
+      ASSERT_NE(tree, nullptr);
+      EXPECT_EQ(elem.second.m_Node, tree->GetCurrentNode());
+
+      std::vector<int> services;
+      tree->VisitActiveServices([&](int service_index) { services.push_back(service_index); });
+      EXPECT_EQ(elem.second.m_Services, services);
+    }
+  };
+
+  tick();
+  EXPECT_TRUE(reader.IsKeyFrame());
+  EXPECT_EQ(reader.GetFrameRecordCount(), kInstanceCount);
+  check_instances();
+
+  // Only the instances that changed are sent
+  datas[1].m_ToggleActive = true;
+  tick();
+  EXPECT_FALSE(reader.IsKeyFrame());
+  EXPECT_EQ(reader.GetFrameRecordCount(), 1);
+  check_instances();
+
+  world.RemoveInstance(3);
+  tick();
+  EXPECT_EQ(reader.GetFrameRecordCount(), 1);
+  check_instances();
+
+  // Backpressure drops frames, then the writer resyncs with a key frame
+  sink.m_Capacity = sink.m_Data.size();
+  writer.SetMaxPendingBytes(4);
+  datas[0].m_ToggleActive = false;
+  datas[2].m_ToggleActive = false;
+  tick();
+  tick();
+  EXPECT_GT(writer.GetDroppedFrames(), 0u);
+
+  sink.m_Capacity = 0;
+  writer.SetMaxPendingBytes(1024 * 1024);
+  tick();
+  EXPECT_TRUE(reader.IsKeyFrame());
+  check_instances();
+
+  // Sampling
+  auto frame_count = reader.GetFrameCount();
+  writer.SetSampleInterval(1000);
+  tick();
+  tick();
+  EXPECT_LE(reader.GetFrameCount(), frame_count + 1);
+}
+
+TEST_F(StormBehaviorTestFixture, ParamBlock)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(StormBehaviorParam<int>("id", 1))
+        .AddConditional<TestConditional>(false, false, StormBehaviorParam<bool>("enabled", true))
+      )
+      .AddChild(
+        State<TestUpdater>(StormBehaviorParam<int>("fallback_id", 2))
+        .AddConditional<TestConditional>(false, false, StormBehaviorParam<bool>("enabled", true))
+      )
+      .AddChild(
+        State<TestUpdater>(3)
+      ));
+
+  EXPECT_EQ(TestTreeTemplate.GetParamCount(), 3);
+  EXPECT_NE(TestTreeTemplate.FindParam("enabled"), -1);
+
+  BTInst default_tree(TestTreeTemplate);
+  default_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+
+  auto params = TestTreeTemplate.CreateParamBlock();
+  EXPECT_TRUE(params.Set("id", 10));
+  EXPECT_FALSE(params.Set("missing", 10));
+  EXPECT_FALSE(params.Set("id", 10.0f));
+  EXPECT_FALSE(params.Set("id", static_cast<int64_t>(10)));
+  EXPECT_FALSE(params.Set(-1, 10));
+
+  BTInst override_tree(TestTreeTemplate, params);
+  override_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 10);
+
+  // Both conditionals read the same slot
+  params.Set("enabled", false);
+
+  BTInst disabled_tree(TestTreeTemplate, params);
+  disabled_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+
+  StormBehaviorTreePool<TestData, TestContext> pool;
+  params.Set("enabled", true);
+  params.Set("id", 20);
+  auto handle = pool.Create(TestTreeTemplate, &params);
+  pool.Get(handle).Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 20);
+}
+
+TEST_F(StormBehaviorTestFixture, TransitionStats)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalToggle>(false, true)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+      ));
+
+  TestTreeTemplate.EnableTransitionStats(4);
+
+  std::vector<TestData> datas(32);
+  std::vector<std::unique_ptr<BTInst>> trees;
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  for(auto & elem : datas)
+  {
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    world.AddInstance(trees.back().get(), &elem);
+  }
+
+  auto tick = [&](bool toggle_active)
+  {
+    for(auto & elem : datas)
+    {
+      elem.m_ToggleActive = toggle_active;
+    }
+
+    world.Update(context, [&](int handle) { return StormBehaviorCounterRandom(1, handle, 0); }, 4, 4);
+  };
+
+  for(int index = 0; index < 3; ++index)
+  {
+    tick(true);
+  }
+
+  for(int index = 0; index < 5; ++index)
+  {
+    tick(false);
+  }
+
+  tick(true);
+
+  auto snapshot = TestTreeTemplate.GetTransitionSnapshot();
+  EXPECT_EQ(snapshot.m_LeafCount, 2);
+  EXPECT_EQ(snapshot.GetTransitionCount(0, 1), 32u);
+  EXPECT_EQ(snapshot.GetTransitionCount(1, 0), 32u);
+  EXPECT_EQ(snapshot.GetTransitionCount(0, 0), 0u);
+  EXPECT_EQ(snapshot.GetDwellCount(0, 1), 32u);
+  EXPECT_EQ(snapshot.GetDwellCount(1, 2), 32u);
+  EXPECT_DOUBLE_EQ(snapshot.GetAverageDwell(0), 3.0);
+  EXPECT_DOUBLE_EQ(snapshot.GetAverageDwell(1), 5.0);
+  EXPECT_EQ(snapshot.GetPreemptionCount(0), 32u);
+
+  TestTreeTemplate.ResetTransitionStats();
+  snapshot = TestTreeTemplate.GetTransitionSnapshot();
+  EXPECT_EQ(snapshot.GetTransitionCount(0, 1), 0u);
+  EXPECT_EQ(snapshot.GetPreemptionCount(0), 0u);
+}
+
+TEST_F(StormBehaviorTestFixture, PopulationSaveLoad)
+{
+  std::vector<std::unique_ptr<StormBehaviorTreeTemplate<TestData, TestContext>>> templates;
+  templates.emplace_back(std::make_unique<StormBehaviorTreeTemplate<TestData, TestContext>>(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestHistoryUpdater>()
+        .AddService<TestService>()
+      )));
+
+  templates.emplace_back(std::make_unique<StormBehaviorTreeTemplate<TestData, TestContext>>(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(7, false)
+      )));
+
+  EXPECT_TRUE(templates[0]->IsSerializable());
+  EXPECT_TRUE(templates[1]->IsSerializable());
+
+  std::vector<BTInst> trees;
+  for(int index = 0; index < 40; ++index)
+  {
+    trees.emplace_back(*templates[index % 2]);
+    for(int update = 0; update < index / 2; ++update)
+    {
+      trees.back().Update(data, context, r);
+    }
+  }
+
+  StormBehaviorTelemetryBufferSink sink;
+  StormBehaviorTreePopulationWriter<StormBehaviorTelemetryBufferSink> writer(sink, 64);
+  for(int index = 0; index < static_cast<int>(trees.size()); ++index)
+  {
+    writer.Write(index % 2, trees[index]);
+  }
+
+  EXPECT_TRUE(writer.Finish());
+  EXPECT_EQ(writer.GetWrittenBytes(), sink.m_Data.size());
+
+  auto load = [&](const void * file_data, std::size_t size)
+  {
+    std::vector<BTInst> loaded_trees(trees.size());
+    StormBehaviorTreePopulationReader reader(file_data, size);
+
+    int template_id;
+    int count = 0;
+    while(reader.NextInstance(template_id))
+    {
+      EXPECT_EQ(template_id, count % 2);
+      EXPECT_TRUE(reader.Load(loaded_trees[count], *templates[template_id]));
+      count++;
+    }
+
+    EXPECT_TRUE(reader.IsFinished());
+    EXPECT_FALSE(reader.HasFailed());
+    EXPECT_EQ(count, static_cast<int>(trees.size()));
+    return loaded_trees;
+  };
+
+  data.m_ServiceActive = false;
+  auto loaded_trees = load(sink.m_Data.data(), sink.m_Data.size());
+
+  // Loading restores the active leaf without activating it again
+  EXPECT_FALSE(data.m_ServiceActive);
+
+  for(int index = 0; index < static_cast<int>(trees.size()); ++index)
+  {
+    EXPECT_EQ(loaded_trees[index].GetCurrentNode(), trees[index].GetCurrentNode());
+
+    loaded_trees[index].Update(data, context, r);
+    EXPECT_EQ(data.m_UpdaterId, index % 2 ? 7 : index / 2 + 1);
+  }
+
+  // Through a file
+  const char * path = "StormBehaviorPopulationTest.bin";
+  {
+    StormBehaviorTreeFileSink file_sink;
+    ASSERT_TRUE(file_sink.Open(path));
+
+    StormBehaviorTreePopulationWriter<StormBehaviorTreeFileSink> file_writer(file_sink);
+    for(int index = 0; index < static_cast<int>(trees.size()); ++index)
+    {
+      file_writer.Write(index % 2, trees[index]);
+    }
+
+    EXPECT_TRUE(file_writer.Finish());
+    EXPECT_TRUE(file_sink.Close());
+  }
+
+  {
+    StormBehaviorTreeMappedFile file;
+    ASSERT_TRUE(file.Open(path));
+    auto file_trees = load(file.GetData(), file.GetSize());
+    EXPECT_EQ(file_trees[4].GetCurrentNode(), trees[4].GetCurrentNode());
+  }
+
+  remove(path);
+
+  // Cut short
+  StormBehaviorTreePopulationReader reader(sink.m_Data.data(), sink.m_Data.size() / 2);
+  BTInst tree;
+  int template_id;
+  while(reader.NextInstance(template_id))
+  {
+    reader.Load(tree, *templates[template_id]);
+  }
+
+  EXPECT_TRUE(reader.HasFailed());
+  EXPECT_FALSE(reader.IsFinished());
+}
+
+TEST_F(StormBehaviorTestFixture, Replication)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestReplicatedUpdater>()
+        .AddConditional<TestConditionalToggle>(false, true)
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+      ));
+
+  auto regions = TestTreeTemplate.GetReplicatedRegions();
+  ASSERT_EQ(regions.size(), 1u);
+  EXPECT_EQ(regions[0].m_Size, static_cast<int>(sizeof(TestReplicatedUpdater)));
+
+  std::vector<TestData> datas(4);
+  std::vector<std::unique_ptr<BTInst>> server_trees;
+  std::vector<std::unique_ptr<BTInst>> client_trees;
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  for(auto & elem : datas)
+  {
+    server_trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    client_trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    world.AddInstance(server_trees.back().get(), &elem);
+  }
+
+  StormBehaviorTreeReplicationEncoder<TestData, TestContext> encoder;
+  StormBehaviorTreeReplicationDecoder decoder;
+  StormBehaviorTreeWriteBuffer buffer;
+
+  int node_changes = 0;
+  std::vector<int> removed;
+  auto tick = [&]()
+  {
+    world.Update(context, [&](int) -> std::mt19937 & { return r; });
+
+    buffer.Clear();
+    auto record_count = encoder.EncodeWorld(world, buffer);
+    EXPECT_TRUE(decoder.Decode(buffer.GetData().data(), buffer.GetSize(), 
+      [&](int id) { return client_trees[id].get(); },
+      [&](int id, BTInst & tree, int prev_node) { node_changes++; },
+      [&](int id) { removed.push_back(id); }));
+
+    return record_count;
+  };
+
+  auto check_clients = [&]()
+  {
+    for(int index = 0; index < world.GetHandleCount(); ++index)
+    {
+      if(world.GetInstance(index) == nullptr)
+      {
+        continue;
+      }
+
+      EXPECT_EQ(client_trees[index]->GetCurrentNode(), server_trees[index]->GetCurrentNode());
+      for(auto & region : regions)
+      {
+        EXPECT_EQ(memcmp(static_cast<const uint8_t *>(client_trees[index]->GetNodeMemory()) + region.m_Offset, 
+          static_cast<const uint8_t *>(server_trees[index]->GetNodeMemory()) + region.m_Offset, region.m_Size), 0);
+      }
+    }
+  };
+
+  EXPECT_EQ(tick(), 4);
+  EXPECT_EQ(node_changes, 4);
+  check_clients();
+
+  // The tick counter changes every update, so only its block is sent
+  auto full_size = buffer.GetSize();
+  EXPECT_EQ(tick(), 4);
+  EXPECT_LT(buffer.GetSize(), full_size);
+  check_clients();
+
+  datas[1].m_ToggleActive = false;
+  EXPECT_EQ(tick(), 4);
+  EXPECT_EQ(node_changes, 5);
+  check_clients();
+
+  for(auto & elem : datas)
+  {
+    elem.m_ToggleActive = false;
+  }
+
+  tick();
+  check_clients();
+
+  // Nothing changes once every instance sits in the plain leaf
+  EXPECT_EQ(tick(), 0);
+
+  world.RemoveInstance(2);
+  EXPECT_EQ(tick(), 1);
+  EXPECT_EQ(removed, std::vector<int>{ 2 });
+
+  // Frames must be applied in order
+  buffer.Clear();
+  encoder.EncodeWorld(world, buffer);
+  buffer.Clear();
+  encoder.EncodeWorld(world, buffer);
+  EXPECT_FALSE(decoder.Decode(buffer.GetData().data(), buffer.GetSize(), [&](int id) { return client_trees[id].get(); }));
+}
+
+TEST_F(StormBehaviorTestFixture, BatchConditionals)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalBatchHealth>(true, true, 0.5f)
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+      ));
+
+  // The conditional keeps instances in the first leaf and preempts the second, so both leaves share one batch
+  EXPECT_EQ(TestTreeTemplate.GetConditionalMemoSlotCount(), 1);
+  EXPECT_TRUE(TestTreeTemplate.HasCheckBatch(0));
+
+  static const int kInstanceCount = 100;
+  std::vector<std::unique_ptr<BTInst>> trees;
+  std::vector<std::unique_ptr<BTInst>> reference_trees;
+  std::vector<TestData> datas(kInstanceCount);
+  std::vector<TestData> reference_datas(kInstanceCount);
+
+  StormBehaviorTreeWorld<TestData, TestContext> world;
+  world.SetBatchConditionals(true);
+
+  for(int index = 0; index < kInstanceCount; ++index)
+  {
+    datas[index].m_Health = reference_datas[index].m_Health = index / static_cast<float>(kInstanceCount);
+
+    trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    reference_trees.emplace_back(std::make_unique<BTInst>(TestTreeTemplate));
+    world.AddInstance(trees.back().get(), &datas[index]);
+  }
+
+  auto tick = [&]()
+  {
+    world.Update(context, [&](int) -> std::mt19937 & { return r; }, 4);
+    auto check_count = TestConditionalBatchHealth::s_CheckCount.load();
+
+    for(int index = 0; index < kInstanceCount; ++index)
+    {
+      reference_trees[index]->Update(reference_datas[index], context, r);
+      EXPECT_EQ(datas[index].m_UpdaterId, reference_datas[index].m_UpdaterId);
+    }
+
+    return check_count;
+  };
+
+  // Nothing is in a leaf yet, so the first tick checks one instance at a time
+  TestConditionalBatchHealth::s_CheckCount = 0;
+  TestConditionalBatchHealth::s_BatchCount = 0;
+  EXPECT_GT(tick(), 0);
+  EXPECT_EQ(TestConditionalBatchHealth::s_BatchCount, 0);
+  EXPECT_EQ(datas[0].m_UpdaterId, 2);
+  EXPECT_EQ(datas[kInstanceCount - 1].m_UpdaterId, 1);
+
+  // Every instance flips leaves, and re-selection reuses the batched results
+  for(int index = 0; index < kInstanceCount; ++index)
+  {
+    datas[index].m_Health = reference_datas[index].m_Health = 1.0f - datas[index].m_Health;
+  }
+
+  TestConditionalBatchHealth::s_CheckCount = 0;
+  TestConditionalBatchHealth::s_BatchCount = 0;
+  EXPECT_EQ(tick(), 0);
+  EXPECT_EQ(TestConditionalBatchHealth::s_BatchCount, 1);
+  EXPECT_EQ(datas[0].m_UpdaterId, 1);
+  EXPECT_EQ(datas[kInstanceCount - 1].m_UpdaterId, 2);
+}
+
+TEST_F(StormBehaviorTestFixture, LayeredInstance)
+{
+  auto LocomotionTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalExpensive>(false, true, true)
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+      ));
+
+  auto CombatTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestReplicatedUpdater>()
+        .AddConditional<TestConditionalExpensive>(false, true, true)
+        .AddConditional<TestConditionalPureToggle>(false, true)
+      )
+      .AddChild(
+        State<TestReplicatedUpdater>()
+      ));
+
+  StormBehaviorTreeLayerSet<TestData, TestContext> layer_set({ &LocomotionTemplate, &CombatTemplate });
+  EXPECT_EQ(layer_set.GetMemoSlotCount(), 1);
+
+  StormBehaviorTreeLayered<TestData, TestContext> layered(layer_set);
+  EXPECT_FALSE(layered.GetLayer(0).OwnsMemory());
+  EXPECT_FALSE(layered.GetLayer(1).OwnsMemory());
+
+  // Both layers use the expensive conditional, but it is only checked once per tick for the agent
+  TestConditionalExpensive::s_CheckCount = 0;
+  layered.Update(data, context, r);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 1);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  EXPECT_EQ(layered.GetCurrentNode(1), 1);
+
+  layered.Update(data, context, r);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 2);
+
+  data.m_ToggleActive = false;
+  layered.Update(data, context, r);
+  EXPECT_EQ(layered.GetCurrentNode(0), 1);
+  EXPECT_EQ(layered.GetCurrentNode(1), 2);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 3);
+
+  // Moving the agent leaves the layers where they are
+  auto layer_memory = layered.GetLayer(1).GetNodeMemory();
+  StormBehaviorTreeLayered<TestData, TestContext> moved(std::move(layered));
+  EXPECT_EQ(moved.GetLayer(1).GetNodeMemory(), layer_memory);
+
+  data.m_ToggleActive = true;
+  moved.Update(data, context, r);
+  EXPECT_EQ(moved.GetCurrentNode(0), 1);
+  EXPECT_EQ(moved.GetCurrentNode(1), 2);
+  EXPECT_EQ(TestConditionalExpensive::s_CheckCount, 4);
+}
+
+TEST_F(StormBehaviorTestFixture, ConditionalExpression)
+{
+  using Expr = StormBehaviorTreeConditionalExpression<TestData, TestContext>;
+
+  // (A && !B) || C
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditionalExpression(true, true, 
+          Expr::Or(Expr::And(Expr::Check<TestConditionalFlag>(0), Expr::Not(Expr::Check<TestConditionalFlag>(1))), 
+                   Expr::Check<TestConditionalFlag>(2)))
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+      ));
+
+  EXPECT_EQ(TestTreeTemplate.GetConditionalCount(), 1);
+  EXPECT_EQ(TestTreeTemplate.GetInstanceMemorySize(), 3 * sizeof(TestConditionalFlag) + 2 * sizeof(TestUpdater));
+
+  // Walk through every combination twice so both leaves get entered and preempted
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  for(int tick = 0; tick < 16; ++tick)
+  {
+    data.m_Flags = tick % 8;
+    auto a = (data.m_Flags & 1) != 0;
+    auto b = (data.m_Flags & 2) != 0;
+    auto c = (data.m_Flags & 4) != 0;
+
+    test_tree.Update(data, context, r);
+    EXPECT_EQ(data.m_UpdaterId, (a && !b) || c ? 1 : 2);
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, LazyStates)
+{
+  auto make_builder = []()
+  {
+    return BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestHistoryUpdater>()
+        .AddConditional<TestConditionalToggle>(true, true)
+      )
+      .AddChild(
+        State<TestHistoryUpdater>()
+        .AddService<TestService>()
+      );
+  };
+
+  auto ReferenceTemplate = StormBehaviorTreeTemplate(make_builder());
+  auto LazyTemplate = StormBehaviorTreeTemplate(make_builder());
+  EXPECT_TRUE(LazyTemplate.EnableLazyStates());
+  EXPECT_TRUE(LazyTemplate.HasLazyStates());
+  EXPECT_LE(LazyTemplate.GetInstanceMemorySize(), ReferenceTemplate.GetInstanceMemorySize() - sizeof(TestHistoryUpdater));
+
+  StormBehaviorTree test_tree(LazyTemplate);
+  test_tree.Update(data, context, r);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+
+  data.m_ToggleActive = false;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  EXPECT_TRUE(data.m_ServiceActive);
+
+  // Coming back to the first leaf builds its state from scratch
+  data.m_ToggleActive = true;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+  EXPECT_FALSE(data.m_ServiceActive);
+
+  // The active state moves and saves with the rest of the node memory
+  test_tree.Relocate(nullptr);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+
+  StormBehaviorTreeWriteBuffer buffer;
+  test_tree.Save(buffer);
+
+  StormBehaviorTreeReadBuffer read_buffer(buffer.GetData().data(), buffer.GetSize());
+  BTInst loaded_tree;
+  EXPECT_TRUE(loaded_tree.Load(&LazyTemplate, read_buffer));
+  loaded_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+}
+
+TEST_F(StormBehaviorTestFixture, LazyStateReplication)
+{
+  // A non-replicated state would have the replicated state's bytes copied over it on the client
+  auto MixedTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestReplicatedUpdater>()
+        .AddConditional<TestConditionalToggle>(true, true)
+      )
+      .AddChild(
+        State<TestHistoryUpdater>()
+      ));
+
+  EXPECT_FALSE(MixedTemplate.EnableLazyStates());
+  EXPECT_FALSE(MixedTemplate.HasLazyStates());
+
+  auto regions = MixedTemplate.GetReplicatedRegions();
+  ASSERT_EQ(regions.size(), 1u);
+  EXPECT_EQ(regions[0].m_Size, static_cast<int>(sizeof(TestReplicatedUpdater)));
+
+  auto LazyTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestReplicatedUpdater>()
+        .AddConditional<TestConditionalToggle>(true, true)
+      )
+      .AddChild(
+        State<TestReplicatedUpdater>()
+      ));
+
+  EXPECT_TRUE(LazyTemplate.EnableLazyStates());
+
+  regions = LazyTemplate.GetReplicatedRegions();
+  ASSERT_EQ(regions.size(), 1u);
+
+  BTInst server_tree(LazyTemplate);
+  BTInst client_tree(LazyTemplate);
+
+  StormBehaviorTreeReplicationEncoder<TestData, TestContext> encoder;
+  StormBehaviorTreeReplicationDecoder decoder;
+  StormBehaviorTreeWriteBuffer buffer;
+
+  auto tick = [&]()
+  {
+    server_tree.Update(data, context, r);
+
+    buffer.Clear();
+    encoder.BeginFrame();
+    encoder.Record(0, server_tree);
+    encoder.EndFrame(buffer);
+    EXPECT_TRUE(decoder.Decode(buffer.GetData().data(), buffer.GetSize(), [&](int id) { return &client_tree; }));
+
+    EXPECT_EQ(client_tree.GetCurrentNode(), server_tree.GetCurrentNode());
+    EXPECT_EQ(memcmp(static_cast<const uint8_t *>(client_tree.GetNodeMemory()) + regions[0].m_Offset,
+      static_cast<const uint8_t *>(server_tree.GetNodeMemory()) + regions[0].m_Offset, regions[0].m_Size), 0);
+  };
+
+  tick();
+
+  // The new state ends its first tick with the same bytes the old one was last sent with, but the client built
+  // it from scratch, so the slot still has to be sent
+  data.m_ToggleActive = false;
+  tick();
+  tick();
+}
+
+TEST_F(StormBehaviorTestFixture, TemplateCache)
+{
+  auto make_builder = [](int id)
+  {
+    return BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(id, false)
+        .AddConditional<TestConditionalToggle>(true, true)
+      )
+      .AddChild(
+        State<TestUpdater>(2, false)
+        .AddService<TestService>()
+      );
+  };
+
+  std::vector<BT> builders;
+  builders.emplace_back(make_builder(1));
+  builders.emplace_back(make_builder(1));
+  builders.emplace_back(make_builder(3));
+
+  uint64_t hash_a, hash_b;
+  EXPECT_TRUE(builders[0].GetContentHash(hash_a));
+  EXPECT_TRUE(builders[1].GetContentHash(hash_b));
+  EXPECT_EQ(hash_a, hash_b);
+  EXPECT_TRUE(builders[0].IsSameContent(builders[1]));
+  EXPECT_FALSE(builders[0].IsSameContent(builders[2]));
+
+  StormBehaviorTreeTemplateCache<TestData, TestContext> cache;
+  auto templates = cache.Compile(std::move(builders), 2);
+  EXPECT_EQ(templates[0], templates[1]);
+  EXPECT_NE(templates[0], templates[2]);
+  EXPECT_EQ(cache.GetTemplateCount(), 2);
+
+  // Later calls match against what is already compiled
+  EXPECT_EQ(cache.Compile(make_builder(3)), templates[2]);
+  EXPECT_EQ(cache.GetHitCount(), 2u);
+
+  StormBehaviorTree test_tree(*templates[2]);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+
+  // Parameters with the same name but different defaults are different content
+  auto make_param_builder = [](int default_id)
+  {
+    return BT(StormBehaviorNodeType::kSelect)
+      .AddChild(State<TestUpdater>(StormBehaviorParam<int>("id", default_id), false));
+  };
+
+  std::vector<BT> param_builders;
+  param_builders.emplace_back(make_param_builder(5));
+  param_builders.emplace_back(make_param_builder(10));
+  param_builders.emplace_back(make_param_builder(10));
+
+  uint64_t hash_c;
+  EXPECT_TRUE(param_builders[0].GetContentHash(hash_a));
+  EXPECT_TRUE(param_builders[1].GetContentHash(hash_b));
+  EXPECT_TRUE(param_builders[2].GetContentHash(hash_c));
+  EXPECT_NE(hash_a, hash_b);
+  EXPECT_EQ(hash_b, hash_c);
+  EXPECT_FALSE(param_builders[0].IsSameContent(param_builders[1]));
+
+  auto param_templates = cache.Compile(std::move(param_builders));
+  EXPECT_NE(param_templates[0], param_templates[1]);
+  EXPECT_EQ(param_templates[1], param_templates[2]);
+
+  StormBehaviorTree param_tree(*param_templates[1]);
+  param_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 10);
+}
+
+TEST_F(StormBehaviorTestFixture, ObservedState)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSequence)
+      .AddChild(
+        State<TestUpdater>(1)
+      )
+      .AddChild(
+        State<TestUpdater>(2)
+        .AddService<TestService>()
+      ));
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  EXPECT_EQ(test_tree.Observe().m_CurrentNode, -1);
+
+  // The monitor only ever sees whole leaves, and the service list always matches the leaf it saw
+  std::atomic<bool> done = { false };
+  std::atomic<int> bad_observations = { 0 };
+  std::thread monitor([&]()
+  {
+    while(done.load() == false)
+    {
+      auto state = test_tree.Observe();
+      int service_count = 0;
+      test_tree.VisitObservedServices(state, [&](int) { service_count++; });
+
+      if(state.m_CurrentNode != -1 && (state.m_CurrentNode < 1 || state.m_CurrentNode > 2 || service_count != state.m_CurrentNode - 1))
+      {
+        bad_observations++;
+      }
+    }
+  });
+
+  for(int tick = 0; tick < 10000; ++tick)
+  {
+    test_tree.Update(data, context, r);
+  }
+
+  done = true;
+  monitor.join();
+  EXPECT_EQ(bad_observations.load(), 0);
+
+  auto state = test_tree.Observe();
+  EXPECT_EQ(state.m_CurrentNode, test_tree.GetCurrentNode());
+  EXPECT_EQ(state.m_AdvanceNode, true);
+  EXPECT_EQ(state.m_DwellTicks, 1u);
+}
+
+TEST_F(StormBehaviorTestFixture, ReplayLog)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddConditional<TestConditionalFlag>(false, true, 0)
+      )
+      .AddChild(
+        BT(StormBehaviorNodeType::kRandom)
+        .AddChild(10, State<TestUpdater>(2))
+        .AddChild(20, State<TestUpdater>(3))
+        .AddChild(30, State<TestUpdater>(4))
+      ));
+
+  StormBehaviorTreeReplayLog replay_log;
+  std::vector<int> recorded;
+
+  StormBehaviorTree record_tree(TestTreeTemplate);
+  record_tree.SetReplayLog(&replay_log);
+  for(int tick = 0; tick < 200; ++tick)
+  {
+    data.m_Flags = r() & 1;
+    record_tree.Update(data, context, r);
+    recorded.push_back(data.m_UpdaterId);
+  }
+
+  EXPECT_EQ(replay_log.GetTickCount(), 200);
+
+  StormBehaviorTreeWriteBuffer buffer;
+  replay_log.Save(buffer);
+
+  StormBehaviorTreeReplayLog loaded_log;
+  StormBehaviorTreeReadBuffer read_buffer(buffer.GetData().data(), buffer.GetSize());
+  EXPECT_TRUE(loaded_log.Load(read_buffer));
+
+  // Neither the data the conditional reads nor the random source matter during a replay
+  std::mt19937 replay_random(12345);
+  data.m_Flags = 0;
+
+  StormBehaviorTree replay_tree(TestTreeTemplate);
+  replay_tree.SetReplayLog(&loaded_log);
+  loaded_log.StartReplay();
+  for(int tick = 0; tick < 200; ++tick)
+  {
+    replay_tree.Update(data, context, replay_random);
+    EXPECT_EQ(data.m_UpdaterId, recorded[tick]);
+  }
+
+  EXPECT_EQ(loaded_log.GetDivergentTick(), -1);
+
+  // Running past the end of the log is a divergence
+  replay_tree.Update(data, context, replay_random);
+  EXPECT_EQ(loaded_log.GetDivergentTick(), 200);
+
+  // A tick that consumes less than it recorded is caught even when it is the last one replayed
+  auto IdleTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(State<TestUpdater>(1, false)));
+
+  StormBehaviorTree last_tick_tree(TestTreeTemplate);
+  StormBehaviorTree idle_tree(IdleTemplate);
+  loaded_log.StartReplay();
+  last_tick_tree.SetReplayLog(&loaded_log);
+  idle_tree.SetReplayLog(&loaded_log);
+  for(int tick = 0; tick < 199; ++tick)
+  {
+    last_tick_tree.Update(data, context, replay_random);
+  }
+
+  idle_tree.Update(data, context, replay_random);
+  EXPECT_EQ(loaded_log.GetDivergentTick(), -1);
+  loaded_log.StopReplay();
+  EXPECT_EQ(loaded_log.GetDivergentTick(), 199);
+
+  // Recording again after stopping partway through a replay drops the rest of the old results
+  StormBehaviorTreeReplayLog resume_log;
+  std::vector<int> resume_recorded;
+  StormBehaviorTree resume_tree(TestTreeTemplate);
+  resume_tree.SetReplayLog(&resume_log);
+  data.m_Flags = 1;
+  for(int tick = 0; tick < 10; ++tick)
+  {
+    resume_tree.Update(data, context, r);
+  }
+
+  StormBehaviorTree resume_replay_tree(TestTreeTemplate);
+  resume_replay_tree.SetReplayLog(&resume_log);
+  resume_log.StartReplay();
+  for(int tick = 0; tick < 3; ++tick)
+  {
+    resume_replay_tree.Update(data, context, r);
+    resume_recorded.push_back(data.m_UpdaterId);
+  }
+
+  resume_log.StopReplay();
+  data.m_Flags = 0;
+  for(int tick = 3; tick < 10; ++tick)
+  {
+    resume_replay_tree.Update(data, context, r);
+    resume_recorded.push_back(data.m_UpdaterId);
+  }
+
+  StormBehaviorTree resumed_tree(TestTreeTemplate);
+  resumed_tree.SetReplayLog(&resume_log);
+  resume_log.StartReplay();
+  for(int tick = 0; tick < 10; ++tick)
+  {
+    resumed_tree.Update(data, context, r);
+    EXPECT_EQ(data.m_UpdaterId, resume_recorded[tick]);
+  }
+
+  resume_log.StopReplay();
+  EXPECT_EQ(resume_log.GetDivergentTick(), -1);
+  EXPECT_EQ(resume_recorded[0], 1);
+  EXPECT_NE(resume_recorded[9], 1);
+}
+
+TEST_F(StormBehaviorTestFixture, TimedService)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddTimedService<TestService>(4, 0)
+      ));
+
+  EXPECT_EQ(TestTreeTemplate.GetTimedServiceCount(), 1);
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  for(int tick = 0; tick < 12; ++tick)
+  {
+    test_tree.Update(data, context, r);
+    EXPECT_EQ(data.m_SerivceUpdated, tick / 4 + 1);
+  }
+
+  // Ticks spent asleep count towards the interval
+  test_tree.AddDwellTicks(8);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_SerivceUpdated, 4);
+
+  auto DeviationTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestUpdater>(1, false)
+        .AddTimedService<TestService>(10, 3)
+      ));
+
+  // Every interval stays within the deviation, and differently seeded instances drift apart
+  std::vector<std::vector<int>> update_ticks(8);
+  for(int instance = 0; instance < 8; ++instance)
+  {
+    TestData instance_data;
+    StormBehaviorTree instance_tree(DeviationTemplate);
+    instance_tree.SetServiceSeed(instance);
+
+    for(int tick = 0; tick < 200; ++tick)
+    {
+      auto prev_updated = instance_data.m_SerivceUpdated;
+      instance_tree.Update(instance_data, context, r);
+      if(instance_data.m_SerivceUpdated != prev_updated)
+      {
+        update_ticks[instance].push_back(tick);
+      }
+    }
+
+    for(std::size_t index = 1; index < update_ticks[instance].size(); ++index)
+    {
+      auto interval = update_ticks[instance][index] - update_ticks[instance][index - 1];
+      EXPECT_GE(interval, 7);
+      EXPECT_LE(interval, 13);
+    }
+  }
+
+  EXPECT_NE(update_ticks[0], update_ticks[1]);
+
+  // A loaded instance picks up partway through the interval instead of updating on its first tick
+  TestData save_data;
+  StormBehaviorTree save_tree(TestTreeTemplate);
+  for(int tick = 0; tick < 6; ++tick)
+  {
+    save_tree.Update(save_data, context, r);
+  }
+
+  EXPECT_EQ(save_data.m_SerivceUpdated, 2);
+
+  StormBehaviorTreeWriteBuffer buffer;
+  save_tree.Save(buffer);
+
+  StormBehaviorTreeReadBuffer read_buffer(buffer.GetData().data(), buffer.GetSize());
+  BTInst loaded_tree;
+  EXPECT_TRUE(loaded_tree.Load(&TestTreeTemplate, read_buffer));
+  EXPECT_EQ(read_buffer.GetRemaining(), 0u);
+
+  for(int tick = 6; tick < 12; ++tick)
+  {
+    loaded_tree.Update(save_data, context, r);
+    EXPECT_EQ(save_data.m_SerivceUpdated, tick / 4 + 1);
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, SwitchNode)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSwitch)
+      .SetSwitchKey<TestSwitchKey>()
+      .AddCaseChild(1, State<TestUpdater>(1))
+      .AddCaseChild(2, State<TestUpdater>(2))
+      .AddCaseChild(3,
+        State<TestUpdater>(3)
+        .AddConditional<TestConditionalToggle>(false, false)
+      )
+      .AddCaseChild(1000000, State<TestUpdater>(4))
+      .AddChild(State<TestUpdater>(5)));
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+
+  data.m_Flags = 1;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 1);
+
+  data.m_Flags = 2;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+
+  // Keys without a case go to the default
+  data.m_Flags = 7;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 5);
+
+  data.m_Flags = 1000000;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 4);
+
+  // So does a case without a valid leaf
+  data.m_Flags = 3;
+  data.m_ToggleActive = false;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 5);
+
+  data.m_ToggleActive = true;
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 3);
+
+  // Close keys use a jump table and match the same cases
+  auto DenseTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSwitch)
+      .SetSwitchKey<TestSwitchKey>()
+      .AddCaseChild(-2, State<TestUpdater>(1))
+      .AddCaseChild(0, State<TestUpdater>(2))
+      .AddCaseChild(0, State<TestUpdater>(3))
+      .AddCaseChild(4, State<TestUpdater>(4)));
+
+  StormBehaviorTree dense_tree(DenseTemplate);
+  int expected_ids[] = { 1, -1, 2, -1, -1, -1, 4 };
+  for(int key = -2; key <= 4; ++key)
+  {
+    data.m_UpdaterId = -1;
+    data.m_Flags = key;
+    dense_tree.Update(data, context, r);
+    EXPECT_EQ(data.m_UpdaterId, expected_ids[key + 2]);
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, SwitchProfileLayout)
+{
+  for(auto key_scale : { 1, 100000 })
+  {
+    auto make_builder = [&]()
+    {
+      return BT(StormBehaviorNodeType::kSwitch)
+        .SetSwitchKey<TestSwitchKey>()
+        .AddChild(State<TestUpdater>(9))
+        .AddCaseChild(1 * key_scale, State<TestUpdater>(1))
+        .AddCaseChild(2 * key_scale, State<TestUpdater>(2))
+        .AddCaseChild(3 * key_scale, State<TestUpdater>(3))
+        .AddCaseChild(4 * key_scale, State<TestUpdater>(4));
+    };
+
+    auto ReferenceTemplate = StormBehaviorTreeTemplate(make_builder());
+    auto LayoutTemplate = StormBehaviorTreeTemplate(make_builder());
+    auto profile = LayoutTemplate.CreateProfile();
+
+    // Make the last cases and the default the hottest so the layout moves every child
+    {
+      TestData profile_data;
+      StormBehaviorTree profile_tree(LayoutTemplate);
+      profile_tree.SetProfile(&profile);
+
+      for(int tick = 0; tick < 100; ++tick)
+      {
+        profile_data.m_Flags = (tick % 3 == 0 ? 4 : tick % 3 == 1 ? 3 : 0) * key_scale;
+        profile_tree.Update(profile_data, context, r);
+      }
+    }
+
+    LayoutTemplate.ApplyProfileLayout(profile);
+
+    StormBehaviorTree reference_tree(ReferenceTemplate);
+    StormBehaviorTree layout_tree(LayoutTemplate);
+    for(int key = 0; key <= 5; ++key)
+    {
+      data.m_Flags = key * key_scale;
+      reference_tree.Update(data, context, r);
+      layout_tree.Update(data, context, r);
+      EXPECT_EQ(data.m_UpdaterId, key >= 1 && key <= 4 ? key : 9);
+
+      if(key == 4)
+      {
+        EXPECT_NE(layout_tree.GetCurrentNode(), reference_tree.GetCurrentNode());
+      }
+    }
+  }
+}
+
+TEST_F(StormBehaviorTestFixture, InstanceAlignment)
+{
+  auto TestTreeTemplate = StormBehaviorTreeTemplate(
+    BT(StormBehaviorNodeType::kSelect)
+      .AddChild(
+        State<TestCharUpdater>()
+        .AddConditional<TestConditional>(false, false, false)
+      )
+      .AddChild(State<TestWideUpdater>()));
+
+  // The char state leaves the next free byte at an odd offset, the wide state still has to be aligned
+  EXPECT_EQ(TestTreeTemplate.GetInstanceMemorySize() % alignof(uint64_t), 0u);
+  EXPECT_GT(TestTreeTemplate.GetInstanceMemorySize(), sizeof(TestCharUpdater) + sizeof(TestConditional) + sizeof(TestWideUpdater));
+
+  StormBehaviorTree test_tree(TestTreeTemplate);
+  test_tree.Update(data, context, r);
+  EXPECT_EQ(data.m_UpdaterId, 2);
+  EXPECT_EQ(data.m_Flags, 1);
+}
+
+int main(int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+